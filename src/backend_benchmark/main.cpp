@@ -0,0 +1,175 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Compares storage backends on the same workloads, through interfaces::database_backend only.
+
+#include "backend_memory/backend.hpp"
+#ifdef FALCONDB_WITH_LEVELDB
+#include "backend_leveldb/backend.hpp"
+#endif
+#ifdef FALCONDB_WITH_NESSDB
+#include "backend_nessdb/backend.hpp"
+#endif
+
+#include "utils/filesystem.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace falcondb;
+
+static const std::size_t VALUE_SIZE = 100;
+
+void help()
+{
+    std::cout << "usage: backend_benchmark DIR [COUNT]" << std::endl;
+    std::cout << "Creates a database for each backend in a subdirectory of DIR named after the backend, the subdirectories are removed afterwards" << std::endl;
+}
+
+static std::string make_key(std::size_t i)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "key%016zu", i);
+    return buf;
+}
+
+static void report(const std::string& backend_name, const std::string& workload, std::size_t ops,
+    const std::chrono::steady_clock::time_point& start)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-10s %-12s %10zu ops %10.3f s %12.0f ops/s\n",
+        backend_name.c_str(), workload.c_str(), ops, seconds, seconds > 0 ? ops / seconds : 0.0);
+}
+
+static void run(const std::string& backend_name, interfaces::database_backend& db, std::size_t count)
+{
+    std::mt19937 random(1234);
+    std::vector<std::size_t> order(count);
+    for(std::size_t i = 0; i < count; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), random);
+
+    std::string value(VALUE_SIZE, 'x');
+
+    // random put
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i : order)
+    {
+        db.add(make_key(i), value);
+    }
+    db.sync();
+    report(backend_name, "random-put", count, start);
+
+    // random get
+    std::shuffle(order.begin(), order.end(), random);
+    std::size_t bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for(std::size_t i : order)
+    {
+        bytes += db.get(make_key(i)).size();
+    }
+    report(backend_name, "random-get", count, start);
+
+    // sequential scan
+    std::size_t scanned = 0;
+    start = std::chrono::steady_clock::now();
+    db.for_each([&](const range& key, const range& val) { ++scanned; bytes += val.size(); });
+    report(backend_name, "scan", scanned, start);
+    if (scanned != count)
+    {
+        std::cout << backend_name << ": scan returned " << scanned << " records, expected " << count << std::endl;
+    }
+
+    // mixed: 50% gets, 25% puts, 25% deletes+reinserts
+    std::uniform_int_distribution<std::size_t> key_dist(0, count - 1);
+    std::uniform_int_distribution<int> op_dist(0, 3);
+    start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        std::string key = make_key(key_dist(random));
+        switch(op_dist(random))
+        {
+            case 0:
+            case 1:
+                bytes += db.get(key).size();
+                break;
+            case 2:
+                db.add(key, value);
+                break;
+            default:
+                db.del(key);
+                db.add(key, value);
+        }
+    }
+    db.sync();
+    report(backend_name, "mixed", count, start);
+
+    // keep the reads from being optimized out
+    if (bytes == 0)
+    {
+        std::cout << backend_name << ": no data read" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        help();
+        return 1;
+    }
+    std::string dir = argv[1];
+    std::size_t count = argc > 2 ? boost::lexical_cast<std::size_t>(argv[2]) : 100000;
+    if (dir == "--help" || dir == "-help" || count == 0)
+    {
+        help();
+        return 1;
+    }
+
+    backend_memory::backend memory_backend;
+    std::vector<std::pair<std::string, interfaces::storage_backend*>> backends;
+    backends.push_back(std::make_pair("memory", &memory_backend));
+#ifdef FALCONDB_WITH_LEVELDB
+    backend_leveldb::backend leveldb_backend;
+    backends.push_back(std::make_pair("leveldb", &leveldb_backend));
+#endif
+#ifdef FALCONDB_WITH_NESSDB
+    backend_nessdb::backend nessdb_backend;
+    backends.push_back(std::make_pair("nessdb", &nessdb_backend));
+#endif
+
+    bfs::create_directories(dir);
+    for(auto& b : backends)
+    {
+        std::string path = (bfs::path(dir) / b.first).string();
+        bfs::remove_all(path);
+        {
+            interfaces::database_backend_ptr db = b.second->create_database(path);
+            run(b.first, *db, count);
+        }
+        bfs::remove_all(path);
+    }
+}
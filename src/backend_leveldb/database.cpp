@@ -28,6 +28,74 @@ namespace falcondb { namespace backend_leveldb {
 static inline leveldb::Slice to_slice(range& r) { return leveldb::Slice(r.begin(), r.size()); }
 static inline range from_slice(const leveldb::Slice& s) { return range(s.data(), s.size()); }
 
+/// Thin wrapper over leveldb::WriteBatch
+class write_batch : public interfaces::write_batch
+{
+public:
+
+    virtual void add(range key, range data) { _batch.Put(to_slice(key), to_slice(data)); }
+    virtual void del(range key) { _batch.Delete(to_slice(key)); }
+
+    leveldb::WriteBatch& get() { return _batch; }
+
+private:
+
+    leveldb::WriteBatch _batch;
+};
+
+/// leveldb::Iterator adapter. The iterator reads from an implicit snapshot
+class cursor : public interfaces::cursor
+{
+public:
+
+    cursor(leveldb::Iterator* it) : _it(it) { }
+
+    virtual void seek(range key) { _it->Seek(to_slice(key)); check(); }
+    virtual void seek_to_first() { _it->SeekToFirst(); check(); }
+    virtual void seek_to_last() { _it->SeekToLast(); check(); }
+
+    virtual bool valid() const { return _it->Valid(); }
+
+    virtual void next() { _it->Next(); check(); }
+    virtual void prev() { _it->Prev(); check(); }
+
+    virtual range key() const { return from_slice(_it->key()); }
+    virtual range value() const { return from_slice(_it->value()); }
+
+private:
+
+    void check()
+    {
+        if (!_it->Valid() && !_it->status().ok())
+        {
+            throw exception(_it->status().ToString());
+        }
+    }
+
+    std::unique_ptr<leveldb::Iterator> _it;
+};
+
+/// Owns leveldb::Snapshot
+class snapshot : public interfaces::snapshot
+{
+public:
+
+    snapshot(leveldb::DB* db) : _db(db), _snapshot(db->GetSnapshot()) { }
+    virtual ~snapshot() { _db->ReleaseSnapshot(_snapshot); }
+
+    leveldb::ReadOptions read_options() const
+    {
+        leveldb::ReadOptions options;
+        options.snapshot = _snapshot;
+        return options;
+    }
+
+private:
+
+    leveldb::DB* _db;
+    const leveldb::Snapshot* _snapshot;
+};
+
 database::database(leveldb::DB* db)
 : _db(db)
 {
@@ -84,38 +152,61 @@ void database::del(range key)
 }
 
 std::string database::get(range key)
+{
+    return get(key, leveldb::ReadOptions());
+}
+
+std::string database::get(range key, const interfaces::snapshot& snap)
+{
+    return get(key, static_cast<const snapshot&>(snap).read_options());
+}
+
+std::string database::get(range key, const leveldb::ReadOptions& options)
 {
     std::string out;
-    leveldb::Status s = _db->Get(leveldb::ReadOptions(), to_slice(key), &out);
+    leveldb::Status s = _db->Get(options, to_slice(key), &out);
     throw_if_not_ok(s);
 
     return out;
 }
 
-void database::for_each(const interfaces::database_backend::key_value_handler& handler)
+interfaces::cursor_ptr database::create_cursor()
 {
-    std::unique_ptr<leveldb::Iterator> it(_db->NewIterator(leveldb::ReadOptions()));
-    for (it->SeekToFirst(); it->Valid(); it->Next())
-    {
-        handler(from_slice(it->key()), from_slice(it->value()));
-    }
-    throw_if_not_ok(it->status());
+    return interfaces::cursor_ptr(new cursor(_db->NewIterator(leveldb::ReadOptions())));
 }
 
-void database::for_each(range begin, range end, const key_value_handler& handler)
+interfaces::snapshot_ptr database::create_snapshot()
 {
-    std::unique_ptr<leveldb::Iterator> it(_db->NewIterator(leveldb::ReadOptions()));
-    std::string end_as_string = end.to_string();
+    return interfaces::snapshot_ptr(new snapshot(_db.get()));
+}
 
-    for (it->Seek(to_slice(begin));
-        it->Valid() && it->key().ToString() < end_as_string;
-        it->Next())
-    {
-        handler(from_slice(it->key()), from_slice(it->value()));
-    }
-    throw_if_not_ok(it->status());
+interfaces::cursor_ptr database::create_cursor(const interfaces::snapshot& snap)
+{
+    return interfaces::cursor_ptr(new cursor(_db->NewIterator(static_cast<const snapshot&>(snap).read_options())));
 }
 
+interfaces::write_batch_ptr database::create_write_batch()
+{
+    return interfaces::write_batch_ptr(new write_batch());
+}
+
+void database::write(interfaces::write_batch& batch, bool sync)
+{
+    leveldb::WriteOptions options;
+    options.sync = sync;
+    leveldb::Status s = _db->Write(options, &static_cast<write_batch&>(batch).get());
+    throw_if_not_ok(s);
+}
+
+void database::sync()
+{
+    // synced write appends to the log and syncs it, making all preceding writes durable
+    leveldb::WriteBatch empty;
+    leveldb::WriteOptions options;
+    options.sync = true;
+    leveldb::Status s = _db->Write(options, &empty);
+    throw_if_not_ok(s);
+}
 
 void database::throw_if_not_ok(const leveldb::Status& status)
 {
@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "interfaces/storage_backend.hpp"
 
 #include <leveldb/db.h>
+#include <leveldb/write_batch.h>
 
 #include <memory>
 
@@ -46,12 +47,22 @@ public:
     virtual void add(range key, range data);
     virtual void del(range key);
     virtual std::string get(range key);
-    virtual void for_each(const key_value_handler& handler);
-    virtual void for_each(range begin, range end, const key_value_handler& handler);
+    virtual interfaces::cursor_ptr create_cursor();
+
+    virtual interfaces::snapshot_ptr create_snapshot();
+    virtual std::string get(range key, const interfaces::snapshot& snap);
+    virtual interfaces::cursor_ptr create_cursor(const interfaces::snapshot& snap);
+
+    virtual interfaces::write_batch_ptr create_write_batch();
+    virtual void write(interfaces::write_batch& batch, bool sync);
+    virtual void sync();
+
 private:
 
     database(leveldb::DB* db);
 
+    std::string get(range key, const leveldb::ReadOptions& options);
+
     /// Throws if status is not ok
     static void throw_if_not_ok(const leveldb::Status& status);
 
@@ -0,0 +1,43 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "backend_memory/backend.hpp"
+#include "backend_memory/database.hpp"
+
+namespace falcondb { namespace backend_memory {
+
+backend::backend()
+{
+}
+
+backend::~backend()
+{
+}
+
+std::shared_ptr<interfaces::database_backend> backend::open_database(const std::string& path)
+{
+    return database::open(path);
+}
+
+std::shared_ptr<interfaces::database_backend> backend::create_database(const std::string& path)
+{
+    return database::create(path);
+}
+
+} }
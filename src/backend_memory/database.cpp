@@ -0,0 +1,505 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "backend_memory/database.hpp"
+
+#include "utils/exception.hpp"
+#include "utils/filesystem.hpp"
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace falcondb { namespace backend_memory {
+
+static const std::uint64_t DEFAULT_LOG_LIMIT = 64 * 1024 * 1024;
+static const std::size_t SNAPSHOT_RECORD_SIZE = 1024 * 1024; // pairs are grouped into records of about this size
+
+// Log and snapshot records are sequences of operations:
+//   op (u8), key size (u32), key, [value size (u32), value]
+// the value is present for add only
+enum operation : std::uint8_t
+{
+    op_add = 1,
+    op_del = 2
+};
+
+static void put_u32(std::string& out, std::uint32_t v)
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>((v >> (i*8)) & 0xff));
+    }
+}
+
+static range get_bytes(const char*& it, const char* end)
+{
+    if (end - it < 4)
+    {
+        throw exception("memory backend: malformed record");
+    }
+    std::uint32_t size = 0;
+    for(int i = 3; i >= 0; --i)
+    {
+        size = (size << 8) | static_cast<std::uint8_t>(it[i]);
+    }
+    it += 4;
+    if (std::size_t(end - it) < size)
+    {
+        throw exception("memory backend: malformed record");
+    }
+    range r(it, size);
+    it += size;
+    return r;
+}
+
+static void encode_add(std::string& out, range key, range data)
+{
+    out.push_back(op_add);
+    put_u32(out, key.size());
+    out.append(key.begin(), key.size());
+    put_u32(out, data.size());
+    out.append(data.begin(), data.size());
+}
+
+static void encode_del(std::string& out, range key)
+{
+    out.push_back(op_del);
+    put_u32(out, key.size());
+    out.append(key.begin(), key.size());
+}
+
+static void apply(const range& record, database::map_type& data)
+{
+    const char* it = record.begin();
+    while (it != record.end())
+    {
+        std::uint8_t op = static_cast<std::uint8_t>(*it++);
+        range key = get_bytes(it, record.end());
+        if (op == op_add)
+        {
+            range value = get_bytes(it, record.end());
+            data.insert_or_assign(key, std::make_shared<const std::string>(value.to_string()));
+        }
+        else if (op == op_del)
+        {
+            data.erase(key);
+        }
+        else
+        {
+            throw exception("memory backend: unknown operation ", int(op));
+        }
+    }
+}
+
+/// Buffers encoded operations, written as one log record
+class write_batch : public interfaces::write_batch
+{
+public:
+
+    virtual void add(range key, range data) { encode_add(_record, key, data); }
+    virtual void del(range key) { encode_del(_record, key); }
+
+    const std::string& record() const { return _record; }
+
+private:
+
+    std::string _record;
+};
+
+/// Version of the content, shared with the database until it writes
+class snapshot : public interfaces::snapshot
+{
+public:
+
+    snapshot(const database::map_type& data) : _data(data) { }
+
+    const database::map_type& data() const { return _data; }
+
+private:
+
+    database::map_type _data;
+};
+
+/// Iterator over immutable version of the content
+class cursor : public interfaces::cursor
+{
+public:
+
+    cursor(const database::map_type& data) : _data(data), _it(_data.end()) { }
+
+    virtual void seek(range key) { _it = _data.lower_bound(key); }
+    virtual void seek_to_first() { _it = _data.begin(); }
+    virtual void seek_to_last() { _it = --_data.end(); }
+
+    virtual bool valid() const { return _it != _data.end(); }
+
+    virtual void next() { assert(valid()); ++_it; }
+    virtual void prev() { assert(valid()); --_it; } // the first one goes to the end
+
+    virtual range key() const { return _it.key(); }
+    virtual range value() const { return range(*_it.value()); }
+
+private:
+
+    database::map_type _data;
+    database::map_type::const_iterator _it;
+};
+
+/// Parses "prefix.N" file name
+static bool parse_file_name(const std::string& name, const char* prefix, std::uint64_t& generation)
+{
+    std::string format = std::string(prefix) + ".%llu%c";
+    unsigned long long g = 0;
+    char tail = 0;
+    if (std::sscanf(name.c_str(), format.c_str(), &g, &tail) == 1)
+    {
+        generation = g;
+        return true;
+    }
+    return false;
+}
+
+database::database(const std::string& path)
+:
+    _path(path),
+    _generation(1),
+    _log_limit(DEFAULT_LOG_LIMIT),
+    _snapshot_running(false)
+{
+}
+
+database::~database()
+{
+    wait_for_checkpoint();
+}
+
+std::shared_ptr<database> database::open(const std::string& path)
+{
+    std::shared_ptr<database> db(new database(path));
+    db->recover();
+    return db;
+}
+
+std::shared_ptr<database> database::create(const std::string& path)
+{
+    if (bfs::exists(path) && !bfs::is_empty(path))
+    {
+        throw exception("memory backend: ", path, " is not empty");
+    }
+    bfs::create_directories(path);
+
+    std::shared_ptr<database> db(new database(path));
+    db->_log.reset(new append_log(db->file_path("log", db->_generation)));
+    return db;
+}
+
+void database::remove_files(std::uint64_t below_generation)
+{
+    std::vector<bfs::path> obsolete;
+    for(bfs::directory_iterator it(_path); it != bfs::directory_iterator(); ++it)
+    {
+        std::string name = it->path().filename().string();
+        std::uint64_t generation = 0;
+        if ((parse_file_name(name, "snapshot", generation) || parse_file_name(name, "log", generation))
+            && generation < below_generation)
+        {
+            obsolete.push_back(it->path());
+        }
+    }
+
+    for(const bfs::path& p : obsolete)
+    {
+        bfs::remove(p);
+    }
+}
+
+std::string database::file_path(const char* prefix, std::uint64_t generation) const
+{
+    return (bfs::path(_path) / build_string(prefix, '.', generation)).string();
+}
+
+void database::recover()
+{
+    // find the newest snapshot and all logs
+    std::uint64_t snapshot_generation = 0;
+    std::vector<std::uint64_t> logs;
+
+    if (bfs::is_directory(_path))
+    {
+        for(bfs::directory_iterator it(_path); it != bfs::directory_iterator(); ++it)
+        {
+            std::string name = it->path().filename().string();
+            std::uint64_t generation = 0;
+            if (parse_file_name(name, "snapshot", generation))
+            {
+                snapshot_generation = std::max(snapshot_generation, generation);
+            }
+            else if (parse_file_name(name, "log", generation))
+            {
+                logs.push_back(generation);
+            }
+            else if (name.find(".tmp") != std::string::npos)
+            {
+                // unfinished snapshot
+                bfs::remove(it->path());
+            }
+        }
+    }
+
+    if (snapshot_generation == 0 && logs.empty())
+    {
+        throw exception("memory backend: no database in ", _path);
+    }
+
+    map_type& data = _data;
+    if (snapshot_generation > 0)
+    {
+        append_log::replay(file_path("snapshot", snapshot_generation), [&data](const range& r) { apply(r, data); });
+        _generation = snapshot_generation;
+    }
+
+    std::sort(logs.begin(), logs.end());
+    for(std::uint64_t generation : logs)
+    {
+        if (generation < snapshot_generation)
+        {
+            continue; // already in the snapshot
+        }
+
+        std::string log_path = file_path("log", generation);
+        std::uint64_t valid = append_log::replay(log_path, [&data](const range& r) { apply(r, data); });
+        if (valid < bfs::file_size(log_path))
+        {
+            logging::info("memory backend: ", log_path, " has torn tail, truncated at ", valid);
+            append_log::truncate(log_path, valid);
+        }
+        _generation = generation;
+    }
+
+    _log.reset(new append_log(file_path("log", _generation)));
+}
+
+void database::drop()
+{
+    wait_for_checkpoint();
+
+    boost::mutex::scoped_lock write_lock(_write_mutex);
+    rwmutex::scoped_write_lock lock(_data_mutex);
+    boost::mutex::scoped_lock log_lock(_log_mutex);
+
+    _log.reset();
+    _data.clear();
+    remove_files(std::numeric_limits<std::uint64_t>::max());
+    _generation = 1;
+    _log.reset(new append_log(file_path("log", _generation)));
+}
+
+void database::add(range key, range data)
+{
+    std::string record;
+    encode_add(record, key, data);
+    log_and_apply(record);
+}
+
+void database::del(range key)
+{
+    std::string record;
+    encode_del(record, key);
+    log_and_apply(record);
+}
+
+database::map_type database::current_data()
+{
+    rwmutex::scoped_read_lock lock(_data_mutex);
+    return _data;
+}
+
+std::string database::get(range key)
+{
+    rwmutex::scoped_read_lock lock(_data_mutex);
+
+    const map_type::mapped_type* value = _data.get(key);
+    if (!value)
+    {
+        throw exception("NotFound");
+    }
+    return **value;
+}
+
+interfaces::cursor_ptr database::create_cursor()
+{
+    return interfaces::cursor_ptr(new cursor(current_data()));
+}
+
+interfaces::snapshot_ptr database::create_snapshot()
+{
+    return interfaces::snapshot_ptr(new snapshot(current_data()));
+}
+
+std::string database::get(range key, const interfaces::snapshot& snap)
+{
+    const map_type& data = static_cast<const snapshot&>(snap).data();
+
+    const map_type::mapped_type* value = data.get(key);
+    if (!value)
+    {
+        throw exception("NotFound");
+    }
+    return **value;
+}
+
+interfaces::cursor_ptr database::create_cursor(const interfaces::snapshot& snap)
+{
+    return interfaces::cursor_ptr(new cursor(static_cast<const snapshot&>(snap).data()));
+}
+
+interfaces::write_batch_ptr database::create_write_batch()
+{
+    return interfaces::write_batch_ptr(new write_batch());
+}
+
+void database::write(interfaces::write_batch& batch, bool sync)
+{
+    const std::string& record = static_cast<write_batch&>(batch).record();
+    if (!record.empty())
+    {
+        // one log record, so the batch is replayed completely or not at all
+        log_and_apply(record);
+    }
+    if (sync)
+    {
+        this->sync();
+    }
+}
+
+void database::sync()
+{
+    boost::mutex::scoped_lock lock(_log_mutex);
+    _log->sync();
+}
+
+void database::log_and_apply(const std::string& record)
+{
+    bool over_limit = false;
+    {
+        // only writers change _data, so holding the write mutex it is read without the lock
+        boost::mutex::scoped_lock write_lock(_write_mutex);
+        {
+            boost::mutex::scoped_lock log_lock(_log_mutex);
+            _log->append(record);
+            over_limit = _log->size() > _log_limit;
+        }
+
+        map_type data = _data;
+        apply(record, data);
+
+        rwmutex::scoped_write_lock lock(_data_mutex);
+        _data = std::move(data);
+    }
+
+    if (over_limit)
+    {
+        checkpoint();
+    }
+}
+
+void database::checkpoint()
+{
+    boost::mutex::scoped_lock snapshot_lock(_snapshot_mutex);
+    if (_snapshot_running)
+    {
+        return;
+    }
+    if (_snapshot_thread.joinable())
+    {
+        _snapshot_thread.join();
+    }
+
+    map_type data;
+    std::uint64_t generation;
+    {
+        boost::mutex::scoped_lock write_lock(_write_mutex);
+        boost::mutex::scoped_lock log_lock(_log_mutex);
+
+        // the snapshot covers everything in the current log, new writes go to the next one
+        _log->sync();
+        data = _data;
+        generation = ++_generation;
+        _log.reset(new append_log(file_path("log", generation)));
+        append_log::sync_directory(_path);
+    }
+
+    _snapshot_running = true;
+    _snapshot_thread = boost::thread([this, data, generation] { write_snapshot(data, generation); });
+}
+
+void database::wait_for_checkpoint()
+{
+    boost::mutex::scoped_lock snapshot_lock(_snapshot_mutex);
+    if (_snapshot_thread.joinable())
+    {
+        _snapshot_thread.join();
+    }
+}
+
+void database::write_snapshot(map_type data, std::uint64_t generation)
+{
+    try
+    {
+        std::string final_path = file_path("snapshot", generation);
+        std::string tmp_path = final_path + ".tmp";
+        {
+            append_log out(tmp_path);
+            std::string record;
+            for(map_type::const_iterator it = data.begin(); it != data.end(); ++it)
+            {
+                encode_add(record, it.key(), *it.value());
+                if (record.size() >= SNAPSHOT_RECORD_SIZE)
+                {
+                    out.append(record);
+                    record.clear();
+                }
+            }
+            if (!record.empty())
+            {
+                out.append(record);
+            }
+            out.sync();
+        }
+        bfs::rename(tmp_path, final_path);
+        append_log::sync_directory(_path);
+
+        // older files are not needed anymore
+        remove_files(generation);
+
+        logging::info("memory backend: snapshot ", generation, " of ", _path, " written, ", data.size(), " keys");
+    }
+    catch(const std::exception& e)
+    {
+        // logs are kept, nothing is lost
+        logging::error("memory backend: error writing snapshot ", generation, " of ", _path, ": ", e.what());
+    }
+    _snapshot_running = false;
+}
+
+} }
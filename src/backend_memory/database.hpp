@@ -0,0 +1,127 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_BACKEND_MEMORY_DATABASE_HPP
+#define FALCONDB_BACKEND_MEMORY_DATABASE_HPP
+
+#include "interfaces/storage_backend.hpp"
+
+#include "utils/append_log.hpp"
+#include "utils/persistent_map.hpp"
+#include "utils/rwmutex.hpp"
+
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <memory>
+
+namespace falcondb { namespace backend_memory {
+
+/// Ordered in-memory database, for collections that fit in RAM.
+///
+/// Durability comes from an operation log, and snapshots written periodically in the background.
+/// Files are numbered by generation: snapshot.N holds the content as of the end of log.(N-1).
+/// Recovery loads the newest snapshot and replays the logs from its generation on.
+///
+/// Content is a persistent map. Cursors, snapshots and the snapshot writer keep the version
+/// they started with, at no cost; a write copies the paths to the changed keys, O(log n) each.
+/// Writers are serialized, they append to the log and build the next version without blocking
+/// readers, which wait only while the new version is published.
+class database : public interfaces::database_backend
+{
+public:
+
+    typedef persistent_map<std::shared_ptr<const std::string>> map_type;
+
+    /// Named constructor - opens existing database
+    static std::shared_ptr<database> open(const std::string& path);
+
+    /// Named constructor - creates new database
+    static std::shared_ptr<database> create(const std::string& path);
+
+    /// Waits for the snapshot being written
+    virtual ~database();
+
+    virtual void drop();
+
+    virtual void add(range key, range data);
+    virtual void del(range key);
+    virtual std::string get(range key);
+    virtual interfaces::cursor_ptr create_cursor();
+
+    virtual interfaces::snapshot_ptr create_snapshot();
+    virtual std::string get(range key, const interfaces::snapshot& snap);
+    virtual interfaces::cursor_ptr create_cursor(const interfaces::snapshot& snap);
+
+    virtual interfaces::write_batch_ptr create_write_batch();
+    virtual void write(interfaces::write_batch& batch, bool sync);
+    virtual void sync();
+
+    // other
+
+    /// Starts writing a snapshot in the background and switches to the next log.
+    /// Does nothing if a snapshot is already being written
+    void checkpoint();
+
+    /// Waits until the snapshot being written, if any, is complete
+    void wait_for_checkpoint();
+
+    /// Log size that triggers automatic checkpoint
+    void set_log_limit(std::uint64_t bytes) { _log_limit = bytes; }
+
+private:
+
+    database(const std::string& path);
+
+    /// Loads the newest snapshot and replays the logs
+    void recover();
+
+    /// Appends record to the log and applies it. Record is a sequence of operations
+    void log_and_apply(const std::string& record);
+
+    /// Current version of the content
+    map_type current_data();
+
+    /// Snapshot thread body
+    void write_snapshot(map_type data, std::uint64_t generation);
+
+    std::string file_path(const char* prefix, std::uint64_t generation) const;
+
+    /// Removes log and snapshot files of older generations
+    void remove_files(std::uint64_t below_generation);
+
+    const std::string _path;
+
+    boost::mutex _write_mutex; // serializes writers, taken first
+    rwmutex _data_mutex; // guards publishing new versions
+    map_type _data;
+
+    boost::mutex _log_mutex; // taken after _data_mutex
+    std::unique_ptr<append_log> _log;
+    std::uint64_t _generation;
+    std::uint64_t _log_limit;
+
+    boost::mutex _snapshot_mutex; // guards starting and joining the thread
+    boost::thread _snapshot_thread;
+    std::atomic<bool> _snapshot_running;
+};
+
+} }
+
+#endif
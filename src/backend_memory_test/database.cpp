@@ -0,0 +1,188 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "backend_memory/database.hpp"
+
+#include "utils/filesystem.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <vector>
+
+namespace falcondb {
+
+using backend_memory::database;
+
+BOOST_AUTO_TEST_SUITE(backend_memory_test_suite)
+
+// test env
+class fixture
+{
+public:
+
+    fixture()
+    : _path(bfs::temp_directory_path() / bfs::unique_path("falcondb-memory-%%%%-%%%%"))
+    {
+    }
+
+    ~fixture()
+    {
+        bfs::remove_all(_path);
+    }
+
+    std::string path() const { return _path.string(); }
+
+    static std::vector<std::string> keys(interfaces::database_backend& db, range begin, range end)
+    {
+        std::vector<std::string> result;
+        db.for_each(begin, end, [&result](const range& k, const range&) { result.push_back(k.to_string()); });
+        return result;
+    }
+
+private:
+
+    bfs::path _path;
+};
+
+BOOST_FIXTURE_TEST_CASE(ordered_access, fixture)
+{
+    std::shared_ptr<database> db = database::create(path());
+    db->add(std::string("b"), std::string("2"));
+    db->add(std::string("d"), std::string("4"));
+    db->add(std::string("a"), std::string("1"));
+    db->add(std::string("c"), std::string("3"));
+    db->del(std::string("d"));
+
+    BOOST_CHECK_EQUAL(db->get(std::string("c")), "3");
+    BOOST_CHECK_THROW(db->get(std::string("d")), std::exception);
+
+    std::vector<std::string> expected = { "b", "c" };
+    std::vector<std::string> actual = keys(*db, std::string("b"), std::string("d"));
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+
+    interfaces::cursor_ptr c = db->create_cursor();
+    c->seek(std::string("bb"));
+    BOOST_REQUIRE(c->valid());
+    BOOST_CHECK_EQUAL(c->key().to_string(), "c");
+    c->prev();
+    BOOST_CHECK_EQUAL(c->key().to_string(), "b");
+    c->seek_to_last();
+    BOOST_CHECK_EQUAL(c->value().to_string(), "3");
+    c->next();
+    BOOST_CHECK(!c->valid());
+}
+
+BOOST_FIXTURE_TEST_CASE(snapshot_isolation, fixture)
+{
+    std::shared_ptr<database> db = database::create(path());
+    db->add(std::string("a"), std::string("old"));
+
+    interfaces::snapshot_ptr snap = db->create_snapshot();
+    interfaces::cursor_ptr c = db->create_cursor();
+
+    db->add(std::string("a"), std::string("new"));
+    db->add(std::string("b"), std::string("new"));
+
+    BOOST_CHECK_EQUAL(db->get(std::string("a"), *snap), "old");
+    BOOST_CHECK_THROW(db->get(std::string("b"), *snap), std::exception);
+    BOOST_CHECK_EQUAL(db->get(std::string("a")), "new");
+
+    // cursor sees the content as of its creation
+    c->seek_to_first();
+    BOOST_CHECK_EQUAL(c->value().to_string(), "old");
+    c->next();
+    BOOST_CHECK(!c->valid());
+}
+
+BOOST_FIXTURE_TEST_CASE(recovery_from_log, fixture)
+{
+    {
+        std::shared_ptr<database> db = database::create(path());
+        db->add(std::string("a"), std::string("1"));
+
+        interfaces::write_batch_ptr batch = db->create_write_batch();
+        batch->add(std::string("b"), std::string("2"));
+        batch->add(std::string("c"), std::string("3"));
+        batch->del(std::string("a"));
+        db->write(*batch, true);
+    }
+
+    // torn write at the end of the log
+    {
+        std::ofstream log((bfs::path(path()) / "log.1").string().c_str(), std::ios::binary | std::ios::app);
+        log << "\x40\x00\x00";
+    }
+
+    std::shared_ptr<database> db = database::open(path());
+    std::vector<std::string> expected = { "b", "c" };
+    std::vector<std::string> actual = keys(*db, std::string("a"), std::string("z"));
+    BOOST_CHECK_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+
+    // the log continues after the valid part
+    db->add(std::string("d"), std::string("4"));
+    db.reset();
+    db = database::open(path());
+    BOOST_CHECK_EQUAL(db->get(std::string("d")), "4");
+}
+
+BOOST_FIXTURE_TEST_CASE(recovery_from_snapshot, fixture)
+{
+    {
+        std::shared_ptr<database> db = database::create(path());
+        for(int i = 0; i < 1000; ++i)
+        {
+            db->add(std::to_string(i), std::string(100, 'x'));
+        }
+        db->checkpoint();
+        db->del(std::string("5"));
+        db->add(std::string("new"), std::string("after snapshot"));
+        db->wait_for_checkpoint();
+    }
+
+    // the snapshot replaced the first log
+    BOOST_CHECK(!bfs::exists(bfs::path(path()) / "log.1"));
+    BOOST_CHECK(bfs::exists(bfs::path(path()) / "snapshot.2"));
+
+    std::shared_ptr<database> db = database::open(path());
+    BOOST_CHECK_EQUAL(db->get(std::string("999")), std::string(100, 'x'));
+    BOOST_CHECK_THROW(db->get(std::string("5")), std::exception);
+    BOOST_CHECK_EQUAL(db->get(std::string("new")), "after snapshot");
+    BOOST_CHECK_EQUAL(keys(*db, std::string(), std::string("\xff")).size(), 1000);
+}
+
+BOOST_FIXTURE_TEST_CASE(automatic_checkpoint, fixture)
+{
+    {
+        std::shared_ptr<database> db = database::create(path());
+        db->set_log_limit(10000);
+        for(int i = 0; i < 1000; ++i)
+        {
+            db->add(std::to_string(i), std::string(100, 'y'));
+        }
+        db->wait_for_checkpoint();
+    }
+
+    std::shared_ptr<database> db = database::open(path());
+    BOOST_CHECK_EQUAL(keys(*db, std::string(), std::string("\xff")).size(), 1000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
@@ -0,0 +1,145 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "utils/persistent_map.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace falcondb {
+
+BOOST_AUTO_TEST_SUITE(persistent_map_test_suite)
+
+typedef persistent_map<int> map_type;
+typedef std::map<std::string, int> reference_type;
+
+static void check_equal(const map_type& m, const reference_type& expected)
+{
+    BOOST_REQUIRE_EQUAL(m.size(), expected.size());
+
+    auto it = m.begin();
+    for(const reference_type::value_type& pair : expected)
+    {
+        BOOST_REQUIRE(it != m.end());
+        BOOST_CHECK_EQUAL(it.key().to_string(), pair.first);
+        BOOST_CHECK_EQUAL(it.value(), pair.second);
+        ++it;
+    }
+    BOOST_CHECK(it == m.end());
+
+    // backwards, from the end
+    for(auto r = expected.rbegin(); r != expected.rend(); ++r)
+    {
+        --it;
+        BOOST_REQUIRE(it != m.end());
+        BOOST_CHECK_EQUAL(it.key().to_string(), r->first);
+    }
+    if (!expected.empty())
+    {
+        BOOST_CHECK(--it == m.end());
+    }
+}
+
+static std::string make_key(int i)
+{
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "k%05d", i);
+    return buf;
+}
+
+BOOST_AUTO_TEST_CASE(versions)
+{
+    std::mt19937 random(7);
+    map_type m;
+    reference_type expected;
+    std::vector<std::pair<map_type, reference_type>> versions;
+    for(int i = 0; i < 50000; ++i)
+    {
+        std::string key = make_key(random() % 5000);
+        if (random() % 3 == 0)
+        {
+            BOOST_CHECK_EQUAL(m.erase(key), expected.erase(key));
+        }
+        else
+        {
+            BOOST_CHECK_EQUAL(m.insert_or_assign(key, i), expected.find(key) == expected.end());
+            expected[key] = i;
+        }
+        if (i % 5000 == 0)
+        {
+            versions.push_back(std::make_pair(m, expected));
+        }
+    }
+    check_equal(m, expected);
+
+    // older versions are not changed by the later writes
+    for(const auto& version : versions)
+    {
+        check_equal(version.first, version.second);
+    }
+
+    // the tree shrinks back to nothing
+    for(const reference_type::value_type& pair : expected)
+    {
+        BOOST_CHECK_EQUAL(m.erase(pair.first), 1u);
+    }
+    check_equal(m, reference_type());
+    BOOST_CHECK(m.empty());
+}
+
+BOOST_AUTO_TEST_CASE(lookups)
+{
+    map_type m;
+    BOOST_CHECK(m.begin() == m.end());
+    BOOST_CHECK(m.lower_bound(std::string("a")) == m.end());
+    BOOST_CHECK_EQUAL(m.erase(std::string("a")), 0u);
+
+    for(int i = 0; i < 100; i += 2)
+    {
+        m.insert_or_assign(make_key(i), i);
+    }
+    BOOST_CHECK_EQUAL(m.lower_bound(make_key(10)).value(), 10);
+    BOOST_CHECK_EQUAL(m.lower_bound(make_key(11)).value(), 12);
+    BOOST_CHECK_EQUAL(m.lower_bound(std::string()).value(), 0);
+    BOOST_CHECK(m.lower_bound(make_key(99)) == m.end());
+    BOOST_CHECK(m.find(make_key(11)) == m.end());
+    BOOST_CHECK_EQUAL(m.find(make_key(98)).value(), 98);
+    BOOST_CHECK_EQUAL(*m.get(make_key(98)), 98);
+    BOOST_CHECK(!m.get(make_key(11)));
+
+    map_type::const_iterator it = m.lower_bound(make_key(11));
+    BOOST_CHECK_EQUAL((--it).value(), 10);
+    BOOST_CHECK_EQUAL((++it).value(), 12);
+    BOOST_CHECK_EQUAL((--m.end()).value(), 98);
+
+    map_type copy = m;
+    m.clear();
+    BOOST_CHECK(m.empty());
+    BOOST_CHECK_EQUAL(copy.size(), 50u);
+    BOOST_CHECK_EQUAL(copy.find(make_key(20)).value(), 20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
@@ -49,7 +49,8 @@ std::shared_ptr<interfaces::database_backend> backend::open_database(const std::
 
 std::shared_ptr<interfaces::database_backend> backend::create_database(const std::string& path)
 {
-    if (!bfs::exists(path))
+    // the engine creates the database directory before calling the backend
+    if (!bfs::exists(path) || (bfs::is_directory(path) && bfs::is_empty(path)))
     {
         return std::shared_ptr<interfaces::database_backend>(new database(path));
     }
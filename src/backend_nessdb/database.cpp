@@ -19,17 +19,168 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "backend_nessdb/database.hpp"
 
-#include <utils/exception.hpp>
+#include "utils/exception.hpp"
+#include "utils/filesystem.hpp"
+#include "utils/log.hpp"
 
 #include <nessdb/util.h>
 
 #include <cassert>
+#include <string>
+#include <vector>
 
 namespace falcondb { namespace backend_nessdb {
 
+static const char* JOURNAL_FILE = "falcondb_keys";
+static const std::uint64_t MIN_JOURNAL_COMPACTION_SIZE = 4 * 1024 * 1024;
+
+// Journal records are sequences of operations: op (u8), key size (u32), key
+enum operation : std::uint8_t
+{
+    op_add = 1,
+    op_del = 2
+};
+
+static void encode_op(std::string& out, operation op, range key)
+{
+    out.push_back(op);
+    std::uint32_t size = key.size();
+    for(int i = 0; i < 4; ++i)
+    {
+        out.push_back(static_cast<char>((size >> (i*8)) & 0xff));
+    }
+    out.append(key.begin(), key.size());
+}
+
+static void apply(const range& record, database::key_set& keys)
+{
+    const char* it = record.begin();
+    while (it != record.end())
+    {
+        if (record.end() - it < 5)
+        {
+            throw exception("nessdb backend: malformed key journal");
+        }
+        std::uint8_t op = static_cast<std::uint8_t>(*it);
+        std::uint32_t size = 0;
+        for(int i = 4; i >= 1; --i)
+        {
+            size = (size << 8) | static_cast<std::uint8_t>(it[i]);
+        }
+        it += 5;
+        if (std::size_t(record.end() - it) < size)
+        {
+            throw exception("nessdb backend: malformed key journal");
+        }
+
+        range key(it, size);
+        it += size;
+        if (op == op_add)
+        {
+            keys.insert_or_assign(key, 0);
+        }
+        else
+        {
+            keys.erase(key);
+        }
+    }
+}
+
+static slice to_slice(range r)
+{
+    slice s;
+    s.data = const_cast<char*>(r.begin());
+    s.len = r.size();
+    return s;
+}
+
+/// NessDB has no batches. Operations are buffered and replayed one by one,
+/// so the batch is not atomic with this backend
+class write_batch : public interfaces::write_batch
+{
+public:
+
+    virtual void add(range key, range data) { _ops.push_back(op{key.to_string(), data.to_string(), false}); }
+    virtual void del(range key) { _ops.push_back(op{key.to_string(), std::string(), true}); }
+
+    struct op
+    {
+        std::string key;
+        std::string data;
+        bool is_del;
+    };
+
+    const std::vector<op>& ops() const { return _ops; }
+
+private:
+
+    std::vector<op> _ops;
+};
+
+/// Iterates over a version of the key set, reading values on the way
+class cursor : public interfaces::cursor
+{
+public:
+
+    cursor(database& db, const database::key_set& keys, std::uint64_t version)
+    : _db(db), _keys(keys), _it(_keys.end()), _version(version)
+    { }
+
+    ~cursor() { _db.close_cursor(_version); }
+
+    virtual void seek(range key) { _it = _keys.lower_bound(key); settle(true); }
+    virtual void seek_to_first() { _it = _keys.begin(); settle(true); }
+    virtual void seek_to_last() { _it = --_keys.end(); settle(false); }
+
+    virtual bool valid() const { return _it != _keys.end(); }
+
+    virtual void next() { assert(valid()); ++_it; settle(true); }
+    virtual void prev() { assert(valid()); --_it; settle(false); } // the first one goes to the end
+
+    virtual range key() const { return _it.key(); }
+    virtual range value() const { return range(_value); }
+
+private:
+
+    // skips keys without a value, left in the journal by a crash
+    void settle(bool forward)
+    {
+        while (valid() && !_db.cursor_get(_it.key(), _it.value(), _value))
+        {
+            if (forward) ++_it;
+            else --_it;
+        }
+    }
+
+    database& _db;
+    database::key_set _keys;
+    database::key_set::const_iterator _it;
+    const std::uint64_t _version;
+    std::string _value;
+};
+
 database::database(const std::string& path)
+:
+    _path(path),
+    _db(nullptr),
+    _journal_compacted_size(0),
+    _last_write(0)
 {
     _db = ::db_open(path.c_str(), 1);
+    if (!_db)
+    {
+        throw exception("error opening nessdb database ", path);
+    }
+
+    try
+    {
+        load_keys();
+    }
+    catch(...)
+    {
+        ::db_close(_db);
+        throw;
+    }
 }
 
 database::~database()
@@ -38,20 +189,199 @@ database::~database()
     _db = nullptr;
 }
 
+std::string database::journal_path() const
+{
+    return (bfs::path(_path) / JOURNAL_FILE).string();
+}
+
+void database::load_keys()
+{
+    std::string path = journal_path();
+    if (bfs::exists(path))
+    {
+        key_set& keys = _keys;
+        std::uint64_t valid = append_log::replay(path, [&keys](const range& r) { apply(r, keys); });
+        if (valid < bfs::file_size(path))
+        {
+            logging::info("nessdb backend: ", path, " has torn tail, truncated at ", valid);
+            append_log::truncate(path, valid);
+        }
+    }
+    _journal.reset(new append_log(path));
+    _journal_compacted_size = _journal->size();
+}
+
+void database::compact_journal()
+{
+    if (_journal->size() < std::max(MIN_JOURNAL_COMPACTION_SIZE, 2 * _journal_compacted_size))
+    {
+        return;
+    }
+
+    std::string path = journal_path();
+    std::string tmp_path = path + ".tmp";
+    {
+        bfs::remove(tmp_path);
+        append_log out(tmp_path);
+        std::string record;
+        for(key_set::const_iterator it = _keys.begin(); it != _keys.end(); ++it)
+        {
+            encode_op(record, op_add, it.key());
+        }
+        out.append(record);
+        out.sync();
+    }
+    _journal.reset();
+    bfs::rename(tmp_path, path);
+    append_log::sync_directory(_path);
+
+    _journal.reset(new append_log(path));
+    _journal_compacted_size = _journal->size();
+}
+
 void database::drop()
 {
-    // TODO
+    boost::mutex::scoped_lock lock(_mutex);
+
+    for(key_set::const_iterator it = _keys.begin(); it != _keys.end(); ++it)
+    {
+        save_for_cursors(it.key());
+        ness_del(it.key());
+    }
+    ++_last_write;
+    _keys.clear();
+
+    _journal.reset();
+    bfs::remove(journal_path());
+    _journal.reset(new append_log(journal_path()));
+    _journal_compacted_size = 0;
 }
 
 void database::add(range key, range data)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+
+    std::string record;
+    encode_op(record, op_add, key);
+    _journal->append(record);
+
+    save_for_cursors(key);
+    ness_add(key, data);
+    _keys.insert_or_assign(key, ++_last_write);
+    compact_journal();
+}
+
+void database::del(range key)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+
+    save_for_cursors(key);
+    ness_del(key);
+    ++_last_write;
+
+    std::string record;
+    encode_op(record, op_del, key);
+    _journal->append(record);
+
+    _keys.erase(key);
+    compact_journal();
+}
+
+std::string database::get(range key)
+{
+    std::string result;
+    if (!try_get(key, result))
+    {
+        throw exception("error reading from ness backend");
+    }
+    return result;
+}
+
+bool database::try_get(range key, std::string& out)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return ness_get(key, out);
+}
+
+bool database::cursor_get(range key, std::uint64_t set_by, std::string& out)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+
+    // not written since, NessDB holds the value
+    const std::uint64_t* current = _keys.get(key);
+    if (current && *current == set_by)
+    {
+        return ness_get(key, out);
+    }
+
+    auto saved = _saved.find(std::make_pair(key.to_string(), set_by));
+    assert(saved != _saved.end());
+    if (saved == _saved.end() || !saved->second.exists)
+    {
+        return false;
+    }
+    out = saved->second.value;
+    return true;
+}
+
+void database::save_for_cursors(range key)
+{
+    const std::uint64_t* set_by = _cursor_versions.empty() ? nullptr : _keys.get(key);
+    if (!set_by)
+    {
+        return;
+    }
+
+    // cursors created since the key was set see its value
+    if (_cursor_versions.lower_bound(*set_by) == _cursor_versions.end())
+    {
+        return;
+    }
+
+    saved_value& saved = _saved[std::make_pair(key.to_string(), *set_by)];
+    saved.replaced_by = _last_write + 1;
+    saved.exists = ness_get(key, saved.value);
+}
+
+void database::close_cursor(std::uint64_t version)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+
+    _cursor_versions.erase(_cursor_versions.find(version));
+
+    // a saved value is needed by cursors created after the key was set, and before it was replaced
+    for(auto it = _saved.begin(); it != _saved.end(); )
+    {
+        auto cursor = _cursor_versions.lower_bound(it->first.second);
+        if (cursor == _cursor_versions.end() || *cursor >= it->second.replaced_by)
+            it = _saved.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool database::ness_get(range key, std::string& out)
 {
     assert(_db);
-    struct slice sk, sv;
 
-    sk.data  = const_cast<char*>(key.begin());
-    sk.len = key.size();
-    sv.data  = const_cast<char*>(data.begin());
-    sv.len = data.size();
+    slice sk = to_slice(key);
+    slice sv;
+    if (::db_get(_db, &sk, &sv) == 0)
+    {
+        return false;
+    }
+
+    // copy the data out
+    out.assign(sv.data, sv.len);
+    ::free(sv.data);
+    return true;
+}
+
+void database::ness_add(range key, range data)
+{
+    assert(_db);
+    slice sk = to_slice(key);
+    slice sv = to_slice(data);
 
     if (::db_add(_db, &sk, &sv) == 0)
     {
@@ -59,40 +389,66 @@ void database::add(range key, range data)
     }
 }
 
-void database::del(range key)
+void database::ness_del(range key)
 {
     assert(_db);
-    struct slice sk;
-
-    sk.data  = const_cast<char*>(key.begin());
-    sk.len = key.size();
+    slice sk = to_slice(key);
 
     ::db_remove(_db, &sk);
 }
 
-std::string database::get(range key)
+interfaces::cursor_ptr database::create_cursor()
 {
-    assert(_db);
-    struct slice sk, sv;
+    boost::mutex::scoped_lock lock(_mutex);
+    _cursor_versions.insert(_last_write);
+    return interfaces::cursor_ptr(new cursor(*this, _keys, _last_write));
+}
 
-    sk.data  = const_cast<char*>(key.begin());
-    sk.len = key.size();
+interfaces::snapshot_ptr database::create_snapshot()
+{
+    throw exception("snapshots not implemented in nessdb backend");
+}
 
-    if (::db_get(_db, &sk, &sv) == 0)
+std::string database::get(range key, const interfaces::snapshot& snap)
+{
+    throw exception("snapshots not implemented in nessdb backend");
+}
+
+interfaces::cursor_ptr database::create_cursor(const interfaces::snapshot& snap)
+{
+    throw exception("snapshots not implemented in nessdb backend");
+}
+
+interfaces::write_batch_ptr database::create_write_batch()
+{
+    return interfaces::write_batch_ptr(new write_batch());
+}
+
+void database::write(interfaces::write_batch& batch, bool sync)
+{
+    for(const write_batch::op& o : static_cast<write_batch&>(batch).ops())
     {
-        throw exception("error reading from ness backend");
+        if (o.is_del)
+        {
+            del(o.key);
+        }
+        else
+        {
+            add(o.key, o.data);
+        }
     }
 
-    // copy the data out
-    std::string result(sv.data, sv.len);
-    ::free(sv.data);
-    return result;
+    if (sync)
+    {
+        this->sync();
+    }
 }
 
-void database::for_each(const interfaces::database_backend::key_handler& handler)
+void database::sync()
 {
-    // undoable with current nessdb
-    throw exception("for_each not implemented in nessdb backend");
+    // nessdb writes through its own log, only the key journal needs syncing
+    boost::mutex::scoped_lock lock(_mutex);
+    _journal->sync();
 }
 
 } }
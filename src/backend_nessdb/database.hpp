@@ -22,16 +22,40 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "interfaces/storage_backend.hpp"
 
+#include "utils/append_log.hpp"
+#include "utils/persistent_map.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <memory>
+#include <set>
+
 extern "C" {
 #include <nessdb/db.h>
 }
 
 namespace falcondb { namespace backend_nessdb {
 
+/// NessDB database.
+///
+/// NessDB offers only point access, so the database keeps the ordered set of keys in memory,
+/// persisted in a key journal next to the NessDB files. The journal is written before adding
+/// a value and after removing one, so after a crash it may only contain extra keys; cursors
+/// skip keys without a value.
+///
+/// Cursors iterate over the key set as of their creation, values are read when the cursor
+/// reaches the key. The key set is a persistent map: a cursor takes its version in O(1), and
+/// later writes copy only the paths to the changed keys. Writes are numbered, and each key
+/// holds the number of the write which set it. A write replacing a value which a live cursor
+/// still sees saves the old value for it, so cursors see the values as of their creation too.
+/// NessDB has no snapshots and no atomic batches.
 class database : public interfaces::database_backend
 {
 public:
 
+    typedef persistent_map<std::uint64_t> key_set; // number of the write which set the key
+
     virtual ~database();
 
     virtual void drop();
@@ -39,16 +63,66 @@ public:
     virtual void add(range key, range data);
     virtual void del(range key);
     virtual std::string get(range key);
-    virtual void for_each(const key_handler& handler);
+    virtual interfaces::cursor_ptr create_cursor();
 
+    virtual interfaces::snapshot_ptr create_snapshot();
+    virtual std::string get(range key, const interfaces::snapshot& snap);
+    virtual interfaces::cursor_ptr create_cursor(const interfaces::snapshot& snap);
+
+    virtual interfaces::write_batch_ptr create_write_batch();
+    virtual void write(interfaces::write_batch& batch, bool sync);
+    virtual void sync();
+
+    /// Reads value, returns false if there is no such key
+    bool try_get(range key, std::string& out);
 
 private:
 
     database(const std::string& path);
     friend class backend;
+    friend class cursor;
+
+    /// Forgets cursor created at 'version', and the values saved only for it
+    void close_cursor(std::uint64_t version);
+
+    /// Reads value of the key as set by the write 'set_by', for cursors created after it
+    bool cursor_get(range key, std::uint64_t set_by, std::string& out);
+
+    /// Saves the value of the key for live cursors, before a write replaces it. Requires the lock
+    void save_for_cursors(range key);
+
+    /// Rebuilds the key set from the journal
+    void load_keys();
+
+    /// Rewrites the journal with the current key set, if it grew much larger. Requires the lock
+    void compact_journal();
+
+    // value operations, require the lock
+    void ness_add(range key, range data);
+    void ness_del(range key);
+    bool ness_get(range key, std::string& out);
+
+    std::string journal_path() const;
 
+    const std::string _path;
     nessdb* _db;
 
+    /// Value replaced by a write, while a cursor created before it was open
+    struct saved_value
+    {
+        std::uint64_t replaced_by; // number of the write
+        bool exists;
+        std::string value;
+    };
+
+    boost::mutex _mutex; // NessDB calls, key set, journal and cursor versions
+    key_set _keys;
+    std::unique_ptr<append_log> _journal;
+    std::uint64_t _journal_compacted_size; // journal size after last compaction
+
+    std::uint64_t _last_write; // number of the last add or del, keys loaded from the journal have 0
+    std::multiset<std::uint64_t> _cursor_versions; // _last_write at creation of open cursors
+    std::map<std::pair<std::string, std::uint64_t>, saved_value> _saved; // by key and the write which set it
 };
 
 } }
@@ -0,0 +1,154 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "backend_nessdb/backend.hpp"
+
+#include "utils/filesystem.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <string>
+
+namespace falcondb {
+
+BOOST_AUTO_TEST_SUITE(backend_nessdb_test_suite)
+
+// test env
+class fixture
+{
+public:
+
+    fixture()
+    : _path(bfs::temp_directory_path() / bfs::unique_path("falcondb-nessdb-%%%%-%%%%"))
+    {
+    }
+
+    ~fixture()
+    {
+        bfs::remove_all(_path);
+    }
+
+    std::string path() const { return _path.string(); }
+
+    static std::map<std::string, std::string> read_all(interfaces::cursor& c)
+    {
+        std::map<std::string, std::string> result;
+        for(c.seek_to_first(); c.valid(); c.next())
+        {
+            result[c.key().to_string()] = c.value().to_string();
+        }
+        return result;
+    }
+
+    backend_nessdb::backend backend;
+
+private:
+
+    bfs::path _path;
+};
+
+static std::string key(int i)
+{
+    return "k" + std::to_string(1000 + i);
+}
+
+// cursors see the values as of their creation, whatever is written while they are open
+BOOST_FIXTURE_TEST_CASE(cursor_consistency, fixture)
+{
+    interfaces::database_backend_ptr db = backend.create_database(path());
+    for(int i = 0; i < 100; ++i)
+    {
+        db->add(key(i), "v" + std::to_string(i));
+    }
+
+    interfaces::cursor_ptr first = db->create_cursor();
+    std::map<std::string, std::string> before = read_all(*first);
+    BOOST_REQUIRE_EQUAL(before.size(), 100);
+
+    // overwritten, removed, removed and added again, new
+    for(int i = 0; i < 100; i += 2)
+    {
+        db->add(key(i), std::string("new"));
+    }
+    for(int i = 1; i < 100; i += 4)
+    {
+        db->del(key(i));
+    }
+    db->del(key(3));
+    db->add(key(3), std::string("again"));
+    db->add(std::string("k0000"), std::string("added"));
+
+    std::map<std::string, std::string> between;
+    {
+        interfaces::cursor_ptr second = db->create_cursor();
+        between = read_all(*second);
+        // replaced again while both cursors are open
+        db->add(key(10), std::string("newer"));
+        BOOST_CHECK(read_all(*second) == between);
+    }
+    BOOST_CHECK_EQUAL(between.size(), 76);
+    BOOST_CHECK_EQUAL(between[key(10)], "new");
+    BOOST_CHECK_EQUAL(between[key(3)], "again");
+
+    BOOST_CHECK(read_all(*first) == before);
+    std::size_t backwards = 0;
+    for(first->seek_to_last(); first->valid(); first->prev())
+    {
+        BOOST_CHECK_EQUAL(before[first->key().to_string()], first->value().to_string());
+        ++backwards;
+    }
+    BOOST_CHECK_EQUAL(backwards, 100);
+    first.reset();
+
+    interfaces::cursor_ptr last = db->create_cursor();
+    std::map<std::string, std::string> now = read_all(*last);
+    BOOST_CHECK_EQUAL(now.size(), 76);
+    BOOST_CHECK_EQUAL(now[key(10)], "newer");
+    BOOST_CHECK_EQUAL(now[key(0)], "new");
+    BOOST_CHECK_EQUAL(now.count(key(1)), 0);
+    BOOST_CHECK_EQUAL(now["k0000"], "added");
+}
+
+// the key journal gives the same key set after reopening
+BOOST_FIXTURE_TEST_CASE(reopen, fixture)
+{
+    {
+        interfaces::database_backend_ptr db = backend.create_database(path());
+        for(int i = 0; i < 100; ++i)
+        {
+            db->add(key(i), std::to_string(i));
+        }
+        for(int i = 0; i < 100; i += 3)
+        {
+            db->del(key(i));
+        }
+    }
+
+    interfaces::database_backend_ptr db = backend.open_database(path());
+    interfaces::cursor_ptr c = db->create_cursor();
+    std::map<std::string, std::string> reopened = read_all(*c);
+    BOOST_CHECK_EQUAL(reopened.size(), 66);
+    BOOST_CHECK_EQUAL(reopened[key(1)], "1");
+    BOOST_CHECK_EQUAL(reopened.count(key(3)), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
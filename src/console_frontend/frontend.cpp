@@ -43,7 +43,7 @@ frontend::frontend(interfaces::engine& engine)
         [this](const arg_list& al) { handle_quit(al); });
     _dispatcher.add_command("help", "help", "Display this help",
         [this](const arg_list& al) { _dispatcher.print_help(); });
-    _dispatcher.add_command("create", "create DBNAME", "Create new database",
+    _dispatcher.add_command("create", "create DBNAME [BACKEND]", "Create new database",
         [this](const arg_list& al) { handle_create_db(al); });
     _dispatcher.add_command("drop", "drop DBNAME", "Drop existing database",
         [this](const arg_list& al) { handle_drop_db(al); });
@@ -51,8 +51,20 @@ frontend::frontend(interfaces::engine& engine)
         [this](const arg_list& al) { handle_insert(al); });
     _dispatcher.add_command("list", "list DATABASE", "Get the entire content of the db",
         [this](const arg_list& al) { handle_list(al); });
+    _dispatcher.add_command("find", "find DATABASE QUERY", "Get documents in index order, QUERY: {\"index\":NAME, ...}",
+        [this](const arg_list& al) { handle_find(al); });
     _dispatcher.add_command("listindexes", "listindexes DATABASE", "Get the entire content of the db",
         [this](const arg_list& al) { handle_listindexes(al); });
+    _dispatcher.add_command("createindex", "createindex DATABASE NAME DEFINITION [background]", "Create index over existing documents",
+        [this](const arg_list& al) { handle_createindex(al); });
+    _dispatcher.add_command("indexbuilds", "indexbuilds DATABASE", "Show progress of background index builds",
+        [this](const arg_list& al) { handle_indexbuilds(al); });
+    _dispatcher.add_command("compactindex", "compactindex DATABASE NAME", "Rebuild index densely",
+        [this](const arg_list& al) { handle_compactindex(al); });
+    _dispatcher.add_command("cachestats", "cachestats DATABASE", "Show document cache counters",
+        [this](const arg_list& al) { handle_cachestats(al); });
+    _dispatcher.add_command("indexstats", "indexstats DATABASE", "Show index counters",
+        [this](const arg_list& al) { handle_indexstats(al); });
     _dispatcher.add_command("remove", "remove DATABASE KEY", "Remove document with _id=KEY from db",
         [this](const arg_list& al) { handle_remove(al); });
     _dispatcher.add_command("showdbs", "showdbs", "List databases",
@@ -156,7 +168,14 @@ void frontend::handle_quit(const frontend::arg_list &al)
 
 void frontend::handle_create_db(const frontend::arg_list& al)
 {
-    _engine.create_database(require_arg(al, 0));
+    if (al.size() > 1)
+    {
+        _engine.create_database(al[0], al[1]);
+    }
+    else
+    {
+        _engine.create_database(require_arg(al, 0));
+    }
     std::cout << "ok" << std::endl;
 }
 
@@ -200,12 +219,57 @@ void frontend::handle_list(const frontend::arg_list& al)
     post_command(db_name, "list");
 }
 
+void frontend::handle_find(const frontend::arg_list& al)
+{
+    std::string db_name = require_arg(al, 0);
+    post_command(db_name, "find", document::from_json(require_arg(al, 1)));
+}
+
 void frontend::handle_listindexes(const frontend::arg_list& al)
 {
     std::string db_name = require_arg(al, 0);
     post_command(db_name, "listindexes");
 }
 
+void frontend::handle_createindex(const frontend::arg_list& al)
+{
+    std::string db_name = require_arg(al, 0);
+    document_object param;
+    param.set_field("name", document_scalar::from(require_arg(al, 1)));
+    param.set_field("definition", document::from_json(require_arg(al, 2)));
+    if (al.size() > 3 && al[3] == "background")
+    {
+        param.set_field("background", document_scalar::from(true));
+    }
+    post_command(db_name, "createindex", param);
+}
+
+void frontend::handle_indexbuilds(const frontend::arg_list& al)
+{
+    std::string db_name = require_arg(al, 0);
+    post_command(db_name, "indexbuilds");
+}
+
+void frontend::handle_compactindex(const frontend::arg_list& al)
+{
+    std::string db_name = require_arg(al, 0);
+    document_object param;
+    param.set_field("name", document_scalar::from(require_arg(al, 1)));
+    post_command(db_name, "compactindex", param);
+}
+
+void frontend::handle_cachestats(const frontend::arg_list& al)
+{
+    std::string db_name = require_arg(al, 0);
+    post_command(db_name, "cachestats");
+}
+
+void frontend::handle_indexstats(const frontend::arg_list& al)
+{
+    std::string db_name = require_arg(al, 0);
+    post_command(db_name, "indexstats");
+}
+
 void frontend::handle_remove(const arg_list& al)
 {
     std::string db_name = require_arg(al, 0);
@@ -68,7 +68,13 @@ private:
     void handle_drop_db(const arg_list& al);
     void handle_insert(const arg_list& al);
     void handle_list(const arg_list& al);
+    void handle_find(const arg_list& al);
     void handle_listindexes(const arg_list& al);
+    void handle_createindex(const arg_list& al);
+    void handle_indexbuilds(const arg_list& al);
+    void handle_compactindex(const arg_list& al);
+    void handle_cachestats(const arg_list& al);
+    void handle_indexstats(const arg_list& al);
     void handle_remove(const arg_list& al);
     void handle_showdbs();
     void handle_dump(const arg_list& al);
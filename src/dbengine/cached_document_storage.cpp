@@ -0,0 +1,83 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dbengine/cached_document_storage.hpp"
+
+namespace falcondb { namespace dbengine {
+
+cached_document_storage::cached_document_storage(dbengine::document_storage& storage, document_cache& cache)
+:
+    _storage(storage),
+    _cache(cache)
+{
+}
+
+void cached_document_storage::write(const document& key, const document& doc)
+{
+    _cache.invalidate(_storage.encode_key(key));
+    _storage.write(key, doc);
+}
+
+document cached_document_storage::read(const document& key)
+{
+    std::string key_data = _storage.encode_key(key);
+    boost::optional<document> cached = _cache.get(key_data);
+    if (cached)
+    {
+        return *cached;
+    }
+
+    std::string doc_data = _storage.read_raw(key);
+    document doc = dbengine::document_storage::decode_value(doc_data);
+    _cache.put(key_data, doc, doc_data.size());
+    return doc;
+}
+
+void cached_document_storage::remove(const document& key)
+{
+    _cache.invalidate(_storage.encode_key(key));
+    _storage.remove(key);
+}
+
+void cached_document_storage::for_each(const key_value_handler& fun)
+{
+    _storage.for_each(fun);
+}
+
+void cached_document_storage::for_each(const document& begin, const document& end, const key_value_handler& fun)
+{
+    _storage.for_each(begin, end, fun);
+}
+
+void cached_document_storage::read_view(const document& key, const view_handler& fun)
+{
+    _storage.read_view(key, fun);
+}
+
+void cached_document_storage::for_each_view(const key_view_handler& fun)
+{
+    _storage.for_each_view(fun);
+}
+
+document_cursor cached_document_storage::create_cursor()
+{
+    return _storage.create_cursor();
+}
+
+} }
@@ -0,0 +1,57 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_DBENGINE_CACHED_DOCUMENT_STORAGE_HPP
+#define FALCONDB_DBENGINE_CACHED_DOCUMENT_STORAGE_HPP
+
+#include "dbengine/document_storage.hpp"
+#include "dbengine/document_cache.hpp"
+
+namespace falcondb { namespace dbengine {
+
+/// document_storage decorator, serving point reads from document_cache.
+/// Writes and removals go through to the storage and invalidate the cached entry.
+/// Iteration and views are not cached, they are passed to the storage.
+class cached_document_storage : public interfaces::document_storage
+{
+public:
+
+    /// The cache may be shared between storages of different namespaces
+    cached_document_storage(dbengine::document_storage& storage, document_cache& cache);
+
+    virtual void write(const document& key, const document& doc);
+    virtual document read(const document& key);
+    virtual void remove(const document& key);
+    virtual void for_each(const key_value_handler& fun);
+    virtual void for_each(const document& begin, const document& end, const key_value_handler& fun);
+    virtual void read_view(const document& key, const view_handler& fun);
+    virtual void for_each_view(const key_view_handler& fun);
+
+    /// Ordered cursor over the storage, values are not cached
+    document_cursor create_cursor();
+
+private:
+
+    dbengine::document_storage& _storage;
+    document_cache& _cache;
+};
+
+} }
+
+#endif
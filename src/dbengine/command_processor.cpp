@@ -21,10 +21,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "dbengine/database.hpp"
 
 #include "utils/exception.hpp"
+#include "utils/log.hpp"
+
+#include <map>
 
 namespace falcondb { namespace dbengine {
 
 command_processor::command_processor()
+: _flush_scheduled(false)
 {
 }
 
@@ -70,6 +74,70 @@ void command_processor::post(
     _io_service.post([=,&db](){ handler_wrapper(command, params, result, db, handler); });
 }
 
+void command_processor::post_task(const std::function<void ()>& task)
+{
+    _io_service.post(task);
+}
+
+bool command_processor::commit(
+    const interfaces::database_backend_ptr& backend,
+    interfaces::write_batch& batch,
+    const commit_handler& handler)
+{
+    try
+    {
+        backend->write(batch, false);
+    }
+    catch(const falcondb::exception& e)
+    {
+        handler(e);
+        return false;
+    }
+
+    _pending_commits.push_back(pending_commit{backend, handler});
+
+    // the flush is queued after commands already waiting, they will join this group
+    if (!_flush_scheduled)
+    {
+        _flush_scheduled = true;
+        _io_service.post([this] { flush(); });
+    }
+    return true;
+}
+
+void command_processor::flush()
+{
+    _flush_scheduled = false;
+    std::vector<pending_commit> group;
+    group.swap(_pending_commits);
+
+    // one sync per backend covers all writes applied before it
+    std::map<interfaces::database_backend*, error_message> synced;
+    for(const pending_commit& c : group)
+    {
+        if (synced.find(c.backend.get()) == synced.end())
+        {
+            error_message error;
+            try
+            {
+                c.backend->sync();
+            }
+            catch(const falcondb::exception& e)
+            {
+                error = e;
+            }
+            synced.insert(std::make_pair(c.backend.get(), error));
+        }
+    }
+
+    logging::debug("group commit: ", group.size(), " commits, ", synced.size(), " syncs");
+
+    for(const pending_commit& c : group)
+    {
+        c.handler(synced[c.backend.get()]);
+    }
+}
+
 void command_processor::handler_wrapper(
     const std::string& command,
     const document& params,
@@ -83,10 +151,12 @@ void command_processor::handler_wrapper(
     }
     catch(const falcondb::exception& e)
     {
+        db.abort_write();
         result(e, document_list());
     }
     catch(const std::exception& e)
     {
+        db.abort_write();
         result(std::string(e.what()), document_list());
     }
 }
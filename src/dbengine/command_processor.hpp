@@ -31,6 +31,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace falcondb { namespace dbengine {
 
@@ -56,6 +57,17 @@ public:
         const interfaces::result_handler& result,
         database& db);
 
+    // posts a task for execution on the worker thread, between the commands
+    void post_task(const std::function<void ()>& task);
+
+    typedef std::function<void (const error_message&)> commit_handler;
+
+    // Group commit. Applies the batch immediately, so it is visible to the following commands,
+    // but calls the handler only after the data is durable. All commands committed before
+    // the next flush share a single sync. Must be called from the worker thread.
+    // Returns false if the batch could not be applied, the handler has been called with the error
+    bool commit(const interfaces::database_backend_ptr& backend, interfaces::write_batch& batch, const commit_handler& handler);
+
 private:
 
     // commands
@@ -68,6 +80,18 @@ private:
     std::unique_ptr<boost::thread> _thread;
     std::unique_ptr<boost::asio::io_service::work> _work;
 
+    // group commit
+    struct pending_commit
+    {
+        interfaces::database_backend_ptr backend;
+        commit_handler handler;
+    };
+    std::vector<pending_commit> _pending_commits; // accessed only by the worker thread
+    bool _flush_scheduled;
+
+    // syncs all backends with pending commits, acknowledges the commits
+    void flush();
+
     static void handler_wrapper(
         const std::string& command,
         const document& params,
@@ -21,9 +21,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "interfaces/document_storage.hpp"
 
+#include "document/key_encoding.hpp"
+
+#include "utils/exception.hpp"
+
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/random_generator.hpp>
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <set>
+
 namespace falcondb { namespace dbengine {
 namespace commands {
 
@@ -36,13 +45,18 @@ static void insert_with_id(database& db, const document_object& doc)
 
     document key = doc.get_field("_id");
 
+    // a document with the same _id is replaced, its index entries go first
+    document_cursor existing = db.get_data_storage().create_cursor();
+    existing.seek(key);
+    if (existing.valid() && existing.key() == key)
+    {
+        existing.view_value([&db, &key](const document_view& old_doc) { db.index_remove(key, old_doc); });
+    }
+
     db.get_data_storage().write(key, doc);
 
     // update indexes
-    for( const auto& index : db.get_indexes())
-    {
-        index.second->insert(key, doc);
-    }
+    db.index_insert(key, doc);
 }
 
 void insert(const document& param,
@@ -50,6 +64,10 @@ void insert(const document& param,
     database& db)
 {
     const document_object& as_obj = param.as_object();
+
+    // document and index nodes are written atomically
+    db.begin_write();
+
     // does the object has _id field?
     if (as_obj.has_field("_id"))
     {
@@ -67,7 +85,7 @@ void insert(const document& param,
         insert_with_id(db, copy);
     }
 
-    handler(error_message(), document_list());
+    db.commit_write([handler](const error_message& error) { handler(error, document_list()); });
 }
 
 ////////////////////////////////////////////////////
@@ -77,13 +95,154 @@ void list(const document& param,
     const interfaces::result_handler& handler,
     database& db)
 {
+    boost::optional<std::size_t> limit;
+    boost::optional<document> after;
+
+    const document_object* options = boost::get<document_object>(&param._v());
+    if (options)
+    {
+        if (options->has_field("limit"))
+            limit = options->get_field("limit").as_scalar().to_number<std::size_t>();
+        if (options->has_field("after"))
+            after = options->get_field("after");
+    }
+
+    // stream from the cursor, reading only what is returned. Commands run one at a time,
+    // so nothing writes during the scan
     document_list result;
+    document_cursor cursor = db.get_data_storage().create_cursor();
+    if (after)
+    {
+        cursor.seek(*after);
+        if (cursor.valid() && cursor.key() == *after)
+        {
+            cursor.next();
+        }
+    }
+    else
+    {
+        cursor.seek_to_first();
+    }
+
+    for(; cursor.valid() && (!limit || result.size() < *limit); cursor.next())
+    {
+        result.push_back(cursor.value());
+    }
 
-    db.get_data_storage().for_each(
-        [&result](const document& key, const document& value)
+    handler(error_message(), result);
+}
+
+////////////////////////////////////////////////////
+/// find
+
+static document project(const document_object& doc, const std::vector<std::string>& fields)
+{
+    document_object result;
+    for(const std::string& name : fields)
+    {
+        auto it = doc.find(name);
+        if (it != doc.end())
+            result.set_field(name, it->second);
+    }
+    return result;
+}
+
+void find(const document& param,
+    const interfaces::result_handler& handler,
+    database& db)
+{
+    const document_object& options = param.as_object();
+    std::string name = options.get_field("index").as<std::string>();
+    auto index_it = db.get_indexes().find(name);
+    if (index_it == db.get_indexes().end())
+        throw exception("no index '", name, "'");
+    interfaces::index& index = *index_it->second;
+
+    boost::optional<document> min;
+    boost::optional<document> max;
+    std::uint64_t limit = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t skip = 0;
+    bool reverse = false;
+    boost::optional<std::vector<std::string>> fields;
+    if (options.has_field("min"))
+        min = options.get_field("min");
+    if (options.has_field("max"))
+        max = options.get_field("max");
+    if (options.has_field("limit"))
+        limit = options.get_field("limit").as_scalar().to_number<std::uint64_t>();
+    if (options.has_field("skip"))
+        skip = options.get_field("skip").as_scalar().to_number<std::uint64_t>();
+    if (options.has_field("reverse"))
+        reverse = options.get_field("reverse").as<bool>();
+    if (options.has_field("fields"))
+    {
+        fields = std::vector<std::string>();
+        for(const document& f : options.get_field("fields").as_list())
+            fields->push_back(f.as_scalar().as<std::string>());
+    }
+
+    // unordered indexes have no positions, they find all the entries equal to the key in one lookup
+    if (!index.ordered())
+    {
+        document_list result;
+        for(const document& storage_key : index.scan(min, true, max, true, std::size_t(limit), std::size_t(skip), reverse))
         {
-            result.push_back(value);
-        });
+            document doc = db.get_data_storage().read(storage_key);
+            result.push_back(fields ? project(doc.as_object(), *fields) : doc);
+        }
+        handler(error_message(), result);
+        return;
+    }
+
+    // the range and the page are positions in the index, found by its subtree counts.
+    // A document has an entry for each array element in a multikey index, it is returned once:
+    // the page is counted in documents, skipping over the range
+    bool multikey = index.multikey();
+    std::uint64_t begin = min ? index.rank(*min, false) : 0;
+    std::uint64_t end = max ? index.rank(*max, true) : index.count(boost::none, true, boost::none, true);
+    if (!multikey)
+    {
+        if (reverse)
+            end = end > skip ? end - skip : 0;
+        else
+            begin += skip;
+        skip = 0;
+    }
+    std::uint64_t entries = end > begin ? end - begin : 0;
+    if (!multikey)
+        entries = std::min(entries, limit);
+
+    // fields included in the index are stored as in the documents, _id as well: the storage key
+    // comes back from its key encoding, which does not keep the number type
+    bool covered = fields && index.covers(*fields);
+
+    document_list result;
+    if (entries > 0 && limit > 0)
+    {
+        std::set<std::string> returned; // key-encoded storage keys, for multikey indexes
+        interfaces::index_cursor::unique_ptr cursor = index.create_cursor();
+        cursor->seek_to_position(reverse ? end - 1 : begin);
+        for(; cursor->valid() && entries > 0 && result.size() < limit; --entries, reverse ? cursor->prev() : cursor->next())
+        {
+            if (multikey && !returned.insert(key_encoding::encode(cursor->storage_key())).second)
+                continue;
+            if (skip > 0)
+            {
+                --skip;
+                continue;
+            }
+
+            if (covered)
+            {
+                result.push_back(project(cursor->covered_fields().as_object(), *fields));
+            }
+            else
+            {
+                document doc = db.get_data_storage().read(cursor->storage_key());
+                result.push_back(fields ? project(doc.as_object(), *fields) : doc);
+            }
+        }
+    }
 
     handler(error_message(), result);
 }
@@ -95,15 +254,18 @@ void remove(const document& param,
     const interfaces::result_handler& handler,
     database& db)
 {
+    db.begin_write();
+
     // remove from indexes
-    document doc = db.get_data_storage().read(param);
-    for(const auto& index : db.get_indexes())
-    {
-        index.second->del(doc);
-    }
+    db.get_data_storage().read_view(
+        param,
+        [&db, &param](const document_view& doc)
+        {
+            db.index_remove(param, doc);
+        });
 
     db.get_data_storage().remove(param); // the param is the key
-    handler(error_message(), document_list());
+    db.commit_write([handler](const error_message& error) { handler(error, document_list()); });
 }
 
 ////////////////////////////////////////////////////
@@ -125,6 +287,113 @@ void listindexes(const document& param,
     handler(error_message(), result);
 }
 
+////////////////////////////////////////////////////
+/// createindex
+
+void createindex(const document& param,
+    const interfaces::result_handler& handler,
+    database& db)
+{
+    const document_object& as_obj = param.as_object();
+    std::string name = as_obj.get_field("name").as<std::string>();
+
+    bool background = false;
+    if (as_obj.has_field("background"))
+        background = as_obj.get_field("background").as<bool>();
+
+    if (background)
+    {
+        // returns once started, progress is reported by 'indexbuilds'
+        db.start_index_build(name, as_obj.get_field("definition"));
+    }
+    else
+    {
+        db.create_index(name, as_obj.get_field("definition"));
+    }
+
+    handler(error_message(), document_list());
+}
+
+////////////////////////////////////////////////////
+/// compactindex
+
+void compactindex(const document& param,
+    const interfaces::result_handler& handler,
+    database& db)
+{
+    std::string name = param.as_object().get_field("name").as<std::string>();
+
+    document_list result;
+    result.push_back(db.compact_index(name));
+    handler(error_message(), result);
+}
+
+////////////////////////////////////////////////////
+/// indexbuilds
+
+void indexbuilds(const document& param,
+    const interfaces::result_handler& handler,
+    database& db)
+{
+    document_list result;
+    for(const database::index_build_status& status : db.get_index_builds())
+    {
+        document_object build;
+        build.set_field("name", document_scalar::from(status.name));
+        build.set_field("state", document_scalar::from(status.state));
+        build.set_field("documents_read", document_scalar::from(std::uint64_t(status.documents_read)));
+        build.set_field("entries_written", document_scalar::from(std::uint64_t(status.entries_written)));
+        build.set_field("side_log_records", document_scalar::from(std::uint64_t(status.side_log_records)));
+        build.set_field("elapsed", document_scalar::from(status.elapsed));
+        double rate = status.elapsed > 0 ? status.documents_read / status.elapsed : 0.0;
+        build.set_field("documents_per_second", document_scalar::from(rate));
+        if (!status.error.empty())
+            build.set_field("error", document_scalar::from(status.error));
+        result.push_back(build);
+    }
+
+    handler(error_message(), result);
+}
+
+////////////////////////////////////////////////////
+/// cachestats
+
+void cachestats(const document& param,
+    const interfaces::result_handler& handler,
+    database& db)
+{
+    document_cache::stats stats = db.get_cache().get_stats();
+
+    document_object result;
+    result.set_field("hits", document_scalar::from(std::uint64_t(stats.hits)));
+    result.set_field("misses", document_scalar::from(std::uint64_t(stats.misses)));
+    result.set_field("evictions", document_scalar::from(std::uint64_t(stats.evictions)));
+    result.set_field("size", document_scalar::from(std::uint64_t(stats.size)));
+    result.set_field("entries", document_scalar::from(std::uint64_t(stats.entries)));
+    result.set_field("capacity", document_scalar::from(std::uint64_t(db.get_cache().capacity())));
+
+    document_list list;
+    list.push_back(result);
+    handler(error_message(), list);
+}
+
+////////////////////////////////////////////////////
+/// indexstats
+
+void indexstats(const document& param,
+    const interfaces::result_handler& handler,
+    database& db)
+{
+    document_list result;
+    for(const auto& index : db.get_indexes())
+    {
+        document_object stats = index.second->stats().as_object();
+        stats.set_field("name", document_scalar::from(index.first));
+        result.push_back(stats);
+    }
+
+    handler(error_message(), result);
+}
 
 } // namespace commands
 } }
@@ -32,12 +32,22 @@ void insert(
     const interfaces::result_handler& handler,
     database& db);
 
-// returns the entire content of the collection in no particular order
+// returns the content of the collection in _id order.
+// Optional param object: { "limit" : max number of documents, "after" : _id to resume after }
 void list(
     const document& param,
     const interfaces::result_handler& handler,
     database& db);
 
+// returns documents in the order of an index.
+// params: {"index": NAME, "min": KEY, "max": KEY, "limit": N, "skip": N, "reverse": BOOL, "fields": [NAME, ...]}
+// Bounds are inclusive objects with the indexed fields. With 'fields' only these fields are returned,
+// read from the index alone if it stores all of them
+void find(
+    const document& param,
+    const interfaces::result_handler& handler,
+    database& db);
+
 // removes object which _id is equal to param
 void remove(
     const document& param,
@@ -55,6 +65,36 @@ void listindexes(
     const interfaces::result_handler& handler,
     database& db);
 
+// returns document cache counters
+void cachestats(
+    const document& param,
+    const interfaces::result_handler& handler,
+    database& db);
+
+// creates index over existing documents. params: {"name": NAME, "definition": {"fields": [...]}, "background": BOOL}
+void createindex(
+    const document& param,
+    const interfaces::result_handler& handler,
+    database& db);
+
+// rebuilds index densely. params: {"name": NAME}
+void compactindex(
+    const document& param,
+    const interfaces::result_handler& handler,
+    database& db);
+
+// returns progress of background index builds
+void indexbuilds(
+    const document& param,
+    const interfaces::result_handler& handler,
+    database& db);
+
+// returns counters of each index
+void indexstats(
+    const document& param,
+    const interfaces::result_handler& handler,
+    database& db);
+
 } } }
 
 #endif
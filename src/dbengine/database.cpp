@@ -23,27 +23,85 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "dbengine/document_storage.hpp"
 
 #include "indexes/btree/index_type.hpp"
+#include "indexes/hash/index_type.hpp"
 
+#include "document/key_encoding.hpp"
+
+#include "utils/append_log.hpp"
+#include "utils/exception.hpp"
+#include "utils/filesystem.hpp"
+#include "utils/log.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <cassert>
 
 namespace falcondb { namespace dbengine {
 
+static const std::size_t CACHE_SIZE = 32 * 1024 * 1024; // bytes of encoded documents
+static const std::string META_DATA_KEY("000meta_data");
+
+/// Index being built in the background.
+/// Fields written by the build thread are read by the worker thread only after joining it,
+/// except for the progress counters
+struct database::index_build
+{
+    index_build(const std::string& n, const document& d)
+    : name(n), definition(d), started(boost::posix_time::microsec_clock::universal_time()),
+      documents_read(0), entries_written(0), side_log_records(0), cancelled(false)
+    {
+    }
+
+    const std::string name;
+    const document definition;
+    const boost::posix_time::ptime started;
+
+    std::atomic<std::size_t> documents_read;
+    std::atomic<std::size_t> entries_written;
+    std::size_t side_log_records;
+
+    std::unique_ptr<append_log> side_log; // reset when the build is done
+    std::string side_log_path;
+
+    std::unique_ptr<boost::thread> thread;
+    std::atomic<bool> cancelled;
+
+    // results of the build thread
+    boost::optional<document> description;
+    std::string error;
+};
+
 database::database(const interfaces::database_backend_ptr& storage, command_processor& processor)
 :
     _storage(storage),
     _processor(processor),
     _index_storage(_storage, "index"),
-    _data_storage(_storage, "data")
+    _data_storage(_storage, "data"),
+    _cache(CACHE_SIZE),
+    _cached_data_storage(_data_storage, _cache)
 {
-    _default_index_type = std::make_shared<indexes::btree::index_type>();
+    _index_types["btree"] = std::make_shared<indexes::btree::index_type>();
+    _index_types["hash"] = std::make_shared<indexes::hash::index_type>();
 
     // load meta-data
-    std::string key("000meta_data");
+    boost::optional<std::string> doc_data;
     try
     {
-        std::string doc_data = _storage->get(key);
-        _meta_data = document::from_json(doc_data);
+        doc_data = _storage->get(META_DATA_KEY);
+    }
+    catch(...)
+    {
+        // no meta-data
+    }
+
+    if (doc_data)
+    {
+        _meta_data = document_storage::decode_value(*doc_data);
+        upgrade_storage_format();
 
         document_object index_descriptions = _meta_data.get_field("indexes").as_object();
         for(auto description : index_descriptions)
@@ -51,12 +109,13 @@ database::database(const interfaces::database_backend_ptr& storage, command_proc
             _indexes.insert(
                 std::make_pair(
                     description.first,
-                    _default_index_type->load_index(_index_storage, description.second)
+                    index_type_of(description.second.as_object().get_field("definition"))->load_index(
+                        _index_storage, description.second)
                 )
             );
         }
     }
-    catch(...)
+    else
     {
         // so this is a new database
         // create main index
@@ -76,10 +135,11 @@ database::database(const interfaces::database_backend_ptr& storage, command_proc
 
         std::cout << "creating main index: " << definition.to_json() << std::endl;
 
-        interfaces::index_type::create_result result = _default_index_type->create_index(
+        interfaces::index_type::create_result result = index_type_of(definition)->create_index(
             definition,
             _index_storage,
-            data_storage);
+            data_storage,
+            interfaces::index_type::progress_handler());
 
         _indexes.insert(std::make_pair("main", std::move(result.new_index)));
 
@@ -87,8 +147,26 @@ database::database(const interfaces::database_backend_ptr& storage, command_proc
         document_object index_descriptions;
         index_descriptions.insert(std::make_pair("main", result.index_description));
         _meta_data.set_field("indexes", index_descriptions);
-        _storage->add(key, _meta_data.to_json());
+        _meta_data.set_field("storage_format", document_scalar::from(std::int32_t(document_storage::storage_format_version)));
+        store_meta_data();
+    }
+}
 
+database::~database()
+{
+    // the side logs are useless without the builds
+    for(const index_build_ptr& build : _index_builds)
+    {
+        build->cancelled = true;
+    }
+    for(const index_build_ptr& build : _index_builds)
+    {
+        if (build->thread) build->thread->join();
+        if (build->side_log)
+        {
+            bfs::remove(build->side_log_path);
+            drop_build_output(*build);
+        }
     }
 }
 
@@ -100,13 +178,375 @@ bool database::post(const std::string& command,
     return true;
 }
 
+void database::begin_write()
+{
+    assert(!_batch);
+    _batch = _storage->create_write_batch();
+    _data_storage.attach_batch(*_batch);
+    _index_storage.attach_batch(*_batch);
+}
+
+void database::commit_write(const std::function<void (const error_message&)>& done)
+{
+    assert(_batch);
+
+    // index nodes modified by the command go into the same batch
+    for(const auto& index : _indexes)
+    {
+        index.second->flush();
+    }
+
+    _data_storage.detach_batch();
+    _index_storage.detach_batch();
+
+    interfaces::write_batch_ptr batch = std::move(_batch);
+    if (!_processor.commit(_storage, *batch, done))
+    {
+        // the flushed nodes are marked clean, but were never stored
+        discard_cached_changes();
+        _pending_side_log.clear();
+        return;
+    }
+
+    // the command is recorded for the builds only once it's applied
+    for(const index_build_ptr& build : _index_builds)
+    {
+        if (build->side_log)
+        {
+            for(const std::string& record : _pending_side_log)
+            {
+                build->side_log->append(range(record));
+            }
+            build->side_log_records += _pending_side_log.size();
+        }
+    }
+    _pending_side_log.clear();
+}
+
+void database::abort_write()
+{
+    _pending_side_log.clear();
+    if (_batch)
+    {
+        _data_storage.detach_batch();
+        _index_storage.detach_batch();
+        _batch.reset();
+        discard_cached_changes();
+    }
+}
+
+void database::discard_cached_changes()
+{
+    // the cache may hold documents read back from the discarded batch
+    _cache.clear();
+    for(const auto& index : _indexes)
+    {
+        index.second->discard();
+    }
+}
+
 void database::dump()
 {
     _storage->for_each(
         [&](const range& key, const range& value)
         {
-            std::cout << key.to_string() << " => " << value.to_string() << std::endl;
+            // keys are namespace prefix followed by encoded document
+            const char* encoded = std::find_if(key.begin(), key.end(), [](char c) { return std::uint8_t(c) < 0x20; });
+            std::cout << std::string(key.begin(), encoded);
+            if (encoded != key.end())
+            {
+                std::cout << key_encoding::decode(range(encoded, key.end() - encoded));
+            }
+            std::cout << " => " << document_storage::decode_value(value) << std::endl;
         });
 }
 
+void database::upgrade_storage_format()
+{
+    std::int32_t format = 0; // databases created before the format was recorded
+    if (_meta_data.has_field("storage_format"))
+    {
+        format = _meta_data.get_field("storage_format").as<std::int32_t>();
+    }
+
+    if (format > document_storage::storage_format_version)
+    {
+        throw exception("database storage format ", format, " is newer than supported ", document_storage::storage_format_version);
+    }
+
+    if (format < document_storage::storage_format_version)
+    {
+        logging::info("migrating database from storage format ", format, " to ", document_storage::storage_format_version);
+        _data_storage.migrate();
+        _index_storage.migrate();
+
+        _meta_data.set_field("storage_format", document_scalar::from(std::int32_t(document_storage::storage_format_version)));
+        store_meta_data();
+    }
+}
+
+void database::store_meta_data()
+{
+    if (_batch)
+    {
+        _batch->add(META_DATA_KEY, document_storage::encode_value(_meta_data));
+    }
+    else
+    {
+        _storage->add(META_DATA_KEY, document_storage::encode_value(_meta_data));
+    }
+}
+
+void database::check_new_index_name(const std::string& name) const
+{
+    if (_indexes.find(name) != _indexes.end())
+    {
+        throw exception("index ", name, " already exists");
+    }
+    for(const index_build_ptr& build : _index_builds)
+    {
+        if (build->name == name && build->side_log)
+        {
+            throw exception("index ", name, " is being built");
+        }
+    }
+}
+
+const interfaces::index_type::pointer& database::index_type_of(const document& definition) const
+{
+    std::string type = "btree";
+    if (definition.as_object().has_field("type"))
+    {
+        type = definition.as_object().get_field("type").as_scalar().as<std::string>();
+    }
+
+    auto it = _index_types.find(type);
+    if (it == _index_types.end())
+    {
+        throw exception("unknown index type: ", type);
+    }
+    return it->second;
+}
+
+void database::create_index(const std::string& name, const document& definition)
+{
+    check_new_index_name(name);
+
+    // nodes are written directly, the index is visible once recorded in the meta-data
+    interfaces::index_type::create_result result = index_type_of(definition)->create_index(
+        definition,
+        _index_storage,
+        _data_storage,
+        interfaces::index_type::progress_handler());
+
+    _indexes.insert(std::make_pair(name, std::move(result.new_index)));
+    _meta_data.get_field("indexes").as_object().set_field(name, result.index_description);
+    store_meta_data();
+}
+
+document database::compact_index(const std::string& name)
+{
+    auto it = _indexes.find(name);
+    if (it == _indexes.end())
+    {
+        throw exception("no such index: ", name);
+    }
+
+    // the description doesn't change, the index keeps its storage key
+    document result = it->second->compact();
+    logging::info("index ", name, " compacted: ", result);
+    return result;
+}
+
+void database::start_index_build(const std::string& name, const document& definition)
+{
+    check_new_index_name(name);
+    interfaces::index_type::pointer type = index_type_of(definition);
+    _index_builds.remove_if([&name](const index_build_ptr& build) { return build->name == name; }); // failed attempts
+
+    // Runs on the worker thread, between commands: the snapshot has all the writes committed so far,
+    // the side log gets all the following ones
+    std::shared_ptr<document_storage> data_storage =
+        std::make_shared<document_storage>(_data_storage.at_snapshot(create_snapshot()));
+
+    index_build_ptr build = std::make_shared<index_build>(name, definition);
+    build->side_log_path = (bfs::temp_directory_path() / bfs::unique_path("falcondb-index-build-%%%%-%%%%-%%%%-%%%%.log")).string();
+    build->side_log.reset(new append_log(build->side_log_path));
+
+    interfaces::database_backend_ptr storage = _storage;
+    build->thread.reset(new boost::thread(
+        [this, build, data_storage, storage, type]()
+        {
+            try
+            {
+                // own storage object, so the nodes are written directly and not into the batches of the commands
+                document_storage index_storage(storage, "index");
+                interfaces::index_type::create_result result = type->create_index(
+                    build->definition,
+                    index_storage,
+                    *data_storage,
+                    [&build](std::size_t documents_read, std::size_t entries_written)
+                    {
+                        if (build->cancelled)
+                        {
+                            throw exception("index build cancelled");
+                        }
+                        build->documents_read = documents_read;
+                        build->entries_written = entries_written;
+                    });
+                build->description = result.index_description;
+            }
+            catch(const std::exception& e)
+            {
+                build->error = e.what();
+            }
+
+            if (!build->cancelled)
+            {
+                // the database may be gone by the time the task runs, it cancels the builds first
+                _processor.post_task(
+                    [this, build]()
+                    {
+                        if (!build->cancelled)
+                            finish_index_build(build);
+                    });
+            }
+        }));
+
+    _index_builds.push_back(build);
+    logging::info("index ", name, ": background build started");
+}
+
+void database::finish_index_build(const index_build_ptr& build)
+{
+    build->thread->join();
+    build->side_log.reset();
+    try
+    {
+        if (!build->description)
+        {
+            throw exception(build->error);
+        }
+
+        // no command runs until the index is published, so nothing is missed after the replay
+        interfaces::index::unique_ptr index = index_type_of(build->definition)->load_index(
+            _index_storage, *build->description);
+        begin_write();
+        append_log::replay(
+            build->side_log_path,
+            [&index](const range& record)
+            {
+                const document_object op = document::from_binary(record).as_object();
+                if (op.get_field("op").as<std::string>() == "insert")
+                {
+                    index->insert(op.get_field("key"), op.get_field("doc"));
+                }
+                else
+                {
+                    index->del(op.get_field("key"), op.get_field("doc"));
+                }
+            });
+
+        _indexes.insert(std::make_pair(build->name, std::move(index)));
+        _meta_data.get_field("indexes").as_object().set_field(build->name, *build->description);
+        store_meta_data();
+
+        std::string name = build->name;
+        commit_write(
+            [name](const error_message& error)
+            {
+                if (error)
+                    logging::info("index ", name, ": storing failed: ", error);
+            });
+
+        double elapsed = (boost::posix_time::microsec_clock::universal_time() - build->started).total_milliseconds() / 1000.0;
+        logging::info("index ", build->name, ": built over ", build->documents_read.load(), " documents in ", elapsed,
+            "s, ", build->side_log_records, " writes replayed");
+        _index_builds.remove(build);
+    }
+    catch(const std::exception& e)
+    {
+        abort_write();
+        build->error = e.what();
+        logging::info("index ", build->name, ": background build failed: ", build->error);
+        if (_indexes.find(build->name) == _indexes.end())
+        {
+            drop_build_output(*build);
+        }
+    }
+
+    bfs::remove(build->side_log_path);
+}
+
+void database::drop_build_output(const index_build& build)
+{
+    // a failed creation removes its output itself, a complete one is known by the description
+    if (!build.description)
+    {
+        return;
+    }
+    try
+    {
+        index_type_of(build.definition)->drop_index(_index_storage, *build.description);
+    }
+    catch(const std::exception& e)
+    {
+        logging::info("index ", build.name, ": removing the unused index failed: ", e.what());
+    }
+}
+
+std::vector<database::index_build_status> database::get_index_builds() const
+{
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    std::vector<index_build_status> result;
+    for(const index_build_ptr& build : _index_builds)
+    {
+        bool running = bool(build->side_log);
+        result.push_back(index_build_status{
+            build->name,
+            running ? "building" : "failed",
+            build->documents_read,
+            build->entries_written,
+            build->side_log_records,
+            (now - build->started).total_milliseconds() / 1000.0,
+            running ? std::string() : build->error
+        });
+    }
+    return result;
+}
+
+void database::index_insert(const document& storage_key, const document& doc)
+{
+    for(const auto& index : _indexes)
+    {
+        index.second->insert(storage_key, doc);
+    }
+
+    if (!_index_builds.empty())
+    {
+        document_object op;
+        op.set_field("op", document_scalar::from(std::string("insert")));
+        op.set_field("key", storage_key);
+        op.set_field("doc", doc);
+        _pending_side_log.push_back(document(op).to_binary());
+    }
+}
+
+void database::index_remove(const document& storage_key, const document_view& doc)
+{
+    for(const auto& index : _indexes)
+    {
+        index.second->del(storage_key, doc);
+    }
+
+    if (!_index_builds.empty())
+    {
+        document_object op;
+        op.set_field("op", document_scalar::from(std::string("remove")));
+        op.set_field("key", storage_key);
+        op.set_field("doc", doc.to_document());
+        _pending_side_log.push_back(document(op).to_binary());
+    }
+}
+
 } }
@@ -25,6 +25,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "interfaces/index.hpp"
 
 #include "dbengine/document_storage.hpp"
+#include "dbengine/document_cache.hpp"
+#include "dbengine/cached_document_storage.hpp"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace falcondb { namespace dbengine {
 
@@ -34,6 +41,7 @@ class database : public interfaces::database
 {
 public:
     database(const interfaces::database_backend_ptr& storage, command_processor& processor);
+    ~database();
 
     virtual bool post(
         const std::string& command,
@@ -45,11 +53,86 @@ public:
     // interface for own commands
     typedef std::map<std::string, interfaces::index::unique_ptr> index_map;
     index_map& get_indexes() { return _indexes; }
-    document_storage& get_data_storage() { return _data_storage; }
+    /// Documents by storage key. Point reads are served from the cache
+    cached_document_storage& get_data_storage() { return _cached_data_storage; }
+    const document_cache& get_cache() const { return _cache; }
+
+    /// Point-in-time state of the whole database, see document_storage::at_snapshot
+    interfaces::snapshot_ptr create_snapshot() { return _storage->create_snapshot(); }
+
+    // writes
+
+    /// Starts collecting writes to data and index storage in a single batch
+    void begin_write();
+
+    /// Applies collected writes atomically. 'done' is called once they are durable;
+    /// durable writes of concurrent commands are merged by the command processor
+    void commit_write(const std::function<void (const error_message&)>& done);
+
+    /// Discards collected writes, if any
+    void abort_write();
+
+    // indexes
+
+    /// Creates index covering all existing documents, and records it in the meta-data
+    void create_index(const std::string& name, const document& definition);
+
+    /// Rebuilds the index densely. Runs between commands, so no writes are batched.
+    /// Returns summary of the index implementation
+    document compact_index(const std::string& name);
+
+    /// Starts building the index in the background, from a snapshot of the data.
+    /// Writes committed meanwhile are recorded in a side log, replayed on the worker thread
+    /// once the build is done. Only then the index appears in get_indexes() and the meta-data
+    void start_index_build(const std::string& name, const document& definition);
+
+    struct index_build_status
+    {
+        std::string name;
+        std::string state; // "building" or "failed"
+        std::size_t documents_read;
+        std::size_t entries_written;
+        std::size_t side_log_records;
+        double elapsed; // seconds
+        std::string error;
+    };
+
+    /// Builds in progress, and the failed ones
+    std::vector<index_build_status> get_index_builds() const;
+
+    /// Adds document to all indexes, including the ones being built
+    void index_insert(const document& storage_key, const document& doc);
+
+    /// Removes document from all indexes, including the ones being built
+    void index_remove(const document& storage_key, const document_view& doc);
 
 
 private:
 
+    /// Converts data stored by older versions to the current storage format
+    void upgrade_storage_format();
+
+    /// Writes meta-data to the attached batch, or directly to the storage
+    void store_meta_data();
+
+    /// Drops cached documents and index nodes, after their batch was discarded or failed
+    void discard_cached_changes();
+
+    /// Type named in the definition, 'btree' if not given. Throws if there is no such type
+    const interfaces::index_type::pointer& index_type_of(const document& definition) const;
+
+    /// throws if index 'name' exists or is being built
+    void check_new_index_name(const std::string& name) const;
+
+    struct index_build;
+    typedef std::shared_ptr<index_build> index_build_ptr;
+
+    /// Replays the side log and publishes the index. Called on the worker thread
+    void finish_index_build(const index_build_ptr& build);
+
+    /// Removes the index written by a build which is not going to be published
+    void drop_build_output(const index_build& build);
+
     interfaces::database_backend_ptr _storage;
     command_processor& _processor;
     document_object _meta_data;
@@ -59,7 +142,18 @@ private:
 
     document_storage _data_storage;
 
-    interfaces::index_type::pointer _default_index_type;
+    // decoded documents of the data namespace. Indexes keep their decoded nodes themselves, see document_cache
+    document_cache _cache;
+    cached_document_storage _cached_data_storage;
+
+    // index types by name, chosen by the 'type' field of the definition
+    std::map<std::string, interfaces::index_type::pointer> _index_types;
+
+    interfaces::write_batch_ptr _batch;
+
+    // background index builds
+    std::list<index_build_ptr> _index_builds;
+    std::vector<std::string> _pending_side_log; // side log records of the current write, appended on commit
 
 };
 
@@ -0,0 +1,168 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dbengine/document_cache.hpp"
+
+#include <algorithm>
+
+namespace falcondb { namespace dbengine {
+
+// parameters recommended by the 2Q paper
+static const std::size_t RECENT_PERCENT = 25;
+static const std::size_t MIN_GHOSTS = 256;
+
+document_cache::document_cache(std::size_t capacity)
+:
+    _capacity(capacity),
+    _recent_capacity(capacity * RECENT_PERCENT / 100),
+    _recent_size(0),
+    _frequent_size(0)
+{
+}
+
+boost::optional<document> document_cache::get(const std::string& key)
+{
+    auto it = _entries.find(key);
+    if (it == _entries.end())
+    {
+        ++_stats.misses;
+        return boost::none;
+    }
+
+    ++_stats.hits;
+    location& loc = it->second;
+    if (loc.q == &_frequent)
+    {
+        _frequent.splice(_frequent.begin(), _frequent, loc.it);
+    }
+    // entries in the FIFO keep their position, a burst of accesses is not a sign of popularity
+    return loc.it->doc;
+}
+
+void document_cache::put(const std::string& key, const document& doc, std::size_t size)
+{
+    if (size > _capacity)
+    {
+        return;
+    }
+
+    auto existing = _entries.find(key);
+    if (existing != _entries.end())
+    {
+        remove(existing);
+    }
+
+    auto ghost = _ghost_index.find(key);
+    queue* q;
+    if (ghost != _ghost_index.end())
+    {
+        // seen again after leaving the FIFO - this one is hot
+        _ghosts.erase(ghost->second);
+        _ghost_index.erase(ghost);
+        q = &_frequent;
+        _frequent_size += size;
+    }
+    else
+    {
+        q = &_recent;
+        _recent_size += size;
+    }
+
+    q->push_front(entry{key, doc, size});
+    _entries.insert(std::make_pair(key, location{q, q->begin()}));
+
+    while (_recent_size + _frequent_size > _capacity)
+    {
+        evict();
+    }
+}
+
+void document_cache::invalidate(const std::string& key)
+{
+    auto it = _entries.find(key);
+    if (it != _entries.end())
+    {
+        remove(it);
+    }
+}
+
+void document_cache::clear()
+{
+    _recent.clear();
+    _frequent.clear();
+    _recent_size = 0;
+    _frequent_size = 0;
+    _entries.clear();
+    _ghosts.clear();
+    _ghost_index.clear();
+}
+
+document_cache::stats document_cache::get_stats() const
+{
+    stats s = _stats;
+    s.size = _recent_size + _frequent_size;
+    s.entries = _entries.size();
+    return s;
+}
+
+void document_cache::remove(const std::unordered_map<std::string, location>::iterator& it)
+{
+    location& loc = it->second;
+    if (loc.q == &_recent)
+    {
+        _recent_size -= loc.it->size;
+    }
+    else
+    {
+        _frequent_size -= loc.it->size;
+    }
+    loc.q->erase(loc.it);
+    _entries.erase(it);
+}
+
+void document_cache::evict()
+{
+    ++_stats.evictions;
+    if (!_recent.empty() && (_recent_size > _recent_capacity || _frequent.empty()))
+    {
+        std::string key = _recent.back().key;
+        remove(_entries.find(key));
+        remember(key);
+    }
+    else
+    {
+        remove(_entries.find(_frequent.back().key));
+    }
+}
+
+void document_cache::remember(const std::string& key)
+{
+    _ghosts.push_front(key);
+    _ghost_index.insert(std::make_pair(key, _ghosts.begin()));
+
+    // remember about as many keys as there are entries
+    std::size_t limit = std::max(MIN_GHOSTS, _entries.size());
+    while (_ghosts.size() > limit)
+    {
+        _ghost_index.erase(_ghosts.back());
+        _ghosts.pop_back();
+    }
+}
+
+} }
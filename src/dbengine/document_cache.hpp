@@ -0,0 +1,114 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_DBENGINE_DOCUMENT_CACHE_HPP
+#define FALCONDB_DBENGINE_DOCUMENT_CACHE_HPP
+
+#include "document/document.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+namespace falcondb { namespace dbengine {
+
+/// Memory-bounded cache of decoded documents, keyed by raw storage key (namespace + encoded key).
+///
+/// Admission follows 2Q: new entries enter a small FIFO and are evicted from it first,
+/// remembering only their keys. An entry is promoted to the main LRU queue when its key
+/// is requested again while remembered, so a single long scan can't flush the hot entries.
+/// Entry size is the size of the encoded document.
+///
+/// The database puts it in front of the data namespace, serving the point reads of find.
+/// Index nodes, the B-tree root and interior nodes included, are not cached here: each index
+/// keeps its decoded nodes in its own node_cache, with the upper levels resident, so caching
+/// the index namespace as well would hold every node twice.
+///
+/// Not thread-safe, used from the command-processing thread
+class document_cache
+{
+public:
+
+    struct stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::size_t size = 0; // bytes
+        std::size_t entries = 0;
+    };
+
+    explicit document_cache(std::size_t capacity);
+
+    boost::optional<document> get(const std::string& key);
+
+    /// Stores document read from the storage after a miss
+    void put(const std::string& key, const document& doc, std::size_t size);
+
+    /// Removes the entry, if present
+    void invalidate(const std::string& key);
+
+    /// Removes all entries, keeps the stats
+    void clear();
+
+    stats get_stats() const;
+    std::size_t capacity() const { return _capacity; }
+
+private:
+
+    struct entry
+    {
+        std::string key;
+        document doc;
+        std::size_t size;
+    };
+    typedef std::list<entry> queue;
+
+    struct location
+    {
+        queue* q;
+        queue::iterator it;
+    };
+
+    void remove(const std::unordered_map<std::string, location>::iterator& it);
+    void evict();
+    void remember(const std::string& key);
+
+    const std::size_t _capacity;
+    const std::size_t _recent_capacity; // limit of the FIFO
+
+    queue _recent; // A1in: entries seen once, FIFO
+    queue _frequent; // Am: entries seen again, LRU
+    std::size_t _recent_size;
+    std::size_t _frequent_size;
+    std::unordered_map<std::string, location> _entries;
+
+    // A1out: keys recently evicted from the FIFO
+    std::list<std::string> _ghosts;
+    std::unordered_map<std::string, std::list<std::string>::iterator> _ghost_index;
+
+    stats _stats;
+};
+
+} }
+
+#endif
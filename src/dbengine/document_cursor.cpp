@@ -0,0 +1,111 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dbengine/document_cursor.hpp"
+#include "dbengine/document_storage.hpp"
+
+#include "document/key_encoding.hpp"
+
+#include <cassert>
+
+namespace falcondb { namespace dbengine {
+
+document_cursor::document_cursor(interfaces::cursor_ptr&& raw, const std::string& ns)
+:
+    _raw(std::move(raw)),
+    _ns(ns),
+    _ns_end(ns)
+{
+    assert(!_ns.empty());
+    ++_ns_end.back();
+}
+
+document_cursor::document_cursor(document_cursor&& other)
+:
+    _raw(std::move(other._raw)),
+    _ns(std::move(other._ns)),
+    _ns_end(std::move(other._ns_end))
+{
+}
+
+void document_cursor::seek(const document& key)
+{
+    std::string key_data = _ns;
+    key_encoding::encode(key_data, key);
+    _raw->seek(key_data);
+}
+
+void document_cursor::seek_to_first()
+{
+    _raw->seek(_ns);
+}
+
+void document_cursor::seek_to_last()
+{
+    // last entry before the end of the namespace
+    _raw->seek(_ns_end);
+    if (_raw->valid())
+    {
+        _raw->prev();
+    }
+    else
+    {
+        _raw->seek_to_last();
+    }
+}
+
+bool document_cursor::valid() const
+{
+    return _raw->valid()
+        && !interfaces::database_backend::less(_raw->key(), _ns)
+        && interfaces::database_backend::less(_raw->key(), _ns_end);
+}
+
+void document_cursor::next()
+{
+    assert(valid());
+    _raw->next();
+}
+
+void document_cursor::prev()
+{
+    assert(valid());
+    _raw->prev();
+}
+
+document document_cursor::key() const
+{
+    assert(valid());
+    range key_data = _raw->key();
+    return key_encoding::decode(range(key_data.begin() + _ns.size(), key_data.size() - _ns.size()));
+}
+
+document document_cursor::value() const
+{
+    assert(valid());
+    return document_storage::decode_value(_raw->value());
+}
+
+void document_cursor::view_value(const interfaces::document_storage::view_handler& fun) const
+{
+    assert(valid());
+    document_storage::view_value(_raw->value(), fun);
+}
+
+} }
@@ -0,0 +1,63 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_DBENGINE_DOCUMENT_CURSOR_HPP
+#define FALCONDB_DBENGINE_DOCUMENT_CURSOR_HPP
+
+#include "interfaces/document_storage.hpp"
+#include "interfaces/storage_backend.hpp"
+
+namespace falcondb { namespace dbengine {
+
+/// Ordered cursor over documents in one namespace of document_storage.
+/// Reads from the backend only: writes pending in an attached batch are not visible
+class document_cursor
+{
+public:
+
+    document_cursor(interfaces::cursor_ptr&& raw, const std::string& ns);
+    document_cursor(document_cursor&& other);
+
+    /// Positions at the first document with key >= 'key'
+    void seek(const document& key);
+    void seek_to_first();
+    void seek_to_last();
+
+    /// false if moved past either end of the namespace
+    bool valid() const;
+
+    void next();
+    void prev();
+
+    document key() const;
+    document value() const;
+
+    /// Calls 'fun' with lazy view of the value, see document_storage::view_value
+    void view_value(const interfaces::document_storage::view_handler& fun) const;
+
+private:
+
+    interfaces::cursor_ptr _raw;
+    std::string _ns;
+    std::string _ns_end;
+};
+
+} }
+
+#endif
@@ -19,58 +19,259 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "dbengine/document_storage.hpp"
 
+#include "document/binary_parser.hpp"
+#include "document/key_encoding.hpp"
+
+#include "utils/log.hpp"
+
 namespace falcondb { namespace dbengine {
 
 document_storage::document_storage(const interfaces::database_backend_ptr& raw_storage, const std::string& ns)
-    : _raw_storage(raw_storage), _ns(ns)
+    : _raw_storage(raw_storage), _ns(ns), _batch(nullptr)
 {
 }
 
+document_storage::document_storage(const document_storage& other, const interfaces::snapshot_ptr& snapshot)
+    : _raw_storage(other._raw_storage), _ns(other._ns), _batch(nullptr), _snapshot(snapshot)
+{
+    assert(snapshot);
+}
+
 void document_storage::write(const falcondb::document& key, const falcondb::document& doc)
 {
-    std::string key_data = _ns + key.to_json();
-    std::string doc_data = doc.to_json();
+    check_writable();
+    std::string key_data = encode_key(key);
+    std::string doc_data = encode_value(doc);
 
-    _raw_storage->add(key_data, doc_data);
+    if (_batch)
+    {
+        _batch->add(key_data, doc_data);
+        _pending[key_data] = std::move(doc_data);
+    }
+    else
+    {
+        _raw_storage->add(key_data, doc_data);
+    }
 }
 
 document document_storage::read(const document& key)
 {
-    std::string key_data = _ns + key.to_json();
+    return decode_value(read_raw(key));
+}
+
+std::string document_storage::read_raw(const document& key)
+{
+    std::string key_data = encode_key(key);
     try
     {
-        std::string doc_data = _raw_storage->get(key_data);
-        return document::from_json(doc_data);
+        return get_raw(key_data);
     }
     catch(const std::exception& e)
     {
         // add more useful info to the exception
-        throw exception("Error reading key ", key_data, " from storage: ", e.what());
+        throw exception("Error reading key ", key, " from storage: ", e.what());
     }
 }
 
 void document_storage::remove(const document& key)
 {
-    std::string key_data = _ns + key.to_json();
-    _raw_storage->del(key_data);
+    check_writable();
+    std::string key_data = encode_key(key);
+    if (_batch)
+    {
+        _batch->del(key_data);
+        _pending[key_data] = boost::none;
+    }
+    else
+    {
+        _raw_storage->del(key_data);
+    }
 }
 
 void document_storage::for_each(const key_value_handler& fun)
 {
-    // create the end of the range by incremeting the last byte of namespace
-    assert(!_ns.empty());
-    std::string end = _ns;
-    ++end.back();
+    for_each_encoded(_ns, ns_end(), fun);
+}
+
+void document_storage::for_each(const document& begin, const document& end, const key_value_handler& fun)
+{
+    for_each_encoded(encode_key(begin), encode_key(end), fun);
+}
+
+void document_storage::for_each_encoded(const std::string& begin, const std::string& end, const key_value_handler& fun)
+{
+    for_each_raw(
+        begin, end,
+        [&](const range& key, const range& val)
+        {
+            fun(decode_key(key), decode_value(val));
+        });
+}
+
+void document_storage::read_view(const document& key, const view_handler& fun)
+{
+    view_value(read_raw(key), fun);
+}
+
+void document_storage::for_each_view(const key_view_handler& fun)
+{
+    for_each_raw(
+        _ns, ns_end(),
+        [&](const range& key, const range& val)
+        {
+            document decoded_key = decode_key(key);
+            view_value(val, [&](const document_view& view) { fun(decoded_key, view); });
+        });
+}
 
+document_cursor document_storage::create_cursor()
+{
+    return document_cursor(create_raw_cursor(), _ns);
+}
+
+document_storage document_storage::at_snapshot(const interfaces::snapshot_ptr& snapshot) const
+{
+    return document_storage(*this, snapshot);
+}
+
+void document_storage::for_each_raw(
+    const std::string& begin,
+    const std::string& end,
+    const interfaces::database_backend::key_value_handler& fun)
+{
+    interfaces::cursor_ptr c = create_raw_cursor();
+    for(c->seek(begin); c->valid() && interfaces::database_backend::less(c->key(), end); c->next())
+    {
+        fun(c->key(), c->value());
+    }
+}
+
+interfaces::cursor_ptr document_storage::create_raw_cursor()
+{
+    if (_snapshot)
+    {
+        return _raw_storage->create_cursor(*_snapshot);
+    }
+    return _raw_storage->create_cursor();
+}
+
+void document_storage::check_writable() const
+{
+    if (_snapshot)
+    {
+        throw exception("namespace '", _ns, "': storage is a read-only snapshot");
+    }
+}
+
+void document_storage::attach_batch(interfaces::write_batch& batch)
+{
+    check_writable();
+    assert(!_batch);
+    _batch = &batch;
+}
+
+void document_storage::detach_batch()
+{
+    _batch = nullptr;
+    _pending.clear();
+}
+
+std::string document_storage::get_raw(const std::string& key_data)
+{
+    auto it = _pending.find(key_data);
+    if (it == _pending.end())
+    {
+        return _snapshot ? _raw_storage->get(key_data, *_snapshot) : _raw_storage->get(key_data);
+    }
+    if (!it->second)
+    {
+        throw exception("key removed in pending batch");
+    }
+    return *it->second;
+}
+
+std::size_t document_storage::migrate()
+{
+    std::string end = ns_end();
+
+    // the backend iterates over a consistent view, so records can be rewritten in place.
+    // Encoded keys and legacy keys never collide: the first byte tells them apart
+    std::size_t converted = 0;
     _raw_storage->for_each(
         _ns, end,
         [&](const range& key, const range& val)
         {
-            std::string key_as_string = std::string(key.begin() + _ns.length(), key.size() - _ns.length());
-            std::string value_as_string = val.to_string();
-
-            fun(document::from_json(key_as_string), document::from_json(value_as_string));
+            range key_data(key.begin() + _ns.size(), key.size() - _ns.size());
+            if (!key_encoding::is_encoded(key_data))
+            {
+                document legacy_key = document::from_json(key_data.to_string());
+                _raw_storage->add(encode_key(legacy_key), encode_value(decode_value(val)));
+                _raw_storage->del(key);
+                ++converted;
+            }
+            else if (!binary_parser::is_binary(val))
+            {
+                _raw_storage->add(key, encode_value(decode_value(val)));
+                ++converted;
+            }
         });
+
+    logging::info("namespace '", _ns, "': ", converted, " records migrated to storage format ", storage_format_version);
+    return converted;
+}
+
+std::string document_storage::ns_end() const
+{
+    // create the end of the range by incremeting the last byte of namespace
+    assert(!_ns.empty());
+    std::string end = _ns;
+    ++end.back();
+    return end;
+}
+
+std::string document_storage::encode_key(const document& key) const
+{
+    std::string result = _ns;
+    key_encoding::encode(result, key);
+    return result;
+}
+
+document document_storage::decode_key(const range& data) const
+{
+    assert(data.size() >= _ns.size());
+    return key_encoding::decode(range(data.begin() + _ns.size(), data.size() - _ns.size()));
+}
+
+std::string document_storage::encode_value(const document& doc)
+{
+    return doc.to_binary();
+}
+
+document document_storage::decode_value(const range& data)
+{
+    if (binary_parser::is_binary(data))
+    {
+        return document::from_binary(data);
+    }
+    else
+    {
+        // legacy format
+        return document::from_json(data.to_string());
+    }
+}
+
+void document_storage::view_value(const range& data, const view_handler& fun)
+{
+    if (binary_parser::is_binary(data))
+    {
+        fun(document_view::from_binary(data));
+    }
+    else
+    {
+        // legacy format
+        std::string converted = encode_value(decode_value(data));
+        fun(document_view::from_binary(converted));
+    }
 }
 
 
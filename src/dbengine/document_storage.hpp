@@ -23,13 +23,25 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "interfaces/document_storage.hpp"
 #include "interfaces/storage_backend.hpp"
 
+#include "dbengine/document_cursor.hpp"
+
+#include <boost/optional.hpp>
+
+#include <map>
+
 namespace falcondb { namespace dbengine {
 
 /// Simple implementation of serializing storage.
-/// Adds namespace prefix to each key after serialization
+/// Adds namespace prefix to each key after serialization.
+/// Keys are stored in order-preserving key_encoding, so backend order is the document order.
+/// Values are stored in binary format, values written as JSON by older versions are still readable.
 class document_storage : public interfaces::document_storage
 {
 public:
+
+    /// Version of the on-disk format written by this class. Stored in database meta-data
+    static const int storage_format_version = 2;
+
     document_storage(const interfaces::database_backend_ptr& raw_storage, const std::string& ns);
 
     // document_storage
@@ -38,11 +50,76 @@ public:
     virtual document read(const document& key);
     virtual void remove(const document& key);
     virtual void for_each(const key_value_handler& fun);
+    virtual void for_each(const document& begin, const document& end, const key_value_handler& fun);
+    virtual void read_view(const document& key, const view_handler& fun);
+    virtual void for_each_view(const key_view_handler& fun);
+
+    /// Creates ordered cursor over this namespace
+    document_cursor create_cursor();
+
+    // snapshots
+
+    /// Read-only storage over the same namespace, reading the data as of the snapshot.
+    /// Writes throw. The snapshot is held for the lifetime of the returned storage
+    document_storage at_snapshot(const interfaces::snapshot_ptr& snapshot) const;
+
+    // batches
+
+    /// Redirects all writes and removals to the batch, until detached.
+    /// Reads by key see the pending writes; iteration sees only data already in the backend
+    void attach_batch(interfaces::write_batch& batch);
+    void detach_batch();
+
+    // other
+
+    /// Storage key: namespace followed by encoded key
+    std::string encode_key(const document& key) const;
+
+    /// Reads encoded value, as stored
+    std::string read_raw(const document& key);
+
+    /// Rewrites all records stored in older formats. Returns number of records converted
+    std::size_t migrate();
+
+    /// Serializes value in current storage format
+    static std::string encode_value(const document& doc);
+
+    /// Deserializes value stored in any supported format
+    static document decode_value(const range& data);
+
+    /// Calls 'fun' with view of value stored in any supported format.
+    /// Binary values are viewed in place, legacy values are converted first
+    static void view_value(const range& data, const view_handler& fun);
 
 private:
 
+    document decode_key(const range& data) const;
+
+    document_storage(const document_storage& other, const interfaces::snapshot_ptr& snapshot);
+
+    void for_each_encoded(const std::string& begin, const std::string& end, const key_value_handler& fun);
+
+    /// iterates over raw keys in [begin, end), at the snapshot if set
+    void for_each_raw(const std::string& begin, const std::string& end, const interfaces::database_backend::key_value_handler& fun);
+
+    interfaces::cursor_ptr create_raw_cursor();
+
+    /// throws if bound to a snapshot
+    void check_writable() const;
+
+    /// end of the key range of this namespace
+    std::string ns_end() const;
+
+    /// Reads from the attached batch, or the backend (at the snapshot, if set) if the key is not pending
+    std::string get_raw(const std::string& key_data);
+
     interfaces::database_backend_ptr _raw_storage;
     const std::string _ns;
+
+    interfaces::write_batch* _batch;
+    std::map<std::string, boost::optional<std::string>> _pending; // writes in the attached batch
+
+    interfaces::snapshot_ptr _snapshot;
 };
 
 
@@ -24,26 +24,129 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "utils/exception.hpp"
 #include "utils/filesystem.hpp"
 
+#include <boost/asio/io_service.hpp>
+#include <boost/thread.hpp>
+
 #include <algorithm>
+#include <fstream>
 #include <memory>
 
 namespace falcondb { namespace dbengine {
 
+// file in database directory, containing name of the backend. Absent for the default backend
+static const char* BACKEND_FILE = "falcondb_backend";
+static const char* DEFAULT_BACKEND = "default";
+
 engine::engine(const engine_config& config, interfaces::storage_backend& backend)
 :
-    _config(config),
-    _storage_backend(backend)
+    _config(config)
 {
+    _backends.insert(std::make_pair(DEFAULT_BACKEND, &backend));
+
     _processor.register_command("insert", commands::insert);
     _processor.register_command("list", commands::list);
+    _processor.register_command("find", commands::find);
     _processor.register_command("remove", commands::remove);
     _processor.register_command("listindexes", commands::listindexes);
+    _processor.register_command("createindex", commands::createindex);
+    _processor.register_command("indexbuilds", commands::indexbuilds);
+    _processor.register_command("compactindex", commands::compactindex);
+    _processor.register_command("cachestats", commands::cachestats);
+    _processor.register_command("indexstats", commands::indexstats);
 }
 
 engine::~engine()
 {
 }
 
+void engine::add_backend(const std::string& name, interfaces::storage_backend& backend)
+{
+    if (!_backends.insert(std::make_pair(name, &backend)).second)
+    {
+        throw exception("backend ", name, " already registered");
+    }
+}
+
+interfaces::storage_backend& engine::get_backend(const std::string& name)
+{
+    auto it = _backends.find(name);
+    if (it == _backends.end())
+    {
+        throw exception("no such backend: ", name);
+    }
+    return *it->second;
+}
+
+std::string engine::read_backend_name(const bfs::path& db_path)
+{
+    bfs::path backend_file = db_path / BACKEND_FILE;
+    if (!bfs::exists(backend_file))
+    {
+        return DEFAULT_BACKEND;
+    }
+
+    std::ifstream in(backend_file.string().c_str());
+    std::string name;
+    in >> name;
+    return name;
+}
+
+interfaces::database_ptr engine::open_database(const std::string& db_name)
+{
+    bfs::path db_path = bfs::path(_config.data_dir) / db_name;
+    interfaces::storage_backend& backend = get_backend(read_backend_name(db_path));
+    interfaces::database_backend_ptr storage = backend.open_database(db_path.string());
+    return std::make_shared<database>(storage, std::ref(_processor));
+}
+
+void engine::open_all()
+{
+    unsigned threads = _config.open_threads;
+    if (threads == 0)
+    {
+        threads = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    boost::asio::io_service io_service;
+    boost::mutex output_mutex;
+    std::vector<std::string> failed;
+
+    for(const database_map::value_type& entry : _databases)
+    {
+        std::string name = entry.first;
+        database_slot_ptr slot = entry.second;
+        io_service.post([=, &output_mutex, &failed]()
+        {
+            try
+            {
+                slot->db = open_database(name);
+
+                boost::mutex::scoped_lock lock(output_mutex);
+                std::cout << "opening " << name << " ... OK" << std::endl;
+            }
+            catch(const std::exception& e)
+            {
+                boost::mutex::scoped_lock lock(output_mutex);
+                std::cout << "opening " << name << " ... Failed: " << e.what() << std::endl;
+                failed.push_back(name);
+            }
+        });
+    }
+
+    // the threads exit once all databases are processed
+    boost::thread_group pool;
+    for(unsigned i = 0; i < std::min<std::size_t>(threads, _databases.size()); ++i)
+    {
+        pool.create_thread([&io_service] { io_service.run(); });
+    }
+    pool.join_all();
+
+    for(const std::string& name : failed)
+    {
+        _databases.erase(name);
+    }
+}
+
 void engine::run()
 {
     std::cout << "initializing databases from " << _config.data_dir << std::endl;
@@ -52,32 +155,27 @@ void engine::run()
 
     if (bfs::exists(data_dir_path))
     {
+        rwmutex::scoped_write_lock lock(_databases_mutex);
+
         bfs::directory_iterator it(data_dir_path);
         for( ;it != bfs::directory_iterator(); ++it)
         {
             if (it->status().type() == bfs::directory_file)
             {
-                std::cout << "trying " << it->path() << " ... ";
-                try
-                {
-                    rwmutex::scoped_write_lock lock(_databases_mutex);
-                    interfaces::database_backend_ptr storage = _storage_backend.open_database(it->path().string());
-                    interfaces::database_ptr db = std::make_shared<database>(storage, std::ref(_processor));
-
-                    std::string name = it->path().filename().generic_string();
-                    _databases.insert(std::make_pair(name, db));
-
-                    std::cout << "OK";
-
-                }
-                catch(const std::exception& e)
-                {
-                    std::cout << "Failed: " << e.what();
-                }
-                std::cout << std::endl;
+                std::string name = it->path().filename().generic_string();
+                _databases.insert(std::make_pair(name, std::make_shared<database_slot>()));
             }
         }
-        std::cout << _databases.size() << " databases loaded" << std::endl;
+
+        if (_config.lazy_open)
+        {
+            std::cout << _databases.size() << " databases found, will be opened on first use" << std::endl;
+        }
+        else
+        {
+            open_all();
+            std::cout << _databases.size() << " databases loaded" << std::endl;
+        }
     }
     else
     {
@@ -89,6 +187,8 @@ void engine::run()
 
 std::vector<std::string> engine::get_databases()
 {
+    rwmutex::scoped_read_lock lock(_databases_mutex);
+
     std::vector<std::string> result;
     std::transform(_databases.begin(), _databases.end(),
         std::back_inserter(result), [](const database_map::value_type& p) { return p.first; });
@@ -98,21 +198,45 @@ std::vector<std::string> engine::get_databases()
 
 interfaces::database_ptr engine::get_database(const std::string& db_name)
 {
-    rwmutex::scoped_read_lock lock(_databases_mutex);
-
-    auto it = _databases.find(db_name);
-    if (it == _databases.end())
+    database_slot_ptr slot;
     {
-        throw exception("no such database: ", db_name);
+        rwmutex::scoped_read_lock lock(_databases_mutex);
+
+        auto it = _databases.find(db_name);
+        if (it == _databases.end())
+        {
+            throw exception("no such database: ", db_name);
+        }
+        slot = it->second;
     }
-    else
+
+    // opening a lazy database blocks only users of this database
+    boost::mutex::scoped_lock lock(slot->mutex);
+    if (!slot->db)
     {
-        return it->second;
+        try
+        {
+            slot->db = open_database(db_name);
+        }
+        catch(const std::exception& e)
+        {
+            throw exception("error opening database ", db_name, ": ", e.what());
+        }
     }
+    return slot->db;
 }
 
 void engine::create_database(const std::string& db_name)
 {
+    create_database(db_name, DEFAULT_BACKEND);
+}
+
+void engine::create_database(const std::string& db_name, const std::string& backend_name)
+{
+    interfaces::storage_backend& storage_backend = get_backend(backend_name);
+
+    rwmutex::scoped_write_lock lock(_databases_mutex);
+
     // does the db already exists?
     if (_databases.find(db_name) != _databases.end())
     {
@@ -127,19 +251,31 @@ void engine::create_database(const std::string& db_name)
     }
 
     bfs::create_directory(new_db_path);
-    interfaces::database_backend_ptr backend = _storage_backend.create_database(new_db_path.generic_string());
-    interfaces::database_ptr db = std::make_shared<database>(backend, std::ref(_processor));
-    _databases.insert(std::make_pair(db_name, db));
+    interfaces::database_backend_ptr backend = storage_backend.create_database(new_db_path.generic_string());
+    if (backend_name != DEFAULT_BACKEND)
+    {
+        std::ofstream out((new_db_path / BACKEND_FILE).string().c_str());
+        out << backend_name << std::endl;
+    }
+    database_slot_ptr slot = std::make_shared<database_slot>();
+    slot->db = std::make_shared<database>(backend, std::ref(_processor));
+    _databases.insert(std::make_pair(db_name, slot));
 }
 
 void engine::drop_database(const std::string& db_name)
 {
+    rwmutex::scoped_write_lock lock(_databases_mutex);
+
     // does the db exists?
     auto it = _databases.find(db_name);
     if (it == _databases.end())
     {
         throw exception("Dastabase ", db_name, " does not exists");
     }
+
+    // wait for lazy opening in progress
+    database_slot_ptr slot = it->second;
+    boost::mutex::scoped_lock slot_lock(slot->mutex);
     _databases.erase(it);
 
     bfs::path db_path = bfs::path(_config.data_dir) / db_name;
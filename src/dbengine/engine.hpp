@@ -25,23 +25,33 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "dbengine/command_processor.hpp"
 
+#include "utils/filesystem.hpp"
 #include "utils/rwmutex.hpp"
 
+#include <boost/thread/mutex.hpp>
+
 
 namespace falcondb { namespace dbengine {
 
 struct engine_config
 {
     std::string data_dir; // main data directory
+    bool lazy_open; // open databases on first use instead of in run()
+    unsigned open_threads; // threads opening databases in run(), 0 - one per core
 };
 
 class engine : public interfaces::engine
 {
 public:
+    /// 'backend' is the default, used for databases without explicit backend
     engine(const engine_config& config, interfaces::storage_backend& backend);
     virtual ~engine();
 
-    /// Initializes the database, then spawns the engine worker threads and return
+    /// Makes backend available for new databases. Has to be called before run()
+    void add_backend(const std::string& name, interfaces::storage_backend& backend);
+
+    /// Initializes the databases, then spawns the engine worker threads and return.
+    /// Databases are opened in parallel, or only registered if lazy_open is set
     void run();
 
     // API
@@ -49,15 +59,35 @@ public:
     virtual std::vector<std::string> get_databases();
     virtual interfaces::database_ptr get_database(const std::string& db_name);
     virtual void create_database(const std::string& db_name);
+    virtual void create_database(const std::string& db_name, const std::string& backend_name);
     virtual void drop_database(const std::string& db_name);
 
 private:
 
+    /// Name of the backend storing the database in the directory
+    static std::string read_backend_name(const bfs::path& db_path);
+
+    interfaces::storage_backend& get_backend(const std::string& name);
+
+    /// Opens existing database in the data directory
+    interfaces::database_ptr open_database(const std::string& db_name);
+
+    /// Opens all registered databases on a thread pool, unregisters those which fail
+    void open_all();
+
     engine_config _config;
-    interfaces::storage_backend& _storage_backend;
 
-    // databases
-    typedef std::map<std::string, interfaces::database_ptr> database_map;
+    // backends, by name
+    std::map<std::string, interfaces::storage_backend*> _backends;
+
+    // databases. Slots of databases not opened yet hold null, the slot mutex serializes the opening
+    struct database_slot
+    {
+        boost::mutex mutex;
+        interfaces::database_ptr db;
+    };
+    typedef std::shared_ptr<database_slot> database_slot_ptr;
+    typedef std::map<std::string, database_slot_ptr> database_map;
     database_map _databases;
     rwmutex _databases_mutex;
 
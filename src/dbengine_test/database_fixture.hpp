@@ -0,0 +1,128 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_DBENGINE_TEST_DATABASE_FIXTURE_HPP
+#define FALCONDB_DBENGINE_TEST_DATABASE_FIXTURE_HPP
+
+#include "dbengine/command_processor.hpp"
+#include "dbengine/commands.hpp"
+#include "dbengine/database.hpp"
+
+#include "backend_memory/backend.hpp"
+
+#include "utils/filesystem.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <future>
+#include <string>
+#include <vector>
+
+namespace falcondb {
+
+// database on the memory backend, with commands run by the command processor
+class database_fixture
+{
+public:
+
+    database_fixture()
+    :
+        _path(bfs::temp_directory_path() / bfs::unique_path("falcondb-engine-%%%%-%%%%")),
+        _storage(_backend.create_database(_path.string())),
+        _posted(0),
+        _done(0)
+    {
+        _processor.register_command("insert", dbengine::commands::insert);
+        _processor.register_command("remove", dbengine::commands::remove);
+        _processor.register_command("createindex", dbengine::commands::createindex);
+        _processor.register_command("indexbuilds", dbengine::commands::indexbuilds);
+        _processor.register_command("find", dbengine::commands::find);
+        _processor.run();
+        _db.reset(new dbengine::database(_storage, _processor));
+    }
+
+    ~database_fixture()
+    {
+        _db.reset();
+        bfs::remove_all(_path);
+    }
+
+    dbengine::database& db() { return *_db; }
+    dbengine::command_processor& processor() { return _processor; }
+    const interfaces::database_backend_ptr& storage() const { return _storage; }
+
+    /// Posts command, the result is collected by wait()
+    void post(const std::string& command, const document& params)
+    {
+        ++_posted;
+        _db->post(command, params,
+            [this](const error_message& error, const document_list& result)
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                if (error)
+                    _errors.push_back(error.get_message());
+                _result = result;
+                ++_done;
+                _condition.notify_all();
+            });
+    }
+
+    /// Waits for all posted commands, returns the result of the last one
+    document_list wait()
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        while(_done < _posted)
+        {
+            _condition.wait(lock);
+        }
+        BOOST_REQUIRE(_errors.empty());
+        return _result;
+    }
+
+    /// Runs on the worker thread, after everything posted so far
+    void run_task(const std::function<void ()>& task)
+    {
+        std::promise<void> done;
+        _processor.post_task([&]() { task(); done.set_value(); });
+        done.get_future().wait();
+    }
+
+    /// Destroys the database. Called on the worker thread
+    void close_database() { _db.reset(); }
+
+private:
+
+    bfs::path _path;
+    backend_memory::backend _backend;
+    interfaces::database_backend_ptr _storage;
+    dbengine::command_processor _processor;
+    std::unique_ptr<dbengine::database> _db;
+
+    boost::mutex _mutex;
+    boost::condition_variable _condition;
+    std::size_t _posted;
+    std::size_t _done;
+    std::vector<std::string> _errors;
+    document_list _result;
+};
+
+}
+
+#endif
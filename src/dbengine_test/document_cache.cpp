@@ -0,0 +1,130 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dbengine/document_cache.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+namespace falcondb {
+
+using dbengine::document_cache;
+
+BOOST_AUTO_TEST_SUITE(document_cache_test_suite)
+
+static const std::size_t SIZE = 100;
+
+static bool cached(document_cache& cache, const std::string& key)
+{
+    return bool(cache.get(key));
+}
+
+// capacity of four entries, one of them in the FIFO of new entries
+static void fill(document_cache& cache)
+{
+    for(const char* key : { "a", "b", "c", "d", "e" })
+    {
+        cache.put(key, document::from(std::string(key)), SIZE);
+    }
+    // 'a' left the FIFO, requested again it goes to the LRU queue, pushing out the next oldest one
+    for(const char* key : { "a", "b", "c" })
+    {
+        BOOST_CHECK(!cached(cache, key));
+        cache.put(key, document::from(std::string(key)), SIZE);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(admission_and_eviction)
+{
+    document_cache cache(4 * SIZE);
+    fill(cache);
+
+    // the LRU queue holds c, b, a; 'a' is used again, so 'b' is the least recently used
+    BOOST_CHECK(cache.get("a")->as_scalar().as<std::string>() == "a");
+    BOOST_CHECK(!cached(cache, "d"));
+    cache.put("d", document::from(std::string("d")), SIZE);
+    BOOST_CHECK(!cached(cache, "b"));
+    for(const char* key : { "a", "c", "d", "e" })
+    {
+        BOOST_CHECK(cached(cache, key));
+    }
+
+    document_cache::stats stats = cache.get_stats();
+    BOOST_CHECK_EQUAL(stats.evictions, 5u);
+    BOOST_CHECK_EQUAL(stats.entries, 4u);
+    BOOST_CHECK_EQUAL(stats.size, 4 * SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(scan_resistance)
+{
+    document_cache cache(4 * SIZE);
+    fill(cache);
+
+    // entries read once pass through the FIFO only
+    for(int i = 0; i < 20; ++i)
+    {
+        std::string key = "scan" + std::to_string(i);
+        BOOST_CHECK(!cached(cache, key));
+        cache.put(key, document::from(i), SIZE);
+    }
+    for(const char* key : { "a", "b", "c" })
+    {
+        BOOST_CHECK(cached(cache, key));
+    }
+    BOOST_CHECK(!cached(cache, "e"));
+    BOOST_CHECK(cached(cache, "scan19"));
+    BOOST_CHECK_EQUAL(cache.get_stats().size, 4 * SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(invalidation)
+{
+    document_cache cache(4 * SIZE);
+    fill(cache);
+
+    cache.invalidate("a");
+    cache.invalidate("e");
+    cache.invalidate("nothing");
+    BOOST_CHECK(!cached(cache, "a"));
+    BOOST_CHECK(!cached(cache, "e"));
+    BOOST_CHECK(cached(cache, "b"));
+    BOOST_CHECK_EQUAL(cache.get_stats().entries, 2u);
+    BOOST_CHECK_EQUAL(cache.get_stats().size, 2 * SIZE);
+
+    // a new value replaces the cached one
+    cache.put("b", document::from(std::string("new")), SIZE);
+    BOOST_CHECK(cache.get("b")->as_scalar().as<std::string>() == "new");
+    BOOST_CHECK_EQUAL(cache.get_stats().size, 2 * SIZE);
+
+    // too large to be cached
+    cache.put("large", document::from(1), 5 * SIZE);
+    BOOST_CHECK(!cached(cache, "large"));
+
+    // stats are kept
+    std::uint64_t hits = cache.get_stats().hits;
+    cache.clear();
+    BOOST_CHECK(!cached(cache, "b"));
+    BOOST_CHECK_EQUAL(cache.get_stats().entries, 0u);
+    BOOST_CHECK_EQUAL(cache.get_stats().size, 0u);
+    BOOST_CHECK_EQUAL(cache.get_stats().hits, hits);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
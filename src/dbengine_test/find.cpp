@@ -0,0 +1,90 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dbengine_test/database_fixture.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+namespace falcondb {
+
+BOOST_AUTO_TEST_SUITE(find_test_suite)
+
+static document index_params(const std::string& name, const std::vector<std::string>& include)
+{
+    document_object field;
+    field.set_field("name", document::from(std::string("a")));
+    field.set_field("direction", document::from(std::int32_t(1)));
+    document_object definition;
+    definition.set_field("fields", document_list({field}));
+    if (!include.empty())
+        definition.set_field("include", document::from(include));
+
+    document_object params;
+    params.set_field("name", document::from(name));
+    params.set_field("definition", definition);
+    return params;
+}
+
+static document find_params(const std::string& index, const std::vector<std::string>& fields)
+{
+    document_object params;
+    params.set_field("index", document::from(index));
+    params.set_field("fields", document::from(fields));
+    return params;
+}
+
+// projections answered by a covering index are the same as those read from the documents
+BOOST_AUTO_TEST_CASE(covered_projection)
+{
+    database_fixture f;
+    for(int i = 0; i < 200; ++i)
+    {
+        document_object doc;
+        doc.set_field("_id", document::from(i));
+        if (i % 5 != 0)
+            doc.set_field("a", document::from(std::int32_t(i % 7)));
+        if (i % 3 != 0)
+            doc.set_field("b", document::from(std::string("b") + std::to_string(i)));
+        f.post("insert", doc);
+    }
+    f.post("createindex", index_params("plain", {}));
+    f.post("createindex", index_params("covering", {"_id", "a", "b"}));
+    f.wait();
+
+    BOOST_CHECK(f.db().get_indexes().at("covering")->covers({"_id", "a", "b"}));
+    BOOST_CHECK(!f.db().get_indexes().at("plain")->covers({"a"}));
+
+    for(const std::vector<std::string>& fields : { std::vector<std::string>{"_id", "a", "b"}, std::vector<std::string>{"a"}, std::vector<std::string>{"b"} })
+    {
+        f.post("find", find_params("plain", fields));
+        document_list read = f.wait();
+        f.post("find", find_params("covering", fields));
+        document_list covered = f.wait();
+
+        BOOST_REQUIRE_EQUAL(read.size(), 200);
+        // missing fields stay absent, numbers keep their type
+        BOOST_CHECK(document(covered).to_binary() == document(read).to_binary());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
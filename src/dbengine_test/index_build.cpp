@@ -0,0 +1,189 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "dbengine_test/database_fixture.hpp"
+
+#include "utils/exception.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <future>
+#include <string>
+#include <vector>
+
+namespace falcondb {
+
+using dbengine::database;
+
+BOOST_AUTO_TEST_SUITE(index_build_test_suite)
+
+static document make_doc(int id, int a)
+{
+    document_object doc;
+    doc.set_field("_id", document::from(id));
+    doc.set_field("a", document::from(a));
+    return doc;
+}
+
+static document create_params(const std::string& name, bool background)
+{
+    document_object field;
+    field.set_field("name", document::from(std::string("a")));
+    field.set_field("direction", document::from(std::int32_t(1)));
+    document_object definition;
+    definition.set_field("fields", document_list({field}));
+
+    document_object params;
+    params.set_field("name", document::from(name));
+    params.set_field("definition", definition);
+    params.set_field("background", document::from(background));
+    return params;
+}
+
+static document_list scan_all(interfaces::index& index)
+{
+    return index.scan(boost::none, false, boost::none, false, boost::none, boost::none, false);
+}
+
+static std::size_t count_index_storage(const interfaces::database_backend_ptr& storage)
+{
+    std::size_t result = 0;
+    dbengine::document_storage index_storage(storage, "index");
+    index_storage.for_each([&result](const document&, const document&) { ++result; });
+    return result;
+}
+
+// inserts, updates and removals made during the build reach the index through the side log
+BOOST_AUTO_TEST_CASE(writes_during_background_build)
+{
+    database_fixture f;
+    for(int i = 0; i < 5000; ++i)
+    {
+        f.post("insert", make_doc(i, i % 100));
+    }
+    f.wait();
+
+    // the worker is held until the build and the writes are queued, so the writes run before
+    // the build can be finished: it is posted only once the build is started
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    f.processor().post_task([released]() { released.wait(); });
+
+    f.post("createindex", create_params("by_a", true));
+    for(int i = 5000; i < 5500; ++i)
+    {
+        f.post("insert", make_doc(i, i % 100));
+    }
+    for(int i = 0; i < 500; i += 2)
+    {
+        f.post("remove", document::from(i));
+    }
+    for(int i = 1000; i < 1200; ++i)
+    {
+        f.post("insert", make_doc(i, 1000 + i % 7)); // changes the key
+    }
+
+    bool visible_during_build = true;
+    std::vector<database::index_build_status> builds;
+    f.processor().post_task(
+        [&]()
+        {
+            visible_during_build = f.db().get_indexes().count("by_a") > 0;
+            builds = f.db().get_index_builds();
+        });
+    release.set_value();
+    f.wait();
+    f.run_task([]() { });
+
+    BOOST_CHECK(!visible_during_build);
+    BOOST_REQUIRE_EQUAL(builds.size(), 1u);
+    BOOST_CHECK_EQUAL(builds[0].name, "by_a");
+    BOOST_CHECK_EQUAL(builds[0].state, "building");
+    BOOST_CHECK(builds[0].side_log_records >= 950u);
+
+    // published once the side log is replayed
+    bool published = false;
+    for(int i = 0; i < 6000 && !published; ++i)
+    {
+        f.run_task([&]() { published = f.db().get_indexes().count("by_a") > 0; });
+        if (!published)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    BOOST_REQUIRE(published);
+    f.post("indexbuilds", document_list());
+    BOOST_CHECK(f.wait().empty());
+
+    f.post("createindex", create_params("by_a_foreground", false));
+    f.wait();
+
+    document_list background, foreground;
+    f.run_task(
+        [&]()
+        {
+            background = scan_all(*f.db().get_indexes().at("by_a"));
+            foreground = scan_all(*f.db().get_indexes().at("by_a_foreground"));
+        });
+    BOOST_CHECK_EQUAL(background.size(), 5250u);
+    BOOST_REQUIRE_EQUAL(background.size(), foreground.size());
+    for(std::size_t i = 0; i < background.size(); ++i)
+    {
+        BOOST_CHECK(background[i] == foreground[i]);
+    }
+}
+
+// an index built, but not published before the database is closed, is removed
+BOOST_AUTO_TEST_CASE(unpublished_background_build)
+{
+    database_fixture f;
+    for(int i = 0; i < 5000; ++i)
+    {
+        f.post("insert", make_doc(i, i % 100));
+    }
+    f.wait();
+    std::size_t index_entries = count_index_storage(f.storage());
+
+    // the worker waits for the build to write all entries and closes the database,
+    // the task publishing the index is queued after it
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    f.processor().post_task([released]() { released.wait(); });
+    f.post("createindex", create_params("by_a", true));
+    std::size_t entries_written = 0;
+    std::promise<void> closed;
+    f.processor().post_task(
+        [&]()
+        {
+            for(int i = 0; i < 6000 && entries_written < 5000; ++i)
+            {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+                entries_written = f.db().get_index_builds().at(0).entries_written;
+            }
+            f.close_database();
+            closed.set_value();
+        });
+    release.set_value();
+    closed.get_future().wait();
+
+    BOOST_CHECK_EQUAL(entries_written, 5000u);
+    BOOST_CHECK_EQUAL(count_index_storage(f.storage()), index_entries);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
@@ -0,0 +1,196 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "document/binary_parser.hpp"
+#include "document/detail/binary_format.hpp"
+
+#include "utils/exception.hpp"
+
+#include <boost/uuid/nil_generator.hpp>
+#include <boost/uuid/uuid.hpp>
+
+#include <cstring>
+
+namespace falcondb {
+
+namespace bf = detail::binary_format;
+
+namespace detail {
+
+/// Recursive-descent reader over a byte range
+class binary_reader
+{
+public:
+
+    binary_reader(const char* begin, const char* end)
+    : _it(begin), _end(end)
+    { }
+
+    document read_document()
+    {
+        std::uint8_t t = static_cast<std::uint8_t>(*take(1));
+        switch(t)
+        {
+            case bf::tag_list: return read_list();
+            case bf::tag_object: return read_object();
+            default: return read_scalar(t);
+        }
+    }
+
+    bool at_end() const { return _it == _end; }
+
+private:
+
+    document_scalar read_scalar(std::uint8_t t)
+    {
+        switch(t)
+        {
+            case bf::tag_null: return document_scalar::null();
+            case bf::tag_false: return document_scalar::from(false);
+            case bf::tag_true: return document_scalar::from(true);
+            case bf::tag_int32: return document_scalar::from(bf::read_fixed<std::int32_t>(take(4)));
+            case bf::tag_uint32: return document_scalar::from(bf::read_fixed<std::uint32_t>(take(4)));
+            case bf::tag_int64: return document_scalar::from(bf::read_fixed<std::int64_t>(take(8)));
+            case bf::tag_uint64: return document_scalar::from(bf::read_fixed<std::uint64_t>(take(8)));
+            case bf::tag_double:
+            {
+                std::uint64_t bits = bf::read_fixed<std::uint64_t>(take(8));
+                double d;
+                std::memcpy(&d, &bits, sizeof(d));
+                return document_scalar::from(d);
+            }
+            case bf::tag_string:
+            {
+                std::size_t size = bf::read_varint(_it, _end);
+                const char* data = take(size);
+                return document_scalar::from(std::string(data, size));
+            }
+            case bf::tag_ptime:
+                return document_scalar::from(bf::ticks_to_ptime(bf::read_fixed<std::int64_t>(take(8))));
+            case bf::tag_uuid:
+            {
+                boost::uuids::uuid uuid = boost::uuids::nil_uuid();
+                std::memcpy(uuid.data, take(uuid.size()), uuid.size());
+                return document_scalar::from(uuid);
+            }
+            default:
+                throw exception("binary document: unknown tag ", int(t));
+        }
+    }
+
+    document_list read_list()
+    {
+        const char* end = container_end();
+        std::size_t count = bf::read_varint(_it, end);
+        // each item takes at least its tag byte
+        if (count > std::size_t(end - _it))
+        {
+            throw exception("binary document: list count exceeds data size");
+        }
+
+        document_list result;
+        result.reserve(count);
+        binary_reader content(_it, end);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            result.push_back(content.read_document());
+        }
+        _it = end;
+        return result;
+    }
+
+    document_object read_object()
+    {
+        const char* end = container_end();
+        std::size_t count = bf::read_varint(_it, end);
+
+        document_object result;
+        binary_reader content(_it, end);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            std::size_t name_size = bf::read_varint(content._it, end);
+            const char* name = content.take(name_size);
+            result.insert(result.end(), std::make_pair(std::string(name, name_size), content.read_document()));
+        }
+        _it = end;
+        return result;
+    }
+
+    // reads container size, returns the end of container content
+    const char* container_end()
+    {
+        std::uint32_t size = bf::read_fixed<std::uint32_t>(take(bf::container_size_bytes));
+        if (std::size_t(_end - _it) < size)
+        {
+            throw exception("binary document: container size exceeds data size");
+        }
+        return _it + size;
+    }
+
+    // returns pointer to next 'n' bytes, advances
+    const char* take(std::size_t n)
+    {
+        if (std::size_t(_end - _it) < n)
+        {
+            throw exception("binary document truncated");
+        }
+        const char* r = _it;
+        _it += n;
+        return r;
+    }
+
+    const char* _it;
+    const char* _end;
+};
+
+}
+
+document binary_parser::parse_doc(const range& in)
+{
+    if (!is_binary(in))
+    {
+        throw exception("binary document: unsupported format version");
+    }
+
+    detail::binary_reader reader(in.begin() + 1, in.end());
+    document result = reader.read_document();
+    if (!reader.at_end())
+    {
+        throw exception("binary document: trailing data after the document");
+    }
+    return result;
+}
+
+document binary_parser::parse_value(const range& in)
+{
+    detail::binary_reader reader(in.begin(), in.end());
+    document result = reader.read_document();
+    if (!reader.at_end())
+    {
+        throw exception("binary document: trailing data after the value");
+    }
+    return result;
+}
+
+bool binary_parser::is_binary(const range& in)
+{
+    return !in.empty() && static_cast<std::uint8_t>(*in.begin()) == bf::version;
+}
+
+}
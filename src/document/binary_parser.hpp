@@ -0,0 +1,47 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_BINARY_PARSER_HPP
+#define FALCONDB_BINARY_PARSER_HPP
+
+#include "document/document.hpp"
+
+#include "utils/range.hpp"
+
+namespace falcondb {
+
+/// Decodes documents written by binary_writer
+class binary_parser
+{
+public:
+
+    /// Parses complete, versioned document. Throws if the data is malformed
+    static document parse_doc(const range& in);
+
+    /// Parses single value, without the version byte (as referenced by document_view)
+    static document parse_value(const range& in);
+
+    /// Checks if the data starts with the binary format version byte.
+    /// JSON text never does, so this tells the two encodings apart
+    static bool is_binary(const range& in);
+};
+
+}
+
+#endif
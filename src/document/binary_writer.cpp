@@ -0,0 +1,181 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "document/binary_writer.hpp"
+#include "document/detail/binary_format.hpp"
+
+#include <cstring>
+
+namespace falcondb {
+
+namespace bf = detail::binary_format;
+
+namespace detail {
+
+struct binary_visitor : public boost::static_visitor<>
+{
+    binary_visitor(binary_writer& writer) : _writer(writer) { }
+
+    template<typename T>
+    void operator()(const T& t)
+    {
+        _writer.write(t);
+    }
+
+    binary_writer& _writer;
+};
+
+}
+
+binary_writer::binary_writer(std::string& out)
+: _out(out)
+{
+}
+
+void binary_writer::write_document(const document& doc)
+{
+    _out.push_back(static_cast<char>(bf::version));
+    write(doc);
+}
+
+void binary_writer::write(const document& doc)
+{
+    write(doc._v());
+}
+
+void binary_writer::write(const detail::raw_document_any& doc)
+{
+    detail::binary_visitor v(*this);
+    boost::apply_visitor(v, doc);
+}
+
+void binary_writer::write(const document_scalar& scalar)
+{
+    detail::binary_visitor v(*this);
+    boost::apply_visitor(v, scalar._v());
+}
+
+void binary_writer::write(const document_list& list)
+{
+    _out.push_back(bf::tag_list);
+    std::size_t size_offset = begin_container();
+    bf::write_varint(_out, list.size());
+    for(const document& item : list)
+    {
+        write(item);
+    }
+    end_container(size_offset);
+}
+
+void binary_writer::write(const document_object& object)
+{
+    _out.push_back(bf::tag_object);
+    std::size_t size_offset = begin_container();
+    bf::write_varint(_out, object.size());
+    for(const auto& field : object)
+    {
+        bf::write_varint(_out, field.first.size());
+        _out.append(field.first);
+        write(field.second);
+    }
+    end_container(size_offset);
+}
+
+void binary_writer::write(const std::string& s)
+{
+    _out.push_back(bf::tag_string);
+    bf::write_varint(_out, s.size());
+    _out.append(s);
+}
+
+void binary_writer::write(std::int32_t v)
+{
+    _out.push_back(bf::tag_int32);
+    bf::write_fixed(_out, v);
+}
+
+void binary_writer::write(std::uint32_t v)
+{
+    _out.push_back(bf::tag_uint32);
+    bf::write_fixed(_out, v);
+}
+
+void binary_writer::write(std::int64_t v)
+{
+    _out.push_back(bf::tag_int64);
+    bf::write_fixed(_out, v);
+}
+
+void binary_writer::write(std::uint64_t v)
+{
+    _out.push_back(bf::tag_uint64);
+    bf::write_fixed(_out, v);
+}
+
+void binary_writer::write(double v)
+{
+    std::uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    _out.push_back(bf::tag_double);
+    bf::write_fixed(_out, bits);
+}
+
+void binary_writer::write(bool b)
+{
+    _out.push_back(b ? bf::tag_true : bf::tag_false);
+}
+
+void binary_writer::write(const boost::posix_time::ptime& pt)
+{
+    _out.push_back(bf::tag_ptime);
+    bf::write_fixed(_out, bf::ptime_to_ticks(pt));
+}
+
+void binary_writer::write(const boost::uuids::uuid& uuid)
+{
+    _out.push_back(bf::tag_uuid);
+    _out.append(reinterpret_cast<const char*>(uuid.begin()), uuid.size());
+}
+
+void binary_writer::write(const null_type&)
+{
+    _out.push_back(bf::tag_null);
+}
+
+std::size_t binary_writer::begin_container()
+{
+    std::size_t offset = _out.size();
+    _out.append(bf::container_size_bytes, '\0');
+    return offset;
+}
+
+void binary_writer::end_container(std::size_t size_offset)
+{
+    std::size_t content_size = _out.size() - size_offset - bf::container_size_bytes;
+    if (content_size > std::numeric_limits<std::uint32_t>::max())
+    {
+        throw exception("binary_writer: container too big to encode, size: ", content_size);
+    }
+
+    std::string size_bytes;
+    bf::write_fixed(size_bytes, static_cast<std::uint32_t>(content_size));
+    _out.replace(size_offset, bf::container_size_bytes, size_bytes);
+}
+
+}
@@ -0,0 +1,72 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_BINARY_WRITER_HPP
+#define FALCONDB_BINARY_WRITER_HPP
+
+#include "document/document.hpp"
+
+#include <string>
+
+namespace falcondb {
+
+/// Writes documents in compact, length-prefixed binary form.
+/// The layout is described in doc/StorageFormats.txt
+class binary_writer
+{
+public:
+
+    /// Encoded data is appended to 'out'
+    binary_writer(std::string& out);
+
+    /// Writes complete, versioned document
+    void write_document(const document& doc);
+
+    // individual values, without the version byte
+
+    void write(const document& doc);
+    void write(const detail::raw_document_any& doc);
+    void write(const document_scalar& scalar);
+    void write(const document_list& list);
+    void write(const document_object& object);
+
+    void write(const std::string& s);
+    void write(std::int32_t v);
+    void write(std::uint32_t v);
+    void write(std::int64_t v);
+    void write(std::uint64_t v);
+    void write(double v);
+    void write(bool b);
+    void write(const boost::posix_time::ptime& pt);
+    void write(const boost::uuids::uuid& uuid);
+    void write(const null_type&);
+
+private:
+
+    /// reserves space for container size, returns its offset
+    std::size_t begin_container();
+    /// writes the size of content written since begin_container
+    void end_container(std::size_t size_offset);
+
+    std::string& _out;
+};
+
+}
+
+#endif
@@ -0,0 +1,205 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_DETAIL_BINARY_FORMAT_HPP
+#define FALCONDB_DETAIL_BINARY_FORMAT_HPP
+
+#include "utils/exception.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+// Binary document encoding. See doc/StorageFormats.txt for the layout.
+
+namespace falcondb { namespace detail { namespace binary_format {
+
+/// First byte of every encoded document. Never a valid first character of JSON text,
+/// so the binary and JSON encodings can be told apart.
+const std::uint8_t version = 0x01;
+
+enum tag : std::uint8_t
+{
+    tag_null = 0,
+    tag_false,
+    tag_true,
+    tag_int32,
+    tag_uint32,
+    tag_int64,
+    tag_uint64,
+    tag_double,
+    tag_string,
+    tag_ptime,
+    tag_uuid,
+    tag_list,
+    tag_object
+};
+
+/// size of the byte-length field preceding list and object content
+const std::size_t container_size_bytes = 4;
+
+// little-endian fixed-width integers
+
+template<typename T>
+void write_fixed(std::string& out, T v)
+{
+    typedef typename std::make_unsigned<T>::type unsigned_type;
+    unsigned_type u = static_cast<unsigned_type>(v);
+    for(std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out.push_back(static_cast<char>(u & 0xff));
+        u >>= 8;
+    }
+}
+
+template<typename T>
+T read_fixed(const char* in)
+{
+    typedef typename std::make_unsigned<T>::type unsigned_type;
+    unsigned_type u = 0;
+    for(std::size_t i = sizeof(T); i > 0; --i)
+    {
+        u = (u << 8) | static_cast<std::uint8_t>(in[i-1]);
+    }
+    return static_cast<T>(u);
+}
+
+// LEB128 varints for lengths and counts
+
+inline void write_varint(std::string& out, std::uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+/// Number of bytes write_varint writes for 'v'
+inline std::size_t varint_size(std::uint64_t v)
+{
+    std::size_t size = 1;
+    while (v >= 0x80)
+    {
+        ++size;
+        v >>= 7;
+    }
+    return size;
+}
+
+/// Reads varint from [it, end), advances the iterator. Throws on truncated input
+inline std::uint64_t read_varint(const char*& it, const char* end)
+{
+    std::uint64_t result = 0;
+    for(unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (it == end)
+        {
+            throw exception("binary document truncated inside varint");
+        }
+        std::uint8_t b = static_cast<std::uint8_t>(*it++);
+        result |= std::uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            return result;
+        }
+    }
+    throw exception("binary document: varint too long");
+}
+
+/// Returns the end of the value starting at 'it' (tag included), without parsing it.
+/// Throws if the value extends past 'end'
+inline const char* skip_value(const char* it, const char* end)
+{
+    if (it == end)
+    {
+        throw exception("binary document truncated");
+    }
+
+    std::size_t size = 0;
+    switch(static_cast<std::uint8_t>(*it++))
+    {
+        case tag_null:
+        case tag_false:
+        case tag_true:
+            size = 0; break;
+        case tag_int32:
+        case tag_uint32:
+            size = 4; break;
+        case tag_int64:
+        case tag_uint64:
+        case tag_double:
+        case tag_ptime:
+            size = 8; break;
+        case tag_uuid:
+            size = 16; break;
+        case tag_string:
+            size = read_varint(it, end); break;
+        case tag_list:
+        case tag_object:
+            if (std::size_t(end - it) < container_size_bytes)
+            {
+                throw exception("binary document truncated");
+            }
+            size = read_fixed<std::uint32_t>(it);
+            it += container_size_bytes;
+            break;
+        default:
+            throw exception("binary document: unknown tag ", int(static_cast<std::uint8_t>(it[-1])));
+    }
+
+    if (std::size_t(end - it) < size)
+    {
+        throw exception("binary document truncated");
+    }
+    return it + size;
+}
+
+// ptime <-> microseconds since the unix epoch. Special values are mapped to the extremes
+
+inline std::int64_t ptime_to_ticks(const boost::posix_time::ptime& pt)
+{
+    if (pt.is_not_a_date_time()) return std::numeric_limits<std::int64_t>::min();
+    if (pt.is_neg_infinity()) return std::numeric_limits<std::int64_t>::min() + 1;
+    if (pt.is_pos_infinity()) return std::numeric_limits<std::int64_t>::max();
+
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return (pt - epoch).total_microseconds();
+}
+
+inline boost::posix_time::ptime ticks_to_ptime(std::int64_t ticks)
+{
+    if (ticks == std::numeric_limits<std::int64_t>::min())
+        return boost::posix_time::ptime(boost::posix_time::not_a_date_time);
+    if (ticks == std::numeric_limits<std::int64_t>::min() + 1)
+        return boost::posix_time::ptime(boost::posix_time::neg_infin);
+    if (ticks == std::numeric_limits<std::int64_t>::max())
+        return boost::posix_time::ptime(boost::posix_time::pos_infin);
+
+    static const boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
+    return epoch + boost::posix_time::microseconds(ticks);
+}
+
+}}}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_DETAIL_TYPE_ORDER_HPP
+#define FALCONDB_DETAIL_TYPE_ORDER_HPP
+
+#include "document/detail/scalar_variant.hpp"
+
+#include <string>
+#include <type_traits>
+
+namespace falcondb { namespace detail {
+
+/// Canonical order of value types, used when comparing values of different types.
+/// All numeric types form one class and are compared by value.
+/// The values are used as type bytes by key_encoding, so they must stay below 0x20
+/// (never the first byte of JSON text) and above the encoding's terminator bytes.
+enum class type_order : std::uint8_t
+{
+    null = 0x02,
+    number = 0x04,
+    string = 0x06,
+    object = 0x08,
+    list = 0x0a,
+    uuid = 0x0c,
+    boolean = 0x0e,
+    ptime = 0x10
+};
+
+/// arithmetic types except bool
+template<typename T>
+struct is_number : public std::integral_constant<bool,
+    std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>
+{ };
+
+inline type_order type_order_of(const null_type&) { return type_order::null; }
+inline type_order type_order_of(const std::string&) { return type_order::string; }
+inline type_order type_order_of(const boost::uuids::uuid&) { return type_order::uuid; }
+inline type_order type_order_of(bool) { return type_order::boolean; }
+inline type_order type_order_of(const boost::posix_time::ptime&) { return type_order::ptime; }
+
+template<typename T>
+typename std::enable_if<is_number<T>::value, type_order>::type
+type_order_of(const T&) { return type_order::number; }
+
+struct type_order_visitor : public boost::static_visitor<type_order>
+{
+    template<typename T>
+    type_order operator()(const T& t) const { return type_order_of(t); }
+};
+
+inline type_order type_order_of(const raw_document_scalar& s)
+{
+    return boost::apply_visitor(type_order_visitor(), s);
+}
+
+}}
+
+#endif
@@ -23,6 +23,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "document/json_writer.hpp"
 #include "document/json_parser.hpp"
+#include "document/binary_writer.hpp"
+#include "document/binary_parser.hpp"
+#include "document/detail/type_order.hpp"
 
 #include "utils/exception.hpp"
 
@@ -43,14 +46,17 @@ document document::from_json(const std::string& s)
     return json_parser::parse_doc(s);
 }
 
-std::string document_object::to_json() const
+std::string document::to_binary() const
 {
-    return document::from(*this).to_json();
+    std::string out;
+    binary_writer w(out);
+    w.write_document(*this);
+    return out;
 }
 
-document_object document_object::from_json(const std::string& s)
+document document::from_binary(const range& r)
 {
-    return document::from_json(s).as_object();
+    return binary_parser::parse_doc(r);
 }
 
 std::ostream& operator<<(std::ostream& o, const document& d)
@@ -60,44 +66,43 @@ std::ostream& operator<<(std::ostream& o, const document& d)
     return o;
 }
 
-struct less_visitor : boost::static_visitor<bool>
-{
-    template<typename T>
-    bool operator()(const T& a, const T& b) const
-    {
-        return a < b;
-    }
+namespace detail {
 
-    template<typename T, typename U>
-    bool operator()(const T&, const U&) const
-    {
-        return false; // TODO how to compare different types?
-    }
-};
+inline type_order type_order_of(const document_scalar& s) { return type_order_of(s._v()); }
+inline type_order type_order_of(const document_list&) { return type_order::list; }
+inline type_order type_order_of(const document_object&) { return type_order::object; }
+
+}
 
-struct equals_visitor : boost::static_visitor<bool>
+struct compare_visitor : boost::static_visitor<int>
 {
     template<typename T>
-    bool operator()(const T& a, const T& b) const
+    int operator()(const T& a, const T& b) const
     {
-        return a == b;
+        return a.compare(b);
     }
 
     template<typename T, typename U>
-    bool operator()(const T&, const U&) const
+    int operator()(const T& a, const U& b) const
     {
-        return false;
+        // different kinds of values can't be of the same type order
+        return detail::type_order_of(a) < detail::type_order_of(b) ? -1 : 1;
     }
 };
 
+int document::compare(const document& other) const
+{
+    return boost::apply_visitor(compare_visitor(), _variant, other._variant);
+}
+
 bool document::operator < (const document& other) const
 {
-    return boost::apply_visitor(less_visitor(), _variant, other._variant);
+    return compare(other) < 0;
 }
 
 bool document::operator == (const document& other) const
 {
-    return boost::apply_visitor(equals_visitor(), _variant, other._variant);
+    return compare(other) == 0;
 }
 
 bool document::is_null() const
@@ -24,6 +24,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "document/document_list.hpp"
 #include "document/document_object.hpp"
 
+#include "utils/range.hpp"
+
 namespace falcondb {
 
 /// Provides some extra functinality on top of document_any
@@ -96,8 +98,14 @@ public:
     std::string to_json() const;
     static document from_json(const std::string& s);
 
+    std::string to_binary() const;
+    static document from_binary(const range& r);
+
     // other
 
+    /// Total order across all types, see detail::type_order. Returns <0, 0 or >0
+    int compare(const document& other) const;
+
     bool operator < (const document& other) const;
     bool operator == (const document& other) const;
     void swap(document& other) { _variant.swap(other._variant); }
@@ -36,18 +36,21 @@ document_list document_list::from_json(const std::string& s)
     return document::from_json(s).as_list();
 }
 
-bool document_list::operator < (const document_list& other) const
+int document_list::compare(const document_list& other) const
 {
     auto me = begin();
     auto him = other.begin();
 
     for(;me != end() && him != other.end(); ++me, ++him)
     {
-        if (*me < *him) return true;
+        int r = me->compare(*him);
+        if (r != 0) return r;
     }
 
     // [a,b,c] <  [a,b,c,d]
-    return him != other.end();
+    if (me != end()) return 1;
+    if (him != other.end()) return -1;
+    return 0;
 }
 
 }
@@ -53,7 +53,10 @@ public:
 
     // other
 
-    bool operator < (const document_list& other) const;
+    /// Lexicographical comparison
+    int compare(const document_list& other) const;
+
+    bool operator < (const document_list& other) const { return compare(other) < 0; }
 };
 
 }
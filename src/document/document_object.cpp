@@ -38,4 +38,23 @@ document_object document_object::from_json(const std::string& s)
     return document::from_json(s).as_object();
 }
 
+int document_object::compare(const document_object& other) const
+{
+    auto me = begin();
+    auto him = other.begin();
+
+    for(;me != end() && him != other.end(); ++me, ++him)
+    {
+        int r = me->first.compare(him->first);
+        if (r != 0) return r < 0 ? -1 : 1;
+
+        r = me->second.compare(him->second);
+        if (r != 0) return r;
+    }
+
+    if (me != end()) return 1;
+    if (him != other.end()) return -1;
+    return 0;
+}
+
 }
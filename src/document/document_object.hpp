@@ -66,7 +66,10 @@ public:
 
     // other
 
-    bool operator < (const document_object& ) const { return false; }
+    /// Compares field by field: name first, then value. Fields are in name order
+    int compare(const document_object& other) const;
+
+    bool operator < (const document_object& other) const { return compare(other) < 0; }
 
 };
 
@@ -18,95 +18,130 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "document/document_scalar.hpp"
+#include "document/detail/type_order.hpp"
+#include "document/detail/binary_format.hpp"
 
-#include <boost/lexical_cast.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
+#include <cmath>
 #include <type_traits>
 
 namespace falcondb {
 
-struct scalar_less_visitor : boost::static_visitor<bool>
+namespace detail {
+
+// numbers are compared by value, across types.
+// integers are widened to 128 bits, so all combinations of signed and unsigned types are exact
+
+typedef __int128 wide_integer;
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value, wide_integer>::type
+to_comparable_number(T v) { return v; }
+
+inline double to_comparable_number(double v) { return v; }
+
+inline int compare_numbers(wide_integer a, wide_integer b)
 {
-    // the same types - use native comparison
-    template<typename T>
-    bool operator()(const T& a, const T& b) const
-    {
-        return a < b;
-    }
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
 
-    // everything is greater than null
-    template<typename T>
-    typename std::enable_if<!std::is_same<T, null_type>::value, bool>::type
-    operator()(const null_type&, const T&) const
-    {
-        return true;
-    }
-    template<typename T>
-    typename std::enable_if<!std::is_same<T, null_type>::value, bool>::type
-    operator()(const T&, const null_type&) const
+// NaN is equal to itself and below all other numbers
+inline int compare_numbers(double a, double b)
+{
+    if (std::isnan(a) || std::isnan(b))
     {
-        return false;
+        return int(!std::isnan(a)) - int(!std::isnan(b));
     }
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
 
-    // different types, both arithmetic
-    template<typename T, typename U>
-    typename std::enable_if<std::is_arithmetic<T>::value && std::is_arithmetic<U>::value, bool>::type
-    operator()(const T& a, const U& b) const
-    {
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wsign-compare"
-        return a < b;
-        #pragma GCC diagnostic pop
-    }
+inline int compare_numbers(wide_integer a, double b)
+{
+    if (std::isnan(b)) return 1;
 
-    // different types, at least one nont-arithemtic. convert to string
-    template<typename T, typename U>
-    typename std::enable_if<!std::is_arithmetic<T>::value || !std::is_arithmetic<U>::value, bool>::type
-    operator()(const T& a, const U& b) const
-    {
-        return boost::lexical_cast<std::string>(a) < boost::lexical_cast<std::string>(b);
-    }
+    // all 64-bit integers are in [-2^63, 2^64)
+    if (b >= 18446744073709551616.0) return -1;
+    if (b < -9223372036854775808.0) return 1;
 
-};
+    double whole = std::floor(b);
+    int r = compare_numbers(a, wide_integer(whole));
+    if (r != 0) return r;
+    return whole < b ? -1 : 0; // b has a fractional part
+}
 
-bool document_scalar::operator<(const document_scalar& other) const
+inline int compare_numbers(double a, wide_integer b)
 {
-    return boost::apply_visitor(scalar_less_visitor(), _variant, other._variant);
+    return -compare_numbers(b, a);
+}
+
+template<typename T>
+int compare_values(const T& a, const T& b)
+{
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
 }
 
-struct scalar_equals_visitor : boost::static_visitor<bool>
+struct scalar_compare_visitor : boost::static_visitor<int>
 {
-    // the same types - use native comparison
-    template<typename T>
-    bool operator()(const T& a, const T& b) const
+    template<typename T, typename U>
+    int operator()(const T& a, const U& b) const
     {
-        return a == b;
+        detail::type_order ta = detail::type_order_of(a);
+        detail::type_order tb = detail::type_order_of(b);
+        if (ta != tb)
+        {
+            return ta < tb ? -1 : 1;
+        }
+        return compare_same_order(a, b);
     }
 
-    // different types, both arithmetic
+    // numbers
     template<typename T, typename U>
-    typename std::enable_if<std::is_arithmetic<T>::value && std::is_arithmetic<U>::value, bool>::type
-    operator()(const T& a, const U& b) const
+    typename std::enable_if<detail::is_number<T>::value && detail::is_number<U>::value, int>::type
+    compare_same_order(const T& a, const U& b) const
     {
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wsign-compare"
-        return a == b;
-        #pragma GCC diagnostic pop
+        return detail::compare_numbers(detail::to_comparable_number(a), detail::to_comparable_number(b));
     }
 
-    // different types - not equal
+    // different types of the same order. Only numbers are like that, this is never called
     template<typename T, typename U>
-    typename std::enable_if<!std::is_arithmetic<T>::value || !std::is_arithmetic<U>::value, bool>::type
-    operator()(const T& a, const U& b) const
+    typename std::enable_if<!detail::is_number<T>::value || !detail::is_number<U>::value, int>::type
+    compare_same_order(const T&, const U&) const
+    {
+        return 0;
+    }
+
+    int compare_same_order(const null_type&, const null_type&) const { return 0; }
+    int compare_same_order(const std::string& a, const std::string& b) const
     {
-        return false;
+        int r = a.compare(b);
+        return r < 0 ? -1 : (r > 0 ? 1 : 0);
+    }
+    int compare_same_order(bool a, bool b) const { return detail::compare_values(a, b); }
+    int compare_same_order(const boost::uuids::uuid& a, const boost::uuids::uuid& b) const { return detail::compare_values(a, b); }
+
+    // the same order as in binary and key encoding, including special values
+    int compare_same_order(const boost::posix_time::ptime& a, const boost::posix_time::ptime& b) const
+    {
+        return detail::compare_values(detail::binary_format::ptime_to_ticks(a), detail::binary_format::ptime_to_ticks(b));
     }
 };
 
+int document_scalar::compare(const document_scalar& other) const
+{
+    return boost::apply_visitor(scalar_compare_visitor(), _variant, other._variant);
+}
+
+bool document_scalar::operator<(const document_scalar& other) const
+{
+    return compare(other) < 0;
+}
+
 bool document_scalar::operator==(const document_scalar& other) const
 {
-    return boost::apply_visitor(scalar_equals_visitor(), _variant, other._variant);
+    return compare(other) == 0;
 }
 
 }
@@ -53,10 +53,17 @@ public:
     template<typename T>
     const T& as() const;
 
+    /// Value of any numeric type, converted to T. Throws if the value is not a number
+    template<typename T>
+    T to_number() const;
+
     // null handling
     static document_scalar null();
     bool is_null() const;
 
+    /// Total order across all types, see detail::type_order. Returns <0, 0 or >0
+    int compare(const document_scalar& other) const;
+
     bool operator<(const document_scalar& other) const;
     bool operator==(const document_scalar& other) const;
 
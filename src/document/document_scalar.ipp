@@ -21,6 +21,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define FALCONDB_DOCUMENT_SCALAR_IPP
 
 #include "document/document.hpp"
+#include "document/detail/type_order.hpp"
+
+#include "utils/exception.hpp"
 
 namespace falcondb {
 
@@ -46,6 +49,28 @@ const T& document_scalar::as() const
     return boost::get<T>(_variant);
 }
 
+namespace detail {
+
+template<typename T>
+struct to_number_visitor : public boost::static_visitor<T>
+{
+    template<typename V>
+    typename std::enable_if<is_number<V>::value, T>::type
+    operator()(const V& v) const { return static_cast<T>(v); }
+
+    template<typename V>
+    typename std::enable_if<!is_number<V>::value, T>::type
+    operator()(const V&) const { throw exception("value is not a number"); }
+};
+
+}
+
+template<typename T>
+T document_scalar::to_number() const
+{
+    return boost::apply_visitor(detail::to_number_visitor<T>(), _variant);
+}
+
 inline document_scalar document_scalar::null()
 {
     return  detail::raw_document_scalar(null_type());
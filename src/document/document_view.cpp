@@ -0,0 +1,207 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "document/document_view.hpp"
+#include "document/binary_parser.hpp"
+#include "document/detail/binary_format.hpp"
+
+#include "utils/exception.hpp"
+
+#include <cstring>
+
+namespace falcondb {
+
+namespace bf = detail::binary_format;
+
+document_view::document_view(const range& data)
+: _data(data)
+{
+}
+
+document_view document_view::from_binary(const range& data)
+{
+    if (!binary_parser::is_binary(data))
+    {
+        throw exception("document view: data is not in binary format");
+    }
+    range value(data.begin() + 1, data.size() - 1);
+    if (bf::skip_value(value.begin(), value.end()) != value.end())
+    {
+        throw exception("binary document: trailing data after the document");
+    }
+    return document_view(value);
+}
+
+std::uint8_t document_view::tag() const
+{
+    return static_cast<std::uint8_t>(*_data.begin());
+}
+
+bool document_view::is_object() const
+{
+    return tag() == bf::tag_object;
+}
+
+bool document_view::is_list() const
+{
+    return tag() == bf::tag_list;
+}
+
+bool document_view::is_scalar() const
+{
+    return !is_object() && !is_list();
+}
+
+bool document_view::is_null() const
+{
+    return tag() == bf::tag_null;
+}
+
+range document_view::container_content(std::uint8_t expected_tag, std::size_t& count) const
+{
+    if (tag() != expected_tag)
+    {
+        throw exception(expected_tag == bf::tag_object ? "document view: not an object" : "document view: not a list");
+    }
+
+    // the view was validated by skip_value, so the size is consistent with the data
+    const char* it = _data.begin() + 1 + bf::container_size_bytes;
+    count = bf::read_varint(it, _data.end());
+    return range(it, _data.end() - it);
+}
+
+boost::optional<document_view> document_view::find_field(const std::string& name) const
+{
+    std::size_t count;
+    range content = container_content(bf::tag_object, count);
+
+    const char* it = content.begin();
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        std::size_t name_size = bf::read_varint(it, content.end());
+        if (std::size_t(content.end() - it) < name_size)
+        {
+            throw exception("binary document truncated");
+        }
+        const char* field_name = it;
+        it += name_size;
+        const char* value_end = bf::skip_value(it, content.end());
+
+        // same order as std::string::compare, used by the document_object map
+        int cmp = std::memcmp(field_name, name.data(), std::min(name_size, name.size()));
+        if (cmp == 0)
+        {
+            cmp = name_size < name.size() ? -1 : (name_size > name.size() ? 1 : 0);
+        }
+
+        if (cmp == 0)
+        {
+            return document_view(range(it, value_end - it));
+        }
+        if (cmp > 0)
+        {
+            break;
+        }
+        it = value_end;
+    }
+
+    return boost::none;
+}
+
+document_view document_view::get_field(const std::string& name) const
+{
+    boost::optional<document_view> field = find_field(name);
+    if (!field)
+    {
+        throw exception("document view: no such field: ", name);
+    }
+    return *field;
+}
+
+bool document_view::has_field(const std::string& name) const
+{
+    return static_cast<bool>(find_field(name));
+}
+
+void document_view::for_each_field(const field_handler& fun) const
+{
+    std::size_t count;
+    range content = container_content(bf::tag_object, count);
+
+    const char* it = content.begin();
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        std::size_t name_size = bf::read_varint(it, content.end());
+        if (std::size_t(content.end() - it) < name_size)
+        {
+            throw exception("binary document truncated");
+        }
+        range field_name(it, name_size);
+        it += name_size;
+        const char* value_end = bf::skip_value(it, content.end());
+
+        fun(field_name, document_view(range(it, value_end - it)));
+        it = value_end;
+    }
+}
+
+document_view document_view::get_item(std::size_t index) const
+{
+    std::size_t count;
+    range content = container_content(bf::tag_list, count);
+    if (index >= count)
+    {
+        throw exception("document view: index ", index, " out of range, list size is ", count);
+    }
+
+    const char* it = content.begin();
+    for(std::size_t i = 0; i < index; ++i)
+    {
+        it = bf::skip_value(it, content.end());
+    }
+    return document_view(range(it, bf::skip_value(it, content.end()) - it));
+}
+
+void document_view::for_each_item(const item_handler& fun) const
+{
+    std::size_t count;
+    range content = container_content(bf::tag_list, count);
+
+    const char* it = content.begin();
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        const char* item_end = bf::skip_value(it, content.end());
+        fun(document_view(range(it, item_end - it)));
+        it = item_end;
+    }
+}
+
+std::size_t document_view::size() const
+{
+    std::size_t count;
+    container_content(is_object() ? bf::tag_object : bf::tag_list, count);
+    return count;
+}
+
+document document_view::to_document() const
+{
+    return binary_parser::parse_value(_data);
+}
+
+}
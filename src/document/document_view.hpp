@@ -0,0 +1,101 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_DOCUMENT_VIEW_HPP
+#define FALCONDB_DOCUMENT_VIEW_HPP
+
+#include "document/document.hpp"
+
+#include "utils/range.hpp"
+
+#include <boost/optional.hpp>
+
+#include <functional>
+#include <string>
+
+namespace falcondb {
+
+/// Read-only view over a document in binary format (see binary_writer).
+/// Doesn't own the data, which has to outlive the view. Nothing is parsed up-front:
+/// fields and items are located on demand by skipping over the length-prefixed values,
+/// and only the requested parts are ever materialized.
+class document_view
+{
+public:
+
+    typedef std::function<void (const range& name, const document_view& value)> field_handler;
+    typedef std::function<void (const document_view& item)> item_handler;
+
+    /// View over complete, versioned document, as produced by document::to_binary.
+    /// Throws if the data is not in binary format
+    static document_view from_binary(const range& data);
+
+    bool is_object() const;
+    bool is_list() const;
+    bool is_scalar() const;
+    bool is_null() const;
+
+    // objects
+
+    /// Looks up a field. Fields are stored in name order, so the search stops at the first greater name
+    boost::optional<document_view> find_field(const std::string& name) const;
+    /// Throws if there is no such field
+    document_view get_field(const std::string& name) const;
+    bool has_field(const std::string& name) const;
+
+    void for_each_field(const field_handler& fun) const;
+
+    // lists
+
+    /// Throws if out of range
+    document_view get_item(std::size_t index) const;
+
+    void for_each_item(const item_handler& fun) const;
+
+    // both
+
+    /// Number of fields or items. Stored in the container header, no scanning required
+    std::size_t size() const;
+
+    // materialization
+
+    /// Parses the viewed value into a document
+    document to_document() const;
+
+    /// Scalar value, converted like document_scalar::as
+    template<typename T>
+    T as() const { return to_document().as_scalar().as<T>(); }
+
+    /// Encoded bytes of the viewed value, without the version byte
+    const range& data() const { return _data; }
+
+private:
+
+    document_view(const range& data);
+
+    /// returns the content range of the container, past the item count
+    range container_content(std::uint8_t expected_tag, std::size_t& count) const;
+    std::uint8_t tag() const;
+
+    range _data;
+};
+
+}
+
+#endif
@@ -184,7 +184,7 @@ document json_parser::parse_doc(const std::string& in)
     qi::phrase_parse(
         first,
         last,
-        doc_parser[ [&result](const detail::parse_document& r, UU) { result = r; } ],
+        doc_parser[ ([&result](const detail::parse_document& r, UU) { result = r; }) ],
         qi::ascii::space
     );
 
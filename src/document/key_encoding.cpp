@@ -0,0 +1,453 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "document/key_encoding.hpp"
+#include "document/detail/type_order.hpp"
+#include "document/detail/binary_format.hpp"
+
+#include "utils/exception.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace falcondb {
+
+using detail::type_order;
+
+namespace detail {
+
+// terminates strings, lists and objects. Lower than any type byte
+const char key_end = 0x00;
+// precedes each object field. Lower than any type byte, higher than key_end
+const char key_field = 0x01;
+// follows 0x00 inside strings, so the string terminator is never ambiguous
+const char key_escaped_zero = static_cast<char>(0xff);
+
+const char number_nan = 0x00;
+const char number_value = 0x01;
+
+typedef __int128 wide_integer;
+
+template<typename T>
+void write_big_endian(std::string& out, T v)
+{
+    for(std::size_t i = sizeof(T); i > 0; --i)
+    {
+        out.push_back(static_cast<char>((v >> ((i-1)*8)) & 0xff));
+    }
+}
+
+template<typename T>
+T read_big_endian(const char* in)
+{
+    T v = 0;
+    for(std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        v = (v << 8) | static_cast<std::uint8_t>(in[i]);
+    }
+    return v;
+}
+
+// IEEE 754 bits, transformed so that unsigned comparison gives numeric order
+inline std::uint64_t sortable_double(double d)
+{
+    if (d == 0.0) d = 0.0; // -0 == 0
+    std::uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    const std::uint64_t sign = std::uint64_t(1) << 63;
+    return (bits & sign) ? ~bits : (bits | sign);
+}
+
+inline double unsortable_double(std::uint64_t bits)
+{
+    const std::uint64_t sign = std::uint64_t(1) << 63;
+    bits = (bits & sign) ? (bits & ~sign) : ~bits;
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+// Number is encoded as the nearest double, followed by the exact difference between the value
+// and the double. Rounding is monotonic, so the pair orders the same way as the exact values.
+// For 64-bit integers the difference is below 2^11
+inline void write_number(std::string& out, double nearest, std::int16_t difference)
+{
+    out.push_back(static_cast<char>(type_order::number));
+    if (std::isnan(nearest))
+    {
+        out.push_back(number_nan);
+    }
+    else
+    {
+        out.push_back(number_value);
+        write_big_endian(out, sortable_double(nearest));
+        write_big_endian(out, std::uint16_t(std::uint16_t(difference) ^ 0x8000));
+    }
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value>::type
+write_number(std::string& out, T v)
+{
+    wide_integer exact = v;
+    double nearest = static_cast<double>(exact);
+    write_number(out, nearest, std::int16_t(exact - static_cast<wide_integer>(nearest)));
+}
+
+inline void write_number(std::string& out, double v)
+{
+    write_number(out, v, 0);
+}
+
+inline void write_escaped(std::string& out, const std::string& s)
+{
+    for(char c : s)
+    {
+        out.push_back(c);
+        if (c == key_end)
+        {
+            out.push_back(key_escaped_zero);
+        }
+    }
+    out.push_back(key_end);
+}
+
+class key_writer : public boost::static_visitor<>
+{
+public:
+
+    key_writer(std::string& out) : _out(out) { }
+
+    void operator()(const document_scalar& s) { boost::apply_visitor(*this, s._v()); }
+
+    void operator()(const document_list& l)
+    {
+        _out.push_back(static_cast<char>(type_order::list));
+        for(const document& item : l)
+        {
+            boost::apply_visitor(*this, item._v());
+        }
+        _out.push_back(key_end);
+    }
+
+    void operator()(const document_object& o)
+    {
+        _out.push_back(static_cast<char>(type_order::object));
+        for(const auto& field : o)
+        {
+            _out.push_back(key_field);
+            write_escaped(_out, field.first);
+            boost::apply_visitor(*this, field.second._v());
+        }
+        _out.push_back(key_end);
+    }
+
+    void operator()(const null_type&)
+    {
+        _out.push_back(static_cast<char>(type_order::null));
+    }
+
+    template<typename T>
+    typename std::enable_if<is_number<T>::value>::type
+    operator()(const T& v)
+    {
+        write_number(_out, v);
+    }
+
+    void operator()(const std::string& s)
+    {
+        _out.push_back(static_cast<char>(type_order::string));
+        write_escaped(_out, s);
+    }
+
+    void operator()(bool b)
+    {
+        _out.push_back(static_cast<char>(type_order::boolean));
+        _out.push_back(b ? 1 : 0);
+    }
+
+    void operator()(const boost::posix_time::ptime& pt)
+    {
+        _out.push_back(static_cast<char>(type_order::ptime));
+        std::int64_t ticks = binary_format::ptime_to_ticks(pt);
+        write_big_endian(_out, std::uint64_t(ticks) ^ (std::uint64_t(1) << 63));
+    }
+
+    void operator()(const boost::uuids::uuid& uuid)
+    {
+        _out.push_back(static_cast<char>(type_order::uuid));
+        _out.append(reinterpret_cast<const char*>(uuid.begin()), uuid.size());
+    }
+
+private:
+
+    std::string& _out;
+};
+
+class key_reader
+{
+public:
+
+    key_reader(const char* begin, const char* end)
+    : _it(begin), _end(end)
+    { }
+
+    document read_document()
+    {
+        type_order t = static_cast<type_order>(*take(1));
+        switch(t)
+        {
+            case type_order::null: return document_scalar::null();
+            case type_order::number: return read_number();
+            case type_order::string: return document_scalar::from(read_escaped());
+            case type_order::object: return read_object();
+            case type_order::list: return read_list();
+            case type_order::uuid:
+            {
+                boost::uuids::uuid uuid;
+                std::memcpy(uuid.data, take(uuid.size()), uuid.size());
+                return document_scalar::from(uuid);
+            }
+            case type_order::boolean: return document_scalar::from(*take(1) != 0);
+            case type_order::ptime:
+            {
+                std::uint64_t u = read_big_endian<std::uint64_t>(take(8)) ^ (std::uint64_t(1) << 63);
+                return document_scalar::from(binary_format::ticks_to_ptime(std::int64_t(u)));
+            }
+        }
+        throw exception("encoded key: unknown type ", int(t));
+    }
+
+    bool at_end() const { return _it == _end; }
+    const char* position() const { return _it; }
+    void skip(std::size_t n) { take(n); }
+
+    /// reads list header or terminator
+    void expect(char c)
+    {
+        if (*take(1) != c)
+        {
+            throw exception("encoded key: malformed list");
+        }
+    }
+
+private:
+
+    document_scalar read_number()
+    {
+        if (*take(1) == number_nan)
+        {
+            return document_scalar::from(std::numeric_limits<double>::quiet_NaN());
+        }
+
+        double nearest = unsortable_double(read_big_endian<std::uint64_t>(take(8)));
+        std::int16_t difference = std::int16_t(read_big_endian<std::uint16_t>(take(2)) ^ std::uint16_t(0x8000));
+
+        // integral values in 64-bit range come back as integers
+        const double min_integer = -9223372036854775808.0;
+        const double max_integer = 18446744073709551616.0;
+        if (difference == 0 && !(std::floor(nearest) == nearest && nearest >= min_integer && nearest < max_integer))
+        {
+            return document_scalar::from(nearest);
+        }
+
+        wide_integer exact = static_cast<wide_integer>(nearest) + difference;
+        if (exact >= std::numeric_limits<std::int64_t>::min() && exact <= std::numeric_limits<std::int64_t>::max())
+        {
+            return document_scalar::from(std::int64_t(exact));
+        }
+        return document_scalar::from(std::uint64_t(exact));
+    }
+
+    std::string read_escaped()
+    {
+        std::string result;
+        while(true)
+        {
+            char c = *take(1);
+            if (c == key_end)
+            {
+                if (_it != _end && *_it == key_escaped_zero)
+                {
+                    ++_it;
+                }
+                else
+                {
+                    return result;
+                }
+            }
+            result.push_back(c);
+        }
+    }
+
+    document_list read_list()
+    {
+        document_list result;
+        while(peek() != key_end)
+        {
+            result.push_back(read_document());
+        }
+        ++_it;
+        return result;
+    }
+
+    document_object read_object()
+    {
+        document_object result;
+        while(peek() != key_end)
+        {
+            if (*take(1) != key_field)
+            {
+                throw exception("encoded key: malformed object");
+            }
+            std::string name = read_escaped();
+            result.insert(result.end(), std::make_pair(name, read_document()));
+        }
+        ++_it;
+        return result;
+    }
+
+    char peek() const
+    {
+        if (_it == _end)
+        {
+            throw exception("encoded key truncated");
+        }
+        return *_it;
+    }
+
+    const char* take(std::size_t n)
+    {
+        if (std::size_t(_end - _it) < n)
+        {
+            throw exception("encoded key truncated");
+        }
+        const char* r = _it;
+        _it += n;
+        return r;
+    }
+
+    const char* _it;
+    const char* _end;
+};
+
+}
+
+std::string key_encoding::encode(const document& doc)
+{
+    std::string out;
+    encode(out, doc);
+    return out;
+}
+
+void key_encoding::encode(std::string& out, const document& doc)
+{
+    detail::key_writer writer(out);
+    boost::apply_visitor(writer, doc._v());
+}
+
+document key_encoding::decode(const range& in)
+{
+    detail::key_reader reader(in.begin(), in.end());
+    document result = reader.read_document();
+    if (!reader.at_end())
+    {
+        throw exception("encoded key: trailing data after the key");
+    }
+    return result;
+}
+
+// after a descending item. Complemented items are compared as bytes in reverse order; the terminator
+// sorts a string before the longer strings it is an escaped prefix of, which continue with ~0xff
+const char descending_end = static_cast<char>(0xff);
+
+std::string key_encoding::encode_list(const document_list& items, const std::vector<bool>& descending)
+{
+    assert(items.size() == descending.size());
+    std::string out;
+    out.push_back(static_cast<char>(type_order::list));
+    for(std::size_t i = 0; i < items.size(); ++i)
+    {
+        std::size_t begin = out.size();
+        encode(out, items[i]);
+        if (descending[i])
+        {
+            for(std::size_t j = begin; j < out.size(); ++j)
+            {
+                out[j] = ~out[j];
+            }
+            out.push_back(descending_end);
+        }
+    }
+    out.push_back(detail::key_end);
+    return out;
+}
+
+document_list key_encoding::decode_list(const range& in, const std::vector<bool>& descending)
+{
+    std::size_t size = 0;
+    document_list result = decode_list(in, descending, size);
+    if (size != in.size())
+    {
+        throw exception("encoded key: trailing data after the key");
+    }
+    return result;
+}
+
+document_list key_encoding::decode_list(const range& in, const std::vector<bool>& descending, std::size_t& size)
+{
+    detail::key_reader reader(in.begin(), in.end());
+    reader.expect(static_cast<char>(type_order::list));
+
+    document_list result;
+    result.reserve(descending.size());
+    for(bool desc : descending)
+    {
+        if (!desc)
+        {
+            result.push_back(reader.read_document());
+            continue;
+        }
+
+        // the item length is known once decoded, the rest of the key is restored
+        std::string restored(reader.position(), in.end());
+        for(char& c : restored)
+        {
+            c = ~c;
+        }
+        detail::key_reader item_reader(restored.data(), restored.data() + restored.size());
+        result.push_back(item_reader.read_document());
+        reader.skip(item_reader.position() - restored.data());
+        reader.expect(descending_end);
+    }
+    reader.expect(detail::key_end);
+    size = reader.position() - in.begin();
+    return result;
+}
+
+bool key_encoding::is_encoded(const range& in)
+{
+    return !in.empty()
+        && static_cast<std::uint8_t>(*in.begin()) >= static_cast<std::uint8_t>(type_order::null)
+        && static_cast<std::uint8_t>(*in.begin()) <= static_cast<std::uint8_t>(type_order::ptime);
+}
+
+}
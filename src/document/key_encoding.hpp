@@ -0,0 +1,68 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_KEY_ENCODING_HPP
+#define FALCONDB_KEY_ENCODING_HPP
+
+#include "document/document.hpp"
+
+#include "utils/range.hpp"
+
+#include <string>
+#include <vector>
+
+namespace falcondb {
+
+/// Order-preserving (normalized) key encoding.
+/// For any two documents, comparing their encoded forms with memcmp gives the same result
+/// as document::compare. The layout is described in doc/StorageFormats.txt
+///
+/// Numbers of different types that are equal encode to the same bytes, so the exact type
+/// is not preserved: numbers are decoded as int64, uint64 or double.
+class key_encoding
+{
+public:
+
+    static std::string encode(const document& doc);
+
+    /// Appends encoded document to 'out'
+    static void encode(std::string& out, const document& doc);
+
+    /// Decodes complete key. Throws if the data is malformed
+    static document decode(const range& in);
+
+    /// Encodes list as encode() does, except that items marked in 'descending' sort in reverse order:
+    /// they are stored complemented and followed by 0xff. Without descending items the result is
+    /// the same as encode()'s
+    static std::string encode_list(const document_list& items, const std::vector<bool>& descending);
+
+    /// Decodes list written by encode_list with the same 'descending'
+    static document_list decode_list(const range& in, const std::vector<bool>& descending);
+
+    /// Decodes list written by encode_list at the start of 'in', followed by other data.
+    /// Sets 'size' to the encoded size of the list
+    static document_list decode_list(const range& in, const std::vector<bool>& descending, std::size_t& size);
+
+    /// Checks if the data starts like an encoded key. Keys written as JSON text never do
+    static bool is_encoded(const range& in);
+};
+
+}
+
+#endif
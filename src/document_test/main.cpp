@@ -3,6 +3,8 @@
 #include "document/document.hpp"
 #include "document/json_writer.hpp"
 #include "document/json_parser.hpp"
+#include "document/key_encoding.hpp"
+#include "document/document_view.hpp"
 
 #include <boost/type_traits.hpp>
 #include <boost/type_traits/is_arithmetic.hpp>
@@ -155,6 +157,101 @@ void hobbit(const std::string& json) // there and back again
     std::cout << std::endl;
 }
 
+void corrupt_binary(const std::string& what, const std::string& binary)
+{
+    try
+    {
+        falcondb::document d = falcondb::document::from_binary(binary);
+        std::cout << what << ": parsed as " << to_json(d) << std::endl;
+    }
+    catch(const falcondb::exception& e)
+    {
+        std::cout << what << ": " << e.what() << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cout << what << ": UNEXPECTED ERROR " << e.what() << std::endl;
+    }
+}
+
+void binary_hobbit(const falcondb::document& d) // there and back again, in binary
+{
+    std::cout << "binary hobbit: " << std::endl;
+    try
+    {
+        std::string binary = d.to_binary();
+        falcondb::document back = falcondb::document::from_binary(binary);
+
+        std::cout << to_json(d) << " -> " << binary.size() << " bytes -> " << to_json(back)
+            << (back == d ? " (equal)" : " (DIFFERENT)") << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cout << "binary error: " << e.what() << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void view(const std::string& json, const std::string& field) // peek at one field without parsing the rest
+{
+    std::cout << "view: " << json << " [" << field << "] : ";
+    try
+    {
+        falcondb::document d = falcondb::json_parser::parse_doc(json);
+        std::string binary = d.to_binary();
+        falcondb::document_view v = falcondb::document_view::from_binary(binary);
+
+        boost::optional<falcondb::document_view> f = v.find_field(field);
+        if (f)
+        {
+            falcondb::document expected = d.as_object().get_field(field);
+            std::cout << to_json(f->to_document())
+                << (f->to_document() == expected ? " (equal)" : " (DIFFERENT)");
+        }
+        else
+        {
+            std::cout << "absent" << (d.as_object().has_field(field) ? " (WRONG)" : "");
+        }
+        std::cout << ", " << v.size() << " fields, whole: "
+            << (v.to_document() == d ? "equal" : "DIFFERENT") << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cout << "view error: " << e.what() << std::endl;
+    }
+}
+
+void key_order(const falcondb::document& a, const falcondb::document& b)
+{
+    std::string ka = falcondb::key_encoding::encode(a);
+    std::string kb = falcondb::key_encoding::encode(b);
+    int by_doc = a.compare(b);
+    int by_key = ka.compare(kb);
+    bool same = (by_doc < 0) == (by_key < 0) && (by_doc == 0) == (by_key == 0);
+
+    std::cout << to_json(a) << " vs " << to_json(b) << " : " << by_doc
+        << (same ? " (key order ok)" : " (KEY ORDER MISMATCH)")
+        << ", decoded: " << to_json(falcondb::key_encoding::decode(ka)) << std::endl;
+}
+
+// compares [x, a] with [x, b], the second field descending
+void descending_key_order(const falcondb::document& a, const falcondb::document& b)
+{
+    std::vector<bool> descending = { false, true };
+    falcondb::document_list la = { falcondb::document::from(1), a };
+    falcondb::document_list lb = { falcondb::document::from(1), b };
+    std::string ka = falcondb::key_encoding::encode_list(la, descending);
+    std::string kb = falcondb::key_encoding::encode_list(lb, descending);
+    int by_doc = b.compare(a);
+    int by_key = ka.compare(kb);
+    bool same = (by_doc < 0) == (by_key < 0) && (by_doc == 0) == (by_key == 0);
+    bool decoded = falcondb::document(falcondb::key_encoding::decode_list(ka, descending)) == falcondb::document(la);
+
+    std::cout << to_json(a) << " vs " << to_json(b) << " descending : " << by_doc
+        << (same ? " (key order ok)" : " (KEY ORDER MISMATCH)")
+        << (decoded ? ", decoded equal" : ", DECODED DIFFERENT") << std::endl;
+}
+
 int main(int argc, char** argv)
 {
     std::cout << "scalars" << std::endl << std::endl;
@@ -214,6 +311,44 @@ int main(int argc, char** argv)
     hobbit("{}");
     hobbit("{\"data\":[],\"next\":null,\"prev\":null,\"type\":\"leaf\"}");
 
+    binary_hobbit(falcondb::json_parser::parse_doc("[\"moo\", 23.45, true, [1, 2, \"no!\"]]"));
+    binary_hobbit(falcondb::json_parser::parse_doc(" { \"constants\" : { \"pi\":3.14,\"e\":2.7 } , \"natual\":[1,2,3,4,5,6,7,8,9] } "));
+    binary_hobbit(falcondb::json_parser::parse_doc("{\"data\":[],\"next\":null,\"prev\":null,\"type\":\"leaf\"}"));
+    binary_hobbit(falcondb::document_scalar::from(std::int32_t(-7)));
+    binary_hobbit(falcondb::document_scalar::from(std::uint32_t(7)));
+    binary_hobbit(falcondb::document_scalar::from(boost::posix_time::ptime(boost::posix_time::time_from_string("2012-10-17 12:34:56.789"))));
+    binary_hobbit(falcondb::document_scalar::from(boost::posix_time::ptime(boost::posix_time::pos_infin)));
+    corrupt_binary("list count over data size", std::string("\x01\x0b\x05\x00\x00\x00\xff\xff\xff\xff\x0f", 11));
+
+    view("{\"a\":1,\"b\":[1,2,{\"x\":\"y\"}],\"c\":\"moo\",\"d\":null}", "c");
+    view("{\"a\":1,\"b\":[1,2,{\"x\":\"y\"}],\"c\":\"moo\",\"d\":null}", "b");
+    view("{\"a\":1,\"b\":[1,2,{\"x\":\"y\"}],\"c\":\"moo\",\"d\":null}", "bb");
+    view("{\"a\":1,\"b\":[1,2,{\"x\":\"y\"}],\"c\":\"moo\",\"d\":null}", "z");
+    view("{}", "a");
+    std::cout << std::endl;
+
+    std::cout << "key order" << std::endl;
+    key_order(falcondb::document::from(10), falcondb::document::from(9));
+    key_order(falcondb::document::from(-1), falcondb::document::from(std::uint64_t(0)));
+    key_order(falcondb::document::from(2.5), falcondb::document::from(std::int64_t(2)));
+    key_order(falcondb::document::from(1.0), falcondb::document::from(std::int32_t(1)));
+    key_order(falcondb::document::from(std::uint64_t(18446744073709551615ull)), falcondb::document::from(18446744073709551616.0));
+    key_order(falcondb::document::from(std::int64_t(9007199254740993ll)), falcondb::document::from(9007199254740992.0));
+    key_order(falcondb::document::from(std::string("a")), falcondb::document::from(std::string("a\0", 2)));
+    key_order(falcondb::document::from(std::string("ab")), falcondb::document::from(std::string("b")));
+    key_order(falcondb::document::from(5), falcondb::document::from(std::string("5")));
+    key_order(falcondb::document_scalar::null(), falcondb::document::from(false));
+    key_order(falcondb::json_parser::parse_doc("[1, \"a\"]"), falcondb::json_parser::parse_doc("[1, \"a\", null]"));
+    key_order(falcondb::json_parser::parse_doc("[2, 1]"), falcondb::json_parser::parse_doc("[1, 2]"));
+    key_order(falcondb::json_parser::parse_doc("{\"a\":1}"), falcondb::json_parser::parse_doc("{\"a\":1,\"b\":0}"));
+    key_order(falcondb::json_parser::parse_doc("{\"b\":1}"), falcondb::json_parser::parse_doc("[]"));
+    descending_key_order(falcondb::document::from(10), falcondb::document::from(9));
+    descending_key_order(falcondb::document::from(std::string("a")), falcondb::document::from(std::string("a\0", 2)));
+    descending_key_order(falcondb::document::from(std::string("a")), falcondb::document::from(std::string("ab")));
+    descending_key_order(falcondb::document_scalar::null(), falcondb::document::from(std::string("")));
+    descending_key_order(falcondb::json_parser::parse_doc("[1, \"a\"]"), falcondb::json_parser::parse_doc("[1, \"a\", null]"));
+    std::cout << std::endl;
+
     //type traits
 
     std::cout << "type traits" << std::endl;
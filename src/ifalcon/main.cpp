@@ -20,6 +20,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "console_frontend/frontend.hpp"
 
 #include "backend_leveldb/backend.hpp"
+#include "backend_memory/backend.hpp"
 
 #include "dbengine/engine.hpp"
 
@@ -27,17 +28,19 @@ using namespace falcondb;
 
 void help()
 {
-    std::cout << "usage: ifalcon DBPATH" << std::endl;
+    std::cout << "usage: ifalcon [--lazy] DBPATH" << std::endl;
+    std::cout << "  --lazy  open databases on first use" << std::endl;
 }
 
 int main(int argc, char** argv)
 {
-    if (argc < 2)
+    bool lazy = argc > 1 && std::string(argv[1]) == "--lazy";
+    if (argc < 2 + lazy)
     {
         help();
         return 1;
     }
-    std::string arg = argv[1];
+    std::string arg = argv[1 + lazy];
     if (arg == "--help" || arg == "-help")
     {
         help();
@@ -45,9 +48,11 @@ int main(int argc, char** argv)
     }
 
     backend_leveldb::backend backend;
+    backend_memory::backend memory_backend;
 
-    dbengine::engine_config config = { arg };
+    dbengine::engine_config config = { arg, lazy, 0 };
     dbengine::engine engine(config, backend);
+    engine.add_backend("memory", memory_backend);
 
     console_frontend::frontend frontend(engine);
 
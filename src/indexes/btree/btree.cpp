@@ -19,714 +19,1760 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "indexes/btree/btree.hpp"
 
-#include <boost/uuid/random_generator.hpp>
+#include "document/detail/binary_format.hpp"
+#include "document/key_encoding.hpp"
 
+#include <boost/uuid/uuid.hpp>
 
+#include <algorithm>
+#include <list>
 
 namespace falcondb { namespace indexes { namespace btree {
 
-template<typename T>
-std::string optional_to_string(const boost::optional<T>& opt)
+using falcondb::detail::binary_format::varint_size;
+
+// comparisons made by the scan running in this thread
+static thread_local std::size_t scan_comparisons = 0;
+
+namespace detail
+{
+    // node summary
+    struct node_summary
+    {
+        std::uint64_t count;
+        std::string min_key;
+        std::string max_key;
+        document storage_key;
+    };
+
+    // insert result. ther leaf may have been split into two.
+    // Unless changed, the node keeps its key range and is not split, only its count grows by one
+    struct insert_result
+    {
+        bool changed;
+        node_summary left;
+        boost::optional<node_summary> right;
+    };
+
+    // remove result. Unless changed, the node keeps its key range and is not underflowing,
+    // only its count drops by the number removed
+    struct remove_result
+    {
+        std::size_t removed_records;
+        boost::optional<node_summary> node;
+        bool underflow; // the node is less than half full
+        bool changed;
+    };
+
+    // node pinned in the cache, with its latch held shared, exclusively or not at all
+    class latched_node
+    {
+    public:
+
+        latched_node() : _mode(none) {}
+        explicit latched_node(node_cache::pin pin) : _pin(std::move(pin)), _mode(none) {}
+
+        latched_node(latched_node&& other) noexcept
+        :
+            _pin(std::move(other._pin)),
+            _mode(other._mode)
+        {
+            other._mode = none;
+        }
+
+        latched_node& operator=(latched_node&& other) noexcept
+        {
+            if (this != &other)
+            {
+                unlatch();
+                _pin = std::move(other._pin);
+                _mode = other._mode;
+                other._mode = none;
+            }
+            return *this;
+        }
+
+        ~latched_node() { unlatch(); }
+
+        void latch_shared() { _pin.latch().lock_shared(); _mode = shared; }
+        void latch_exclusive() { _pin.latch().lock(); _mode = exclusive; }
+
+        bool try_latch_shared()
+        {
+            if (!_pin.latch().try_lock_shared()) return false;
+            _mode = shared;
+            return true;
+        }
+
+        bool try_latch_exclusive()
+        {
+            if (!_pin.latch().try_lock()) return false;
+            _mode = exclusive;
+            return true;
+        }
+
+        void unlatch()
+        {
+            if (_mode == shared) _pin.latch().unlock_shared();
+            if (_mode == exclusive) _pin.latch().unlock();
+            _mode = none;
+        }
+
+        // waits until the latch is free, without keeping it
+        void wait_shared() { latch_shared(); unlatch(); }
+        void wait_exclusive() { latch_exclusive(); unlatch(); }
+
+        bool held() const { return _mode != none; }
+        bool exclusively() const { return _mode == exclusive; }
+
+        node& operator*() const { return *_pin; }
+        node* operator->() const { return &*_pin; }
+        const node_cache::pin& pin() const { return _pin; }
+
+    private:
+
+        enum mode { none, shared, exclusive };
+
+        node_cache::pin _pin;
+        mode _mode;
+    };
+
+    // interior node on the way to a leaf, and the child followed
+    struct path_step
+    {
+        latched_node node;
+        std::size_t child;
+    };
+
+    // nodes used by a restructuring change, kept pinned until it's done. The tree structure changes
+    // only by it, so interior nodes are read unlatched. Changed nodes are latched exclusively
+    class restructuring
+    {
+    public:
+
+        explicit restructuring(node_cache& nodes) : _nodes(nodes) {}
+
+        node& read(const document& key) { return *find(key); }
+
+        node& change(const document& key)
+        {
+            latched_node& n = find(key);
+            if (!n.exclusively())
+            {
+                n.latch_exclusive();
+            }
+            return *n;
+        }
+
+        // the count of an unchanged child, updated atomically, the node may be unlatched
+        void add_to_count(const document& key, std::size_t i, std::int64_t delta)
+        {
+            latched_node& n = find(key);
+            n->counts[i].add(delta);
+            _nodes.mark_dirty(n.pin());
+        }
+
+    private:
+
+        latched_node& find(const document& key)
+        {
+            for(latched_node& n : _used)
+            {
+                if (n.pin().key() == key)
+                {
+                    return n;
+                }
+            }
+            _used.push_back(latched_node(_nodes.get_pinned(key)));
+            return _used.back();
+        }
+
+        node_cache& _nodes;
+        std::list<latched_node> _used;
+    };
+
+}
+
+static detail::node_summary summarize(const node& n, const document& storage_key)
 {
-    std::ostringstream ss;
-    if (opt) ss << *opt;
-    else ss << "none";
-    return ss.str();
+    assert(n.size() > 0);
+    return detail::node_summary {
+        n.count(),
+        n.keys.front(),
+        n.is_leaf() ? n.keys.back() : n.max_keys.back(),
+        storage_key };
 }
 
-namespace detail
+static void set_child(node& n, std::size_t i, const detail::node_summary& s)
+{
+    n.set_child(i, s.min_key, s.max_key, s.count, s.storage_key);
+}
+
+static void insert_child(node& n, std::size_t i, const detail::node_summary& s)
+{
+    n.insert_child(i, s.min_key, s.max_key, s.count, s.storage_key);
+}
+
+btree::node_limits::node_limits(std::size_t max_items)
+:
+    max_items(max_items),
+    leaf_bytes(0),
+    interior_bytes(0)
+{
+}
+
+btree::node_limits::node_limits(std::size_t max_items, std::size_t leaf_bytes, std::size_t interior_bytes)
+:
+    max_items(max_items),
+    leaf_bytes(leaf_bytes),
+    interior_bytes(interior_bytes)
+{
+}
+
+bool btree::node_limits::overflows(const node& n) const
+{
+    if (n.size() <= (n.is_leaf() ? 1u : 2u))
+        return false;
+    if (n.size() > max_items)
+        return true;
+    return bytes(n) > 0 && n.encoded_size() > bytes(n);
+}
+
+bool btree::node_limits::underflows(const node& n) const
+{
+    return n.size() < max_items / 2 && (bytes(n) == 0 || 2 * n.encoded_size() < bytes(n));
+}
+
+std::size_t btree::node_limits::split_point(const node& n) const
+{
+    assert(n.size() > 1);
+    if (bytes(n) == 0)
+    {
+        return n.size() / 2;
+    }
+
+    // the first entry of the upper half no longer shares a prefix with its predecessor, close enough
+    std::vector<std::size_t> sizes(n.size());
+    std::size_t total = 0;
+    for(std::size_t i = 0; i < n.size(); ++i)
+    {
+        sizes[i] = n.entry_size(i);
+        total += sizes[i];
+    }
+    std::size_t lower = 0;
+    std::size_t i = 0;
+    while(i + 1 < n.size() && 2 * (lower + sizes[i]) <= total)
+    {
+        lower += sizes[i++];
+    }
+    return std::max<std::size_t>(i, 1);
+}
+
+btree::builder::builder(
+    interfaces::document_storage& storage,
+    const document& storage_key,
+    const node_limits& limits,
+    std::uint64_t first_node_id)
+:
+    _storage(storage),
+    _storage_key(storage_key),
+    _limits(limits),
+    _node_key_prefix(node_key_prefix(storage_key)),
+    _next_node_id(first_node_id),
+    _leaf(node::create_leaf()),
+    _leaf_key(allocate_node_key()),
+    _leaf_entries_size(0),
+    _size(0)
+{
+}
+
+void btree::builder::add(const range& key, const range& value)
+{
+    assert(_leaf.size() == 0 || !(key.to_string() < _leaf.keys.back()));
+    _leaf.keys.push_back(key.to_string());
+    _leaf.values.push_back(value.to_string());
+    _leaf_entries_size += _leaf.entry_size(_leaf.size() - 1);
+
+    // the leaf size is tracked as it grows, the entries are not measured again
+    if (_leaf.size() > 1 && (_leaf.size() > _limits.max_items || (_limits.leaf_bytes > 0 && leaf_size() > _limits.leaf_bytes)))
+    {
+        // the entry starts the next leaf
+        node last = _leaf.split(_leaf.size() - 1);
+        close_leaf();
+        _leaf.append(last);
+        _leaf_entries_size = _leaf.entry_size(0);
+    }
+    ++_size;
+}
+
+std::size_t btree::builder::leaf_size() const
+{
+    // the next leaf id has the size of this one's
+    return 2 + varint_size(_leaf.size()) + _leaf_entries_size + node::id_size(_leaf.prev) + node::id_size(_leaf_key);
+}
+
+void btree::builder::close_leaf()
+{
+    // the next leaf is known to exist only now
+    document next_key = allocate_node_key();
+    _leaf.next = next_key;
+    _storage.write(_leaf_key, _leaf.to_document());
+    add_to_level(0, summarize(_leaf, _leaf_key));
+
+    _leaf = node::create_leaf();
+    _leaf.prev = _leaf_key;
+    _leaf_key = next_key;
+    _leaf_entries_size = 0;
+}
+
+void btree::builder::add_to_level(std::size_t level, const detail::node_summary& summary)
+{
+    if (_levels.size() == level)
+    {
+        _levels.push_back(node::create_interior());
+    }
+
+    insert_child(_levels[level], _levels[level].size(), summary);
+    if (_limits.overflows(_levels[level]))
+    {
+        // the child starts the next node
+        _levels[level].erase(_levels[level].size() - 1);
+        document key = allocate_node_key();
+        _storage.write(key, _levels[level].to_document());
+        detail::node_summary full = summarize(_levels[level], key);
+        _levels[level] = node::create_interior();
+        add_to_level(level + 1, full);
+        insert_child(_levels[level], 0, summary);
+    }
+}
+
+btree btree::builder::finish(bool unique, std::size_t cached_leaves)
+{
+    document root = _leaf_key;
+    _storage.write(_leaf_key, _leaf.to_document());
+
+    if (!_levels.empty())
+    {
+        // close the partially filled nodes, bottom-up. The top level always has at least two children
+        add_to_level(0, summarize(_leaf, _leaf_key));
+        for(std::size_t level = 0; level < _levels.size(); ++level)
+        {
+            document key = allocate_node_key();
+            _storage.write(key, _levels[level].to_document());
+            if (level + 1 == _levels.size())
+            {
+                assert(_levels[level].size() > 1);
+                root = key;
+            }
+            else
+            {
+                add_to_level(level + 1, summarize(_levels[level], key));
+            }
+        }
+    }
+
+    document_object meta;
+    meta.set_field("root", root);
+    meta.set_field("next_node_id", document::from(_next_node_id));
+    _storage.write(_storage_key, meta);
+
+    return btree(_storage, _storage_key, unique, _limits, cached_leaves);
+}
+
+btree btree::load(interfaces::document_storage& storage,  const document& storage_key, bool unique, const node_limits& limits, std::size_t cached_leaves)
+{
+    return btree(storage, storage_key, unique, limits, cached_leaves);
+}
+
+btree btree::create(interfaces::document_storage& storage,  const document& storage_key, bool unique, const node_limits& limits, std::size_t cached_leaves)
+{
+    document root_storage_key = node_key(node_key_prefix(storage_key), 0);
+    document_object meta;
+    meta.set_field("root", root_storage_key);
+    meta.set_field("next_node_id", document::from(std::uint64_t(1)));
+    storage.write(root_storage_key, node::create_leaf().to_document());
+    storage.write(storage_key, meta);
+
+    return btree(storage, storage_key, unique, limits, cached_leaves);
+}
+
+btree::btree(btree&& other)
+:
+    _storage(other._storage),
+    _storage_key(std::move(other._storage_key)),
+    _unique(other._unique),
+    _limits(other._limits),
+    _node_key_prefix(other._node_key_prefix),
+
+    _root_storage_key(std::move(other._root_storage_key)),
+    _next_node_id(other._next_node_id),
+    _meta_dirty(other._meta_dirty),
+    _nodes(std::move(other._nodes)),
+    _scans(other._scans.load()),
+    _comparisons(other._comparisons.load()),
+    _last_scan_comparisons(other._last_scan_comparisons.load())
+{
+}
+
+btree::btree(interfaces::document_storage& storage, const document& storage_key, bool unique, const node_limits& limits, std::size_t cached_leaves)
+:
+    _storage(storage),
+    _storage_key(storage_key),
+    _unique(unique),
+    _limits(limits),
+    _node_key_prefix(node_key_prefix(storage_key)),
+
+    _root_storage_key(document_scalar::null()),
+    _next_node_id(0),
+    _meta_dirty(false),
+    _nodes(storage, cached_leaves),
+    _scans(0),
+    _comparisons(0),
+    _last_scan_comparisons(0)
+{
+    load_meta_data();
+}
+
+void btree::flush()
+{
+    // the nodes are written under their latches, the root and the node ids are kept by restructuring changes
+    boost::mutex::scoped_lock lock(_restructuring_mutex);
+    flush_nodes();
+}
+
+void btree::flush_nodes()
+{
+    _nodes.flush();
+    if (_meta_dirty)
+    {
+        store_meta_data();
+    }
+}
+
+void btree::discard()
+{
+    boost::mutex::scoped_lock lock(_restructuring_mutex);
+    _nodes.clear();
+    load_meta_data();
+}
+
+btree::stats btree::get_stats() const
+{
+    return stats { _scans, _comparisons, _last_scan_comparisons };
+}
+
+void btree::load_meta_data()
+{
+    document_object meta = _nodes.read(_storage_key);
+    _root_storage_key = meta.get_field("root");
+    // trees written by older versions have random node keys, no sequence to continue
+    _next_node_id = meta.has_field("next_node_id") ? meta.get_field("next_node_id").as_scalar().to_number<std::uint64_t>() : 0;
+    _meta_dirty = false;
+}
+
+void btree::store_meta_data()
+{
+    document_object meta;
+    meta.set_field("root", root_key());
+    meta.set_field("next_node_id", document::from(_next_node_id));
+    _nodes.write(_storage_key, meta);
+    _meta_dirty = false;
+}
+
+std::string btree::encode_key(const document_list& key)
+{
+    return key_encoding::encode(key);
+}
+
+bool btree::key_less(const std::string& a, const std::string& b)
+{
+    ++scan_comparisons;
+    return a < b;
+}
+
+std::size_t btree::lower_bound(const std::vector<std::string>& keys, std::size_t first, std::size_t last, const std::string& key)
+{
+    return std::lower_bound(
+        keys.begin() + first, keys.begin() + last,
+        key,
+        [this](const std::string& a, const std::string& b) { return key_less(a, b); }) - keys.begin();
+}
+
+std::size_t btree::upper_bound(const std::vector<std::string>& keys, std::size_t first, std::size_t last, const std::string& key)
+{
+    return std::upper_bound(
+        keys.begin() + first, keys.begin() + last,
+        key,
+        [this](const std::string& a, const std::string& b) { return key_less(a, b); }) - keys.begin();
+}
+
+document btree::root_key() const
+{
+    boost::mutex::scoped_lock lock(_root_mutex);
+    return _root_storage_key;
+}
+
+void btree::set_root(const document& key)
+{
+    boost::mutex::scoped_lock lock(_root_mutex);
+    _root_storage_key = key;
+    _meta_dirty = true;
+}
+
+detail::latched_node btree::latch_root(bool exclusive)
+{
+    for(;;)
+    {
+        detail::latched_node root;
+        {
+            // pinned before the key can change, so a root replaced meanwhile is still there
+            boost::mutex::scoped_lock lock(_root_mutex);
+            root = detail::latched_node(_nodes.get_pinned(_root_storage_key));
+        }
+        if (exclusive)
+            root.latch_exclusive();
+        else
+            root.latch_shared();
+
+        if (root.pin().key() == root_key())
+        {
+            return root;
+        }
+    }
+}
+
+template<typename Choose>
+detail::latched_node btree::try_descend(Choose choose)
+{
+    detail::latched_node current = latch_root(false);
+    while(!current->is_leaf())
+    {
+        detail::latched_node child(_nodes.get_pinned(current->children[choose(*current)]));
+        if (!child.try_latch_shared())
+        {
+            current = detail::latched_node();
+            child.wait_shared();
+            return detail::latched_node();
+        }
+        current = std::move(child);
+    }
+    return current;
+}
+
+template<typename Choose>
+detail::latched_node btree::descend(Choose choose)
+{
+    for(;;)
+    {
+        detail::latched_node leaf = try_descend(choose);
+        if (leaf.held())
+        {
+            return leaf;
+        }
+    }
+}
+
+template<typename Choose>
+bool btree::descend_to_change(Choose choose, std::vector<detail::path_step>& path, detail::latched_node& leaf)
+{
+    path.clear();
+    leaf = detail::latched_node();
+    detail::latched_node current = latch_root(false);
+    if (current->is_leaf())
+    {
+        current = detail::latched_node();
+        leaf = latch_root(true);
+        if (!leaf->is_leaf())
+        {
+            // the root has split meanwhile
+            leaf = detail::latched_node();
+            return false;
+        }
+        return true;
+    }
+
+    for(;;)
+    {
+        std::size_t i = choose(*current);
+        detail::latched_node child(_nodes.get_pinned(current->children[i]));
+        bool taken = child.try_latch_shared();
+        bool is_leaf = taken && child->is_leaf();
+        if (is_leaf)
+        {
+            // the parent is latched, so the leaf stays in place
+            child.unlatch();
+            taken = child.try_latch_exclusive();
+        }
+        if (!taken)
+        {
+            path.clear();
+            current = detail::latched_node();
+            if (is_leaf)
+                child.wait_exclusive();
+            else
+                child.wait_shared();
+            return false;
+        }
+
+        path.push_back(detail::path_step { std::move(current), i });
+        if (is_leaf)
+        {
+            leaf = std::move(child);
+            return true;
+        }
+        current = std::move(child);
+    }
+}
+
+void btree::add_to_counts(const std::vector<detail::path_step>& path, std::int64_t delta)
+{
+    // the path stays latched shared, so no restructuring recomputes the counts meanwhile
+    for(auto it = path.rbegin(); it != path.rend(); ++it)
+    {
+        it->node->counts[it->child].add(delta);
+        _nodes.mark_dirty(it->node.pin());
+    }
+}
+
+std::size_t btree::insert_child_index(const node& n, const std::string& key)
+{
+    // the last node where min <= key, keys below the minimum go to the first node
+    std::size_t i = std::upper_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin();
+    return i > 0 ? i - 1 : 0;
+}
+
+std::size_t btree::remove_child_index(const node& n, const std::string& key)
+{
+    // duplicates of the key may span several nodes, starting with the last one with min < key
+    std::size_t i = std::lower_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin();
+    return i > 0 ? i - 1 : 0;
+}
+
+document_list btree::scan(
+    const boost::optional<document_list>& min,
+    bool min_inclusive,
+    const boost::optional<document_list>& max,
+    bool max_inclusive,
+    std::size_t limit,
+    std::size_t skip)
+{
+    boost::optional<std::string> min_key;
+    boost::optional<std::string> max_key;
+    if (min) min_key = encode_key(*min);
+    if (max) max_key = encode_key(*max);
+    return scan_encoded(min_key, min_inclusive, max_key, max_inclusive, limit, skip);
+}
+
+document_list btree::scan_encoded(
+    const boost::optional<std::string>& min_key,
+    bool min_inclusive,
+    const boost::optional<std::string>& max_key,
+    bool max_inclusive,
+    std::size_t limit,
+    std::size_t skip)
+{
+    scan_comparisons = 0;
+
+    document_list result;
+    if (skip > 0)
+    {
+        // the first entry is found by the subtree counts, the skipped ones are not read
+        std::uint64_t below_min = min_key ? rank(*min_key, !min_inclusive) : 0;
+        result = tree_scan(below_min + skip, boost::none, true, max_key, max_inclusive, limit);
+    }
+    else
+    {
+        result = tree_scan(boost::none, min_key, min_inclusive, max_key, max_inclusive, limit);
+    }
+    _nodes.trim();
+
+    ++_scans;
+    _comparisons += scan_comparisons;
+    _last_scan_comparisons = scan_comparisons;
+    return result;
+}
+
+document_list btree::tree_scan(
+    const boost::optional<std::uint64_t>& position,
+    const boost::optional<std::string>& min,
+    bool min_inclusive,
+    const boost::optional<std::string>& max,
+    bool max_inclusive,
+    std::size_t limit)
+{
+    document_list result;
+
+    // if the scan starts over, it continues past 'passed' entries with key 'from'
+    boost::optional<std::string> from = min;
+    bool from_inclusive = min_inclusive;
+    std::size_t passed = 0;
+
+    detail::latched_node leaf;
+    bool positioning = false;
+    std::size_t to_pass = 0;
+    std::size_t begin = 0;
+    while(limit > 0)
+    {
+        if (!leaf.held())
+        {
+            if (position && passed == 0)
+            {
+                std::pair<detail::latched_node, std::size_t> first = locate(*position);
+                leaf = std::move(first.first);
+                begin = first.second;
+            }
+            else
+            {
+                // start at the last child with min < search.min, keys equal to search.min may end the
+                // preceding node, the leaf scan continues through the following ones.
+                // The child may end below search.min, then the next one is used
+                leaf = descend(
+                    [&](const node& n)
+                    {
+                        if (!from)
+                            return std::size_t(0);
+                        std::size_t i = lower_bound(n.keys, 0, n.size(), *from);
+                        if (i > 0)
+                            --i;
+                        if (i + 1 < n.size() && key_less(n.max_keys[i], *from))
+                            ++i;
+                        return i;
+                    });
+                positioning = bool(from);
+                to_pass = passed;
+                begin = 0;
+            }
+        }
+        const node& n = *leaf;
+
+        // leaves are positioned until the first key above min is found, the following ones are scanned from the beginning
+        if (positioning)
+        {
+            begin = from_inclusive
+                ? lower_bound(n.keys, 0, n.size(), *from)
+                : upper_bound(n.keys, 0, n.size(), *from);
+            for(; to_pass > 0 && begin < n.size() && n.keys[begin] == *from; --to_pass)
+            {
+                ++begin;
+            }
+            positioning = (begin == n.size());
+        }
+
+        std::size_t end = n.size();
+        if (max)
+        {
+            end = max_inclusive
+                ? upper_bound(n.keys, begin, n.size(), *max)
+                : lower_bound(n.keys, begin, n.size(), *max);
+        }
+
+        std::size_t taken = std::min(limit, end - begin);
+        limit -= taken;
+        for(std::size_t i = begin; i < begin + taken; ++i)
+        {
+            result.push_back(document::from_binary(n.values[i]));
+        }
+
+        if (taken > 0)
+        {
+            const std::string& last = n.keys[begin + taken - 1];
+            std::size_t run = 1;
+            while(run < taken && n.keys[begin + taken - 1 - run] == last)
+            {
+                ++run;
+            }
+            passed = (run == taken && from && from_inclusive && *from == last) ? passed + run : run;
+            from = last;
+            from_inclusive = true;
+        }
+
+        // max crossed in this leaf
+        if (limit == 0 || end != n.size() || n.next.is_null())
+        {
+            break;
+        }
+
+        detail::latched_node next(_nodes.get_pinned(n.next));
+        if (!next.try_latch_shared())
+        {
+            leaf = detail::latched_node();
+            next.wait_shared();
+            continue;
+        }
+        leaf = std::move(next);
+        begin = 0;
+    }
+    return result;
+}
+
+std::uint64_t btree::count_encoded(
+    const boost::optional<std::string>& min,
+    bool min_inclusive,
+    const boost::optional<std::string>& max,
+    bool max_inclusive)
+{
+    std::uint64_t below_min = min ? rank(*min, !min_inclusive) : 0;
+    std::uint64_t up_to_max = max ? rank(*max, max_inclusive) : size();
+    _nodes.trim();
+
+    return up_to_max > below_min ? up_to_max - below_min : 0;
+}
+
+std::uint64_t btree::rank_encoded(const std::string& key, bool inclusive)
+{
+    std::uint64_t result = rank(key, inclusive);
+    _nodes.trim();
+    return result;
+}
+
+std::uint64_t btree::size()
+{
+    return latch_root(false)->count();
+}
+
+std::uint64_t btree::rank(const std::string& key, bool inclusive)
+{
+    // descend to the first child with entries not below the key (above, if inclusive).
+    // The children before it are below entirely, the ones after it start above.
+    // Past the last child, all entries are below, the last leaf counts its own
+    for(;;)
+    {
+        std::uint64_t result = 0;
+        detail::latched_node leaf = try_descend(
+            [&](const node& n)
+            {
+                std::size_t i = inclusive
+                    ? upper_bound(n.max_keys, 0, n.size(), key)
+                    : lower_bound(n.max_keys, 0, n.size(), key);
+                i = std::min(i, n.size() - 1);
+                for(std::size_t c = 0; c < i; ++c)
+                {
+                    result += n.counts[c];
+                }
+                return i;
+            });
+        if (leaf.held())
+        {
+            return result + (inclusive
+                ? upper_bound(leaf->keys, 0, leaf->size(), key)
+                : lower_bound(leaf->keys, 0, leaf->size(), key));
+        }
+    }
+}
+
+std::pair<detail::latched_node, std::size_t> btree::locate(std::uint64_t n)
+{
+    for(;;)
+    {
+        std::uint64_t remaining = n;
+        detail::latched_node leaf = try_descend(
+            [&](const node& current)
+            {
+                std::size_t i = 0;
+                while(i + 1 < current.size() && remaining >= current.counts[i])
+                {
+                    remaining -= current.counts[i];
+                    ++i;
+                }
+                return i;
+            });
+        if (leaf.held())
+        {
+            std::size_t i = std::min<std::uint64_t>(remaining, leaf->size());
+            return std::make_pair(std::move(leaf), i);
+        }
+    }
+}
+
+btree::cursor::cursor(btree& tree)
+:
+    _tree(tree),
+    _leaf(node::create_leaf()),
+    _leaf_key(document_scalar::null()),
+    _stamp(0),
+    _position(0),
+    _duplicates(0)
+{
+}
+
+void btree::cursor::seek_to_first()
+{
+    copy_leaf(_tree.descend([](const node&) { return std::size_t(0); }));
+    _position = 0;
+    _duplicates = 0;
+    _tree._nodes.trim();
+}
+
+void btree::cursor::seek_to_last()
+{
+    copy_leaf(_tree.descend([](const node& n) { return n.size() - 1; }));
+    _position = _leaf.size() > 0 ? _leaf.size() - 1 : 0;
+    _duplicates = 0;
+    _tree._nodes.trim();
+}
+
+void btree::cursor::seek_for_prev(const std::string& key, bool inclusive)
+{
+    seek_for_prev_leaf(key, inclusive);
+    _tree._nodes.trim();
+}
+
+void btree::cursor::seek_for_prev_leaf(const std::string& key, bool inclusive)
+{
+    // descend to the last child starting at or below the key: the entries following
+    // it in the next child are all above the key
+    copy_leaf(_tree.descend(
+        [&](const node& n)
+        {
+            std::size_t i = inclusive
+                ? _tree.upper_bound(n.keys, 0, n.size(), key)
+                : _tree.lower_bound(n.keys, 0, n.size(), key);
+            return i > 0 ? i - 1 : 0;
+        }));
+    _duplicates = 0;
+
+    std::size_t end = inclusive
+        ? _tree.upper_bound(_leaf.keys, 0, _leaf.size(), key)
+        : _tree.lower_bound(_leaf.keys, 0, _leaf.size(), key);
+    // nothing at or below the key: past the beginning
+    _position = end > 0 ? end - 1 : _leaf.size();
+}
+
+void btree::cursor::seek_to_position(std::uint64_t n)
+{
+    std::pair<detail::latched_node, std::size_t> located = _tree.locate(n);
+    copy_leaf(located.first);
+    _position = located.second;
+    located.first = detail::latched_node();
+
+    // entries with the same key before this one count as passed, for position()
+    std::uint64_t below = valid() ? _tree.rank(key(), false) : n;
+    _duplicates = n > below ? n - below : 0;
+    _tree._nodes.trim();
+}
+
+void btree::cursor::seek(const std::string& key, bool inclusive)
+{
+    seek_latched(key, inclusive);
+    _tree._nodes.trim();
+}
+
+detail::latched_node btree::cursor::seek_latched(const std::string& key, bool inclusive)
+{
+    for(;;)
+    {
+        // descend as the scan does: the last child starting below the key, unless it ends below it
+        detail::latched_node leaf = _tree.descend(
+            [&](const node& n)
+            {
+                std::size_t i = _tree.lower_bound(n.keys, 0, n.size(), key);
+                if (i > 0)
+                    --i;
+                if (i + 1 < n.size() && _tree.key_less(n.max_keys[i], key))
+                    ++i;
+                return i;
+            });
+        copy_leaf(leaf);
+        _duplicates = 0;
+
+        // equal keys may continue in the following leaves
+        for(;;)
+        {
+            _position = inclusive
+                ? _tree.lower_bound(_leaf.keys, 0, _leaf.size(), key)
+                : _tree.upper_bound(_leaf.keys, 0, _leaf.size(), key);
+            if (_position < _leaf.size() || _leaf.next.is_null())
+                return leaf;
+            if (!move_to_next_leaf(leaf))
+                break;
+        }
+    }
+}
+
+void btree::cursor::next()
+{
+    assert(valid());
+    std::string previous = _leaf.keys[_position];
+    std::size_t duplicates = _duplicates;
+
+    ++_position;
+    if (_position == _leaf.size() && !_leaf.next.is_null())
+    {
+        {
+            // the leaf link is followed if the leaf is unchanged since copied. Otherwise it may be stale,
+            // and the entry following the last one returned is found again
+            detail::latched_node current = latch_copied_leaf();
+            if (!current.held() || !skip_exhausted_leaves(current))
+            {
+                current = detail::latched_node();
+                resume_from(previous, duplicates + 1);
+            }
+        }
+        _tree._nodes.trim();
+    }
+
+    if (valid() && _leaf.keys[_position] == previous)
+        _duplicates = duplicates + 1;
+    else
+        _duplicates = 0;
+}
+
+void btree::cursor::prev()
+{
+    assert(valid());
+    std::string previous = _leaf.keys[_position];
+    std::string previous_value = _leaf.values[_position];
+    std::size_t duplicates = _duplicates;
+
+    if (!step_back())
+    {
+        // as in next(): the entry preceding the last one returned is found again.
+        // Inserted duplicates go to the end of the run, so it is looked up by value first
+        for(;;)
+        {
+            seek_for_prev_leaf(previous, true);
+            bool moved = true;
+            while(moved && valid() && key() == previous && _leaf.values[_position] != previous_value)
+            {
+                moved = step_back();
+            }
+            if (moved && valid() && key() == previous)
+            {
+                moved = step_back();
+            }
+            else if (moved)
+            {
+                // removed meanwhile: counted from the end of the run
+                seek_for_prev_leaf(previous, true);
+                for(std::size_t skipped = 0; moved && skipped <= duplicates && valid() && key() == previous; ++skipped)
+                {
+                    moved = step_back();
+                }
+            }
+            if (moved)
+                break;
+        }
+        _tree._nodes.trim();
+    }
+
+    if (valid() && _leaf.keys[_position] == previous)
+        _duplicates = duplicates + 1;
+    else
+        _duplicates = 0;
+}
+
+bool btree::cursor::step_back()
 {
-    // node summary
-    struct node_summary
+    if (_position > 0)
     {
-        std::size_t count;
-        document_list min_key;
-        document_list max_key;
-        document storage_key;
-    };
-
-    // insert result. ther leaf may have been split into two
-    struct insert_result
+        --_position;
+        return true;
+    }
+    if (_leaf.prev.is_null())
     {
-        node_summary left;
-        boost::optional<node_summary> right;
-    };
+        _position = _leaf.size();
+        return true;
+    }
 
-    // remove result
-    struct remove_result
+    // right to left, against the order of the leaf scans, so the latch is only tried
+    detail::latched_node current = latch_copied_leaf();
+    if (!current.held())
     {
-        std::size_t removed_records;
-        boost::optional<node_summary> node;
-    };
+        return false;
+    }
+    detail::latched_node previous(_tree._nodes.get_pinned(_leaf.prev));
+    if (!previous.try_latch_shared())
+    {
+        current = detail::latched_node();
+        previous.wait_shared();
+        return false;
+    }
 
+    // leaves other than the root are never empty
+    copy_leaf(previous);
+    _position = _leaf.size() - 1;
+    return true;
 }
 
-btree btree::load(interfaces::document_storage& storage,  const document& storage_key, bool unique, std::size_t items_per_leaf)
+document btree::cursor::value() const
 {
-    return btree(storage, storage_key, unique, items_per_leaf);
+    assert(valid());
+    return document::from_binary(_leaf.values[_position]);
 }
 
-btree btree::create(interfaces::document_storage& storage,  const document& storage_key, bool unique, std::size_t items_per_leaf)
+document btree::cursor::position() const
 {
-    document root_doc = create_leaf();
-    document root_storage_key = generate_key();
-    document_object meta;
-    meta.set_field("root", root_storage_key);
-    storage.write(root_storage_key, root_doc);
-    storage.write(storage_key, meta);
-
-    return btree(storage, storage_key, unique, items_per_leaf);
+    assert(valid());
+    document_object result;
+    result.set_field("key", document_scalar::from(key()));
+    result.set_field("passed", document_scalar::from(std::uint64_t(_duplicates + 1)));
+    return result;
 }
 
-btree::btree(btree&& other)
-:
-    _storage(other._storage),
-    _storage_key(std::move(other._storage_key)),
-    _unique(other._unique),
-    _items_per_leaf(other._items_per_leaf),
-
-    _root_storage_key(document_scalar::null())
+void btree::cursor::resume(const document& position)
 {
-    load_meta_data();
-}
-
-btree::btree(interfaces::document_storage& storage, const document& storage_key, bool unique, std::size_t items_per_leaf)
-:
-    _storage(storage),
-    _storage_key(storage_key),
-    _unique(unique),
-    _items_per_leaf(items_per_leaf),
+    const document_object& as_obj = position.as_object();
+    std::string key = as_obj.get_field("key").as<std::string>();
+    std::uint64_t passed = as_obj.get_field("passed").as_scalar().to_number<std::uint64_t>();
 
-    _root_storage_key(document_scalar::null())
-{
-    load_meta_data();
+    _duplicates = resume_from(key, passed);
+    _tree._nodes.trim();
 }
 
-void btree::load_meta_data()
+std::size_t btree::cursor::resume_from(const std::string& key, std::uint64_t passed)
 {
-    document_object meta = _storage.read(_storage_key);
-    _root_storage_key = meta.get_field("root");
-}
+    for(;;)
+    {
+        detail::latched_node leaf = seek_latched(key, true);
 
-void btree::store_meta_data()
-{
-    document_object meta;
-    meta.set_field("root", _root_storage_key);
-    _storage.write(_storage_key, meta);
+        std::size_t skipped = 0;
+        bool moved = true;
+        for(; moved && skipped < passed && valid() && this->key() == key; ++skipped)
+        {
+            ++_position;
+            moved = skip_exhausted_leaves(leaf);
+        }
+        if (moved)
+        {
+            return valid() && this->key() == key ? skipped : 0;
+        }
+    }
 }
 
-document_list btree::scan(
-    const boost::optional<document_list>& min,
-    bool min_inclusive,
-    const boost::optional<document_list>& max,
-    bool max_inclusive,
-    std::size_t limit,
-    std::size_t skip)
+void btree::cursor::copy_leaf(const detail::latched_node& leaf)
 {
-//    std::cout << "===== tree node scan =======" << std::endl;
-//    std::cout << "min: " << optional_to_string(min) << ", max: " << optional_to_string(max) << std::endl;
-//    std::cout << "skip: " << skip << ", limit: " << limit << std::endl;
-//    std::cout << std::endl;
-
-    document_object node = _storage.read(_root_storage_key);
-    return tree_scan(node, min, min_inclusive, max, max_inclusive, limit, skip);
+    _leaf = *leaf;
+    _leaf_key = leaf.pin().key();
+    _stamp = leaf.pin().stamp();
 }
 
-document_list btree::tree_scan(
-    const document_object& node,
-    const boost::optional<document_list>& min,
-    bool min_inclusive,
-    const boost::optional<document_list>& max,
-    bool max_inclusive,
-    std::size_t limit,
-    std::size_t skip)
+detail::latched_node btree::cursor::latch_copied_leaf()
 {
-    if (node.get_field("type").as_scalar().as<std::string>() == "leaf")
+    // the storage is not read: a leaf evicted since is taken as changed
+    detail::latched_node leaf(_tree._nodes.find_pinned(_leaf_key));
+    if (!leaf.pin())
     {
-        return tree_scan_leaf(node, min, min_inclusive, max, max_inclusive, limit, skip);
+        return leaf;
     }
-    else
+    leaf.latch_shared();
+    if (leaf.pin().removed() || leaf.pin().stamp() != _stamp)
     {
-        return tree_scan_interior(node, min, min_inclusive, max, max_inclusive, limit, skip);
+        return detail::latched_node();
     }
+    return leaf;
 }
 
-document_list btree::tree_scan_interior(
-    const document_object& node,
-    const boost::optional<document_list>& min,
-    bool min_inclusive,
-    const boost::optional<document_list>& max,
-    bool max_inclusive,
-    std::size_t limit,
-    std::size_t skip)
+bool btree::cursor::move_to_next_leaf(detail::latched_node& current)
 {
-    /*
-    std::cout << "interior node scan:" << std::endl;
-    std::cout << "min: " << optional_to_string(min) << ", max: " << optional_to_string(max) << std::endl;
-    std::cout << "skip: " << skip << ", limit: " << limit << std::endl;
-    std::cout << "node: " << node << std::endl;
-    std::cout << std::endl;
-    */
-
-    const document_list& data = node.get_field("data");
-    document_list::const_iterator it = data.begin();
-
-    // boundary check - if max below colelction's min or min above max - return immediately
-    if ( (min && *min > data.back().as_object().get_field("max").as_list())
-        ||
-        (max && *max < data.front().as_object().get_field("min").as_list()))
+    detail::latched_node next(_tree._nodes.get_pinned(_leaf.next));
+    if (!next.try_latch_shared())
     {
-        return document_list();
+        current = detail::latched_node();
+        next.wait_shared();
+        return false;
     }
+    current = std::move(next);
+    copy_leaf(current);
+    return true;
+}
 
-    // if min is defined, look for node with min <= thatn the one
-    if (min)
+bool btree::cursor::skip_exhausted_leaves(detail::latched_node& current)
+{
+    while(_position == _leaf.size() && !_leaf.next.is_null())
     {
-        document_object search;
-        search.set_field("min", *min);
-        if (min_inclusive)
-        {
-            // needed: last element with min <= search.min
-            // this is an equivalent of looking from the back for first with search.min > min
-            auto rit = std::upper_bound(
-                data.rbegin(), data.rend(),
-                search,
-                [] (const document& a, const document& b)
-                {
-                    return b.as_object().get_field("min") < a.as_object().get_field("min");
-                });
-            if (rit != data.rend())
-                std::advance(it, std::distance(rit, data.rend()) - 1);
-        }
-        else
+        if (!move_to_next_leaf(current))
         {
-            auto rit = std::lower_bound(
-                data.rbegin(), data.rend(),
-                search,
-                [] (const document& a, const document& b)
-                {
-                    return b.as_object().get_field("min") < a.as_object().get_field("min");
-                });
-            if (rit != data.rend())
-                std::advance(it, std::distance(rit, data.rend()) - 1);
+            return false;
         }
+        _position = 0;
     }
+    return true;
+}
 
-    // skip entire tree branches
-    if (skip > 0)
+void btree::insert(const document_list key, const document& value)
+{
+    insert_encoded(encode_key(key), value);
+}
+
+void btree::insert_encoded(const std::string& key, const document& value)
+{
+    std::string binary_value = value.to_binary();
+    if (!insert_in_leaf(key, binary_value))
     {
-        while(true)
-        {
-            std::size_t count = it->as_object().get_field("count").as_scalar().as<std::size_t>();
-            if(skip >= count && it != data.end())
-            {
-                skip -= count;
-                ++it;
-            }
-            else
-                break;
-        }
-        if (it == data.end())
+        boost::mutex::scoped_lock lock(_restructuring_mutex);
+        detail::restructuring r(_nodes);
+        detail::insert_result result = tree_insert(r, root_key(), key, binary_value);
+
+        // do we need new root?
+        if (result.right)
         {
-            return document_list();
+            node new_root = create_interior(result);
+            document new_root_key = allocate_node_key();
+            _nodes.put(new_root_key, new_root);
+            set_root(new_root_key);
         }
     }
-
-    document inferior_node_storage_key = it->as_object().get_field("storage");
-    document inferior_node = _storage.read(inferior_node_storage_key);
-
-    return tree_scan(inferior_node, min, min_inclusive, max, max_inclusive, limit, skip);
+    _nodes.trim();
 }
 
-document_list btree::tree_scan_leaf(
-    const document_object& nodep,
-    const boost::optional<document_list>& min,
-    bool min_inclusive,
-    const boost::optional<document_list>& max,
-    bool max_inclusive,
-    std::size_t limit,
-    std::size_t skip)
+bool btree::insert_in_leaf(const std::string& key, const std::string& value)
 {
-    document_list result;
-    document_object node = nodep; // local copy for iteration
-    while(true)
+    std::vector<detail::path_step> path;
+    detail::latched_node leaf;
+    while(!descend_to_change([&key](const node& n) { return insert_child_index(n, key); }, path, leaf))
     {
-        /*
-        std::cout << "leaf node scan:" << std::endl;
-        std::cout << "min: " << optional_to_string(min) << " inclusive: " << std::boolalpha << min_inclusive << std::endl;
-        std::cout << "max: " << optional_to_string(max) << " inlcusive: " << std::boolalpha << max_inclusive << std::endl;
-        std::cout << "skip: " << skip << ", limit: " << limit << std::endl;
-        std::cout << "node: " << node << std::endl;
-        std::cout << std::endl;
-        */
+    }
 
-        const document_list& data = node.get_field("data");
+    // the key range of the leaf is kept by its parent. The root leaf has none
+    node& n = *leaf;
+    if (!path.empty() && (key < n.keys.front() || n.keys.back() < key))
+    {
+        return false;
+    }
 
-        // full scan of the array. this could be asyli optimized
-        for(auto kv : data)
-        {
-            document_list key = kv.as_object().get_field("key");
-            document val = kv.as_object().get_field("value");
+    // after the equal keys, so duplicates keep the order of insertion
+    std::size_t pos = std::upper_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin();
+    n.keys.insert(n.keys.begin() + pos, key);
+    n.values.insert(n.values.begin() + pos, value);
+    if (_limits.overflows(n))
+    {
+        n.keys.erase(n.keys.begin() + pos);
+        n.values.erase(n.values.begin() + pos);
+        return false;
+    }
 
-            // skip below min
-            if (min && (key < *min || (!min_inclusive && key == *min)))
-            {
-                continue;
-            }
+    _nodes.mark_dirty(leaf.pin());
+    leaf = detail::latched_node();
+    add_to_counts(path, 1);
+    return true;
+}
 
-            // skip & limit
-            if (skip > 0)
-            {
-                skip--;
-                continue;
-            }
-            if(limit-- == 0)
-            {
-                return result;
-            }
+node btree::create_interior(const detail::insert_result& insert_result)
+{
+    assert(insert_result.right);
 
-            // return if max reached
-            if (max && ((*max < key) || (!max_inclusive && key == *max)))
-            {
-                return result;
-            }
+    node result = node::create_interior();
+    insert_child(result, 0, insert_result.left);
+    insert_child(result, 1, *insert_result.right);
+    return result;
+}
 
-            result.push_back(val);
-        }
+std::size_t btree::remove(const document_list& key)
+{
+    return remove_encoded(encode_key(key));
+}
 
-        document next_node_storage_key = node.get_field("next");
-        if (!next_node_storage_key.is_null())
-        {
-            node = _storage.read(next_node_storage_key);
-        }
-        else
+std::size_t btree::remove_encoded(const std::string& key)
+{
+    return remove_entries(key, nullptr);
+}
+
+std::size_t btree::remove_encoded(const std::string& key, const document& value)
+{
+    std::string binary_value = value.to_binary();
+    return remove_entries(key, &binary_value);
+}
+
+std::size_t btree::remove_entries(const std::string& key, const std::string* value)
+{
+    std::size_t removed = 0;
+    if (!remove_in_leaf(key, value, removed))
+    {
+        boost::mutex::scoped_lock lock(_restructuring_mutex);
+        detail::restructuring r(_nodes);
+        detail::remove_result result = tree_remove(r, root_key(), key, value);
+        removed = result.removed_records;
+        if (removed > 0)
         {
-            return result;
+            shrink_root(r);
         }
     }
+    _nodes.trim();
+    return removed;
 }
 
-void btree::insert(const document_list key, const document& value)
+bool btree::remove_in_leaf(const std::string& key, const std::string* value, std::size_t& removed)
 {
-    detail::insert_result result = tree_insert(_root_storage_key, key, value);
+    std::vector<detail::path_step> path;
+    detail::latched_node leaf;
+    while(!descend_to_change([&key](const node& n) { return remove_child_index(n, key); }, path, leaf))
+    {
+    }
 
-    // do we need new root?
-    if (result.right)
+    // the key may continue in the neighbours, or removing it may change the key range. The root leaf has neither
+    node& n = *leaf;
+    auto range = std::equal_range(n.keys.begin(), n.keys.end(), key);
+    std::size_t first = range.first - n.keys.begin();
+    std::size_t last = range.second - n.keys.begin();
+    if (!path.empty() && (first == 0 || last == n.size()))
     {
-        document_object new_root = create_interior(result);
-        _root_storage_key = generate_key();
-        _storage.write(_root_storage_key, new_root);
+        return false;
+    }
 
-        store_meta_data();
+    // the kept duplicates are moved to the front of the range, the range is kept to undo it
+    std::vector<std::string> values(n.values.begin() + first, n.values.begin() + last);
+    std::size_t kept = first;
+    for(std::size_t i = first; value && i < last; ++i)
+    {
+        if (n.values[i] != *value)
+        {
+            n.values[kept++].swap(n.values[i]);
+        }
+    }
+    removed = last - kept;
+    if (removed == 0)
+    {
+        return true;
     }
+
+    n.keys.erase(n.keys.begin() + kept, n.keys.begin() + last);
+    n.values.erase(n.values.begin() + kept, n.values.begin() + last);
+    if (!path.empty() && _limits.underflows(n))
+    {
+        n.keys.insert(n.keys.begin() + kept, removed, key);
+        n.values.erase(n.values.begin() + first, n.values.begin() + kept);
+        n.values.insert(n.values.begin() + first, values.begin(), values.end());
+        removed = 0;
+        return false;
+    }
+
+    _nodes.mark_dirty(leaf.pin());
+    leaf = detail::latched_node();
+    add_to_counts(path, -std::int64_t(removed));
+    return true;
 }
 
-document_object btree::create_interior()
+void btree::shrink_root(detail::restructuring& r)
 {
-    document_object node;
-    node.set_field("type", document::from("interior"));
-    node.set_field("data", document_list());
+    for(;;)
+    {
+        document root_key = this->root_key();
+        const node& root = r.read(root_key);
+        if (root.is_leaf() || root.size() != 1)
+        {
+            break;
+        }
 
-    return node;
+        // readers holding the old root find it replaced once latched
+        document child = root.children.front();
+        r.change(root_key);
+        set_root(child);
+        _nodes.remove(root_key);
+    }
 }
 
-document_object btree::create_interior(const detail::insert_result& insert_result)
+btree::compact_result btree::compact()
 {
-    assert(insert_result.right);
-
-    document_object left;
-    left.set_field("min", document::from(insert_result.left.min_key));
-    left.set_field("max", document::from(insert_result.left.max_key));
-    left.set_field("count", document::from(insert_result.left.count));
-    left.set_field("storage", document::from(insert_result.left.storage_key));
+    boost::mutex::scoped_lock lock(_restructuring_mutex);
 
-    document_object right;
-    right.set_field("min", document::from(insert_result.right->min_key));
-    right.set_field("max", document::from(insert_result.right->max_key));
-    right.set_field("count", document::from(insert_result.right->count));
-    right.set_field("storage", document::from(insert_result.right->storage_key));
+    flush_nodes();
+    std::vector<document> old_nodes = collect_node_keys();
 
-    document_list entries {left, right};
+    // the new tree replaces the old one when the builder stores the meta-data
+    builder b(_storage, _storage_key, _limits, _next_node_id);
+    // leaves are copied in order, following the chain
+    document leaf_key = _root_storage_key;
+    const node* n = &_nodes.get(_root_storage_key);
+    while(!n->is_leaf())
+    {
+        leaf_key = n->children.front();
+        n = &_nodes.get(leaf_key);
+    }
+    for(;;)
+    {
+        for(std::size_t i = 0; i < n->size(); ++i)
+        {
+            b.add(range(n->keys[i]), range(n->values[i]));
+        }
+        if (n->next.is_null())
+            break;
+        leaf_key = n->next;
+        _nodes.trim();
+        n = &_nodes.get(leaf_key);
+    }
+    b.finish(_unique);
 
-    document_object node;
-    node.set_field("type", document::from("interior"));
-    node.set_field("data", entries);
+    _nodes.clear();
+    for(const document& key : old_nodes)
+    {
+        _storage.remove(key);
+    }
+    load_meta_data();
 
-    return node;
+    return compact_result { old_nodes.size(), collect_node_keys().size() };
 }
 
-
-std::size_t btree::remove(const document_list& key)
+std::vector<document> btree::collect_node_keys()
 {
-    detail::remove_result result = tree_remove(_root_storage_key, key);
-    if (result.removed_records > 0 && !result.node)
+    // all leaves are at the same depth, so they are listed by their parents without being read
+    std::vector<document> result(1, _root_storage_key);
+    std::vector<document> level(1, _root_storage_key);
+    while(!_nodes.get(level.front()).is_leaf())
     {
-        // the root has been removed, the index is now empty. reinitialize root
-        document_object new_root = create_leaf();
-        _storage.write(_root_storage_key, new_root);
+        std::vector<document> children;
+        for(const document& key : level)
+        {
+            const node& n = _nodes.get(key);
+            children.insert(children.end(), n.children.begin(), n.children.end());
+        }
+        result.insert(result.end(), children.begin(), children.end());
+        level.swap(children);
+        _nodes.trim();
     }
-    return result.removed_records;
+    return result;
 }
 
-document btree::generate_key()
+std::uint64_t btree::node_key_prefix(const document& storage_key)
 {
-    boost::uuids::random_generator gen;
-    return document_scalar::from(gen());
+    // stored in the node keys, so it must not depend on the platform: FNV-1a of the encoded key
+    std::uint64_t hash = 14695981039346656037ull;
+    for(char c : key_encoding::encode(storage_key))
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
 }
 
-document_object btree::create_leaf()
+document btree::node_key(std::uint64_t prefix, std::uint64_t id)
 {
-    document_object leaf;
-    leaf.insert(std::make_pair("type", document::from("leaf")));
-    leaf.insert(std::make_pair("data", document_list()));
-    leaf.insert(std::make_pair("prev", document_scalar::null()));
-    leaf.insert(std::make_pair("next", document_scalar::null()));
+    boost::uuids::uuid key;
+    for(int i = 0; i < 8; ++i)
+    {
+        key.data[i] = static_cast<std::uint8_t>(prefix >> (56 - 8*i));
+        key.data[8 + i] = static_cast<std::uint8_t>(id >> (56 - 8*i));
+    }
+    return document_scalar::from(key);
+}
 
-    return document(leaf);
+void btree::drop(interfaces::document_storage& storage, const document& storage_key)
+{
+    std::uint64_t prefix = node_key_prefix(storage_key);
+    std::vector<document> keys;
+    storage.for_each(
+        node_key(prefix, 0),
+        node_key(prefix, std::numeric_limits<std::uint64_t>::max()),
+        [&keys](const document& key, const document&) { keys.push_back(key); });
+
+    for(const document& key : keys)
+    {
+        storage.remove(key);
+    }
+    storage.remove(storage_key);
 }
 
-detail::insert_result btree::tree_insert(const document& node_key, const document_list& key, const document& value)
+document btree::allocate_node_key()
 {
-    document_object node = _storage.read(node_key);
+    _meta_dirty = true;
+    return node_key(_node_key_prefix, _next_node_id++);
+}
 
-    if(node.get_field("type").as_scalar().as<std::string>() == "leaf")
+detail::insert_result btree::tree_insert(detail::restructuring& r, const document& node_key, const std::string& key, const std::string& value)
+{
+    if(r.read(node_key).is_leaf())
     {
-        return tree_insert_leaf(node_key, node, key, value);
+        return tree_insert_leaf(r, node_key, key, value);
     }
     else
     {
-        return tree_insert_interior(node_key, node, key, value);
+        return tree_insert_interior(r, node_key, key, value);
     }
 }
 
 detail::insert_result btree::tree_insert_leaf(
+    detail::restructuring& r,
     const document& node_key,
-    document_object& node,
-    const document_list& key,
-    const document& value)
+    const std::string& key,
+    const std::string& value)
 {
-    document_list& data = node.get_field("data").as_list();
-    document_object new_element;
-    new_element.insert(std::make_pair("key", key));
-    new_element.insert(std::make_pair("value", value));
-
-    auto it = std::lower_bound(
-        data.begin(), data.end(),
-        new_element,
-        [this](const document& a, const document& b)
-        {
-            return
-                a.as_object().get_field("key").as_list() <
-                b.as_object().get_field("key").as_list();
-        });
+    node& n = r.change(node_key);
 
-    data.insert(it, new_element);
+    // after the equal keys, so duplicates keep the order of insertion
+    std::size_t pos = std::upper_bound(n.keys.begin(), n.keys.end(), key) - n.keys.begin();
+    n.keys.insert(n.keys.begin() + pos, key);
+    n.values.insert(n.values.begin() + pos, value);
+    _nodes.mark_dirty(node_key);
 
     // will fit?
-    if (data.size() <= _items_per_leaf)
+    if (!_limits.overflows(n))
     {
-        _storage.write(node_key, node);
-        return detail::insert_result {
-            detail::node_summary {
-                data.size(),
-                data.front().as_object().get_field("key"),
-                data.back().as_object().get_field("key"),
-                node_key },
-            boost::none };
+        // the key range is kept, unless the key is the new first or last one
+        bool changed = (pos == 0 || pos + 1 == n.size());
+        return detail::insert_result { changed, summarize(n, node_key), boost::none };
     }
-    else
-    {
-        // split data, move upper half to new node
-        const std::size_t lh = _items_per_leaf / 2;
-        const std::size_t uh = _items_per_leaf - lh;
-
-        document_list upper_half;
-        upper_half.reserve(uh);
-        std::copy(data.begin() + lh, data.end(), std::back_inserter(upper_half));
-        document_object new_leaf = create_leaf();
-        new_leaf.set_field("prev", node_key);
-        new_leaf.set_field("next", node.get_field("next"));
-        new_leaf.set_field("data", upper_half);
-        document new_leafs_storage_key = generate_key();
-        _storage.write(new_leafs_storage_key, new_leaf);
 
-        // truncate data in existing node
-        document_list lower_half;
-        lower_half.reserve(lh);
-        std::copy(data.begin(), data.begin() + lh, std::back_inserter(lower_half));
-        data.swap(lower_half);
-        node.set_field("next", new_leafs_storage_key);
-        _storage.write(node_key, node);
+    // split data, move upper half to new node
+    node new_leaf = n.split(_limits.split_point(n));
+    document new_leafs_storage_key = allocate_node_key();
+    new_leaf.prev = node_key;
+    new_leaf.next = n.next;
+    n.next = new_leafs_storage_key;
 
-        return detail::insert_result {
-            detail::node_summary {
-                data.size(),
-                data.front().as_object().get_field("key"),
-                data.back().as_object().get_field("key"),
-                node_key },
-            detail::node_summary {
-                upper_half.size(),
-                upper_half.front().as_object().get_field("key"),
-                upper_half.back().as_object().get_field("key"),
-                new_leafs_storage_key }};
-    }
-}
+    detail::insert_result result { true, summarize(n, node_key), summarize(new_leaf, new_leafs_storage_key) };
+    _nodes.put(new_leafs_storage_key, new_leaf);
 
-static std::size_t sum_count(const document_list& data)
-{
-    std::size_t count = 0;
-    for(auto n : data)
+    if (!new_leaf.next.is_null())
     {
-        count += n.as_object().get_field("count").as_scalar().as<std::size_t>();
+        r.change(new_leaf.next).prev = new_leafs_storage_key;
+        _nodes.mark_dirty(new_leaf.next);
     }
-    return count;
+    return result;
 }
 
 detail::insert_result btree::tree_insert_interior(
+    detail::restructuring& r,
     const document& node_key,
-    document_object& node,
-    const document_list& key,
-    const document& value)
+    const std::string& key,
+    const std::string& value)
 {
-    document_list& data = node.get_field("data").as_list();
+    node& n = r.read(node_key);
+    std::size_t i = insert_child_index(n, key);
 
-    // find the node where min >= key
-    document_object search;
-    search.set_field("min", key);
-    auto it = std::lower_bound(
-        data.begin(), data.end(),
-        search,
-        [] (const document& a, const document& b)
-        {
-            return a.as_object().get_field("min") < b.as_object().get_field("min");
-        });
+    document inferior_node_key = n.children[i];
+    detail::insert_result result = tree_insert(r, inferior_node_key, key, value);
 
-    if (it == data.end())
+    if (!result.changed)
     {
-        it = data.end() - 1; // use the last element
+        r.add_to_count(node_key, i, 1);
+        return detail::insert_result { false, summarize(n, node_key), boost::none };
     }
 
-    document inferior_node_key = it->as_object().get_field("storage");
-    detail::insert_result result = tree_insert(inferior_node_key, key, value);
-
-    // update the entry
-    document_object left;
-    left.set_field("storage", result.left.storage_key);
-    left.set_field("min", result.left.min_key);
-    left.set_field("max", result.left.max_key);
-    left.set_field("count", document_scalar::from(result.left.count));
-
-    // if the insert caused the element to split, insert new node here
+    // update the entry, if the insert caused the element to split, insert new node here.
+    // Latched before the count of the child is taken, so the optimistic changes below are all in it
+    r.change(node_key);
+    std::string old_min = n.keys.front();
+    std::string old_max = n.max_keys.back();
+    set_child(n, i, result.left);
     if (result.right)
     {
-        document_object right;
-        right.set_field("storage", result.right->storage_key);
-        right.set_field("min", result.right->min_key);
-        right.set_field("max", result.right->max_key);
-        right.set_field("count",document_scalar::from( result.right->count));
+        insert_child(n, i + 1, *result.right);
+    }
+    _nodes.mark_dirty(node_key);
 
-        *it = right;
-        data.insert(it, left); // ordering is importaint here! nisert may invalidate the container
+    // will fit?
+    if (!_limits.overflows(n))
+    {
+        bool changed = (n.keys.front() != old_min || n.max_keys.back() != old_max);
+        return detail::insert_result { changed, summarize(n, node_key), boost::none };
     }
-    else
+
+    // split data, move upper half to new node
+    node new_interior = n.split(_limits.split_point(n));
+    document new_interior_storage_key = allocate_node_key();
+
+    detail::insert_result split_result { true, summarize(n, node_key), summarize(new_interior, new_interior_storage_key) };
+    _nodes.put(new_interior_storage_key, new_interior);
+    return split_result;
+}
+
+detail::remove_result btree::tree_remove(detail::restructuring& r, const document& node_key, const std::string& key, const std::string* value)
+{
+    if(r.read(node_key).is_leaf())
     {
-        *it = left;
-    }
-    _storage.write(node_key, node);
-
-    // if the node is too big - split it
-    if (data.size() > _items_per_leaf)
-    {
-        // split data, move upper half to new node
-        const std::size_t lh = _items_per_leaf / 2;
-        const std::size_t uh = _items_per_leaf - lh;
-
-        document_list upper_half;
-        upper_half.reserve(uh);
-        std::copy(data.begin() + lh, data.end(), std::back_inserter(upper_half));
-        document_object new_interior = create_interior();
-        new_interior.set_field("data", upper_half);
-        document new_interior_storage_key = generate_key();
-        _storage.write(new_interior_storage_key, new_interior);
-
-        // truncate data in existing node
-        document_list lower_half;
-        lower_half.reserve(lh);
-        std::copy(data.begin(), data.begin() + lh, std::back_inserter(lower_half));
-        data.swap(lower_half);
-        _storage.write(node_key, node);
-
-        return detail::insert_result {
-            detail::node_summary {
-                sum_count(data),
-                data.front().as_object().get_field("min"),
-                data.back().as_object().get_field("max"),
-                node_key },
-            detail::node_summary {
-                sum_count(upper_half),
-                upper_half.front().as_object().get_field("min"),
-                upper_half.back().as_object().get_field("max"),
-                new_interior_storage_key }};
+        return tree_remove_leaf(r, node_key, key, value);
     }
     else
     {
-        // count elements
-
-        return detail::insert_result {
-            detail::node_summary {
-                sum_count(data),
-                data.front().as_object().get_field("min"),
-                data.back().as_object().get_field("max"),
-                node_key },
-            boost::none };
+        return tree_remove_interior(r, node_key, key, value);
     }
 }
 
-detail::remove_result btree::tree_remove(const document& node_storage_key, const document_list& key)
+void btree::unlink_leaf(detail::restructuring& r, const node& n)
 {
-    document_object node = _storage.read(node_storage_key);
-
-    if(node.get_field("type").as_scalar().as<std::string>() == "leaf")
+    if (!n.prev.is_null())
     {
-        return tree_remove_leaf(node_storage_key, node, key);
+        r.change(n.prev).next = n.next;
+        _nodes.mark_dirty(n.prev);
     }
-    else
+    if (!n.next.is_null())
     {
-        return tree_remove_interior(node_storage_key, node, key);
+        r.change(n.next).prev = n.prev;
+        _nodes.mark_dirty(n.next);
     }
 }
 
 detail::remove_result btree::tree_remove_leaf(
-    const document& node_storage_key,
-    document_object& node,
-    const document_list& key)
+    detail::restructuring& r,
+    const document& node_key,
+    const std::string& key,
+    const std::string* value)
 {
-    document_list& data = node.get_field("data").as_list();
+    node& n = r.change(node_key);
+    std::size_t size = n.size();
+    auto range = std::equal_range(n.keys.begin(), n.keys.end(), key);
+    std::size_t first = range.first - n.keys.begin();
+    std::size_t last = range.second - n.keys.begin();
+
+    // the kept duplicates are moved to the front of the range
+    std::size_t kept = first;
+    for(std::size_t i = first; value && i < last; ++i)
+    {
+        if (n.values[i] != *value)
+        {
+            n.values[kept++].swap(n.values[i]);
+        }
+    }
+    std::size_t removed_items = last - kept;
+
+    if (removed_items == 0)
+    {
+        return detail::remove_result { 0, boost::none, false, false };
+    }
 
-    document_object search;
-    search.insert(std::make_pair("key", key));
+    n.keys.erase(n.keys.begin() + kept, n.keys.begin() + last);
+    n.values.erase(n.values.begin() + kept, n.values.begin() + last);
+    _nodes.mark_dirty(node_key);
 
-    auto range = std::equal_range(
-        data.begin(), data.end(),
-        search,
-        [this](const document& a, const document& b)
+    if (n.size() == 0)
+    {
+        // the root leaf is left empty, the other leaves are removed
+        if (!(node_key == root_key()))
         {
-            return
-                a.as_object().get_field("key").as_list() <
-                b.as_object().get_field("key").as_list();
-        });
+            unlink_leaf(r, n);
+            _nodes.remove(node_key);
+        }
+        return detail::remove_result { removed_items, boost::none, false, true };
+    }
 
-    std::size_t removed_items = std::distance(range.first, range.second);
-    data.erase(range.first, range.second);
+    bool underflow = _limits.underflows(n);
+    bool changed = (underflow || first == 0 || last == size);
+    return detail::remove_result { removed_items, summarize(n, node_key), underflow, changed };
+}
 
-    if (removed_items > 0)
+detail::remove_result btree::tree_remove_interior(
+    detail::restructuring& r,
+    const document& node_key,
+    const std::string& key,
+    const std::string* value)
+{
+    node& n = r.read(node_key);
+    std::size_t i = remove_child_index(n, key);
+    std::string old_min = n.keys.front();
+    std::string old_max = n.max_keys.back();
+
+    std::size_t removed_records = 0;
+    bool children_changed = false;
+    std::vector<document> underflowing;
+    while (i < n.size() && !(key < n.keys[i]))
     {
-        if (data.empty())
+        if (n.max_keys[i] < key)
+        {
+            ++i;
+            continue;
+        }
+
+        document inferior_node_key = n.children[i];
+        detail::remove_result result = tree_remove(r, inferior_node_key, key, value);
+        removed_records += result.removed_records;
+
+        if (result.removed_records == 0)
+        {
+            ++i;
+        }
+        else if (!result.changed)
+        {
+            // the child keeps its key range, only its count is updated
+            r.add_to_count(node_key, i, -std::int64_t(result.removed_records));
+            ++i;
+        }
+        else if (result.node)
         {
-            _storage.remove(node_storage_key);
-            return detail::remove_result { removed_items, boost::none };
+            // something removed, but the node still exists
+            r.change(node_key);
+            children_changed = true;
+            set_child(n, i, *result.node);
+            if (result.underflow)
+            {
+                underflowing.push_back(inferior_node_key);
+            }
+            ++i;
         }
         else
         {
-            _storage.write(node_storage_key, node);
+            // the inferior node has been removed
+            r.change(node_key);
+            children_changed = true;
+            n.erase(i);
         }
     }
 
-    return detail::remove_result {
-        removed_items,
-        detail::node_summary {
-            data.size(),
-            data.front().as_object().get_field("key"),
-            data.back().as_object().get_field("key"),
-            node_storage_key }
-        };
-}
-
-static document_list::iterator find_inferiror_for_key(document_list& data, const document_list& key)
-{
-    for(auto it = data.begin(); it != data.end(); ++it)
+    if (!children_changed)
     {
-        const document_list& min = it->as_object().get_field("min").as_list();
-        const document_list& max = it->as_object().get_field("max").as_list();
-        if (min <= key && key <= max)
-            return it;
+        return detail::remove_result { removed_records, boost::none, false, false };
     }
-    return data.end();
-}
 
-detail::remove_result btree::tree_remove_interior(
-    const document& node_storage_key,
-    document_object& node,
-    const document_list& key)
-{
-    document_list& data = node.get_field("data").as_list();
+    // children are rebalanced once all duplicates are gone, the indices above are stable until then
+    for(const document& child : underflowing)
+    {
+        auto it = std::find_if(
+            n.children.begin(), n.children.end(),
+            [&child](const document& c) { return c == child; });
+        if (it == n.children.end() || n.size() < 2 || !_limits.underflows(r.read(child)))
+        {
+            continue; // merged, or refilled, already
+        }
 
-    // find the node where min >= key
-    auto it = find_inferiror_for_key(data, key);
+        std::size_t j = it - n.children.begin();
+        rebalance(r, n, j + 1 < n.size() ? j : j - 1);
+    }
 
-    if (it == data.end())
+    // shall we remove ourselves?
+    if (n.size() == 0)
     {
-        return detail::remove_result { 0, boost::none };
+        // an empty tree has a leaf as the root
+        if (node_key == root_key())
+        {
+            document leaf_key = allocate_node_key();
+            _nodes.put(leaf_key, node::create_leaf());
+            set_root(leaf_key);
+        }
+        _nodes.remove(node_key);
+        return detail::remove_result { removed_records, boost::none, false, true };
     }
 
-    document_object& inferior_summary = it->as_object();
-    document inferior_node_key = inferior_summary.get_field("storage");
-    detail::remove_result result = tree_remove(inferior_node_key, key);
+    _nodes.mark_dirty(node_key);
+    bool underflow = _limits.underflows(n);
+    bool changed = (underflow || n.keys.front() != old_min || n.max_keys.back() != old_max);
+    return detail::remove_result { removed_records, summarize(n, node_key), underflow, changed };
+}
 
-    // handle the removal
-    if (result.removed_records == 0)
-    {
-        // nothing removed
-        return result;
-    }
-    else if (result.node)
-    {
-        // something removed, but the node is still exists
-        inferior_summary.set_field("min", result.node->min_key);
-        inferior_summary.set_field("max", result.node->max_key);
-        inferior_summary.set_field("count", document_scalar::from(result.node->count));
+void btree::rebalance(detail::restructuring& r, node& parent, std::size_t i)
+{
+    assert(i + 1 < parent.size());
+    document left_key = parent.children[i];
+    document right_key = parent.children[i + 1];
+    node& left = r.change(left_key);
+    node& right = r.change(right_key);
 
-        _storage.write(node_storage_key, node);
+    // entries stay in order, so does the chain of leaves
+    left.append(right);
+    _nodes.mark_dirty(left_key);
 
-        return detail::remove_result {
-            result.removed_records,
-            detail::node_summary {
-                sum_count(data),
-                data.front().as_object().get_field("min"),
-                data.back().as_object().get_field("max"),
-                node_storage_key }
-            };
-    }
-    else
+    if (!_limits.overflows(left))
     {
-        // the inferior node has been removed
-        data.erase(it);
-
-        // shall we remove ourselves?
-        if (data.empty())
+        if (left.is_leaf())
         {
-            _storage.remove(node_storage_key);
-            return detail::remove_result { result.removed_records, boost::none };
+            left.next = right.next;
+            if (!left.next.is_null())
+            {
+                r.change(left.next).prev = left_key;
+                _nodes.mark_dirty(left.next);
+            }
         }
-        else
-        {
-            // something removed, but the node is still exists
-            inferior_summary.set_field("min", result.node->min_key);
-            inferior_summary.set_field("max", result.node->max_key);
-            inferior_summary.set_field("count", document_scalar::from(result.node->count));
+        _nodes.remove(right_key);
+        parent.erase(i + 1);
+        set_child(parent, i, summarize(left, left_key));
+        return;
+    }
 
-            _storage.write(node_storage_key, node);
+    node upper = left.split(_limits.split_point(left));
+    upper.prev = right.prev;
+    upper.next = right.next;
+    right = std::move(upper);
+    _nodes.mark_dirty(right_key);
 
-            return detail::remove_result {
-                result.removed_records,
-                detail::node_summary {
-                    sum_count(data),
-                    data.front().as_object().get_field("min"),
-                    data.back().as_object().get_field("max"),
-                    node_storage_key }
-                };
-        }
-    }
+    set_child(parent, i, summarize(left, left_key));
+    set_child(parent, i + 1, summarize(right, right_key));
 }
 
 }}} // ns
@@ -22,39 +22,236 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "interfaces/document_storage.hpp"
 
+#include "indexes/btree/node_cache.hpp"
+
 #include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
 
+#include <atomic>
+#include <cassert>
 #include <limits>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace falcondb { namespace indexes { namespace btree {
 
 namespace detail
 {
+    class node_summary;
     class insert_result;
     class remove_result;
+    class latched_node;
+    struct path_step;
+    class restructuring;
 }
 
 /// B-tree stores key - value pairs in a storage-backend tree
-/// Key has to be a document_list, value can be anything
+/// Key has to be a document_list, value can be anything.
+/// Keys are kept in key_encoding, so they are compared as bytes, see node.
+/// Nodes are cached decoded, changes reach the storage only when flushed.
+/// Node keys are UUIDs made of a prefix derived from the storage key and a node id. Ids are
+/// allocated in sequence and kept in the meta-data, so the nodes of a tree are stored together,
+/// in the order they were created
+///
+/// Thread-safe, with a latch per node, kept in the node cache, taken by latch coupling: the latch of
+/// a node is held until the one of the next node on the way is taken. Readers descend with shared
+/// latches, and follow the leaf links the same way, left to right.
+/// A change within a leaf, which keeps its key range and neither splits nor merges it, takes shared
+/// latches on the path and an exclusive one on the leaf. The subtree counts of the ancestors are atomic,
+/// they are updated once the leaf is released, so readers and other such writers pass them meanwhile.
+/// The other changes restructure the tree. They run one at a time, and as the structure changes by
+/// them only, they read interior nodes unlatched, and latch exclusively just the nodes they change.
+/// Only they wait for a latch while holding others: the other threads try to take it, and start
+/// over from the root if taken, after waiting for it with no latches held. So there are no deadlocks.
+/// Cursors hold no latches between calls: they follow a leaf link if the leaf is unchanged since
+/// copied, otherwise they find their position again.
+/// compact() and discard() replace the nodes wholesale, no other operation may run meanwhile.
+/// The storage is accessed by one thread at a time
 class btree
 {
 public:
 
+    /// Default limit of cached leaves
+    static const std::size_t default_cached_leaves = 1024;
+
+    /// When nodes split and merge. A node overflows when it has more than 'max_items' entries,
+    /// or when its encoded size exceeds the byte limit for its type. Leaves with a single entry
+    /// and interior nodes with two children never overflow, so the tree narrows towards the root
+    /// whatever the key size. A node underflows when less than half full by both measures.
+    /// A byte limit of 0 is no limit
+    struct node_limits
+    {
+        /// by number of entries only
+        node_limits(std::size_t max_items);
+        node_limits(std::size_t max_items, std::size_t leaf_bytes, std::size_t interior_bytes);
+
+        bool overflows(const node& n) const;
+        bool underflows(const node& n) const;
+
+        /// Position to split an overflowing node at, leaving about half of the bytes on each side
+        std::size_t split_point(const node& n) const;
+
+        std::size_t bytes(const node& n) const { return n.is_leaf() ? leaf_bytes : interior_bytes; }
+
+        std::size_t max_items;
+        std::size_t leaf_bytes;
+        std::size_t interior_bytes;
+    };
+
     // constructors
     static btree load(
         interfaces::document_storage& storage,
         const document& storage_key,
         bool unique,
-        std::size_t items_per_leaf);
+        const node_limits& limits,
+        std::size_t cached_leaves = default_cached_leaves);
 
     static btree create(
         interfaces::document_storage& storage,
         const document& storage_key,
         bool unique,
-        std::size_t items_per_leaf);
+        const node_limits& limits,
+        std::size_t cached_leaves = default_cached_leaves);
 
     btree(btree&& other);
 
+    /// Builds new tree bottom-up from entries supplied in key order, with fully packed nodes.
+    /// Nodes are written directly to the storage, leaves get consecutive ids in key order
+    class builder
+    {
+    public:
+
+        /// Node ids are allocated from 'first_node_id', so the nodes of a tree being replaced can be kept until it's done
+        builder(
+            interfaces::document_storage& storage,
+            const document& storage_key,
+            const node_limits& limits,
+            std::uint64_t first_node_id = 0);
+
+        /// 'key' as returned by encode_key, 'value' in binary format. Keys must not decrease
+        void add(const range& key, const range& value);
+
+        /// Writes the remaining nodes and the meta-data
+        btree finish(bool unique, std::size_t cached_leaves = default_cached_leaves);
+
+        std::size_t size() const { return _size; }
+
+    private:
+
+        /// adds child to the interior node being filled at 'level', levels counted from the leaves up
+        void add_to_level(std::size_t level, const detail::node_summary& summary);
+
+        /// writes the leaf being filled and starts the next one
+        void close_leaf();
+
+        /// leaf encoded size, with the next leaf link set
+        std::size_t leaf_size() const;
+
+        document allocate_node_key() { return node_key(_node_key_prefix, _next_node_id++); }
+
+        interfaces::document_storage& _storage;
+        const document _storage_key;
+        const node_limits _limits;
+        const std::uint64_t _node_key_prefix;
+        std::uint64_t _next_node_id;
+
+        node _leaf;
+        document _leaf_key;
+        std::size_t _leaf_entries_size; // bytes taken by the entries of the leaf
+        std::vector<node> _levels; // interior nodes being filled
+        std::size_t _size;
+    };
+
+    /// Ordered iterator over the entries, following the leaf chain in either direction.
+    /// Holds a copy of the current leaf only, so the memory used doesn't depend on the size of the range.
+    /// Changes made to the tree are seen once the cursor moves to the next leaf.
+    /// A cursor is used by one thread at a time
+    class cursor
+    {
+    public:
+
+        explicit cursor(btree& tree);
+
+        void seek_to_first();
+        void seek_to_last();
+
+        /// Positions at the first entry with key not less than 'key' (greater, if not inclusive).
+        /// 'key' as returned by encode_key
+        void seek(const std::string& key, bool inclusive = true);
+
+        /// Positions at the last entry with key not greater than 'key' (less, if not inclusive)
+        void seek_for_prev(const std::string& key, bool inclusive = true);
+
+        /// Positions at the entry with 'n' entries before it, found by the subtree counts.
+        /// Past the end if there are not so many entries
+        void seek_to_position(std::uint64_t n);
+
+        bool valid() const { return _position < _leaf.size(); }
+        void next();
+
+        /// Moves to the preceding entry, following the left-links.
+        /// Equal keys are returned in reverse order of insertion
+        void prev();
+
+        /// Encoded key of the current entry
+        const std::string& key() const { assert(valid()); return _leaf.keys[_position]; }
+        document value() const;
+
+        /// Serializable position after the current entry: the key and the number of entries
+        /// with this key passed so far. Equal keys keep the order of insertion, so inserts don't move it.
+        /// For cursors moving forward
+        document position() const;
+
+        /// Continues after the entry at which 'position' was taken
+        void resume(const document& position);
+
+    private:
+
+        /// positions as seek() does, returns the leaf copied, still latched
+        detail::latched_node seek_latched(const std::string& key, bool inclusive);
+
+        void seek_for_prev_leaf(const std::string& key, bool inclusive);
+
+        /// moves to the preceding entry, or past the beginning. False if the preceding
+        /// leaf couldn't be reached by its link, the position is unchanged then
+        bool step_back();
+
+        /// positions after 'passed' entries with 'key'. Returns number of entries with 'key' passed
+        std::size_t resume_from(const std::string& key, std::uint64_t passed);
+
+        void copy_leaf(const detail::latched_node& leaf);
+
+        /// the leaf copied, latched shared, if unchanged since. Empty otherwise
+        detail::latched_node latch_copied_leaf();
+
+        /// copies the next leaf, latched in place of the current one. False if its latch was taken,
+        /// the current one is released then
+        bool move_to_next_leaf(detail::latched_node& current);
+
+        /// moves to the following leaves while past the end of the current one, latched
+        bool skip_exhausted_leaves(detail::latched_node& current);
+
+        btree& _tree;
+        node _leaf;
+        document _leaf_key;
+        std::uint64_t _stamp; // of the leaf in the node cache, when copied
+        std::size_t _position;
+        std::size_t _duplicates; // entries passed with the same key as the current one, in the direction of movement
+    };
+
+    cursor create_cursor() { return cursor(*this); }
+
+    /// Key as stored in the tree
+    static std::string encode_key(const document_list& key);
+
+    struct stats
+    {
+        std::size_t scans;
+        std::size_t comparisons; // key comparisons made by all scans
+        std::size_t last_scan_comparisons;
+    };
+
     // read data from tree
     document_list scan(
         const boost::optional<document_list>& min,
@@ -65,89 +262,207 @@ public:
         std::size_t skip = 0);
 
     void insert(const document_list key, const document& value);
+
+    /// Removes all entries with the key. Nodes left less than half full are merged with,
+    /// or refilled from, a sibling, a root with a single child is replaced by the child
     std::size_t remove(const document_list& key);
 
+    // as above, with keys already encoded. Any encoding comparing as bytes in the wanted order will do
+
+    document_list scan_encoded(
+        const boost::optional<std::string>& min,
+        bool min_inclusive,
+        const boost::optional<std::string>& max,
+        bool max_inclusive,
+        std::size_t limit = std::numeric_limits<std::size_t>::max(),
+        std::size_t skip = 0);
+
+    void insert_encoded(const std::string& key, const document& value);
+    std::size_t remove_encoded(const std::string& key);
+
+    /// Removes the entries with the key and the value only, passing over the other duplicates of the key
+    std::size_t remove_encoded(const std::string& key, const document& value);
+
+    // order statistics, from the subtree counts of the interior nodes, reading one path per bound
+
+    /// Number of entries in the range
+    std::uint64_t count_encoded(
+        const boost::optional<std::string>& min,
+        bool min_inclusive,
+        const boost::optional<std::string>& max,
+        bool max_inclusive);
+
+    /// Number of entries with key less than 'key' (not greater, if inclusive)
+    std::uint64_t rank_encoded(const std::string& key, bool inclusive = false);
+
+    /// Number of all entries
+    std::uint64_t size();
+
+    struct compact_result
+    {
+        std::size_t nodes_before;
+        std::size_t nodes_after;
+    };
+
+    /// Rebuilds the tree with fully packed nodes, under the same storage key.
+    /// Flushes first, the new nodes are written directly to the storage
+    compact_result compact();
+
+    /// Writes modified nodes to the storage
+    void flush();
+
+    /// Drops changes made since the last flush, the tree is reloaded from the storage
+    void discard();
+
+    stats get_stats() const;
+
+    /// First half of the keys of all nodes of the tree stored under 'storage_key'
+    static std::uint64_t node_key_prefix(const document& storage_key);
+
+    /// Node key: prefix and id, both big-endian, so the keys order by id
+    static document node_key(std::uint64_t prefix, std::uint64_t id);
+
+    /// Removes the meta-data stored under 'storage_key' and all nodes with its key prefix, without
+    /// reading the tree, so incomplete trees are removed as well. Trees written by older versions,
+    /// with random node ids, are not found this way
+    static void drop(interfaces::document_storage& storage, const document& storage_key);
+
 private:
 
     btree(
         interfaces::document_storage& storage,
         const document& root_storage_key,
         bool unique,
-        std::size_t items_per_leaf);
+        const node_limits& limits,
+        std::size_t cached_leaves);
+
+    // keys and values are passed encoded: keys in key_encoding, values in binary format
+
+    // latch coupling
+
+    /// The root, latched
+    detail::latched_node latch_root(bool exclusive);
+
+    /// Descends from the root to a leaf with shared latches. 'choose' returns the child to follow
+    /// from an interior node, latched. Empty if a latch was taken, after waiting for it
+    template<typename Choose>
+    detail::latched_node try_descend(Choose choose);
+
+    /// As above, starting over until the leaf is reached
+    template<typename Choose>
+    detail::latched_node descend(Choose choose);
+
+    /// Descends to the leaf for a change within it: the interior nodes are latched shared, and kept
+    /// in 'path', the leaf exclusively. False if a latch was taken, after waiting for it
+    template<typename Choose>
+    bool descend_to_change(Choose choose, std::vector<detail::path_step>& path, detail::latched_node& leaf);
+
+    /// Adds to the subtree counts along the path, with the leaf released
+    void add_to_counts(const std::vector<detail::path_step>& path, std::int64_t delta);
+
+    document root_key() const;
+
+    /// Replaces the root, by a restructuring change
+    void set_root(const document& key);
 
+    /// children followed by inserts and removes
+    static std::size_t insert_child_index(const node& n, const std::string& key);
+    static std::size_t remove_child_index(const node& n, const std::string& key);
 
     // insert
 
-    detail::insert_result tree_insert(const document& node_key, const document_list& key, const document& value);
+    /// Inserts into the leaf, if it doesn't change the key range of the leaf nor split it
+    bool insert_in_leaf(const std::string& key, const std::string& value);
+
+    detail::insert_result tree_insert(
+        detail::restructuring& r,
+        const document& node_key,
+        const std::string& key,
+        const std::string& value);
 
     detail::insert_result tree_insert_leaf(
+        detail::restructuring& r,
         const document& node_key,
-        document_object& node,
-        const document_list& key,
-        const document& value);
+        const std::string& key,
+        const std::string& value);
 
     detail::insert_result tree_insert_interior(
+        detail::restructuring& r,
         const document& node_key,
-        document_object& node,
-        const document_list& key,
-        const document& value);
+        const std::string& key,
+        const std::string& value);
+
+    // remove. 'value', if set, is the binary form of the only value to remove
 
-    // remove
+    std::size_t remove_entries(const std::string& key, const std::string* value);
 
-    detail::remove_result tree_remove(const document& node_key, const document_list& key);
+    /// Removes from the leaf, if it doesn't change the key range of the leaf nor leave it less
+    /// than half full, and the key doesn't continue in the neighbours. Number removed in 'removed'
+    bool remove_in_leaf(const std::string& key, const std::string* value, std::size_t& removed);
+
+    detail::remove_result tree_remove(
+        detail::restructuring& r,
+        const document& node_key,
+        const std::string& key,
+        const std::string* value);
 
     detail::remove_result tree_remove_leaf(
+        detail::restructuring& r,
         const document& node_key,
-        document_object& node,
-        const document_list& key);
+        const std::string& key,
+        const std::string* value);
 
     detail::remove_result tree_remove_interior(
+        detail::restructuring& r,
         const document& node_key,
-        document_object& node,
-        const document_list& key);
+        const std::string& key,
+        const std::string* value);
 
+    /// links siblings of a leaf being removed
+    void unlink_leaf(detail::restructuring& r, const node& n);
 
-    // scan
+    /// Merges children i and i+1 of 'parent', or evens them out if they don't fit in one node
+    void rebalance(detail::restructuring& r, node& parent, std::size_t i);
 
-    document_list tree_scan(
-        const document_object& node,
-        const boost::optional<document_list>& min,
-        bool min_inclusive,
-        const boost::optional<document_list>& max,
-        bool max_inclusive,
-        std::size_t limit,
-        std::size_t skip);
+    /// Replaces a root having a single child with the child
+    void shrink_root(detail::restructuring& r);
 
-    document_list tree_scan_leaf(
-        const document_object& node,
-        const boost::optional<document_list>& min,
-        bool min_inclusive,
-        const boost::optional<document_list>& max,
-        bool max_inclusive,
-        std::size_t limit,
-        std::size_t skip);
+    /// storage keys of all nodes of the tree
+    std::vector<document> collect_node_keys();
 
-    document_list tree_scan_interior(
-        const document_object& node,
-        const boost::optional<document_list>& min,
+    // scan
+
+    /// scans from the entry with 'position' entries before it if set, from 'min' otherwise
+    document_list tree_scan(
+        const boost::optional<std::uint64_t>& position,
+        const boost::optional<std::string>& min,
         bool min_inclusive,
-        const boost::optional<document_list>& max,
+        const boost::optional<std::string>& max,
         bool max_inclusive,
-        std::size_t limit,
-        std::size_t skip);
-
+        std::size_t limit);
 
+    // order statistics
 
+    std::uint64_t rank(const std::string& key, bool inclusive);
 
+    /// Leaf holding the entry with 'n' entries before it, latched, and its index in the leaf.
+    /// The last leaf and its size if there are not so many entries
+    std::pair<detail::latched_node, std::size_t> locate(std::uint64_t n);
 
+    /// writes modified nodes, by a restructuring change
+    void flush_nodes();
 
+    /// key comparison, counted in scan stats
+    bool key_less(const std::string& a, const std::string& b);
 
+    /// first of keys[first, last) not less than / greater than key
+    std::size_t lower_bound(const std::vector<std::string>& keys, std::size_t first, std::size_t last, const std::string& key);
+    std::size_t upper_bound(const std::vector<std::string>& keys, std::size_t first, std::size_t last, const std::string& key);
 
+    /// Storage key for a new node, by a restructuring change
+    document allocate_node_key();
 
-    static document generate_key();
-    static document_object create_leaf();
-    static document_object create_interior(const detail::insert_result& insert_result);
-    static document_object create_interior();
+    static node create_interior(const detail::insert_result& insert_result);
 
     void load_meta_data();
     void store_meta_data();
@@ -155,9 +470,22 @@ private:
     interfaces::document_storage& _storage;
     const document _storage_key;
     const bool _unique;
-    const std::size_t _items_per_leaf;
+    const node_limits _limits;
+    const std::uint64_t _node_key_prefix;
 
     document _root_storage_key;
+    mutable boost::mutex _root_mutex; // guards the root key, read by all
+    std::uint64_t _next_node_id;
+    bool _meta_dirty; // root or next node id changed since the last flush
+
+    node_cache _nodes;
+
+    boost::mutex _restructuring_mutex; // restructuring changes run one at a time
+
+    // stats
+    std::atomic<std::size_t> _scans;
+    std::atomic<std::size_t> _comparisons;
+    std::atomic<std::size_t> _last_scan_comparisons;
 };
 
 }}} // ns
@@ -18,26 +18,67 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "indexes/btree/index.hpp"
+#include "indexes/btree/index_cursor.hpp"
 
 #include "interfaces/document_storage.hpp"
 
+#include "document/key_encoding.hpp"
+
+#include "utils/exception.hpp"
+#include "utils/external_sorter.hpp"
+#include "utils/filesystem.hpp"
+#include "utils/log.hpp"
+
 #include <algorithm>
 #include <limits>
 #include <cstdint>
 
-static std::size_t ITEMS_PER_LEAF = 100; // completely arbitrary
+static std::size_t BULK_LOAD_MEMORY = 64 * 1024 * 1024; // sorted in memory before spilling to disk
+static std::size_t PROGRESS_INTERVAL = 1000;
 
 namespace falcondb { namespace indexes { namespace btree {
 
-index index::create(interfaces::document_storage& storage, const document& definition, const document& root_storage_key)
+index index::create(
+    interfaces::document_storage& storage,
+    const document& definition,
+    const document& root_storage_key,
+    interfaces::document_storage& data_storage,
+    const interfaces::index_type::progress_handler& progress)
 {
     const document_object def_obj = definition.as_object();
     bool unique = false;
     if (def_obj.has_field("unique"))
         unique = def_obj.get_field("unique").as<bool>();
 
-    btree tree = btree::create(storage, root_storage_key, unique, ITEMS_PER_LEAF);
-    return index(std::move(tree), def_obj);
+    // extract and sort all entries, then build the tree in one sequential pass
+    layout l = read_layout(def_obj);
+    external_sorter sorter(BULK_LOAD_MEMORY, bfs::temp_directory_path().string());
+    std::size_t read = 0;
+    data_storage.for_each_view(
+        [&](const document& storage_key, const document_view& doc)
+        {
+            std::string value = entry_value(l, storage_key, doc).to_binary();
+            for(const std::string& key : index_keys(l.fields, l.multikey, doc))
+            {
+                sorter.add(entry_key(l, key, storage_key), value);
+            }
+            if (progress && ++read % PROGRESS_INTERVAL == 0)
+                progress(read, 0);
+        });
+
+    btree::builder builder(storage, root_storage_key, read_limits(def_obj));
+    sorter.for_each_sorted(
+        [&](const range& key, const range& value)
+        {
+            builder.add(key, value);
+            if (progress && builder.size() % PROGRESS_INTERVAL == 0)
+                progress(read, builder.size());
+        });
+    if (progress)
+        progress(read, builder.size());
+    logging::info("index created over ", read, " documents, ", sorter.size(), " entries, ", sorter.runs(), " sort runs spilled");
+
+    return index(builder.finish(unique), def_obj);
 }
 
 index index::load(interfaces::document_storage& storage, const document& definition, const document& root_storage_key)
@@ -47,7 +88,7 @@ index index::load(interfaces::document_storage& storage, const document& definit
     if (def_obj.has_field("unique"))
         unique = def_obj.get_field("unique").as<bool>();
 
-    btree tree = btree::load(storage, root_storage_key, unique, ITEMS_PER_LEAF);
+    btree tree = btree::load(storage, root_storage_key, unique, read_limits(def_obj));
     return index(std::move(tree), def_obj);
 }
 
@@ -55,23 +96,86 @@ index index::load(interfaces::document_storage& storage, const document& definit
 index::index(btree&& tree, const document_object& definition)
 :
     _tree(std::move(tree)),
-    _fields()
+    _layout(read_layout(definition))
+{
+}
+
+index::field_list index::read_fields(const document_object& definition)
 {
-    // read the fields definition
+    // older definitions: ordered by name, directions not applied
+    bool ordered = definition.has_field("key_format")
+        && definition.get_field("key_format").as_scalar().to_number<int>() >= ORDERED_KEY_FORMAT;
+
+    field_list result;
     const document_list& fields = definition.get_field("fields").as_list();
-    for(const document& field : fields)
+    for(const document& f : fields)
     {
-        const document_object& field_obj = field.as_object();
+        const document_object& field_obj = f.as_object();
         std::string field_name = field_obj.get_field("name").as_scalar().as<std::string>();
-        std::int32_t direction = field_obj.get_field("direction").as_scalar().as<std::int32_t>();
-        _fields.insert(std::make_pair(field_name, direction));
+        std::int32_t direction = field_obj.get_field("direction").as_scalar().to_number<std::int32_t>();
+        result.push_back(field { field_name, ordered && direction < 0 });
+    }
+    if (!ordered)
+    {
+        std::stable_sort(
+            result.begin(), result.end(),
+            [](const field& a, const field& b) { return a.name < b.name; });
+    }
+    return result;
+}
+
+std::vector<std::string> index::read_include(const document_object& definition)
+{
+    std::vector<std::string> result;
+    if (definition.has_field("include"))
+    {
+        for(const document& name : definition.get_field("include").as_list())
+        {
+            result.push_back(name.as_scalar().as<std::string>());
+        }
+    }
+    return result;
+}
+
+index::layout index::read_layout(const document_object& definition)
+{
+    layout result;
+    result.fields = read_fields(definition);
+    result.include = read_include(definition);
+    result.multikey = definition.has_field("multikey") && definition.get_field("multikey").as<bool>();
+    result.posting_lists = definition.has_field("key_format")
+        && definition.get_field("key_format").as_scalar().to_number<int>() >= POSTING_KEY_FORMAT;
+    return result;
+}
+
+btree::node_limits index::read_limits(const document_object& definition)
+{
+    std::size_t leaf_bytes = DEFAULT_PAGE_SIZE;
+    std::size_t interior_bytes = DEFAULT_PAGE_SIZE;
+    if (definition.has_field("options"))
+    {
+        const document_object& options = definition.get_field("options").as_object();
+        auto read = [&](const char* name, std::size_t& value)
+        {
+            if (!options.has_field(name))
+                return;
+            value = options.get_field(name).as_scalar().to_number<std::size_t>();
+            if (value < MIN_PAGE_SIZE)
+                throw exception("index option '", name, "' must be at least ", std::size_t(MIN_PAGE_SIZE), " bytes");
+        };
+        read("page_size", leaf_bytes);
+        interior_bytes = leaf_bytes;
+        read("leaf_page_size", leaf_bytes);
+        read("interior_page_size", interior_bytes);
     }
+    // nodes are limited by size only
+    return btree::node_limits(std::numeric_limits<std::size_t>::max(), leaf_bytes, interior_bytes);
 }
 
 index::index(index&& other)
 :
     _tree(std::move(other._tree)),
-    _fields(std::move(other._fields))
+    _layout(std::move(other._layout))
 {
 }
 
@@ -81,11 +185,11 @@ index::~index()
 
 void index::insert(const document& storage_key, const document& doc)
 {
-    document_list index_key = extract_index_key(doc);
-
-    // enter the actual recursive algo
-    _tree.insert(index_key, storage_key);
-
+    document value = entry_value(_layout, storage_key, doc);
+    for(const std::string& key : index_keys(_layout.fields, _layout.multikey, doc))
+    {
+        _tree.insert_encoded(entry_key(_layout, key, storage_key), value);
+    }
 }
 
 void index::update(const document& old_doc, const document& new_doc)
@@ -94,10 +198,26 @@ void index::update(const document& old_doc, const document& new_doc)
     assert(false);
 }
 
-void index::del(const document& doc)
+void index::del(const document& storage_key, const document& doc)
 {
-    document_list index_key = extract_index_key(doc);
-    _tree.remove(index_key);
+    for(const std::string& key : index_keys(_layout.fields, _layout.multikey, doc))
+    {
+        if (_layout.posting_lists)
+            _tree.remove_encoded(entry_key(_layout, key, storage_key));
+        else
+            _tree.remove_encoded(key, entry_value(_layout, storage_key, doc)); // among the duplicates
+    }
+}
+
+void index::del(const document& storage_key, const document_view& doc)
+{
+    for(const std::string& key : index_keys(_layout.fields, _layout.multikey, doc))
+    {
+        if (_layout.posting_lists)
+            _tree.remove_encoded(entry_key(_layout, key, storage_key));
+        else
+            _tree.remove_encoded(key, entry_value(_layout, storage_key, doc));
+    }
 }
 
 document_list index::scan(
@@ -106,30 +226,266 @@ document_list index::scan(
     const boost::optional<document>& max,
     bool max_inlcusive,
     const boost::optional<std::size_t> limit,
-    const boost::optional<std::size_t> skip)
+    const boost::optional<std::size_t> skip,
+    bool reverse)
 {
-    boost::optional<document_list> min_index_key;
-    boost::optional<document_list> max_index_key;
-    if (min) min_index_key = extract_index_key(*min);
-    if (max) max_index_key = extract_index_key(*max);
+    boost::optional<std::string> min_index_key;
+    boost::optional<std::string> max_index_key;
+    if (min) min_index_key = bound_key(_layout, *min, min_inclusive, false);
+    if (max) max_index_key = bound_key(_layout, *max, max_inlcusive, true);
 
     std::size_t s = 0;
     if (skip) s = *skip;
     std::size_t l = std::numeric_limits<std::size_t>::max();
     if (limit) l = *limit;
 
-    return _tree.scan(min_index_key, min_inclusive, max_index_key, max_inlcusive, l, s);
+    if (!reverse && !_layout.posting_lists)
+    {
+        document_list result = _tree.scan_encoded(min_index_key, min_inclusive, max_index_key, max_inlcusive, l, s);
+        if (!_layout.include.empty())
+        {
+            for(document& value : result)
+            {
+                value = entry_storage_key(_layout, std::string(), value);
+            }
+        }
+        return result;
+    }
+
+    // storage keys in the entry keys are read with a cursor, the skipped entries are passed by the subtree counts
+    btree::cursor c = _tree.create_cursor();
+    if (reverse)
+    {
+        std::uint64_t up_to_max = max_index_key ? _tree.rank_encoded(*max_index_key, max_inlcusive) : _tree.size();
+        if (up_to_max <= s)
+            return document_list();
+        c.seek_to_position(up_to_max - s - 1);
+    }
+    else
+    {
+        std::uint64_t below_min = min_index_key ? _tree.rank_encoded(*min_index_key, !min_inclusive) : 0;
+        c.seek_to_position(below_min + s);
+    }
+
+    document_list result;
+    for(; c.valid() && result.size() < l; reverse ? c.prev() : c.next())
+    {
+        if (reverse && min_index_key && (c.key() < *min_index_key || (!min_inclusive && c.key() == *min_index_key)))
+            break;
+        if (!reverse && max_index_key && (*max_index_key < c.key() || (!max_inlcusive && c.key() == *max_index_key)))
+            break;
+        result.push_back(entry_storage_key(_layout, c.key(), c.value()));
+    }
+    return result;
+}
+
+std::uint64_t index::count(
+    const boost::optional<document>& min,
+    bool min_inclusive,
+    const boost::optional<document>& max,
+    bool max_inclusive)
+{
+    boost::optional<std::string> min_index_key;
+    boost::optional<std::string> max_index_key;
+    if (min) min_index_key = bound_key(_layout, *min, min_inclusive, false);
+    if (max) max_index_key = bound_key(_layout, *max, max_inclusive, true);
+
+    return _tree.count_encoded(min_index_key, min_inclusive, max_index_key, max_inclusive);
+}
+
+std::uint64_t index::rank(const document& key, bool inclusive)
+{
+    // entries below the posting lists of the key, or up to their end
+    return _tree.rank_encoded(bound_key(_layout, key, inclusive, true), inclusive);
 }
 
-document_list index::extract_index_key(const document& doc)
+boost::optional<document> index::select(std::uint64_t n)
+{
+    index_cursor c(_tree, _layout);
+    c.seek_to_position(n);
+    if (!c.valid())
+        return boost::none;
+    return c.key();
+}
+
+interfaces::index_cursor::unique_ptr index::create_cursor()
+{
+    return interfaces::index_cursor::unique_ptr(new index_cursor(_tree, _layout));
+}
+
+bool index::covers(const std::vector<std::string>& fields) const
+{
+    return std::all_of(fields.begin(), fields.end(),
+        [&](const std::string& name)
+        {
+            return std::find(_layout.include.begin(), _layout.include.end(), name) != _layout.include.end();
+        });
+}
+
+void index::flush()
+{
+    _tree.flush();
+}
+
+void index::discard()
+{
+    _tree.discard();
+}
+
+document index::stats()
+{
+    btree::stats s = _tree.get_stats();
+
+    document_object result;
+    result.set_field("scans", document_scalar::from(std::uint64_t(s.scans)));
+    result.set_field("comparisons", document_scalar::from(std::uint64_t(s.comparisons)));
+    result.set_field("last_scan_comparisons", document_scalar::from(std::uint64_t(s.last_scan_comparisons)));
+    return result;
+}
+
+document index::compact()
+{
+    btree::compact_result r = _tree.compact();
+
+    document_object result;
+    result.set_field("nodes_before", document_scalar::from(std::uint64_t(r.nodes_before)));
+    result.set_field("nodes_after", document_scalar::from(std::uint64_t(r.nodes_after)));
+    return result;
+}
+
+static document_object included_fields(const std::vector<std::string>& include, const document& doc)
+{
+    const document_object& as_map = doc.as_object();
+    document_object included;
+    for(const std::string& name : include)
+    {
+        auto it = as_map.find(name);
+        if (it != as_map.end())
+            included.set_field(name, it->second);
+    }
+    return included;
+}
+
+static document_object included_fields(const std::vector<std::string>& include, const document_view& doc)
+{
+    document_object included;
+    for(const std::string& name : include)
+    {
+        boost::optional<document_view> value = doc.find_field(name);
+        if (value)
+            included.set_field(name, value->to_document());
+    }
+    return included;
+}
+
+document index::entry_value(const layout& l, const document& storage_key, const document& doc)
+{
+    if (l.include.empty())
+        return l.posting_lists ? document(document_scalar::null()) : storage_key;
+
+    document included = included_fields(l.include, doc);
+    return l.posting_lists ? included : document(document_list({storage_key, included}));
+}
+
+document index::entry_value(const layout& l, const document& storage_key, const document_view& doc)
+{
+    if (l.include.empty())
+        return l.posting_lists ? document(document_scalar::null()) : storage_key;
+
+    document included = included_fields(l.include, doc);
+    return l.posting_lists ? included : document(document_list({storage_key, included}));
+}
+
+document index::entry_storage_key(const layout& l, const std::string& key, const document& value)
+{
+    if (!l.posting_lists)
+        return l.include.empty() ? value : value.as_list()[0];
+
+    std::size_t size = 0;
+    decode_key(l.fields, range(key), size);
+    return key_encoding::decode(range(key.data() + size, key.size() - size));
+}
+
+const document_object& index::entry_included(const layout& l, const document& value)
+{
+    return l.posting_lists ? value.as_object() : value.as_list()[1].as_object();
+}
+
+std::string index::entry_key(const layout& l, const std::string& index_key, const document& storage_key)
+{
+    std::string result = index_key;
+    if (l.posting_lists)
+        key_encoding::encode(result, storage_key);
+    return result;
+}
+
+std::string index::bound_key(const layout& l, const document& key, bool inclusive, bool upper)
+{
+    // storage keys start with a type byte below 0xff, so the entries of the key sort before its end
+    std::string result = encode_key(l.fields, extract_index_key(l.fields, key));
+    if (l.posting_lists && inclusive == upper)
+        result.push_back(static_cast<char>(0xff));
+    return result;
+}
+
+// keys of one document, for each element of an array in the indexed fields
+static std::vector<std::string> expand_keys(const index::field_list& fields, bool multikey, document_list values)
+{
+    std::size_t array = values.size();
+    for(std::size_t i = 0; multikey && i < values.size(); ++i)
+    {
+        if (boost::get<document_list>(&values[i]._v()))
+        {
+            if (array != values.size())
+                throw exception("multikey index: more than one indexed field is an array");
+            array = i;
+        }
+    }
+
+    std::vector<std::string> result;
+    if (array == values.size())
+    {
+        result.push_back(index::encode_key(fields, values));
+        return result;
+    }
+
+    const document_list elements = values[array].as_list();
+    if (elements.empty())
+    {
+        values[array] = document_scalar::null();
+        result.push_back(index::encode_key(fields, values));
+    }
+    for(const document& element : elements)
+    {
+        values[array] = element;
+        result.push_back(index::encode_key(fields, values));
+    }
+
+    // one entry per document and key
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::vector<std::string> index::index_keys(const field_list& fields, bool multikey, const document& doc)
+{
+    return expand_keys(fields, multikey, extract_index_key(fields, doc));
+}
+
+std::vector<std::string> index::index_keys(const field_list& fields, bool multikey, const document_view& doc)
+{
+    return expand_keys(fields, multikey, extract_index_key(fields, doc));
+}
+
+document_list index::extract_index_key(const field_list& fields, const document& doc)
 {
     const document_object& as_map = doc.as_object();
     document_list result;
-    result.reserve(_fields.size());
+    result.reserve(fields.size());
 
-    for(auto field : _fields)
+    for(auto field : fields)
     {
-        auto it = as_map.find(field.first);
+        auto it = as_map.find(field.name);
         if (it == as_map.end())
         {
             result.push_back(document_scalar::null());
@@ -143,5 +499,52 @@ document_list index::extract_index_key(const document& doc)
     return result;
 }
 
+document_list index::extract_index_key(const field_list& fields, const document_view& doc)
+{
+    document_list result;
+    result.reserve(fields.size());
+
+    // only the indexed fields are parsed
+    for(const auto& field : fields)
+    {
+        boost::optional<document_view> value = doc.find_field(field.name);
+        if (value)
+        {
+            result.push_back(value->to_document());
+        }
+        else
+        {
+            result.push_back(document_scalar::null());
+        }
+    }
+
+    return result;
+}
+
+static std::vector<bool> descending(const index::field_list& fields)
+{
+    std::vector<bool> result;
+    result.reserve(fields.size());
+    for(const index::field& f : fields)
+    {
+        result.push_back(f.descending);
+    }
+    return result;
+}
+
+std::string index::encode_key(const field_list& fields, const document_list& values)
+{
+    return key_encoding::encode_list(values, descending(fields));
+}
+
+document_list index::decode_key(const field_list& fields, const range& key)
+{
+    return key_encoding::decode_list(key, descending(fields));
+}
+
+document_list index::decode_key(const field_list& fields, const range& key, std::size_t& size)
+{
+    return key_encoding::decode_list(key, descending(fields), size);
+}
 
 } } }
@@ -24,23 +24,75 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "indexes/btree/btree.hpp"
 
+#include <string>
+#include <vector>
+
 namespace falcondb { namespace indexes { namespace btree {
 
+/// B-tree index. Entries are ordered by the fields in the order of the definition,
+/// fields with direction -1 in descending order.
+/// Fields listed in the definition's 'include' are stored in the leaves next to the storage keys,
+/// so projections on the included fields are answered by the index alone. Indexed fields are
+/// covered only when included as well: the key encoding loses missing fields and number types.
+/// With 'multikey' set, a document with an array in an indexed field has an entry for each element.
+///
+/// Entry keys end with the storage key of the document, so the entries of an index key form a
+/// posting list sorted by storage key. The leaves store each key as its difference to the
+/// previous one when both are of the same length, as the storage keys of a posting list mostly are.
+/// Each entry can be removed on its own.
+/// Definition options:
+///  page_size           target encoded size of nodes in bytes, default DEFAULT_PAGE_SIZE
+///  leaf_page_size      for leaves, overrides page_size
+///  interior_page_size  for interior nodes, overrides page_size
+///
+/// Indexes created before KEY_FORMAT was stored in the definition are ordered by field name,
+/// all ascending. Indexes created before POSTING_KEY_FORMAT have the storage key in the leaf values
 class index : public interfaces::index
 {
 public:
 
+    static const std::size_t DEFAULT_PAGE_SIZE = 4096;
+    static const std::size_t MIN_PAGE_SIZE = 256;
+
+    /// Written to definitions of new indexes as 'key_format'
+    static const int KEY_FORMAT = 3;
+
+    /// Key formats from which the fields follow the definition, and the entry keys end with the storage key
+    static const int ORDERED_KEY_FORMAT = 2;
+    static const int POSTING_KEY_FORMAT = 3;
+
+    struct field
+    {
+        std::string name;
+        bool descending;
+    };
+
+    /// indexed fields, in key order
+    typedef std::vector<field> field_list;
+
+    /// How the entries are built, from the definition
+    struct layout
+    {
+        field_list fields;
+        std::vector<std::string> include;
+        bool multikey;
+        bool posting_lists; // the entry keys end with the storage key
+    };
+
     // loads existing content
     static index load(
         interfaces::document_storage& storage,
         const document& definition,
         const document& root_storage_key);
 
-    // create new index
+    // create new index, covering all documents in data storage.
+    // 'progress', if set, is called every PROGRESS_INTERVAL documents read and entries written
     static index create(
         interfaces::document_storage& storage,
         const document& definition,
-        const document& root_storage_key);
+        const document& root_storage_key,
+        interfaces::document_storage& data_storage,
+        const interfaces::index_type::progress_handler& progress = interfaces::index_type::progress_handler());
 
     index(index&& other);
     virtual ~index();
@@ -51,7 +103,9 @@ public:
 
     virtual void update(const document& old_doc, const document& new_doc);
 
-    virtual void del(const document& doc);
+    virtual void del(const document& storage_key, const document& doc);
+
+    virtual void del(const document& storage_key, const document_view& doc);
 
     virtual document_list scan(
         const boost::optional<document>& min,
@@ -59,18 +113,87 @@ public:
         const boost::optional<document>& max,
         bool max_inlcusive,
         const boost::optional<std::size_t> limit,
-        const boost::optional<std::size_t> skip);
+        const boost::optional<std::size_t> skip,
+        bool reverse);
+
+    virtual bool ordered() const { return true; }
+
+    virtual bool multikey() const { return _layout.multikey; }
+
+    virtual std::uint64_t count(
+        const boost::optional<document>& min,
+        bool min_inclusive,
+        const boost::optional<document>& max,
+        bool max_inclusive);
+
+    virtual std::uint64_t rank(const document& key, bool inclusive);
+
+    virtual boost::optional<document> select(std::uint64_t n);
+
+    virtual bool covers(const std::vector<std::string>& fields) const;
+
+    virtual interfaces::index_cursor::unique_ptr create_cursor();
+
+    virtual void flush();
+
+    virtual void discard();
+
+    virtual document stats();
+
+    virtual document compact();
+
+    /// Reduce document to an array containing values related to fields specified in index definition
+    static document_list extract_index_key(const field_list& fields, const document& doc);
+    static document_list extract_index_key(const field_list& fields, const document_view& doc);
+
+    /// Encoded keys of the document: the key, or with 'multikey' a key for each distinct element
+    /// of the array in the indexed fields, an empty array indexed as null.
+    /// Throws if more than one of the indexed fields is an array
+    static std::vector<std::string> index_keys(const field_list& fields, bool multikey, const document& doc);
+    static std::vector<std::string> index_keys(const field_list& fields, bool multikey, const document_view& doc);
+
+    /// Key as stored in the tree, in key_encoding with the descending fields reversed
+    static std::string encode_key(const field_list& fields, const document_list& values);
+    static document_list decode_key(const field_list& fields, const range& key);
+
+    /// Decodes the index key at the start of an entry key, sets 'size' to its encoded size
+    static document_list decode_key(const field_list& fields, const range& key, std::size_t& size);
+
+    /// Fields of the definition, in key order
+    static field_list read_fields(const document_object& definition);
+
+    /// Included fields of the definition
+    static std::vector<std::string> read_include(const document_object& definition);
+
+    static layout read_layout(const document_object& definition);
+
+    /// Key of the entry in the tree: the index key, followed by the storage key with posting lists
+    static std::string entry_key(const layout& l, const std::string& index_key, const document& storage_key);
+
+    /// Entry key bounding the entries of the index key from below or above.
+    /// Posting lists of the key lie between the index key and the index key followed by 0xff
+    static std::string bound_key(const layout& l, const document& key, bool inclusive, bool upper);
+
+    /// Value stored in the leaf: {included fields present in the document}, or null without included fields.
+    /// Before posting lists: the storage key, or with included fields [storage key, {included fields}]
+    static document entry_value(const layout& l, const document& storage_key, const document& doc);
+    static document entry_value(const layout& l, const document& storage_key, const document_view& doc);
+
+    /// Storage key of the entry
+    static document entry_storage_key(const layout& l, const std::string& key, const document& value);
+
+    /// Included fields of the entry
+    static const document_object& entry_included(const layout& l, const document& value);
 
 private:
 
     index(btree&& tree, const document_object& definition);
 
-    /// Reduce document to an array containing values related to fields specified in index definition
-    document_list extract_index_key(const document& doc);
+    static btree::node_limits read_limits(const document_object& definition);
 
     // tree
     btree _tree;
-    std::map<std::string, int> _fields;
+    layout _layout;
 
 };
 
@@ -0,0 +1,110 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/btree/index_cursor.hpp"
+
+namespace falcondb { namespace indexes { namespace btree {
+
+index_cursor::index_cursor(btree& tree, const index::layout& layout)
+:
+    _cursor(tree),
+    _layout(layout)
+{
+}
+
+void index_cursor::seek_to_first()
+{
+    _cursor.seek_to_first();
+}
+
+void index_cursor::seek_to_last()
+{
+    _cursor.seek_to_last();
+}
+
+void index_cursor::seek(const document& key, bool inclusive)
+{
+    _cursor.seek(index::bound_key(_layout, key, inclusive, false), inclusive);
+}
+
+void index_cursor::seek_for_prev(const document& key, bool inclusive)
+{
+    _cursor.seek_for_prev(index::bound_key(_layout, key, inclusive, true), inclusive);
+}
+
+void index_cursor::seek_to_position(std::uint64_t n)
+{
+    _cursor.seek_to_position(n);
+}
+
+bool index_cursor::valid() const
+{
+    return _cursor.valid();
+}
+
+void index_cursor::next()
+{
+    _cursor.next();
+}
+
+void index_cursor::prev()
+{
+    _cursor.prev();
+}
+
+document index_cursor::key() const
+{
+    // the key list follows the order of the fields
+    std::size_t size = 0;
+    const document_list values = index::decode_key(_layout.fields, range(_cursor.key()), size);
+    assert(values.size() == _layout.fields.size());
+
+    document_object result;
+    auto value = values.begin();
+    for(const auto& field : _layout.fields)
+    {
+        result.set_field(field.name, *value++);
+    }
+    return result;
+}
+
+document index_cursor::storage_key() const
+{
+    return index::entry_storage_key(_layout, _cursor.key(), _cursor.value());
+}
+
+document index_cursor::covered_fields() const
+{
+    if (_layout.include.empty())
+        return document_object();
+    document value = _cursor.value();
+    return index::entry_included(_layout, value);
+}
+
+document index_cursor::position() const
+{
+    return _cursor.position();
+}
+
+void index_cursor::resume(const document& position)
+{
+    _cursor.resume(position);
+}
+
+} } }
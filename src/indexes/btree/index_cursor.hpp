@@ -0,0 +1,58 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_INDEXES_BTREE_INDEX_CURSOR_HPP
+#define FALCONDB_INDEXES_BTREE_INDEX_CURSOR_HPP
+
+#include "indexes/btree/index.hpp"
+
+namespace falcondb { namespace indexes { namespace btree {
+
+/// Index cursor over the btree, translating keys between documents and the tree encoding
+class index_cursor : public interfaces::index_cursor
+{
+public:
+
+    index_cursor(btree& tree, const index::layout& layout);
+
+    // interface
+
+    virtual void seek_to_first();
+    virtual void seek_to_last();
+    virtual void seek(const document& key, bool inclusive);
+    virtual void seek_for_prev(const document& key, bool inclusive);
+    virtual void seek_to_position(std::uint64_t n);
+    virtual bool valid() const;
+    virtual void next();
+    virtual void prev();
+    virtual document key() const;
+    virtual document storage_key() const;
+    virtual document covered_fields() const;
+    virtual document position() const;
+    virtual void resume(const document& position);
+
+private:
+
+    btree::cursor _cursor;
+    const index::layout _layout;
+};
+
+} } }
+
+#endif
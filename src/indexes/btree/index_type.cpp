@@ -48,21 +48,43 @@ std::unique_ptr<interfaces::index> index_type::load_index(
 interfaces::index_type::create_result index_type::create_index(
     const document& index_definition,
     interfaces::document_storage& index_storage,
-    interfaces::document_storage& data_storage)
+    interfaces::document_storage& data_storage,
+    const progress_handler& progress)
 {
     verify_definition(index_definition);
 
+    // new indexes follow the field order and directions of the definition
+    document_object definition = index_definition.as_object();
+    definition.set_field("key_format", document_scalar::from(int(index::KEY_FORMAT)));
+
     boost::uuids::random_generator gen;
     document new_storage_root = document::from(gen());
-    std::unique_ptr<index> new_index(new index(index::create(index_storage, index_definition, new_storage_root)));
+    std::unique_ptr<index> new_index;
+    try
+    {
+        new_index.reset(new index(index::create(index_storage, definition, new_storage_root, data_storage, progress)));
+    }
+    catch(...)
+    {
+        // the nodes written so far can't be found from anywhere else
+        btree::btree::drop(index_storage, new_storage_root);
+        throw;
+    }
 
     document_object index_description;
     index_description.insert(std::make_pair("root", new_storage_root));
-    index_description.insert(std::make_pair("definition", index_definition));
+    index_description.insert(std::make_pair("definition", document(definition)));
 
     return create_result{ document(index_description), std::move(new_index) };
 }
 
+void index_type::drop_index(
+    interfaces::document_storage& index_storage,
+    const document& index_description)
+{
+    btree::drop(index_storage, index_description.as_object().get_field("root"));
+}
+
 void index_type::verify_definition(const document& definition)
 {
     try
@@ -72,13 +94,28 @@ void index_type::verify_definition(const document& definition)
         {
             const document_object& field_obj = field.as_object();
             field_obj.get_field("name").as_scalar();
-            field_obj.get_field("direction").as_scalar();
+            std::int32_t direction = field_obj.get_field("direction").as_scalar().to_number<std::int32_t>();
+            if (direction != 1 && direction != -1)
+                throw exception("field direction is not 1 or -1");
+        }
+
+        if (definition.as_object().has_field("multikey"))
+        {
+            definition.as_object().get_field("multikey").as<bool>();
+        }
+
+        if (definition.as_object().has_field("include"))
+        {
+            for(const document& name : definition.as_object().get_field("include").as_list())
+            {
+                name.as_scalar().as<std::string>();
+            }
         }
 
     }
-    catch(...)
+    catch(const std::exception& e)
     {
-        throw exception("Index definition invalid");
+        throw exception("Index definition invalid: ", e.what());
     }
 }
 
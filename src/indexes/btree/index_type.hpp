@@ -38,7 +38,12 @@ public:
 
     virtual create_result create_index(const document& index_definition,
         interfaces::document_storage& index_storage,
-        interfaces::document_storage& data_storage);
+        interfaces::document_storage& data_storage,
+        const progress_handler& progress);
+
+    virtual void drop_index(
+        interfaces::document_storage& index_storage,
+        const document& index_description);
 
     // other
 
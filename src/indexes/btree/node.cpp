@@ -0,0 +1,576 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/btree/node.hpp"
+
+#include "document/detail/binary_format.hpp"
+#include "document/key_encoding.hpp"
+
+#include "utils/exception.hpp"
+
+#include <cassert>
+
+namespace falcondb { namespace indexes { namespace btree {
+
+using detail::binary_format::write_varint;
+using detail::binary_format::read_varint;
+using detail::binary_format::varint_size;
+
+static const std::uint8_t NODE_FORMAT_VERSION = 2;
+
+// written before keys of the same length as the previous one were delta-encoded
+static const std::uint8_t PREFIX_KEYS_FORMAT_VERSION = 1;
+
+node::node(node_type t)
+:
+    type(t),
+    prev(document_scalar::null()),
+    next(document_scalar::null())
+{
+}
+
+node node::create_leaf()
+{
+    return node(leaf);
+}
+
+node node::create_interior()
+{
+    return node(interior);
+}
+
+std::uint64_t node::count() const
+{
+    if (is_leaf())
+    {
+        return size();
+    }
+
+    std::uint64_t result = 0;
+    for(std::uint64_t c : counts)
+    {
+        result += c;
+    }
+    return result;
+}
+
+void node::erase(std::size_t i)
+{
+    assert(i < size());
+    keys.erase(keys.begin() + i);
+    if (is_leaf())
+    {
+        values.erase(values.begin() + i);
+    }
+    else
+    {
+        max_keys.erase(max_keys.begin() + i);
+        counts.erase(counts.begin() + i);
+        children.erase(children.begin() + i);
+    }
+}
+
+template<typename T>
+static void move_tail(std::vector<T>& from, std::vector<T>& to, std::size_t at)
+{
+    to.reserve(from.size() - at);
+    std::move(from.begin() + at, from.end(), std::back_inserter(to));
+    from.erase(from.begin() + at, from.end());
+}
+
+node node::split(std::size_t at)
+{
+    assert(at <= size());
+    node result(type);
+    move_tail(keys, result.keys, at);
+    if (is_leaf())
+    {
+        move_tail(values, result.values, at);
+    }
+    else
+    {
+        move_tail(max_keys, result.max_keys, at);
+        move_tail(counts, result.counts, at);
+        move_tail(children, result.children, at);
+    }
+    return result;
+}
+
+template<typename T>
+static void move_all(std::vector<T>& from, std::vector<T>& to)
+{
+    to.reserve(to.size() + from.size());
+    std::move(from.begin(), from.end(), std::back_inserter(to));
+    from.clear();
+}
+
+void node::append(node& other)
+{
+    assert(other.type == type);
+    move_all(other.keys, keys);
+    if (is_leaf())
+    {
+        move_all(other.values, values);
+    }
+    else
+    {
+        move_all(other.max_keys, max_keys);
+        move_all(other.counts, counts);
+        move_all(other.children, children);
+    }
+}
+
+void node::insert_child(std::size_t i, const std::string& min_key, const std::string& max_key, std::uint64_t count, const document& child)
+{
+    assert(!is_leaf() && i <= size());
+    keys.insert(keys.begin() + i, min_key);
+    max_keys.insert(max_keys.begin() + i, max_key);
+    counts.insert(counts.begin() + i, count);
+    children.insert(children.begin() + i, child);
+}
+
+void node::set_child(std::size_t i, const std::string& min_key, const std::string& max_key, std::uint64_t count, const document& child)
+{
+    assert(!is_leaf() && i < size());
+    keys[i] = min_key;
+    max_keys[i] = max_key;
+    counts[i] = count;
+    children[i] = child;
+}
+
+// serialization helpers
+
+static void write_bytes(std::string& out, const std::string& bytes)
+{
+    write_varint(out, bytes.size());
+    out.append(bytes);
+}
+
+static std::string read_bytes(const char*& it, const char* end)
+{
+    std::uint64_t size = read_varint(it, end);
+    if (std::uint64_t(end - it) < size)
+    {
+        throw exception("b-tree node truncated");
+    }
+    std::string result(it, size);
+    it += size;
+    return result;
+}
+
+static std::size_t shared_prefix(const std::string* previous, const std::string& key)
+{
+    std::size_t shared = 0;
+    if (previous)
+    {
+        std::size_t max_shared = std::min(previous->size(), key.size());
+        while (shared < max_shared && (*previous)[shared] == key[shared])
+        {
+            ++shared;
+        }
+    }
+    return shared;
+}
+
+// a key of the same length as the previous one and not below it, as within a posting list,
+// is stored as the difference of the two, read as big-endian numbers
+static bool is_delta(const std::string* previous, const std::string& key, std::size_t shared)
+{
+    return previous && previous->size() == key.size()
+        && (shared == key.size() || std::uint8_t(key[shared]) > std::uint8_t((*previous)[shared]));
+}
+
+// key - previous, passing bytes from the last one to 'out' until it returns false
+template<typename Out>
+static void subtract(const std::string& previous, const std::string& key, Out out)
+{
+    int borrow = 0;
+    for(std::size_t i = key.size(); i > 0; --i)
+    {
+        int digit = std::uint8_t(key[i - 1]) - std::uint8_t(previous[i - 1]) - borrow;
+        borrow = digit < 0;
+        if (!out(i - 1, static_cast<std::uint8_t>(digit + (borrow ? 256 : 0))))
+            return;
+    }
+    assert(borrow == 0);
+}
+
+// whether bytes of key from 'from' on are below those of previous, which are equal after 'last'
+static bool below(const std::uint8_t* k, const std::uint8_t* p, std::size_t from, std::size_t last)
+{
+    while(from < last && k[from] == p[from])
+    {
+        ++from;
+    }
+    return from <= last && k[from] < p[from];
+}
+
+// size of key - previous without leading and trailing zero bytes, the latter counted in 'trailing'
+static std::size_t delta_size(const std::string& previous, const std::string& key, std::size_t shared, std::size_t& trailing)
+{
+    trailing = 0;
+    if (shared == key.size())
+        return 0;
+
+    // bytes equal at the end subtract to zeros, the first different one from the end does not
+    const std::uint8_t* k = reinterpret_cast<const std::uint8_t*>(key.data());
+    const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(previous.data());
+    std::size_t last = key.size() - 1;
+    while(k[last] == p[last])
+    {
+        --last;
+    }
+    trailing = key.size() - 1 - last;
+
+    // the delta starts where the keys differ, unless a borrow from the bytes after cancels the difference,
+    // and so it does for bytes 0x00 over 0xff while the borrow goes on
+    std::size_t first = shared;
+    if (k[shared] - p[shared] == 1 && below(k, p, shared + 1, last))
+    {
+        first = shared + 1;
+        while(k[first] == 0x00 && p[first] == 0xff && below(k, p, first + 1, last))
+        {
+            ++first;
+        }
+    }
+    return last - first + 1;
+}
+
+// key - previous, without leading and trailing zero bytes, the latter counted in 'trailing'
+static std::string key_delta(const std::string& previous, const std::string& key, std::size_t shared, std::size_t& trailing)
+{
+    std::string delta(delta_size(previous, key, shared, trailing), '\0');
+    if (delta.empty())
+        return delta;
+
+    std::size_t end = key.size() - trailing;
+    subtract(previous, key,
+        [&](std::size_t i, std::uint8_t digit)
+        {
+            if (i < end)
+                delta[delta.size() - (end - i)] = static_cast<char>(digit);
+            return i > end - delta.size();
+        });
+    return delta;
+}
+
+// key = previous + delta followed by 'trailing' zero bytes, false if the sum does not fit in the length of previous
+static bool add_delta(std::string& key, const char* delta, std::size_t size, std::size_t trailing)
+{
+    int carry = 0;
+    std::size_t i = key.size() - trailing;
+    for(std::size_t d = size; d > 0 || (carry && i > 0); --i)
+    {
+        int digit = std::uint8_t(key[i - 1]) + carry + (d > 0 ? std::uint8_t(delta[--d]) : 0);
+        carry = digit > 255;
+        key[i - 1] = static_cast<char>(digit & 0xff);
+    }
+    return carry == 0;
+}
+
+// keys are either delta-encoded, or share a prefix with the previous one:
+// 2 * shared length, suffix length, suffix; or 2 * trailing zero bytes of the delta + 1, delta length, delta
+static void write_keys(std::string& out, const std::vector<std::string>& keys)
+{
+    const std::string* previous = nullptr;
+    for(const std::string& key : keys)
+    {
+        std::size_t shared = shared_prefix(previous, key);
+        if (is_delta(previous, key, shared))
+        {
+            std::size_t trailing = 0;
+            std::string delta = key_delta(*previous, key, shared, trailing);
+            write_varint(out, 2 * trailing + 1);
+            write_bytes(out, delta);
+        }
+        else
+        {
+            write_varint(out, 2 * shared);
+            write_varint(out, key.size() - shared);
+            out.append(key, shared, std::string::npos);
+        }
+        previous = &key;
+    }
+}
+
+// nodes of PREFIX_KEYS_FORMAT_VERSION have the shared length alone in place of 2 * shared
+static void read_keys(const char*& it, const char* end, std::size_t count, bool deltas, std::vector<std::string>& keys)
+{
+    keys.reserve(count);
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        std::uint64_t header = read_varint(it, end);
+        if (deltas && (header & 1))
+        {
+            std::uint64_t trailing = header / 2;
+            std::uint64_t size = read_varint(it, end);
+            if (i == 0 || trailing > keys.back().size() || size > keys.back().size() - trailing || std::uint64_t(end - it) < size)
+            {
+                throw exception("b-tree node: malformed key section");
+            }
+
+            std::string key = keys.back();
+            if (!add_delta(key, it, size, trailing))
+            {
+                throw exception("b-tree node: malformed key section");
+            }
+            it += size;
+            keys.push_back(std::move(key));
+            continue;
+        }
+
+        std::uint64_t shared = deltas ? header / 2 : header;
+        std::uint64_t suffix = read_varint(it, end);
+        if ((i == 0 && shared > 0) || (i > 0 && shared > keys.back().size()) || std::uint64_t(end - it) < suffix)
+        {
+            throw exception("b-tree node: malformed key section");
+        }
+
+        std::string key;
+        key.reserve(shared + suffix);
+        if (shared > 0)
+        {
+            key.assign(keys.back(), 0, shared);
+        }
+        key.append(it, suffix);
+        it += suffix;
+        keys.push_back(std::move(key));
+    }
+}
+
+// node ids as binary documents, empty for null
+static void write_id(std::string& out, const document& id)
+{
+    write_bytes(out, id.is_null() ? std::string() : id.to_binary());
+}
+
+std::size_t node::id_size(const document& id)
+{
+    // node ids are uuids, all of the same size: they are not encoded to be measured
+    static const std::size_t uuid_size = document(document_scalar::from(boost::uuids::uuid())).to_binary().size();
+    const document_scalar* scalar = boost::get<document_scalar>(&id._v());
+    std::size_t size = 0;
+    if (scalar && boost::get<boost::uuids::uuid>(&scalar->_v()))
+    {
+        size = uuid_size;
+    }
+    else if (!id.is_null())
+    {
+        size = id.to_binary().size();
+    }
+    return varint_size(size) + size;
+}
+
+static document read_id(const char*& it, const char* end)
+{
+    std::string data = read_bytes(it, end);
+    return data.empty() ? document(document_scalar::null()) : document::from_binary(data);
+}
+
+// leaf values, empty for null: entries of posting list indexes without included fields have no value
+static const std::string& null_value()
+{
+    static const std::string binary_null = document(document_scalar::null()).to_binary();
+    return binary_null;
+}
+
+static std::size_t value_size(const std::string& value)
+{
+    return value == null_value() ? 0 : value.size();
+}
+
+std::string node::encode() const
+{
+    std::string out;
+    out.push_back(NODE_FORMAT_VERSION);
+    out.push_back(type);
+    write_varint(out, size());
+    write_keys(out, keys);
+
+    if (is_leaf())
+    {
+        for(const std::string& value : values)
+        {
+            if (value_size(value) > 0)
+                write_bytes(out, value);
+            else
+                write_varint(out, 0);
+        }
+        write_id(out, prev);
+        write_id(out, next);
+    }
+    else
+    {
+        write_keys(out, max_keys);
+        for(std::uint64_t c : counts)
+        {
+            write_varint(out, c);
+        }
+        for(const document& child : children)
+        {
+            write_id(out, child);
+        }
+    }
+    return out;
+}
+
+// bytes taken by i-th key in the keys section
+static std::size_t key_size(const std::vector<std::string>& keys, std::size_t i)
+{
+    const std::string* previous = i > 0 ? &keys[i - 1] : nullptr;
+    std::size_t shared = shared_prefix(previous, keys[i]);
+    if (is_delta(previous, keys[i], shared))
+    {
+        std::size_t trailing = 0;
+        std::size_t delta = delta_size(*previous, keys[i], shared, trailing);
+        return varint_size(2 * trailing + 1) + varint_size(delta) + delta;
+    }
+
+    std::size_t suffix = keys[i].size() - shared;
+    return varint_size(2 * shared) + varint_size(suffix) + suffix;
+}
+
+std::size_t node::entry_size(std::size_t i) const
+{
+    assert(i < size());
+    if (is_leaf())
+    {
+        std::size_t value = value_size(values[i]);
+        return key_size(keys, i) + varint_size(value) + value;
+    }
+    else
+    {
+        return key_size(keys, i) + key_size(max_keys, i) + varint_size(counts[i]) + id_size(children[i]);
+    }
+}
+
+std::size_t node::encoded_size() const
+{
+    std::size_t result = 2 + varint_size(size());
+    for(std::size_t i = 0; i < size(); ++i)
+    {
+        result += entry_size(i);
+    }
+    if (is_leaf())
+    {
+        result += id_size(prev) + id_size(next);
+    }
+    return result;
+}
+
+node node::decode(const range& data)
+{
+    const char* it = data.begin();
+    const char* end = data.end();
+    std::uint8_t version = data.size() < 2 ? 0 : std::uint8_t(it[0]);
+    if (version != NODE_FORMAT_VERSION && version != PREFIX_KEYS_FORMAT_VERSION)
+    {
+        throw exception("b-tree node: unknown format");
+    }
+    if (std::uint8_t(it[1]) > interior)
+    {
+        throw exception("b-tree node: unknown node type ", int(std::uint8_t(it[1])));
+    }
+
+    node result(static_cast<node_type>(it[1]));
+    it += 2;
+
+    std::size_t count = read_varint(it, end);
+    read_keys(it, end, count, version != PREFIX_KEYS_FORMAT_VERSION, result.keys);
+
+    if (result.is_leaf())
+    {
+        result.values.reserve(count);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            std::string value = read_bytes(it, end);
+            result.values.push_back(value.empty() ? null_value() : std::move(value));
+        }
+        result.prev = read_id(it, end);
+        result.next = read_id(it, end);
+    }
+    else
+    {
+        read_keys(it, end, count, version != PREFIX_KEYS_FORMAT_VERSION, result.max_keys);
+        result.counts.reserve(count);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            result.counts.push_back(read_varint(it, end));
+        }
+        result.children.reserve(count);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            result.children.push_back(read_id(it, end));
+        }
+    }
+
+    if (it != end)
+    {
+        throw exception("b-tree node: trailing data");
+    }
+    return result;
+}
+
+document node::to_document() const
+{
+    return document_scalar::from(encode());
+}
+
+node node::from_document(const document& doc)
+{
+    const document_scalar* encoded = boost::get<document_scalar>(&doc._v());
+    if (encoded)
+    {
+        return decode(encoded->as<std::string>());
+    }
+
+    // legacy layout: {"type":..., "data":[...], "prev":..., "next":...}
+    const document_object& legacy = doc.as_object();
+    const document_list& data = legacy.get_field("data").as_list();
+    if (legacy.get_field("type").as_scalar().as<std::string>() == "leaf")
+    {
+        node result = create_leaf();
+        for(const document& entry : data)
+        {
+            const document_object& kv = entry.as_object();
+            result.keys.push_back(key_encoding::encode(kv.get_field("key")));
+            result.values.push_back(kv.get_field("value").to_binary());
+        }
+        result.prev = legacy.get_field("prev");
+        result.next = legacy.get_field("next");
+        return result;
+    }
+    else
+    {
+        node result = create_interior();
+        for(const document& entry : data)
+        {
+            const document_object& summary = entry.as_object();
+            result.insert_child(
+                result.size(),
+                key_encoding::encode(summary.get_field("min")),
+                key_encoding::encode(summary.get_field("max")),
+                summary.get_field("count").as_scalar().to_number<std::uint64_t>(),
+                summary.get_field("storage"));
+        }
+        return result;
+    }
+}
+
+}}}
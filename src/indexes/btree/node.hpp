@@ -0,0 +1,126 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_INDEXES_BTREE_NODE_HPP
+#define FALCONDB_INDEXES_BTREE_NODE_HPP
+
+#include "document/document.hpp"
+
+#include "utils/range.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace falcondb { namespace indexes { namespace btree {
+
+/// Number of entries in the subtree of a child. Changed atomically, so the writers of a leaf can
+/// apply their changes to its ancestors with only shared latches held, while others read them
+class subtree_count
+{
+public:
+
+    subtree_count(std::uint64_t n = 0) : _n(n) {}
+    subtree_count(const subtree_count& other) : _n(other) {}
+
+    subtree_count& operator=(const subtree_count& other) { _n.store(other, std::memory_order_relaxed); return *this; }
+
+    operator std::uint64_t() const { return _n.load(std::memory_order_relaxed); }
+
+    void add(std::int64_t delta) { _n.fetch_add(static_cast<std::uint64_t>(delta), std::memory_order_relaxed); }
+
+private:
+
+    std::atomic<std::uint64_t> _n;
+};
+
+/// Decoded B-tree node, as struct of arrays. Keys are in key_encoding, so they compare as bytes.
+/// Stored as a single binary string value, in the layout described in doc/StorageFormats.txt
+struct node
+{
+    enum node_type : std::uint8_t
+    {
+        leaf = 0,
+        interior = 1
+    };
+
+    explicit node(node_type t);
+
+    node_type type;
+
+    /// leaf: entry keys; interior: min key of each child
+    std::vector<std::string> keys;
+
+    // leaf only
+    std::vector<std::string> values; // binary format
+    document prev; // siblings, null at the ends
+    document next;
+
+    // interior only
+    std::vector<std::string> max_keys;
+    std::vector<subtree_count> counts;
+    std::vector<document> children;
+
+    static node create_leaf();
+    static node create_interior();
+
+    bool is_leaf() const { return type == leaf; }
+    std::size_t size() const { return keys.size(); }
+
+    /// number of records in the subtree
+    std::uint64_t count() const;
+
+    /// removes i-th entry
+    void erase(std::size_t i);
+
+    /// moves entries [at, size) into returned node of the same type
+    node split(std::size_t at);
+
+    /// moves all entries of 'other', of the same type, to the end
+    void append(node& other);
+
+    void insert_child(std::size_t i, const std::string& min_key, const std::string& max_key, std::uint64_t count, const document& child);
+    void set_child(std::size_t i, const std::string& min_key, const std::string& max_key, std::uint64_t count, const document& child);
+
+    // serialization
+
+    std::string encode() const;
+    static node decode(const range& data);
+
+    /// Size of encode() result, computed without encoding
+    std::size_t encoded_size() const;
+
+    /// Bytes taken by i-th entry in the encoded node. Keys are stored as a shared prefix or a delta
+    /// to the previous one, so the size depends on the preceding entry
+    std::size_t entry_size(std::size_t i) const;
+
+    /// Bytes taken by a sibling or child id
+    static std::size_t id_size(const document& id);
+
+    /// Node as stored in document storage
+    document to_document() const;
+
+    /// Reads stored node. Nodes written as objects, before the binary layout existed, are converted
+    static node from_document(const document& doc);
+};
+
+}}}
+
+#endif
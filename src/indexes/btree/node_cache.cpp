@@ -0,0 +1,326 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/btree/node_cache.hpp"
+
+#include <cassert>
+#include <tuple>
+
+namespace falcondb { namespace indexes { namespace btree {
+
+node_cache::entry::entry(const btree::node& n)
+:
+    node(n),
+    dirty(false),
+    removed(false),
+    pins(0),
+    stamp(0)
+{
+}
+
+node_cache::pin::pin(pin&& other)
+:
+    _cache(other._cache),
+    _it(other._it)
+{
+    other._cache = nullptr;
+}
+
+node_cache::pin& node_cache::pin::operator=(pin&& other)
+{
+    if (this != &other)
+    {
+        release();
+        _cache = other._cache;
+        _it = other._it;
+        other._cache = nullptr;
+    }
+    return *this;
+}
+
+void node_cache::pin::release()
+{
+    if (_cache)
+    {
+        _cache->unpin(_it);
+        _cache = nullptr;
+    }
+}
+
+node_cache::node_cache(interfaces::document_storage& storage, std::size_t max_leaves)
+:
+    _storage(storage),
+    _max_leaves(max_leaves),
+    _dirty_count(0),
+    _next_stamp(0)
+{
+}
+
+node_cache::node_cache(node_cache&& other)
+:
+    _storage(other._storage),
+    _max_leaves(other._max_leaves),
+    _entries(std::move(other._entries)),
+    _lru(std::move(other._lru)),
+    _removed(std::move(other._removed)),
+    _dirty_count(other._dirty_count),
+    _next_stamp(other._next_stamp)
+{
+}
+
+node& node_cache::get(const document& key)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return find_or_load(key)->second.node;
+}
+
+node_cache::pin node_cache::get_pinned(const document& key)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    auto it = find_or_load(key);
+    ++it->second.pins;
+    return pin(*this, it);
+}
+
+node_cache::pin node_cache::find_pinned(const document& key)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    auto it = _entries.find(key);
+    if (it == _entries.end() || it->second.removed)
+    {
+        return pin();
+    }
+    if (it->second.node.is_leaf())
+    {
+        _lru.splice(_lru.begin(), _lru, it->second.lru_position);
+    }
+    ++it->second.pins;
+    return pin(*this, it);
+}
+
+node_cache::entry_map::iterator node_cache::find_or_load(const document& key)
+{
+    auto it = _entries.find(key);
+    if (it == _entries.end())
+    {
+        it = insert(key, node::from_document(_storage.read(key)), false);
+    }
+    else if (it->second.node.is_leaf() && !it->second.removed)
+    {
+        _lru.splice(_lru.begin(), _lru, it->second.lru_position);
+    }
+    return it;
+}
+
+void node_cache::put(const document& key, const node& n)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _removed.erase(key);
+    auto it = _entries.find(key);
+    if (it == _entries.end())
+    {
+        insert(key, n, true);
+    }
+    else
+    {
+        entry& e = it->second;
+        assert(e.node.is_leaf() == n.is_leaf());
+        if (e.removed && n.is_leaf())
+        {
+            _lru.push_front(key);
+            e.lru_position = _lru.begin();
+        }
+        e.removed = false;
+        e.node = n;
+        e.stamp = ++_next_stamp;
+        set_dirty(e);
+    }
+}
+
+void node_cache::mark_dirty(const document& key)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    auto it = _entries.find(key);
+    assert(it != _entries.end());
+    it->second.stamp = ++_next_stamp;
+    set_dirty(it->second);
+}
+
+void node_cache::mark_dirty(const pin& p)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    p._it->second.stamp = ++_next_stamp;
+    set_dirty(p._it->second);
+}
+
+void node_cache::remove(const document& key)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    auto it = _entries.find(key);
+    if (it != _entries.end() && !it->second.removed)
+    {
+        entry& e = it->second;
+        if (e.dirty)
+        {
+            e.dirty = false;
+            --_dirty_count;
+        }
+        if (e.node.is_leaf()) _lru.erase(e.lru_position);
+        if (e.pins == 0)
+        {
+            _entries.erase(it);
+        }
+        else
+        {
+            e.removed = true;
+        }
+    }
+    _removed.insert(key);
+}
+
+void node_cache::flush()
+{
+    boost::mutex::scoped_lock flush_lock(_flush_mutex);
+
+    std::vector<pin> dirty;
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        for(const document& key : _removed)
+        {
+            _storage.remove(key);
+        }
+        _removed.clear();
+
+        for(auto it = _entries.begin(); _dirty_count > dirty.size() && it != _entries.end(); ++it)
+        {
+            if (it->second.dirty)
+            {
+                ++it->second.pins;
+                dirty.push_back(pin(*this, it));
+            }
+        }
+    }
+
+    for(const pin& p : dirty)
+    {
+        // the flag is cleared before the node is encoded, so changes made meanwhile mark it again
+        rwmutex::scoped_read_lock latch(p.latch());
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            if (!p._it->second.dirty)
+            {
+                continue; // removed meanwhile
+            }
+            p._it->second.dirty = false;
+            --_dirty_count;
+        }
+        document encoded = p->to_document();
+        boost::mutex::scoped_lock lock(_mutex);
+        _storage.write(p.key(), encoded);
+    }
+}
+
+void node_cache::clear()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _entries.clear();
+    _lru.clear();
+    _removed.clear();
+    _dirty_count = 0;
+}
+
+void node_cache::trim()
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    auto lru_it = _lru.end();
+    while (_lru.size() > _max_leaves && lru_it != _lru.begin())
+    {
+        --lru_it;
+        auto it = _entries.find(*lru_it);
+        assert(it != _entries.end());
+        if (it->second.pins > 0)
+        {
+            continue;
+        }
+        if (it->second.dirty)
+        {
+            _storage.write(it->first, it->second.node.to_document());
+            --_dirty_count;
+        }
+        lru_it = _lru.erase(lru_it);
+        _entries.erase(it);
+    }
+}
+
+document node_cache::read(const document& key)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _storage.read(key);
+}
+
+void node_cache::write(const document& key, const document& value)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    _storage.write(key, value);
+}
+
+std::size_t node_cache::dirty_count() const
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    return _dirty_count;
+}
+
+node_cache::entry_map::iterator node_cache::insert(const document& key, const node& n, bool dirty)
+{
+    auto it = _entries.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(n)).first;
+    entry& e = it->second;
+    e.lru_position = _lru.end();
+    e.stamp = ++_next_stamp;
+    if (n.is_leaf())
+    {
+        _lru.push_front(key);
+        e.lru_position = _lru.begin();
+    }
+    if (dirty)
+    {
+        set_dirty(e);
+    }
+    return it;
+}
+
+void node_cache::set_dirty(entry& e)
+{
+    if (!e.dirty)
+    {
+        e.dirty = true;
+        ++_dirty_count;
+    }
+}
+
+void node_cache::unpin(entry_map::iterator it)
+{
+    boost::mutex::scoped_lock lock(_mutex);
+    assert(it->second.pins > 0);
+    if (--it->second.pins == 0 && it->second.removed)
+    {
+        _entries.erase(it);
+    }
+}
+
+}}}
@@ -0,0 +1,159 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_INDEXES_BTREE_NODE_CACHE_HPP
+#define FALCONDB_INDEXES_BTREE_NODE_CACHE_HPP
+
+#include "interfaces/document_storage.hpp"
+
+#include "indexes/btree/node.hpp"
+
+#include "utils/rwmutex.hpp"
+
+#include <boost/thread/mutex.hpp>
+
+#include <list>
+#include <map>
+#include <set>
+
+namespace falcondb { namespace indexes { namespace btree {
+
+/// Write-back cache of decoded B-tree nodes, each with the latch guarding it.
+/// Interior nodes stay resident, leaves are kept on LRU basis, up to 'max_leaves'.
+/// Modified nodes are written to the storage only when flushed, or when an evicted leaf is dirty.
+/// Removals reach the storage when flushed as well.
+/// Nodes used concurrently are pinned: pinned nodes are not evicted, and removed ones are kept until
+/// the last pin is released, so a node stays valid for the threads waiting for its latch.
+/// Nodes returned unpinned stay valid until trim(), for callers serializing the access themselves.
+/// The cache is thread-safe, except for clear(), and accesses the storage from one thread at a time.
+/// The nodes are read and modified under their latches, which the cache takes only when flushing
+class node_cache
+{
+    struct entry
+    {
+        explicit entry(const btree::node& n);
+
+        btree::node node;
+        bool dirty;
+        bool removed; // from the tree, kept while pinned
+        std::size_t pins;
+        std::uint64_t stamp;
+        std::list<document>::iterator lru_position; // valid for leaves only
+        rwmutex latch;
+    };
+    typedef std::map<document, entry> entry_map;
+
+public:
+
+    /// Keeps a node in the cache, until released or destroyed
+    class pin
+    {
+    public:
+
+        pin() : _cache(nullptr) {}
+        pin(pin&& other);
+        pin& operator=(pin&& other);
+        ~pin() { release(); }
+
+        explicit operator bool() const { return _cache != nullptr; }
+
+        node& operator*() const { return _it->second.node; }
+        node* operator->() const { return &_it->second.node; }
+
+        const document& key() const { return _it->first; }
+        rwmutex& latch() const { return _it->second.latch; }
+
+        /// Changes whenever the node is modified, or loaded again. Read with the latch held
+        std::uint64_t stamp() const { return _it->second.stamp; }
+
+        /// The node has been removed from the tree. Read with the latch held
+        bool removed() const { return _it->second.removed; }
+
+        void release();
+
+    private:
+
+        friend class node_cache;
+        pin(node_cache& cache, entry_map::iterator it) : _cache(&cache), _it(it) {}
+
+        node_cache* _cache;
+        entry_map::iterator _it;
+    };
+
+    node_cache(interfaces::document_storage& storage, std::size_t max_leaves);
+    node_cache(node_cache&& other);
+
+    /// Returns node, loading it from the storage if needed. Not pinned
+    node& get(const document& key);
+
+    /// As above, pinned
+    pin get_pinned(const document& key);
+
+    /// Pinned node if cached and not removed, empty pin otherwise. The storage is not read
+    pin find_pinned(const document& key);
+
+    /// Adds new node, dirty
+    void put(const document& key, const node& n);
+
+    /// Marks node modified in place. With its latch held exclusively, or shared if only the
+    /// subtree counts, which are atomic, have changed
+    void mark_dirty(const document& key);
+    void mark_dirty(const pin& p);
+
+    /// Removes node from the cache, and from the storage on the next flush
+    void remove(const document& key);
+
+    /// Writes all dirty nodes to the storage, each under its latch held shared
+    void flush();
+
+    /// Drops all nodes, including unflushed changes. No node may be pinned
+    void clear();
+
+    /// Evicts least recently used, unpinned leaves above the limit
+    void trim();
+
+    /// Document other than a node, accessed in turn with the nodes
+    document read(const document& key);
+    void write(const document& key, const document& value);
+
+    std::size_t dirty_count() const;
+
+private:
+
+    entry_map::iterator find_or_load(const document& key);
+    entry_map::iterator insert(const document& key, const node& n, bool dirty);
+    void set_dirty(entry& e);
+    void unpin(entry_map::iterator it);
+
+    interfaces::document_storage& _storage;
+    const std::size_t _max_leaves;
+
+    entry_map _entries;
+    std::list<document> _lru; // leaves, most recently used first
+    std::set<document> _removed; // not yet removed from the storage
+
+    mutable boost::mutex _mutex; // guards the entries, and the storage
+    boost::mutex _flush_mutex; // flushes write nodes in turn, so older versions don't overwrite newer ones
+    std::size_t _dirty_count;
+    std::uint64_t _next_stamp;
+};
+
+}}}
+
+#endif
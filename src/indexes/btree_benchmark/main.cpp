@@ -0,0 +1,280 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+// Measures B-tree node allocation, sequential scans and order statistics over real storage backends,
+// and point lookups against the linear hash table of hash indexes.
+// Nodes are stored through dbengine::document_storage, as the engine stores them.
+
+#include "indexes/btree/btree.hpp"
+#include "indexes/btree/index.hpp"
+#include "indexes/btree/node.hpp"
+#include "indexes/hash/index.hpp"
+#include "indexes/hash/linear_hash.hpp"
+
+#include "dbengine/document_storage.hpp"
+
+#include "backend_memory/backend.hpp"
+#ifdef FALCONDB_WITH_LEVELDB
+#include "backend_leveldb/backend.hpp"
+#endif
+
+#include "utils/filesystem.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace falcondb;
+using indexes::btree::btree;
+
+static const std::size_t FLUSH_EVERY = 1000; // inserts
+
+void help()
+{
+    std::cout << "usage: btree_benchmark DIR [COUNT] [PAGE_SIZE]" << std::endl;
+    std::cout << "Creates a database for each backend in a subdirectory of DIR named after the backend, the subdirectories are removed afterwards" << std::endl;
+}
+
+static void report(const std::string& backend_name, const std::string& workload, std::size_t ops,
+    const std::chrono::steady_clock::time_point& start)
+{
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-10s %-12s %10zu ops %10.3f s %12.0f ops/s\n",
+        backend_name.c_str(), workload.c_str(), ops, seconds, seconds > 0 ? ops / seconds : 0.0);
+}
+
+// share of leaf chain links pointing to a node stored further in the backend
+static void report_leaf_order(const std::string& backend_name, const std::string& workload,
+    dbengine::document_storage& storage, const document& tree_key)
+{
+    using indexes::btree::node;
+    document_object meta = storage.read(tree_key);
+    document leaf_key = meta.get_field("root");
+    node n = node::from_document(storage.read(leaf_key));
+    while(!n.is_leaf())
+    {
+        leaf_key = n.children.front();
+        n = node::from_document(storage.read(leaf_key));
+    }
+    std::size_t links = 0;
+    std::size_t forward = 0;
+    while(!n.next.is_null())
+    {
+        ++links;
+        if (storage.encode_key(leaf_key) < storage.encode_key(n.next))
+            ++forward;
+        leaf_key = n.next;
+        n = node::from_document(storage.read(leaf_key));
+    }
+    std::printf("%-10s %-12s %10zu leaf links, %5.1f%% forward in storage order\n",
+        backend_name.c_str(), workload.c_str(), links, links > 0 ? 100.0 * forward / links : 100.0);
+}
+
+static void scan(const std::string& backend_name, dbengine::document_storage& storage, const document& tree_key,
+    const btree::node_limits& limits, std::size_t count)
+{
+    // starting with a cold node cache each time
+    for(int pass = 0; pass < 3; ++pass)
+    {
+        btree tree = btree::load(storage, tree_key, false, limits);
+        btree::cursor c = tree.create_cursor();
+        std::size_t scanned = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(c.seek_to_first(); c.valid(); c.next())
+        {
+            ++scanned;
+        }
+        report(backend_name, "scan", scanned, start);
+        if (scanned != count)
+        {
+            std::cout << backend_name << ": scan returned " << scanned << " entries, expected " << count << std::endl;
+        }
+    }
+}
+
+// range counts and deep pages, answered from the subtree counts
+static void order_statistics(const std::string& backend_name, dbengine::document_storage& storage, const document& tree_key,
+    const btree::node_limits& limits, std::size_t count)
+{
+    const std::size_t queries = 1000;
+    std::mt19937 random(4321);
+    btree tree = btree::load(storage, tree_key, false, limits);
+
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t counted = 0;
+    for(std::size_t i = 0; i < queries; ++i)
+    {
+        int a = random() % count;
+        int b = random() % count;
+        counted += tree.count_encoded(
+            btree::encode_key(document_list({document::from(std::min(a, b))})), true,
+            btree::encode_key(document_list({document::from(std::max(a, b))})), false);
+    }
+    report(backend_name, "count", queries, start);
+
+    start = std::chrono::steady_clock::now();
+    std::size_t returned = 0;
+    for(std::size_t i = 0; i < queries; ++i)
+    {
+        returned += tree.scan(boost::none, true, boost::none, true, 10, random() % count).size();
+    }
+    report(backend_name, "deep page", queries, start);
+    if (counted == 0 || returned == 0)
+    {
+        std::cout << backend_name << ": no entries counted" << std::endl;
+    }
+}
+
+// random point lookups, in the B-tree and in a hash table with the same entries
+static void point_lookups(const std::string& backend_name, const interfaces::database_backend_ptr& db,
+    dbengine::document_storage& storage, const document& tree_key,
+    const btree::node_limits& limits, const std::vector<int>& order)
+{
+    using indexes::hash::linear_hash;
+    const std::size_t queries = 100000;
+    const document table_key = document::from(std::string("benchmark_hash"));
+
+    {
+        linear_hash table = linear_hash::create(storage, table_key, indexes::hash::index::DEFAULT_BUCKET_ENTRIES);
+        auto start = std::chrono::steady_clock::now();
+        std::size_t inserted = 0;
+        for(int i : order)
+        {
+            table.insert(btree::encode_key(document_list({document::from(i)})), document::from(i));
+            if (++inserted % FLUSH_EVERY == 0)
+                table.flush();
+        }
+        table.flush();
+        db->sync();
+        report(backend_name, "hash insert", order.size(), start);
+    }
+
+    std::mt19937 random(5678);
+    std::vector<std::string> keys(queries);
+    for(std::string& key : keys)
+        key = btree::encode_key(document_list({document::from(order[random() % order.size()])}));
+
+    std::size_t found = 0;
+    {
+        btree tree = btree::load(storage, tree_key, false, limits);
+        auto start = std::chrono::steady_clock::now();
+        for(const std::string& key : keys)
+            found += tree.scan_encoded(key, true, key, true).size();
+        report(backend_name, "btree lookup", queries, start);
+    }
+    {
+        linear_hash table = linear_hash::load(storage, table_key, indexes::hash::index::DEFAULT_BUCKET_ENTRIES);
+        auto start = std::chrono::steady_clock::now();
+        for(const std::string& key : keys)
+            found += table.find(key).size();
+        report(backend_name, "hash lookup", queries, start);
+    }
+    if (found != 2 * queries)
+    {
+        std::cout << backend_name << ": lookups found " << found << " entries, expected " << 2 * queries << std::endl;
+    }
+}
+
+static void run(const std::string& backend_name, const interfaces::database_backend_ptr& db,
+    const btree::node_limits& limits, std::size_t count)
+{
+    std::mt19937 random(1234);
+    std::vector<int> order(count);
+    for(std::size_t i = 0; i < count; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), random);
+
+    const document tree_key = document::from(std::string("benchmark"));
+    dbengine::document_storage storage(db, "index");
+
+    // random insert: leaves split all over the tree, each split allocates a node
+    {
+        btree tree = btree::create(storage, tree_key, false, limits);
+        auto start = std::chrono::steady_clock::now();
+        std::size_t inserted = 0;
+        for(int i : order)
+        {
+            tree.insert(document_list({document::from(i)}), document::from(i));
+            if (++inserted % FLUSH_EVERY == 0)
+                tree.flush();
+        }
+        tree.flush();
+        db->sync();
+        report(backend_name, "insert", count, start);
+    }
+
+    report_leaf_order(backend_name, "insert", storage, tree_key);
+    scan(backend_name, storage, tree_key, limits, count);
+
+    // compaction rewrites the leaves in key order
+    {
+        btree tree = btree::load(storage, tree_key, false, limits);
+        auto start = std::chrono::steady_clock::now();
+        tree.compact();
+        db->sync();
+        report(backend_name, "compact", count, start);
+    }
+    report_leaf_order(backend_name, "compact", storage, tree_key);
+    scan(backend_name, storage, tree_key, limits, count);
+    order_statistics(backend_name, storage, tree_key, limits, count);
+    point_lookups(backend_name, db, storage, tree_key, limits, order);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        help();
+        return 1;
+    }
+    std::string dir = argv[1];
+    std::size_t count = argc > 2 ? boost::lexical_cast<std::size_t>(argv[2]) : 1000000;
+    // nodes limited by size, as in indexes
+    std::size_t page_size = argc > 3 ? boost::lexical_cast<std::size_t>(argv[3]) : indexes::btree::index::DEFAULT_PAGE_SIZE;
+    btree::node_limits limits(std::numeric_limits<std::size_t>::max(), page_size, page_size);
+    if (dir == "--help" || dir == "-help" || count == 0)
+    {
+        help();
+        return 1;
+    }
+
+    backend_memory::backend memory_backend;
+    std::vector<std::pair<std::string, interfaces::storage_backend*>> backends;
+    backends.push_back(std::make_pair("memory", &memory_backend));
+#ifdef FALCONDB_WITH_LEVELDB
+    backend_leveldb::backend leveldb_backend;
+    backends.push_back(std::make_pair("leveldb", &leveldb_backend));
+#endif
+
+    bfs::create_directories(dir);
+    for(auto& b : backends)
+    {
+        std::string path = (bfs::path(dir) / b.first).string();
+        bfs::remove_all(path);
+        run(b.first, b.second->create_database(path), limits, count);
+        bfs::remove_all(path);
+    }
+}
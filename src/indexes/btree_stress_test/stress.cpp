@@ -0,0 +1,208 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/btree/btree.hpp"
+#include "indexes/btree_test/test_document_storage.hpp"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
+
+namespace falcondb {
+
+using indexes::btree::btree;
+
+BOOST_AUTO_TEST_SUITE(btree_stress_test_suite)
+
+static document_list make_key(int i)
+{
+    return document_list({document::from(i)});
+}
+
+// Even keys are inserted up front and never removed, writers keep inserting and removing odd ones.
+// Readers must see every even key, in order, whatever the writers do to the nodes
+BOOST_AUTO_TEST_CASE(readers_and_writers)
+{
+    const int stable_keys = 1000;
+    const int writers = 2;
+    const int readers = 4;
+    const int rounds = 4;
+
+    test_document_storage storage;
+    // small nodes and a small cache, so there are many splits, merges and evictions
+    btree tree = btree::create(storage, document::from(std::string("main")), false, 8, 16);
+    for(int i = 0; i < stable_keys; ++i)
+    {
+        tree.insert(make_key(i * 2), document::from(i * 2));
+    }
+
+    std::atomic<bool> writing(true);
+    std::atomic<int> errors(0);
+    std::atomic<int> full_scans(0);
+
+    boost::thread_group writer_threads;
+    for(int w = 0; w < writers; ++w)
+    {
+        writer_threads.create_thread(
+            [&, w]()
+            {
+                // each writer owns every other odd key
+                for(int round = 0; round < rounds; ++round)
+                {
+                    for(int k = 1 + w * 2; k < stable_keys * 2; k += writers * 2)
+                    {
+                        tree.insert(make_key(k), document::from(k));
+                    }
+                    tree.flush();
+                    for(int k = 1 + w * 2; k < stable_keys * 2; k += writers * 2)
+                    {
+                        if (tree.remove(make_key(k)) != 1)
+                            ++errors;
+                    }
+                    tree.flush();
+                }
+            });
+    }
+
+    boost::thread_group reader_threads;
+    for(int r = 0; r < readers; ++r)
+    {
+        reader_threads.create_thread(
+            [&, r]()
+            {
+                while(writing)
+                {
+                    if (r % 2 == 0)
+                    {
+                        btree::cursor c = tree.create_cursor();
+                        int previous = -1;
+                        int even = 0;
+                        for(c.seek_to_first(); c.valid(); c.next())
+                        {
+                            int k = c.value().as_scalar().to_number<int>();
+                            if (k <= previous)
+                                ++errors;
+                            if (k % 2 == 0)
+                                ++even;
+                            previous = k;
+                        }
+                        if (even != stable_keys)
+                            ++errors;
+                        ++full_scans;
+                    }
+                    else
+                    {
+                        for(int i = 0; i < stable_keys; i += 97)
+                        {
+                            document_list found = tree.scan(make_key(i * 2), true, make_key(i * 2), true);
+                            if (found.size() != 1)
+                                ++errors;
+                        }
+                    }
+                }
+            });
+    }
+
+    // readers stop once writers are done
+    writer_threads.join_all();
+    writing = false;
+    reader_threads.join_all();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK(full_scans > 0);
+    BOOST_CHECK_EQUAL(tree.scan(boost::none, true, boost::none, true).size(), stable_keys);
+}
+
+// A writer keeps inserting and removing keys of its own, counting the operations started and finished.
+// Readers count the point scans made entirely within one write operation: the tree is latched by node,
+// so readers pass a writer changing other nodes, instead of waiting for it
+BOOST_AUTO_TEST_CASE(readers_progress_during_writes)
+{
+    const int stable_keys = 1000;
+    const int readers = 4;
+    const int rounds = 8;
+
+    test_document_storage storage;
+    btree tree = btree::create(storage, document::from(std::string("main")), false, 8, 16);
+    for(int i = 0; i < stable_keys; ++i)
+    {
+        tree.insert(make_key(i * 2), document::from(i * 2));
+    }
+
+    std::atomic<bool> writing(true);
+    std::atomic<int> started(0);
+    std::atomic<int> finished(0);
+    std::atomic<int> errors(0);
+    std::atomic<int> reads_during_write(0);
+
+    boost::thread writer(
+        [&]()
+        {
+            for(int round = 0; round < rounds; ++round)
+            {
+                for(int k = 1; k < stable_keys * 2; k += 2)
+                {
+                    ++started;
+                    tree.insert(make_key(k), document::from(k));
+                    ++finished;
+                }
+                for(int k = 1; k < stable_keys * 2; k += 2)
+                {
+                    ++started;
+                    if (tree.remove(make_key(k)) != 1)
+                        ++errors;
+                    ++finished;
+                }
+            }
+        });
+
+    boost::thread_group reader_threads;
+    for(int r = 0; r < readers; ++r)
+    {
+        reader_threads.create_thread(
+            [&, r]()
+            {
+                for(int i = r; writing; i = (i + 97) % stable_keys)
+                {
+                    // the write in progress at the start is still in progress at the end
+                    int finished_before = finished;
+                    int started_before = started;
+                    document_list found = tree.scan(make_key(i * 2), true, make_key(i * 2), true);
+                    int finished_after = finished;
+                    if (found.size() != 1)
+                        ++errors;
+                    if (started_before > finished_before && finished_after == finished_before)
+                        ++reads_during_write;
+                }
+            });
+    }
+
+    writer.join();
+    writing = false;
+    reader_threads.join_all();
+
+    BOOST_CHECK_EQUAL(errors, 0);
+    BOOST_CHECK(reads_during_write > 0);
+    BOOST_CHECK_EQUAL(tree.size(), std::uint64_t(stable_keys));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // ns
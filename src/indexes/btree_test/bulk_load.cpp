@@ -0,0 +1,294 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/btree/btree.hpp"
+#include "indexes/btree/index_type.hpp"
+#include "indexes/btree_test/test_document_storage.hpp"
+
+#include "utils/external_sorter.hpp"
+#include "utils/filesystem.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <random>
+
+namespace falcondb {
+
+using indexes::btree::btree;
+
+BOOST_AUTO_TEST_SUITE(bulk_load_test_suite)
+
+static document_list make_key(int i)
+{
+    return document_list({document::from(i)});
+}
+
+BOOST_AUTO_TEST_CASE(sorter_spills_and_merges)
+{
+    // budget small enough for several runs
+    external_sorter sorter(4096, bfs::temp_directory_path().string());
+
+    std::mt19937 random(42);
+    const int count = 2000;
+    for(int i = 0; i < count; ++i)
+    {
+        int k = random() % 500;
+        sorter.add(btree::encode_key(make_key(k)), std::to_string(i));
+    }
+    BOOST_CHECK(sorter.runs() > 1);
+    BOOST_CHECK_EQUAL(sorter.size(), count);
+
+    std::string previous_key;
+    int previous_value = -1;
+    int seen = 0;
+    sorter.for_each_sorted(
+        [&](const range& key, const range& value)
+        {
+            std::string k = key.to_string();
+            int v = std::stoi(value.to_string());
+            BOOST_CHECK(!(k < previous_key));
+            // equal keys in the order added
+            if (k == previous_key)
+            {
+                BOOST_CHECK(v > previous_value);
+            }
+            previous_key = k;
+            previous_value = v;
+            ++seen;
+        });
+    BOOST_CHECK_EQUAL(seen, count);
+}
+
+BOOST_AUTO_TEST_CASE(sorter_merges_in_passes)
+{
+    // every record spills as a run, more than can be merged at once
+    bfs::path dir = bfs::temp_directory_path() / bfs::unique_path();
+    bfs::create_directories(dir);
+    {
+        external_sorter sorter(1, dir.string());
+
+        std::mt19937 random(42);
+        const int count = 5000;
+        for(int i = 0; i < count; ++i)
+        {
+            int k = random() % 500;
+            sorter.add(btree::encode_key(make_key(k)), std::to_string(i));
+        }
+        BOOST_CHECK_EQUAL(sorter.runs(), count);
+
+        std::string previous_key;
+        int previous_value = -1;
+        int seen = 0;
+        sorter.for_each_sorted(
+            [&](const range& key, const range& value)
+            {
+                std::string k = key.to_string();
+                int v = std::stoi(value.to_string());
+                BOOST_CHECK(!(k < previous_key));
+                if (k == previous_key)
+                {
+                    BOOST_CHECK(v > previous_value);
+                }
+                previous_key = k;
+                previous_value = v;
+                ++seen;
+            });
+        BOOST_CHECK_EQUAL(seen, count);
+    }
+    BOOST_CHECK(bfs::is_empty(dir));
+    bfs::remove_all(dir);
+}
+
+static void check_tree(btree& tree, int count)
+{
+    document_list result = tree.scan(boost::none, true, boost::none, true);
+    BOOST_REQUIRE_EQUAL(result.size(), count);
+    for(int i = 0; i < count; ++i)
+    {
+        BOOST_CHECK_EQUAL(result[i].as_scalar(), document_scalar::from(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(builder_sizes)
+{
+    // empty, single leaf, exactly full levels, partial levels
+    for(int count : { 0, 1, 4, 5, 16, 17, 64, 65, 1000 })
+    {
+        test_document_storage storage;
+        btree::builder builder(storage, document::from(std::string("main")), 4);
+        for(int i = 0; i < count; ++i)
+        {
+            builder.add(btree::encode_key(make_key(i)), document::from(i).to_binary());
+        }
+        btree tree = builder.finish(false);
+        check_tree(tree, count);
+
+        // ranges crossing leaves
+        if (count > 10)
+        {
+            document_list result = tree.scan(make_key(3), true, make_key(9), false);
+            BOOST_REQUIRE_EQUAL(result.size(), 6);
+            BOOST_CHECK_EQUAL(result[0].as_scalar(), document_scalar::from(3));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(insert_after_bulk_load)
+{
+    test_document_storage storage;
+    btree::builder builder(storage, document::from(std::string("main")), 4);
+    for(int i = 0; i < 200; i += 2)
+    {
+        builder.add(btree::encode_key(make_key(i)), document::from(i).to_binary());
+    }
+    btree tree = builder.finish(false);
+
+    // packed leaves split on insert
+    for(int i = 1; i < 200; i += 2)
+    {
+        tree.insert(make_key(i), document::from(i));
+    }
+    check_tree(tree, 200);
+
+    tree.remove(make_key(0));
+    tree.remove(make_key(100));
+    BOOST_CHECK_EQUAL(tree.scan(boost::none, true, boost::none, true).size(), 198);
+}
+
+BOOST_AUTO_TEST_CASE(index_covers_existing_documents)
+{
+    test_document_storage data;
+    for(int i = 0; i < 300; ++i)
+    {
+        document_object doc;
+        doc.set_field("_id", document::from(i));
+        doc.set_field("group", document::from(i % 3));
+        data.write(document::from(i), doc);
+    }
+
+    document_object field;
+    field.set_field("name", document::from(std::string("group")));
+    field.set_field("direction", document::from(std::int32_t(1)));
+    document_object definition;
+    definition.set_field("fields", document_list({field}));
+
+    test_document_storage index_storage;
+    indexes::btree::index_type type;
+    std::size_t read = 0, written = 0;
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data,
+        [&](std::size_t documents_read, std::size_t entries_written) { read = documents_read; written = entries_written; });
+
+    BOOST_CHECK_EQUAL(read, 300);
+    BOOST_CHECK_EQUAL(written, 300);
+
+    document_object group;
+    group.set_field("group", document::from(1));
+    document_list found = result.new_index->scan(document(group), true, document(group), true, boost::none, boost::none, false);
+    BOOST_CHECK_EQUAL(found.size(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(page_size_option)
+{
+    test_document_storage data;
+    document_object field;
+    field.set_field("name", document::from(std::string("_id")));
+    field.set_field("direction", document::from(std::int32_t(1)));
+    document_object definition;
+    definition.set_field("fields", document_list({field}));
+
+    indexes::btree::index_type type;
+    for(int page_size : { 1024, 16384 })
+    {
+        document_object options;
+        options.set_field("page_size", document::from(page_size));
+        definition.set_field("options", options);
+
+        test_document_storage index_storage;
+        interfaces::index_type::create_result result = type.create_index(
+            definition, index_storage, data, interfaces::index_type::progress_handler());
+        for(int i = 0; i < 2000; ++i)
+        {
+            document_object doc;
+            doc.set_field("_id", document::from(i));
+            result.new_index->insert(document::from(i), doc);
+        }
+        result.new_index->flush();
+
+        // nodes split at the page size: four times fewer nodes with pages four times bigger
+        if (page_size == 1024)
+            BOOST_CHECK(index_storage.size() > 60);
+        else
+            BOOST_CHECK(index_storage.size() < 20);
+    }
+
+    document_object options;
+    options.set_field("page_size", document::from(16));
+    definition.set_field("options", options);
+    test_document_storage index_storage;
+    BOOST_CHECK_THROW(
+        type.create_index(definition, index_storage, data, interfaces::index_type::progress_handler()),
+        exception);
+}
+
+BOOST_AUTO_TEST_CASE(abandoned_creation_is_removed)
+{
+    test_document_storage data;
+    for(int i = 0; i < 5000; ++i)
+    {
+        document_object doc;
+        doc.set_field("_id", document::from(i));
+        data.write(document::from(i), doc);
+    }
+
+    document_object field;
+    field.set_field("name", document::from(std::string("_id")));
+    field.set_field("direction", document::from(std::int32_t(1)));
+    document_object options;
+    options.set_field("page_size", document::from(1024));
+    document_object definition;
+    definition.set_field("fields", document_list({field}));
+    definition.set_field("options", options);
+
+    // abandoned while the nodes are being written
+    test_document_storage index_storage;
+    indexes::btree::index_type type;
+    BOOST_CHECK_THROW(
+        type.create_index(definition, index_storage, data,
+            [](std::size_t documents_read, std::size_t entries_written)
+            {
+                if (entries_written >= 3000)
+                    throw exception("cancelled");
+            }),
+        exception);
+    BOOST_CHECK(index_storage.writes() > 0);
+    BOOST_CHECK_EQUAL(index_storage.size(), 0u);
+
+    // complete index, not used after all
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+    result.new_index.reset();
+    BOOST_CHECK(index_storage.size() > 0u);
+    type.drop_index(index_storage, result.index_description);
+    BOOST_CHECK_EQUAL(index_storage.size(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // ns
@@ -0,0 +1,542 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/btree/btree.hpp"
+#include "indexes/btree/index.hpp"
+#include "indexes/btree/index_type.hpp"
+#include "indexes/btree_test/test_document_storage.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+
+namespace falcondb {
+
+using indexes::btree::btree;
+
+BOOST_AUTO_TEST_SUITE(cursor_test_suite)
+
+static document_list make_key(int i)
+{
+    return document_list({document::from(i)});
+}
+
+static int value_of(const btree::cursor& c)
+{
+    return c.value().as_scalar().to_number<int>();
+}
+
+BOOST_AUTO_TEST_CASE(empty_tree)
+{
+    test_document_storage storage;
+    btree tree = btree::create(storage, document::from(std::string("main")), false, 4);
+
+    btree::cursor c = tree.create_cursor();
+    c.seek_to_first();
+    BOOST_CHECK(!c.valid());
+    c.seek(btree::encode_key(make_key(1)));
+    BOOST_CHECK(!c.valid());
+}
+
+BOOST_AUTO_TEST_CASE(iterates_across_leaves)
+{
+    test_document_storage storage;
+    btree tree = btree::create(storage, document::from(std::string("main")), false, 4);
+    for(int i = 99; i >= 0; --i)
+    {
+        tree.insert(make_key(i), document::from(i));
+    }
+
+    btree::cursor c = tree.create_cursor();
+    int expected = 0;
+    for(c.seek_to_first(); c.valid(); c.next())
+    {
+        BOOST_CHECK_EQUAL(value_of(c), expected);
+        ++expected;
+    }
+    BOOST_CHECK_EQUAL(expected, 100);
+
+    c.seek(btree::encode_key(make_key(37)), true);
+    BOOST_REQUIRE(c.valid());
+    BOOST_CHECK_EQUAL(value_of(c), 37);
+
+    c.seek(btree::encode_key(make_key(37)), false);
+    BOOST_REQUIRE(c.valid());
+    BOOST_CHECK_EQUAL(value_of(c), 38);
+
+    c.seek(btree::encode_key(make_key(99)), false);
+    BOOST_CHECK(!c.valid());
+}
+
+BOOST_AUTO_TEST_CASE(resumes_among_duplicates)
+{
+    // runs of equal keys span several leaves
+    test_document_storage storage;
+    btree tree = btree::create(storage, document::from(std::string("main")), false, 4);
+    for(int i = 0; i < 60; ++i)
+    {
+        tree.insert(make_key(i / 10), document::from(i));
+    }
+
+    // read in pages of 7, each one by a new cursor
+    std::vector<int> read;
+    boost::optional<document> position;
+    for(;;)
+    {
+        btree::cursor c = tree.create_cursor();
+        if (position)
+            c.resume(*position);
+        else
+            c.seek_to_first();
+
+        for(int i = 0; i < 7 && c.valid(); ++i, c.next())
+        {
+            read.push_back(value_of(c));
+            position = c.position();
+        }
+        if (!c.valid())
+            break;
+    }
+
+    BOOST_REQUIRE_EQUAL(read.size(), 60);
+    for(int i = 0; i < 60; ++i)
+    {
+        BOOST_CHECK_EQUAL(read[i], i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(iterates_backwards)
+{
+    test_document_storage storage;
+    btree tree = btree::create(storage, document::from(std::string("main")), false, 4);
+    for(int i = 0; i < 60; ++i)
+    {
+        tree.insert(make_key(i / 2), document::from(i));
+    }
+
+    btree::cursor c = tree.create_cursor();
+    int expected = 59;
+    for(c.seek_to_last(); c.valid(); c.prev())
+    {
+        BOOST_CHECK_EQUAL(value_of(c) / 2, expected / 2);
+        --expected;
+    }
+    BOOST_CHECK_EQUAL(expected, -1);
+
+    c.seek_for_prev(btree::encode_key(make_key(17)), true);
+    BOOST_REQUIRE(c.valid());
+    BOOST_CHECK_EQUAL(value_of(c) / 2, 17);
+    c.prev();
+    c.prev();
+    BOOST_REQUIRE(c.valid());
+    BOOST_CHECK_EQUAL(value_of(c) / 2, 16);
+
+    c.seek_for_prev(btree::encode_key(make_key(17)), false);
+    BOOST_REQUIRE(c.valid());
+    BOOST_CHECK_EQUAL(value_of(c) / 2, 16);
+
+    c.seek_for_prev(btree::encode_key(make_key(0)), false);
+    BOOST_CHECK(!c.valid());
+
+    // the tree changes between steps: keys keep descending, no entry is returned twice
+    c.seek_for_prev(btree::encode_key(make_key(20)), true);
+    BOOST_REQUIRE(c.valid());
+    tree.insert(make_key(19), document::from(1000));
+    tree.insert(make_key(20), document::from(1001));
+    std::string last_key = c.key();
+    std::set<int> seen = { value_of(c) };
+    for(c.prev(); c.valid() && c.key() > btree::encode_key(make_key(18)); c.prev())
+    {
+        BOOST_CHECK(c.key() <= last_key);
+        BOOST_CHECK(seen.insert(value_of(c)).second);
+        last_key = c.key();
+    }
+    BOOST_CHECK(seen.count(38) && seen.count(39) && seen.count(40));
+}
+
+BOOST_AUTO_TEST_CASE(seeks_to_position)
+{
+    test_document_storage storage;
+    btree tree = btree::create(storage, document::from(std::string("main")), false, 4);
+    for(int i = 0; i < 60; ++i)
+    {
+        tree.insert(make_key(i / 10), document::from(i));
+    }
+
+    btree::cursor c = tree.create_cursor();
+    for(int i = 0; i < 60; i += 7)
+    {
+        c.seek_to_position(i);
+        BOOST_REQUIRE(c.valid());
+        BOOST_CHECK_EQUAL(value_of(c), i);
+    }
+    c.seek_to_position(60);
+    BOOST_CHECK(!c.valid());
+
+    // positioned among duplicates, the position resumes after it
+    c.seek_to_position(34);
+    btree::cursor resumed = tree.create_cursor();
+    resumed.resume(c.position());
+    BOOST_REQUIRE(resumed.valid());
+    BOOST_CHECK_EQUAL(value_of(resumed), 35);
+}
+
+BOOST_AUTO_TEST_CASE(index_cursor)
+{
+    test_document_storage data;
+    for(int i = 0; i < 50; ++i)
+    {
+        document_object doc;
+        doc.set_field("_id", document::from(i));
+        doc.set_field("group", document::from(i % 5));
+        data.write(document::from(i), doc);
+    }
+
+    document_object field;
+    field.set_field("name", document::from(std::string("group")));
+    field.set_field("direction", document::from(std::int32_t(1)));
+    document_object definition;
+    definition.set_field("fields", document_list({field}));
+
+    test_document_storage index_storage;
+    indexes::btree::index_type type;
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+
+    document_object group;
+    group.set_field("group", document::from(3));
+    interfaces::index_cursor::unique_ptr c = result.new_index->create_cursor();
+    int found = 0;
+    for(c->seek(document(group), true); c->valid() && c->key().to_json() == document(group).to_json(); c->next())
+    {
+        BOOST_CHECK_EQUAL(c->storage_key().as_scalar().to_number<int>() % 5, 3);
+        ++found;
+    }
+    BOOST_CHECK_EQUAL(found, 10);
+
+    // position passed between cursors
+    c->seek(document(group), false);
+    BOOST_REQUIRE(c->valid());
+    document position = c->position();
+    document first = c->storage_key();
+    c->next();
+
+    interfaces::index_cursor::unique_ptr resumed = result.new_index->create_cursor();
+    resumed->resume(position);
+    BOOST_REQUIRE(resumed->valid());
+    BOOST_CHECK(resumed->storage_key().as_scalar() == c->storage_key().as_scalar());
+    BOOST_CHECK(!(resumed->storage_key().as_scalar() == first.as_scalar()));
+
+    // backwards, from the last entry of the group
+    int previous = 50;
+    found = 0;
+    for(c->seek_for_prev(document(group), true); c->valid() && c->key() == document(group); c->prev())
+    {
+        int storage_key = c->storage_key().as_scalar().to_number<int>();
+        BOOST_CHECK_EQUAL(storage_key % 5, 3);
+        BOOST_CHECK_LT(storage_key, previous);
+        previous = storage_key;
+        ++found;
+    }
+    BOOST_CHECK_EQUAL(found, 10);
+}
+
+static document index_field(const std::string& name, int direction)
+{
+    document_object field;
+    field.set_field("name", document::from(name));
+    field.set_field("direction", document::from(std::int32_t(direction)));
+    return field;
+}
+
+BOOST_AUTO_TEST_CASE(index_field_directions)
+{
+    test_document_storage data;
+    for(int i = 0; i < 40; ++i)
+    {
+        document_object doc;
+        doc.set_field("a", document::from(i));
+        doc.set_field("b", document::from(i % 4));
+        data.write(document::from(i), doc);
+    }
+
+    // b ascending, then a descending
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1), index_field("a", -1)}));
+
+    test_document_storage index_storage;
+    indexes::btree::index_type type;
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+    BOOST_CHECK_EQUAL(result.index_description.as_object().get_field("definition").as_object()
+        .get_field("key_format").as_scalar().to_number<int>(), int(indexes::btree::index::KEY_FORMAT));
+
+    document_list all = result.new_index->scan(boost::none, true, boost::none, true, boost::none, boost::none, false);
+    BOOST_REQUIRE_EQUAL(all.size(), 40);
+    BOOST_CHECK_EQUAL(all[0].as_scalar().to_number<int>(), 36);
+    BOOST_CHECK_EQUAL(all[9].as_scalar().to_number<int>(), 0);
+    BOOST_CHECK_EQUAL(all[10].as_scalar().to_number<int>(), 37);
+
+    // latest three of group 2: the last ones in index order are the smallest 'a'
+    document_object group;
+    group.set_field("b", document::from(2));
+    // a missing descending field is null, the greatest value: the bound is past the group
+    document_list latest = result.new_index->scan(boost::none, true, document(group), true, 3, boost::none, true);
+    BOOST_REQUIRE_EQUAL(latest.size(), 3);
+    BOOST_CHECK_EQUAL(latest[0].as_scalar().to_number<int>(), 2);
+    BOOST_CHECK_EQUAL(latest[1].as_scalar().to_number<int>(), 6);
+    BOOST_CHECK_EQUAL(latest[2].as_scalar().to_number<int>(), 10);
+
+    // bounds on the descending field
+    document_object upper;
+    upper.set_field("b", document::from(2));
+    upper.set_field("a", document::from(14));
+    document_list page = result.new_index->scan(boost::none, true, document(upper), false, 2, 1, true);
+    BOOST_REQUIRE_EQUAL(page.size(), 2);
+    BOOST_CHECK_EQUAL(page[0].as_scalar().to_number<int>(), 22);
+    BOOST_CHECK_EQUAL(page[1].as_scalar().to_number<int>(), 26);
+
+    // order statistics follow the index order
+    BOOST_CHECK_EQUAL(result.new_index->count(boost::none, true, document(upper), false), 26);
+    BOOST_CHECK_EQUAL(result.new_index->count(document(upper), true, document(group), true), 4);
+    BOOST_CHECK_EQUAL(result.new_index->rank(document(upper), false), 26);
+    boost::optional<document> median = result.new_index->select(19);
+    BOOST_REQUIRE(median);
+    BOOST_CHECK(median->as_object().get_field("b") == document::from(1));
+    BOOST_CHECK(median->as_object().get_field("a") == document::from(1));
+    BOOST_CHECK(!result.new_index->select(40));
+
+    // removal finds entries written with directions applied
+    result.new_index->del(document::from(2), data.read(document::from(2)));
+    latest = result.new_index->scan(boost::none, true, document(group), true, 1, boost::none, true);
+    BOOST_REQUIRE_EQUAL(latest.size(), 1);
+    BOOST_CHECK_EQUAL(latest[0].as_scalar().to_number<int>(), 6);
+}
+
+BOOST_AUTO_TEST_CASE(legacy_field_order)
+{
+    // definitions stored without key_format keep the name order, all ascending
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1), index_field("a", -1)}));
+    indexes::btree::index::field_list fields = indexes::btree::index::read_fields(definition);
+    BOOST_REQUIRE_EQUAL(fields.size(), 2);
+    BOOST_CHECK_EQUAL(fields[0].name, "a");
+    BOOST_CHECK(!fields[0].descending);
+    BOOST_CHECK_EQUAL(fields[1].name, "b");
+
+    definition.set_field("key_format", document::from(int(indexes::btree::index::KEY_FORMAT)));
+    fields = indexes::btree::index::read_fields(definition);
+    BOOST_CHECK_EQUAL(fields[0].name, "b");
+    BOOST_CHECK(!fields[0].descending);
+    BOOST_CHECK_EQUAL(fields[1].name, "a");
+    BOOST_CHECK(fields[1].descending);
+}
+
+BOOST_AUTO_TEST_CASE(covering_index)
+{
+    test_document_storage data;
+    for(int i = 0; i < 30; ++i)
+    {
+        document_object doc;
+        doc.set_field("a", document::from(i));
+        doc.set_field("b", document::from(i % 3));
+        if (i % 2 == 0)
+            doc.set_field("c", document::from(std::string("c") + std::to_string(i)));
+        doc.set_field("d", document::from(-i));
+        data.write(document::from(i), doc);
+    }
+
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1)}));
+    definition.set_field("include", document_list({document::from(std::string("a")), document::from(std::string("c"))}));
+
+    test_document_storage index_storage;
+    indexes::btree::index_type type;
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+    interfaces::index& index = *result.new_index;
+
+    // indexed fields are covered only when included: their keys do not keep number types or missing fields
+    BOOST_CHECK(index.covers({"a", "c"}));
+    BOOST_CHECK(!index.covers({"b", "a", "c"}));
+    BOOST_CHECK(!index.covers({"a", "d"}));
+
+    // entries written by the bulk load and by insert carry the included fields
+    document_object inserted;
+    inserted.set_field("a", document::from(100));
+    inserted.set_field("b", document::from(1));
+    inserted.set_field("c", document::from(std::string("c100")));
+    index.insert(document::from(100), inserted);
+
+    document_object group;
+    group.set_field("b", document::from(1));
+    interfaces::index_cursor::unique_ptr c = index.create_cursor();
+    int found = 0;
+    for(c->seek(document(group), true); c->valid() && c->key() == document(group); c->next())
+    {
+        int storage_key = c->storage_key().as_scalar().to_number<int>();
+        const document_object covered = c->covered_fields().as_object();
+        BOOST_CHECK(!covered.has_field("b"));
+        BOOST_CHECK_EQUAL(covered.get_field("a").as_scalar().as<int>(), storage_key);
+        BOOST_CHECK_EQUAL(covered.has_field("c"), storage_key % 2 == 0);
+        BOOST_CHECK(!covered.has_field("d"));
+        ++found;
+    }
+    BOOST_CHECK_EQUAL(found, 11);
+
+    // scans return the storage keys
+    document_list keys = index.scan(document(group), true, document(group), true, boost::none, boost::none, false);
+    BOOST_REQUIRE_EQUAL(keys.size(), 11);
+    BOOST_CHECK_EQUAL(keys[0].as_scalar().to_number<int>(), 1);
+    keys = index.scan(document(group), true, document(group), true, 1, boost::none, true);
+    BOOST_REQUIRE_EQUAL(keys.size(), 1);
+    BOOST_CHECK_EQUAL(keys[0].as_scalar().to_number<int>(), 100);
+
+    BOOST_CHECK_EQUAL(index.count(document(group), true, document(group), true), 11);
+}
+
+static document tag(const std::string& value)
+{
+    document_object key;
+    key.set_field("tags", document::from(value));
+    return key;
+}
+
+static document_list tags(std::initializer_list<const char*> values)
+{
+    document_list result;
+    for(const char* v : values)
+        result.push_back(document::from(std::string(v)));
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(multikey_index)
+{
+    test_document_storage data;
+    for(int i = 0; i < 40; ++i)
+    {
+        document_object doc;
+        doc.set_field("n", document::from(i));
+        if (i % 2 == 0)
+            doc.set_field("tags", i % 4 == 0 ? tags({"even", "four", "even"}) : tags({"even"}));
+        else
+            doc.set_field("tags", document::from(std::string("odd")));
+        data.write(document::from(i), doc);
+    }
+    document_object no_tags;
+    no_tags.set_field("tags", document_list());
+    data.write(document::from(40), no_tags);
+
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("tags", 1)}));
+    definition.set_field("multikey", document::from(true));
+
+    test_document_storage index_storage;
+    indexes::btree::index_type type;
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+    interfaces::index& index = *result.new_index;
+
+    // an entry per distinct element, an empty array as null
+    BOOST_CHECK_EQUAL(index.count(boost::none, true, boost::none, true), 20 + 10 + 20 + 1);
+    BOOST_CHECK_EQUAL(index.count(tag("even"), true, tag("even"), true), 20);
+    BOOST_CHECK_EQUAL(index.count(tag("four"), true, tag("four"), true), 10);
+    BOOST_CHECK_EQUAL(index.count(tag("even"), false, tag("odd"), false), 10);
+    BOOST_CHECK_EQUAL(index.rank(tag("four"), false), 21);
+    BOOST_CHECK_EQUAL(index.rank(tag("four"), true), 31);
+    BOOST_CHECK(!index.covers({"tags"}));
+
+    // posting lists are ordered by storage key
+    document_list found = index.scan(tag("four"), true, tag("four"), true, 3, 1, false);
+    BOOST_REQUIRE_EQUAL(found.size(), 3);
+    BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 4);
+    BOOST_CHECK_EQUAL(found[2].as_scalar().to_number<int>(), 12);
+    found = index.scan(tag("even"), false, tag("odd"), true, 2, boost::none, true);
+    BOOST_REQUIRE_EQUAL(found.size(), 2);
+    BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 39);
+    BOOST_CHECK_EQUAL(found[1].as_scalar().to_number<int>(), 37);
+
+    interfaces::index_cursor::unique_ptr c = index.create_cursor();
+    c->seek(tag("even"), false);
+    BOOST_REQUIRE(c->valid());
+    BOOST_CHECK(c->key() == tag("four"));
+    BOOST_CHECK_EQUAL(c->storage_key().as_scalar().to_number<int>(), 0);
+    c->seek_for_prev(tag("four"), false);
+    BOOST_REQUIRE(c->valid());
+    BOOST_CHECK(c->key() == tag("even"));
+    BOOST_CHECK_EQUAL(c->storage_key().as_scalar().to_number<int>(), 38);
+
+    // removal takes the document's entries only, the posting lists of the other documents stay
+    index.del(document::from(8), data.read(document::from(8)));
+    index.del(document::from(9), data.read(document::from(9)));
+    BOOST_CHECK_EQUAL(index.count(tag("even"), true, tag("even"), true), 19);
+    BOOST_CHECK_EQUAL(index.count(tag("four"), true, tag("four"), true), 9);
+    BOOST_CHECK_EQUAL(index.count(tag("odd"), true, tag("odd"), true), 19);
+
+    document_object doc;
+    doc.set_field("tags", tags({"new", "odd"}));
+    index.insert(document::from(100), doc);
+    found = index.scan(tag("odd"), true, tag("odd"), true, boost::none, boost::none, true);
+    BOOST_REQUIRE_EQUAL(found.size(), 20);
+    BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 100);
+
+    // one array per document
+    document_object two_arrays;
+    two_arrays.set_field("a", document_list({document::from(1), document::from(2)}));
+    two_arrays.set_field("tags", tags({"x"}));
+    document_object compound;
+    compound.set_field("fields", document_list({index_field("tags", 1), index_field("a", 1)}));
+    compound.set_field("multikey", document::from(true));
+    test_document_storage compound_storage;
+    interfaces::index_type::create_result compound_result = type.create_index(
+        compound, compound_storage, data, interfaces::index_type::progress_handler());
+    BOOST_CHECK_THROW(compound_result.new_index->insert(document::from(200), two_arrays), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(legacy_entries_removal)
+{
+    // indexes created before posting lists keep the storage key in the value, duplicates of a key are
+    // told apart by it
+    test_document_storage data;
+    for(int i = 0; i < 30; ++i)
+    {
+        document_object doc;
+        doc.set_field("b", document::from(i % 3));
+        data.write(document::from(i), doc);
+    }
+
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1)}));
+    definition.set_field("key_format", document::from(int(indexes::btree::index::ORDERED_KEY_FORMAT)));
+    test_document_storage index_storage;
+    indexes::btree::index index = indexes::btree::index::create(
+        index_storage, definition, document::from(std::string("legacy")), data);
+
+    document_object group;
+    group.set_field("b", document::from(1));
+    index.del(document::from(4), data.read(document::from(4)));
+    document_list found = index.scan(document(group), true, document(group), true, boost::none, boost::none, false);
+    BOOST_REQUIRE_EQUAL(found.size(), 9);
+    BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 1);
+    BOOST_CHECK_EQUAL(found[1].as_scalar().to_number<int>(), 7);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // ns
@@ -0,0 +1,192 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/btree/node.hpp"
+
+#include "document/key_encoding.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+namespace falcondb {
+
+using indexes::btree::node;
+
+BOOST_AUTO_TEST_SUITE(node_test_suite)
+
+static std::string make_key(int i)
+{
+    return key_encoding::encode(document_list({document::from(std::string("customer-") + std::to_string(i))}));
+}
+
+BOOST_AUTO_TEST_CASE(leaf_round_trip)
+{
+    node leaf = node::create_leaf();
+    for(int i = 0; i < 100; ++i)
+    {
+        leaf.keys.push_back(make_key(1000 + i));
+        leaf.values.push_back(document::from(i).to_binary());
+    }
+    leaf.next = document::from(std::string("next"));
+
+    std::string encoded = leaf.encode();
+    node decoded = node::decode(encoded);
+
+    BOOST_CHECK(decoded.is_leaf());
+    BOOST_CHECK(decoded.keys == leaf.keys);
+    BOOST_CHECK(decoded.values == leaf.values);
+    BOOST_CHECK(decoded.prev.is_null());
+    BOOST_CHECK_EQUAL(decoded.next, leaf.next);
+
+    // shared key prefixes are stored once
+    std::size_t key_bytes = 0;
+    for(const std::string& key : leaf.keys) key_bytes += key.size();
+    BOOST_CHECK(encoded.size() < key_bytes);
+    BOOST_CHECK_EQUAL(leaf.encoded_size(), encoded.size());
+}
+
+BOOST_AUTO_TEST_CASE(interior_round_trip)
+{
+    node interior = node::create_interior();
+    for(int i = 0; i < 10; ++i)
+    {
+        interior.insert_child(i, make_key(i * 10), make_key(i * 10 + 9), 10, document::from(i));
+    }
+
+    node decoded = node::decode(interior.encode());
+
+    BOOST_CHECK(!decoded.is_leaf());
+    BOOST_CHECK(decoded.keys == interior.keys);
+    BOOST_CHECK(decoded.max_keys == interior.max_keys);
+    BOOST_CHECK(decoded.counts == interior.counts);
+    BOOST_CHECK(decoded.children == interior.children);
+    BOOST_CHECK_EQUAL(decoded.count(), 100);
+    BOOST_CHECK_EQUAL(interior.encoded_size(), interior.encode().size());
+}
+
+// entry key of a posting list: the index key followed by the storage key
+static std::string posting_key(const std::string& tag, const document& storage_key)
+{
+    std::string key = key_encoding::encode(document_list({document::from(tag)}));
+    key_encoding::encode(key, storage_key);
+    return key;
+}
+
+BOOST_AUTO_TEST_CASE(posting_list_deltas)
+{
+    node leaf = node::create_leaf();
+    for(int i = 0; i < 200; ++i)
+    {
+        leaf.keys.push_back(posting_key("red", document::from(1000 + 3 * i)));
+        leaf.values.push_back(document(document_scalar::null()).to_binary());
+    }
+    // next index key, and equal keys as in indexes written before posting lists
+    leaf.keys.push_back(posting_key("redder", document::from(1)));
+    leaf.keys.push_back(leaf.keys.back());
+    leaf.values.resize(leaf.keys.size(), document(document_scalar::null()).to_binary());
+
+    std::string encoded = leaf.encode();
+    node decoded = node::decode(encoded);
+    BOOST_CHECK(decoded.keys == leaf.keys);
+    BOOST_CHECK_EQUAL(leaf.encoded_size(), encoded.size());
+
+    // storage keys close to each other take a few bytes: trailing zeros, delta length, delta and the empty value
+    BOOST_CHECK(encoded.size() < 5 * leaf.size());
+}
+
+BOOST_AUTO_TEST_CASE(delta_carries)
+{
+    node leaf = node::create_leaf();
+    // borrows through several bytes, carries on decoding, trailing zeros
+    leaf.keys = {
+        std::string("a\x00\xff\xff", 4), std::string("a\x01\x00\x00", 4), std::string("a\xff\xff\xff", 4),
+        std::string("b\x00\x00\x00", 4), std::string("b\x02\x00\x00", 4),
+        std::string("c\x05\x00\x10", 4), std::string("c\x06\x00\x01", 4) };
+    leaf.values.resize(leaf.keys.size(), document::from(1).to_binary());
+
+    node decoded = node::decode(leaf.encode());
+    BOOST_CHECK(decoded.keys == leaf.keys);
+    BOOST_CHECK_EQUAL(leaf.encoded_size(), leaf.encode().size());
+}
+
+BOOST_AUTO_TEST_CASE(prefix_keys_format)
+{
+    // version 1: keys "ab" and "ac", written as shared length, suffix length, suffix
+    std::string encoded("\x01\x00\x02" "\x00\x02" "ab" "\x01\x01" "c" "\x00\x00" "\x00\x00", 14);
+    node decoded = node::decode(encoded);
+    BOOST_REQUIRE_EQUAL(decoded.size(), 2);
+    BOOST_CHECK(decoded.keys[0] == "ab");
+    BOOST_CHECK(decoded.keys[1] == "ac");
+
+    // a delta which does not fit in the length of the previous key
+    std::string overflow("\x02\x00\x02" "\x00\x01" "\xff" "\x01\x01" "\x01" "\x00\x00" "\x00\x00", 13);
+    BOOST_CHECK_THROW(node::decode(overflow), exception);
+}
+
+BOOST_AUTO_TEST_CASE(split)
+{
+    node leaf = node::create_leaf();
+    for(int i = 0; i < 10; ++i)
+    {
+        leaf.keys.push_back(make_key(i));
+        leaf.values.push_back(document::from(i).to_binary());
+    }
+
+    node upper = leaf.split(4);
+    BOOST_CHECK_EQUAL(leaf.size(), 4);
+    BOOST_CHECK_EQUAL(leaf.values.size(), 4);
+    BOOST_REQUIRE_EQUAL(upper.size(), 6);
+    BOOST_CHECK(upper.keys.front() == make_key(4));
+    BOOST_CHECK(upper.values.front() == document::from(4).to_binary());
+}
+
+BOOST_AUTO_TEST_CASE(legacy_leaf)
+{
+    document_object kv;
+    kv.set_field("key", document_list({document::from(std::string("a"))}));
+    kv.set_field("value", document::from(7));
+
+    document_object legacy;
+    legacy.set_field("type", document::from("leaf"));
+    legacy.set_field("data", document_list({kv}));
+    legacy.set_field("prev", document_scalar::null());
+    legacy.set_field("next", document::from(3));
+
+    node converted = node::from_document(legacy);
+    BOOST_CHECK(converted.is_leaf());
+    BOOST_REQUIRE_EQUAL(converted.size(), 1);
+    BOOST_CHECK(converted.keys[0] == key_encoding::encode(document_list({document::from(std::string("a"))})));
+    BOOST_CHECK_EQUAL(document::from_binary(converted.values[0]), document::from(7));
+    BOOST_CHECK_EQUAL(converted.next, document::from(3));
+
+    // current format goes through the same entry point
+    node stored = node::from_document(converted.to_document());
+    BOOST_CHECK(stored.keys == converted.keys);
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    std::string encoded = node::create_leaf().encode();
+    BOOST_CHECK_THROW(node::decode(encoded.substr(0, 2)), exception);
+    BOOST_CHECK_THROW(node::decode(encoded + "x"), exception);
+    BOOST_CHECK_THROW(node::decode(std::string("\x07\x00", 2)), exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} // ns
@@ -0,0 +1,96 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_INDEXES_BTREE_TEST_TEST_DOCUMENT_STORAGE_HPP
+#define FALCONDB_INDEXES_BTREE_TEST_TEST_DOCUMENT_STORAGE_HPP
+
+#include "interfaces/document_storage.hpp"
+
+#include "utils/exception.hpp"
+
+#include <iostream>
+#include <map>
+
+namespace falcondb {
+
+// fake storage
+class test_document_storage : public interfaces::document_storage
+{
+public:
+
+    test_document_storage() : _writes(0) { }
+
+    virtual void write(const document& key, const document& doc)
+    {
+        ++_writes;
+        _storage.erase(key);
+        _storage.insert(std::make_pair(key, doc));
+    }
+
+    virtual document read(const document& key)
+    {
+        auto it = _storage.find(key);
+        if (it == _storage.end())
+        {
+            throw exception("no such key in doc storage: ", key);
+        }
+        return it->second;
+    }
+
+    virtual void remove(const document& key)
+    {
+        _storage.erase(key);
+    }
+
+    virtual void for_each(const key_value_handler& fun)
+    {
+        for(const auto& p : _storage)
+        {
+            fun(p.first, p.second);
+        }
+    }
+
+    virtual void for_each(const document& begin, const document& end, const key_value_handler& fun)
+    {
+        for(auto it = _storage.lower_bound(begin); it != _storage.lower_bound(end); ++it)
+        {
+            fun(it->first, it->second);
+        }
+    }
+
+
+    void dump()
+    {
+        for(auto p : _storage)
+        {
+            std::cout << p.first << "  =>  " << p.second << std::endl;
+        }
+    }
+
+    std::size_t writes() const { return _writes; }
+    std::size_t size() const { return _storage.size(); }
+
+private:
+    std::map<document, document> _storage;
+    std::size_t _writes;
+};
+
+}
+
+#endif
@@ -18,6 +18,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "indexes/btree/btree.hpp"
+#include "indexes/btree_test/test_document_storage.hpp"
 
 #include "interfaces/document_storage.hpp"
 
@@ -25,9 +26,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <memory>
 #include <sstream>
 #include <iomanip>
+#include <vector>
 
 namespace falcondb {
 
@@ -35,53 +38,6 @@ using indexes::btree::btree;
 
 BOOST_AUTO_TEST_SUITE(btree_test_suite)
 
-// fake storage
-class test_document_storage : public interfaces::document_storage
-{
-public:
-
-    virtual void write(const document& key, const document& doc)
-    {
-        _storage.erase(key);
-        _storage.insert(std::make_pair(key, doc));
-    }
-
-    virtual document read(const document& key)
-    {
-        auto it = _storage.find(key);
-        if (it == _storage.end())
-        {
-            throw exception("no such key in doc storage: ", key);
-        }
-        return it->second;
-    }
-
-    virtual void remove(const document& key)
-    {
-        _storage.erase(key);
-    }
-
-    virtual void for_each(const key_value_handler& fun)
-    {
-        for(const auto& p : _storage)
-        {
-            fun(p.first, p.second);
-        }
-    }
-
-
-    void dump()
-    {
-        for(auto p : _storage)
-        {
-            std::cout << p.first << "  =>  " << p.second << std::endl;
-        }
-    }
-
-private:
-    std::map<document, document> _storage;
-};
-
 // test env
 class fixture
 {
@@ -95,13 +51,21 @@ public:
     {
     }
 
-    void init(bool unique)
+    void init(bool unique, std::size_t cached_leaves = btree::default_cached_leaves)
     {
         _btree.reset(
             new btree(
-                btree::create(_storage, document_scalar::from(std::string("main")), unique, 4)));
+                btree::create(_storage, document_scalar::from(std::string("main")), unique, 4, cached_leaves)));
+    }
+
+    // another tree instance over the same storage
+    btree load()
+    {
+        return btree::load(_storage, document_scalar::from(std::string("main")), false, 4);
     }
 
+    test_document_storage& get_storage() { return _storage; }
+
     template<typename T>
     static document_list make_key(const T& a) { return document_list({document::from(a)}); }
 
@@ -233,6 +197,415 @@ BOOST_FIXTURE_TEST_CASE(int_key_removal, fixture)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(duplicates_across_leaves, fixture)
+{
+    init(false);
+
+    for (int i = 0; i < 10; i++)
+    {
+        get_tree().insert(make_key(i), document_scalar::from(i));
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        get_tree().insert(make_key(5), document_scalar::from(100 + i));
+    }
+
+    BOOST_CHECK_EQUAL(get_tree().scan(make_key(5), true, make_key(5), true).size(), 11);
+    BOOST_CHECK_EQUAL(get_tree().scan(make_key(5), false, make_key(7), false).size(), 1);
+    BOOST_CHECK_EQUAL(get_tree().scan(make_key(4), false, make_key(5), false).size(), 0);
+    BOOST_CHECK_EQUAL(get_tree().scan(make_key(5), true, boost::none, true, 3, 9).size(), 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(removes_single_duplicate, fixture)
+{
+    init(false);
+
+    for (int i = 0; i < 30; i++)
+    {
+        get_tree().insert(make_key(i % 3), document_scalar::from(i));
+    }
+
+    // the duplicates span several leaves, only the entry with the value goes
+    std::string key = btree::encode_key(make_key(1));
+    BOOST_CHECK_EQUAL(get_tree().remove_encoded(key, document_scalar::from(13)), 1);
+    BOOST_CHECK_EQUAL(get_tree().remove_encoded(key, document_scalar::from(13)), 0);
+    BOOST_CHECK_EQUAL(get_tree().remove_encoded(key, document_scalar::from(12)), 0);
+    BOOST_CHECK_EQUAL(get_tree().size(), 29);
+
+    document_list result = get_tree().scan(make_key(1), true, make_key(1), true);
+    BOOST_REQUIRE_EQUAL(result.size(), 9);
+    for(std::size_t i = 0; i < result.size(); ++i)
+    {
+        int expected = 1 + 3 * (i < 4 ? i : i + 1);
+        BOOST_CHECK_EQUAL(result[i].as_scalar().to_number<int>(), expected);
+    }
+    BOOST_CHECK_EQUAL(get_tree().count_encoded(key, true, key, true), 9);
+}
+
+BOOST_FIXTURE_TEST_CASE(point_lookup_comparisons, fixture)
+{
+    init(true);
+
+    const int count = 2000;
+    for (int i = 0; i < count; i++)
+    {
+        get_tree().insert(make_key(i), document_scalar::from(i));
+    }
+
+    document_list result = get_tree().scan(make_key(1234), true, make_key(1234), true);
+    BOOST_REQUIRE_EQUAL(result.size(), 1);
+    BOOST_CHECK_EQUAL(result[0].as_scalar(), document_scalar::from(1234));
+
+    // a few comparisons per level, the tree has about log4(count) levels
+    btree::stats stats = get_tree().get_stats();
+    BOOST_CHECK_EQUAL(stats.scans, 1);
+    BOOST_CHECK(stats.last_scan_comparisons > 0);
+    BOOST_CHECK(stats.last_scan_comparisons <= 60);
+}
+
+BOOST_FIXTURE_TEST_CASE(write_back, fixture)
+{
+    init(false);
+    std::size_t initial_writes = get_storage().writes();
+
+    for (int i = 0; i < 100; i++)
+    {
+        get_tree().insert(make_key(i), document_scalar::from(i));
+    }
+
+    // nothing written until flushed
+    BOOST_CHECK_EQUAL(get_storage().writes(), initial_writes);
+    BOOST_CHECK_EQUAL(get_tree().scan(boost::none, true, boost::none, true).size(), 100);
+
+    get_tree().flush();
+    BOOST_CHECK(get_storage().writes() > initial_writes);
+
+    // flushed nodes are written once
+    std::size_t flushed_writes = get_storage().writes();
+    get_tree().flush();
+    BOOST_CHECK_EQUAL(get_storage().writes(), flushed_writes);
+
+    btree loaded = load();
+    document_list result = loaded.scan(boost::none, true, boost::none, true);
+    BOOST_REQUIRE_EQUAL(result.size(), 100);
+    for(int i = 0; i < 100; ++i)
+    {
+        BOOST_CHECK_EQUAL(result[i].as_scalar(), document_scalar::from(i));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(discard, fixture)
+{
+    init(false);
+
+    for (int i = 0; i < 50; i++)
+    {
+        get_tree().insert(make_key(i), document_scalar::from(i));
+    }
+    get_tree().flush();
+
+    for (int i = 50; i < 100; i++)
+    {
+        get_tree().insert(make_key(i), document_scalar::from(i));
+    }
+    get_tree().remove(make_key(10));
+    get_tree().discard();
+
+    BOOST_CHECK_EQUAL(get_tree().scan(boost::none, true, boost::none, true).size(), 50);
+    BOOST_CHECK_EQUAL(exists(make_key(10)), true);
+    BOOST_CHECK_EQUAL(exists(make_key(60)), false);
+}
+
+BOOST_FIXTURE_TEST_CASE(leaf_eviction, fixture)
+{
+    init(false, 2);
+
+    for (int i = 0; i < 200; i++)
+    {
+        get_tree().insert(make_key((i * 37) % 200), document_scalar::from((i * 37) % 200));
+    }
+
+    // evicted dirty leaves are written
+    BOOST_CHECK(get_storage().writes() > 2);
+
+    document_list result = get_tree().scan(boost::none, true, boost::none, true);
+    BOOST_REQUIRE_EQUAL(result.size(), 200);
+
+    get_tree().flush();
+    btree loaded = load();
+    result = loaded.scan(boost::none, true, boost::none, true);
+    BOOST_REQUIRE_EQUAL(result.size(), 200);
+    for(int i = 0; i < 200; ++i)
+    {
+        BOOST_CHECK_EQUAL(result[i].as_scalar(), document_scalar::from(i));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(removal_merges_nodes, fixture)
+{
+    init(false);
+
+    for (int i = 0; i < 400; i++)
+    {
+        get_tree().insert(make_key((i * 37) % 400), document_scalar::from((i * 37) % 400));
+    }
+
+    // leave every 40th key
+    for (int i = 0; i < 400; i++)
+    {
+        int k = (i * 13) % 400;
+        if (k % 40 != 0)
+            get_tree().remove(make_key(k));
+    }
+    get_tree().flush();
+
+    // 10 entries in leaves at least half full: at most 5 leaves and 3 interior nodes, and the meta-data
+    BOOST_CHECK(get_storage().size() <= 9);
+
+    btree loaded = load();
+    document_list result = loaded.scan(boost::none, true, boost::none, true);
+    BOOST_REQUIRE_EQUAL(result.size(), 10);
+    for(int i = 0; i < 10; ++i)
+    {
+        BOOST_CHECK_EQUAL(result[i].as_scalar(), document_scalar::from(i * 40));
+    }
+
+    // the root shrinks to a single leaf
+    for(int i = 1; i < 10; ++i)
+    {
+        get_tree().remove(make_key(i * 40));
+    }
+    get_tree().flush();
+    BOOST_CHECK_EQUAL(get_storage().size(), 2);
+    BOOST_CHECK_EQUAL(exists(make_key(0)), true);
+}
+
+BOOST_FIXTURE_TEST_CASE(compact, fixture)
+{
+    init(false);
+
+    for (int i = 0; i < 400; i++)
+    {
+        get_tree().insert(make_key((i * 37) % 400), document_scalar::from((i * 37) % 400));
+    }
+
+    btree::compact_result r = get_tree().compact();
+    BOOST_CHECK(r.nodes_after < r.nodes_before);
+    // 100 full leaves, 25 + 7 + 2 interior nodes and the root
+    BOOST_CHECK_EQUAL(r.nodes_after, 135);
+    BOOST_CHECK_EQUAL(get_storage().size(), r.nodes_after + 1);
+
+    get_tree().insert(make_key(1000), document_scalar::from(1000));
+    get_tree().flush();
+
+    btree loaded = load();
+    document_list result = loaded.scan(boost::none, true, boost::none, true);
+    BOOST_REQUIRE_EQUAL(result.size(), 401);
+    for(int i = 0; i < 400; ++i)
+    {
+        BOOST_CHECK_EQUAL(result[i].as_scalar(), document_scalar::from(i));
+    }
+}
+
+// id part of a node key
+static std::uint64_t node_id(const document& key)
+{
+    const boost::uuids::uuid& uuid = key.as_scalar().as<boost::uuids::uuid>();
+    std::uint64_t id = 0;
+    for(int i = 8; i < 16; ++i)
+    {
+        id = (id << 8) | uuid.data[i];
+    }
+    return id;
+}
+
+BOOST_FIXTURE_TEST_CASE(sequential_node_ids, fixture)
+{
+    init(false);
+
+    for (int i = 0; i < 400; i++)
+    {
+        get_tree().insert(make_key((i * 37) % 400), document_scalar::from((i * 37) % 400));
+    }
+    get_tree().compact();
+
+    const document main = document_scalar::from(std::string("main"));
+    document_object meta = get_storage().read(main);
+    std::uint64_t next_node_id = meta.get_field("next_node_id").as_scalar().to_number<std::uint64_t>();
+
+    // node keys share the first half, the second is the id
+    std::vector<std::uint64_t> ids;
+    get_storage().for_each(
+        [&](const document& key, const document&)
+        {
+            if (key == main)
+                return;
+            const boost::uuids::uuid& uuid = key.as_scalar().as<boost::uuids::uuid>();
+            BOOST_CHECK(std::equal(uuid.begin(), uuid.begin() + 8, meta.get_field("root").as_scalar().as<boost::uuids::uuid>().begin()));
+            ids.push_back(node_id(key));
+            BOOST_CHECK(ids.back() < next_node_id);
+        });
+    BOOST_CHECK_EQUAL(ids.size(), 135);
+
+    // after compaction, the leaf chain follows the id order
+    using indexes::btree::node;
+    document leaf_key = meta.get_field("root");
+    node n = node::from_document(get_storage().read(leaf_key));
+    while(!n.is_leaf())
+    {
+        leaf_key = n.children.front();
+        n = node::from_document(get_storage().read(leaf_key));
+    }
+    std::size_t leaves = 1;
+    while(!n.next.is_null())
+    {
+        BOOST_CHECK(node_id(leaf_key) < node_id(n.next));
+        leaf_key = n.next;
+        n = node::from_document(get_storage().read(leaf_key));
+        ++leaves;
+    }
+    BOOST_CHECK_EQUAL(leaves, 100);
+}
+
+BOOST_FIXTURE_TEST_CASE(legacy_node_keys, fixture)
+{
+    // written before node ids: random node keys, no id sequence in the meta-data
+    using indexes::btree::node;
+    const document main = document_scalar::from(std::string("main"));
+    const document root = document_scalar::from(std::string("random root key"));
+    document_object meta;
+    meta.set_field("root", root);
+    get_storage().write(main, meta);
+    get_storage().write(root, node::create_leaf().to_document());
+
+    btree tree = load();
+    for (int i = 0; i < 20; i++)
+    {
+        tree.insert(make_key(i), document_scalar::from(i));
+    }
+    tree.flush();
+
+    document_list result = load().scan(boost::none, true, boost::none, true);
+    BOOST_REQUIRE_EQUAL(result.size(), 20);
+    for(int i = 0; i < 20; ++i)
+    {
+        BOOST_CHECK_EQUAL(result[i].as_scalar(), document_scalar::from(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(byte_size_limits)
+{
+    using indexes::btree::node;
+    test_document_storage storage;
+    const document main = document_scalar::from(std::string("main"));
+    btree tree = btree::create(storage, main, false, btree::node_limits(1000, 512, 1024));
+
+    // long keys: a few per node, while the item limit is never reached.
+    // The padding differs between neighbours, so that deltas between keys are as long as the keys
+    auto make_long_key = [](int i)
+    {
+        std::ostringstream ss;
+        int n = (i * 37) % 500;
+        ss << std::setw(4) << std::setfill('0') << n << std::string(60, char('a' + n % 26));
+        return document_list({document::from(ss.str())});
+    };
+    for(int i = 0; i < 500; ++i)
+    {
+        tree.insert(make_long_key(i), document_scalar::from(i));
+    }
+    for(int i = 0; i < 500; i += 3)
+    {
+        tree.remove(make_long_key(i));
+    }
+    tree.flush();
+
+    std::size_t leaves = 0;
+    storage.for_each(
+        [&](const document& key, const document& value)
+        {
+            if (key == main)
+                return;
+            node n = node::from_document(value);
+            BOOST_CHECK(n.encoded_size() <= (n.is_leaf() ? 512 : 1024));
+            if (n.is_leaf())
+                ++leaves;
+        });
+    // about 70 bytes an entry, leaves at least half full
+    BOOST_CHECK(leaves > 333 * 70 / 512);
+    BOOST_CHECK(leaves < 333 * 70 / 256 + 2);
+
+    BOOST_CHECK_EQUAL(tree.scan(boost::none, true, boost::none, true).size(), 333);
+
+    // bulk-loaded nodes are packed to the limit
+    btree::compact_result r = tree.compact();
+    BOOST_CHECK(r.nodes_after < r.nodes_before);
+    storage.for_each(
+        [&](const document& key, const document& value)
+        {
+            if (key == main)
+                return;
+            node n = node::from_document(value);
+            BOOST_CHECK(n.encoded_size() <= (n.is_leaf() ? 512 : 1024));
+        });
+    BOOST_CHECK_EQUAL(tree.scan(boost::none, true, boost::none, true).size(), 333);
+}
+
+BOOST_FIXTURE_TEST_CASE(order_statistics, fixture)
+{
+    init(false);
+
+    // runs of equal keys spanning several leaves
+    std::vector<int> keys;
+    for (int i = 0; i < 600; i++)
+    {
+        int k = (i * 37) % 100;
+        get_tree().insert(make_key(k), document_scalar::from(i));
+        keys.push_back(k);
+    }
+    for (int k = 0; k < 100; k += 7)
+    {
+        get_tree().remove(make_key(k));
+        keys.erase(std::remove(keys.begin(), keys.end(), k), keys.end());
+    }
+    std::sort(keys.begin(), keys.end());
+
+    BOOST_CHECK_EQUAL(get_tree().size(), keys.size());
+    BOOST_CHECK_EQUAL(get_tree().count_encoded(boost::none, true, boost::none, true), keys.size());
+
+    for (int k = -1; k <= 100; k += 3)
+    {
+        std::string key = btree::encode_key(make_key(k));
+        std::uint64_t below = std::lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+        std::uint64_t up_to = std::upper_bound(keys.begin(), keys.end(), k) - keys.begin();
+        BOOST_CHECK_EQUAL(get_tree().rank_encoded(key, false), below);
+        BOOST_CHECK_EQUAL(get_tree().rank_encoded(key, true), up_to);
+
+        for (int l = k; l <= k + 20; l += 10)
+        {
+            std::string upper = btree::encode_key(make_key(l));
+            BOOST_CHECK_EQUAL(
+                get_tree().count_encoded(key, true, upper, false),
+                get_tree().scan(make_key(k), true, make_key(l), false).size());
+            BOOST_CHECK_EQUAL(
+                get_tree().count_encoded(key, false, upper, true),
+                get_tree().scan(make_key(k), false, make_key(l), true).size());
+        }
+    }
+
+    // deep skip from a bound inside a leaf: the page follows the entries below the bound
+    document_list all = get_tree().scan(boost::none, true, boost::none, true);
+    std::uint64_t first = get_tree().rank_encoded(btree::encode_key(make_key(33)), false);
+    document_list page = get_tree().scan(make_key(33), true, boost::none, true, 10, 101);
+    BOOST_REQUIRE_EQUAL(page.size(), 10);
+    for (std::size_t i = 0; i < page.size(); i++)
+    {
+        BOOST_CHECK(page[i] == all[first + 101 + i]);
+    }
+    BOOST_CHECK(get_tree().scan(boost::none, true, boost::none, true, 10, all.size()).empty());
+    BOOST_CHECK_EQUAL(get_tree().scan(boost::none, true, make_key(50), false, 1000, 3).size(),
+        get_tree().count_encoded(boost::none, true, btree::encode_key(make_key(50)), false) - 3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } // ns
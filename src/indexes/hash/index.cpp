@@ -0,0 +1,271 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/hash/index.hpp"
+
+#include "interfaces/document_storage.hpp"
+
+#include "utils/exception.hpp"
+#include "utils/log.hpp"
+
+#include <algorithm>
+#include <limits>
+
+static std::size_t PROGRESS_INTERVAL = 1000;
+
+namespace falcondb { namespace indexes { namespace hash {
+
+index index::create(
+    interfaces::document_storage& storage,
+    const document& definition,
+    const document& root_storage_key,
+    interfaces::document_storage& data_storage,
+    const interfaces::index_type::progress_handler& progress)
+{
+    const document_object def_obj = definition.as_object();
+    linear_hash table = linear_hash::create(storage, root_storage_key, read_bucket_entries(def_obj), read_page_size(def_obj));
+
+    // no order to build in, the documents are inserted as they come
+    btree::index::layout l = btree::index::read_layout(def_obj);
+    std::size_t read = 0;
+    data_storage.for_each_view(
+        [&](const document& storage_key, const document_view& doc)
+        {
+            for(const std::string& key : btree::index::index_keys(l.fields, l.multikey, doc))
+            {
+                table.insert(key, storage_key);
+            }
+            if (progress && ++read % PROGRESS_INTERVAL == 0)
+                progress(read, read);
+        });
+    table.flush();
+    if (progress)
+        progress(read, read);
+    logging::info("hash index created over ", read, " documents, ", table.bucket_count(), " buckets");
+
+    return index(std::move(table), def_obj);
+}
+
+index index::load(interfaces::document_storage& storage, const document& definition, const document& root_storage_key)
+{
+    const document_object def_obj = definition.as_object();
+    return index(linear_hash::load(storage, root_storage_key, read_bucket_entries(def_obj), read_page_size(def_obj)), def_obj);
+}
+
+index::index(linear_hash&& table, const document_object& definition)
+:
+    _table(std::move(table)),
+    _fields(btree::index::read_fields(definition)),
+    _multikey(btree::index::read_layout(definition).multikey)
+{
+}
+
+index::index(index&& other)
+:
+    _table(std::move(other._table)),
+    _fields(std::move(other._fields)),
+    _multikey(other._multikey)
+{
+}
+
+index::~index()
+{
+}
+
+std::size_t index::read_bucket_entries(const document_object& definition)
+{
+    std::size_t result = DEFAULT_BUCKET_ENTRIES;
+    if (definition.has_field("options"))
+    {
+        const document_object& options = definition.get_field("options").as_object();
+        if (options.has_field("bucket_entries"))
+        {
+            result = options.get_field("bucket_entries").as_scalar().to_number<std::size_t>();
+            if (result == 0)
+                throw exception("index option 'bucket_entries' must be positive");
+        }
+    }
+    return result;
+}
+
+std::size_t index::read_page_size(const document_object& definition)
+{
+    std::size_t result = linear_hash::default_page_size;
+    if (definition.has_field("options"))
+    {
+        const document_object& options = definition.get_field("options").as_object();
+        if (options.has_field("page_size"))
+        {
+            result = options.get_field("page_size").as_scalar().to_number<std::size_t>();
+            if (result < btree::index::MIN_PAGE_SIZE)
+                throw exception("index option 'page_size' must be at least ", std::size_t(btree::index::MIN_PAGE_SIZE), " bytes");
+        }
+    }
+    return result;
+}
+
+void index::insert(const document& storage_key, const document& doc)
+{
+    for(const std::string& key : btree::index::index_keys(_fields, _multikey, doc))
+    {
+        _table.insert(key, storage_key);
+    }
+}
+
+void index::update(const document& old_doc, const document& new_doc)
+{
+    // documents are stored under their _id
+    document old_storage_key = old_doc.as_object().get_field("_id");
+    document new_storage_key = new_doc.as_object().get_field("_id");
+    std::vector<std::string> old_keys = btree::index::index_keys(_fields, _multikey, old_doc);
+    std::vector<std::string> new_keys = btree::index::index_keys(_fields, _multikey, new_doc);
+
+    // keys are sorted; with the same storage key only the changed entries are touched
+    bool same_storage_key = old_storage_key == new_storage_key;
+    for(const std::string& key : old_keys)
+    {
+        if (!same_storage_key || !std::binary_search(new_keys.begin(), new_keys.end(), key))
+            _table.remove(key, old_storage_key);
+    }
+    for(const std::string& key : new_keys)
+    {
+        if (!same_storage_key || !std::binary_search(old_keys.begin(), old_keys.end(), key))
+            _table.insert(key, new_storage_key);
+    }
+}
+
+void index::del(const document& storage_key, const document& doc)
+{
+    for(const std::string& key : btree::index::index_keys(_fields, _multikey, doc))
+    {
+        _table.remove(key, storage_key);
+    }
+}
+
+void index::del(const document& storage_key, const document_view& doc)
+{
+    for(const std::string& key : btree::index::index_keys(_fields, _multikey, doc))
+    {
+        _table.remove(key, storage_key);
+    }
+}
+
+std::string index::equality_key(
+    const boost::optional<document>& min,
+    bool min_inclusive,
+    const boost::optional<document>& max,
+    bool max_inclusive) const
+{
+    if (!min || !max || !min_inclusive || !max_inclusive)
+    {
+        throw exception("hash index answers equality lookups only");
+    }
+    std::string key = btree::index::encode_key(_fields, btree::index::extract_index_key(_fields, *min));
+    if (key != btree::index::encode_key(_fields, btree::index::extract_index_key(_fields, *max)))
+    {
+        throw exception("hash index answers equality lookups only");
+    }
+    return key;
+}
+
+document_list index::scan(
+    const boost::optional<document>& min,
+    bool min_inclusive,
+    const boost::optional<document>& max,
+    bool max_inclusive,
+    const boost::optional<std::size_t> limit,
+    const boost::optional<std::size_t> skip,
+    bool reverse)
+{
+    document_list found = _table.find(equality_key(min, min_inclusive, max, max_inclusive));
+    if (reverse)
+    {
+        std::reverse(found.begin(), found.end());
+    }
+
+    std::size_t s = std::min(skip ? *skip : 0, found.size());
+    std::size_t l = std::min(limit ? *limit : std::numeric_limits<std::size_t>::max(), found.size() - s);
+    document_list result;
+    result.insert(result.end(), found.begin() + s, found.begin() + s + l);
+    return result;
+}
+
+std::uint64_t index::count(
+    const boost::optional<document>& min,
+    bool min_inclusive,
+    const boost::optional<document>& max,
+    bool max_inclusive)
+{
+    if (!min && !max)
+    {
+        return _table.size();
+    }
+    return _table.find(equality_key(min, min_inclusive, max, max_inclusive)).size();
+}
+
+std::uint64_t index::rank(const document& key, bool inclusive)
+{
+    throw exception("hash index is not ordered");
+}
+
+boost::optional<document> index::select(std::uint64_t n)
+{
+    throw exception("hash index is not ordered");
+}
+
+interfaces::index_cursor::unique_ptr index::create_cursor()
+{
+    throw exception("hash index is not ordered");
+}
+
+void index::flush()
+{
+    _table.flush();
+}
+
+void index::discard()
+{
+    _table.discard();
+}
+
+document index::stats()
+{
+    linear_hash::stats s = _table.get_stats();
+
+    document_object result;
+    result.set_field("buckets", document_scalar::from(s.buckets));
+    result.set_field("overflow_pages", document_scalar::from(s.overflow_pages));
+    result.set_field("entries", document_scalar::from(s.entries));
+    result.set_field("lookups", document_scalar::from(std::uint64_t(s.lookups)));
+    result.set_field("splits", document_scalar::from(std::uint64_t(s.splits)));
+    result.set_field("merges", document_scalar::from(std::uint64_t(s.merges)));
+    return result;
+}
+
+document index::compact()
+{
+    // buckets are kept between a quarter and the full load as the table changes, nothing to rebuild
+    _table.flush();
+
+    document_object result;
+    result.set_field("buckets", document_scalar::from(_table.bucket_count()));
+    return result;
+}
+
+} } }
@@ -0,0 +1,127 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_INDEXES_HASH_INDEX_HPP
+#define FALCONDB_INDEXES_HASH_INDEX_HPP
+
+#include "interfaces/index.hpp"
+
+#include "indexes/btree/index.hpp"
+#include "indexes/hash/linear_hash.hpp"
+
+namespace falcondb { namespace indexes { namespace hash {
+
+/// Hash index, for equality lookups: the entries are found by the hash of the key, in one bucket read.
+/// Keys are encoded as in B-tree indexes, 'multikey' is supported as well. There is no key order,
+/// so range scans, cursors and order statistics are not supported.
+/// Definition options:
+///  bucket_entries  average number of entries per bucket before the table grows, default DEFAULT_BUCKET_ENTRIES
+///  page_size       encoded size of bucket pages in bytes, larger buckets continue in overflow pages,
+///                  default linear_hash::default_page_size
+class index : public interfaces::index
+{
+public:
+
+    static const std::size_t DEFAULT_BUCKET_ENTRIES = 256;
+
+    // loads existing content
+    static index load(
+        interfaces::document_storage& storage,
+        const document& definition,
+        const document& root_storage_key);
+
+    // create new index, covering all documents in data storage.
+    // 'progress', if set, is called every PROGRESS_INTERVAL documents read
+    static index create(
+        interfaces::document_storage& storage,
+        const document& definition,
+        const document& root_storage_key,
+        interfaces::document_storage& data_storage,
+        const interfaces::index_type::progress_handler& progress = interfaces::index_type::progress_handler());
+
+    index(index&& other);
+    virtual ~index();
+
+    // interface
+
+    virtual void insert(const document& storage_key, const document& doc);
+
+    virtual void update(const document& old_doc, const document& new_doc);
+
+    virtual void del(const document& storage_key, const document& doc);
+
+    virtual void del(const document& storage_key, const document_view& doc);
+
+    virtual document_list scan(
+        const boost::optional<document>& min,
+        bool min_inclusive,
+        const boost::optional<document>& max,
+        bool max_inclusive,
+        const boost::optional<std::size_t> limit,
+        const boost::optional<std::size_t> skip,
+        bool reverse);
+
+    virtual bool ordered() const { return false; }
+
+    virtual bool multikey() const { return _multikey; }
+
+    virtual std::uint64_t count(
+        const boost::optional<document>& min,
+        bool min_inclusive,
+        const boost::optional<document>& max,
+        bool max_inclusive);
+
+    virtual std::uint64_t rank(const document& key, bool inclusive);
+
+    virtual boost::optional<document> select(std::uint64_t n);
+
+    virtual bool covers(const std::vector<std::string>& fields) const { return false; }
+
+    virtual interfaces::index_cursor::unique_ptr create_cursor();
+
+    virtual void flush();
+
+    virtual void discard();
+
+    virtual document stats();
+
+    virtual document compact();
+
+private:
+
+    index(linear_hash&& table, const document_object& definition);
+
+    static std::size_t read_bucket_entries(const document_object& definition);
+    static std::size_t read_page_size(const document_object& definition);
+
+    /// encoded key of the bounds of an equality scan, throws for other ranges
+    std::string equality_key(
+        const boost::optional<document>& min,
+        bool min_inclusive,
+        const boost::optional<document>& max,
+        bool max_inclusive) const;
+
+    linear_hash _table;
+    btree::index::field_list _fields;
+    bool _multikey;
+};
+
+} } }
+
+#endif
@@ -0,0 +1,99 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/hash/index_type.hpp"
+#include "indexes/hash/index.hpp"
+
+#include "indexes/btree/index_type.hpp"
+
+#include "interfaces/document_storage.hpp"
+
+#include "utils/exception.hpp"
+
+#include <boost/uuid/random_generator.hpp>
+
+namespace falcondb { namespace indexes { namespace hash {
+
+index_type::index_type()
+{
+}
+
+std::unique_ptr<interfaces::index> index_type::load_index(
+    interfaces::document_storage& index_storage,
+    const document& index_description)
+{
+    const document_object& description_as_object = index_description.as_object();
+    document index_root = description_as_object.get_field("root");
+    document index_definition = description_as_object.get_field("definition");
+
+    return std::unique_ptr<interfaces::index>(new index(index::load(index_storage, index_definition, index_root)));
+}
+
+interfaces::index_type::create_result index_type::create_index(
+    const document& index_definition,
+    interfaces::document_storage& index_storage,
+    interfaces::document_storage& data_storage,
+    const progress_handler& progress)
+{
+    verify_definition(index_definition);
+
+    // keys are encoded as in B-tree indexes, following the definition order
+    document_object definition = index_definition.as_object();
+    definition.set_field("key_format", document_scalar::from(int(btree::index::KEY_FORMAT)));
+
+    boost::uuids::random_generator gen;
+    document new_storage_root = document::from(gen());
+    std::unique_ptr<index> new_index;
+    try
+    {
+        new_index.reset(new index(index::create(index_storage, definition, new_storage_root, data_storage, progress)));
+    }
+    catch(...)
+    {
+        // the buckets written so far can't be found from anywhere else
+        btree::btree::drop(index_storage, new_storage_root);
+        throw;
+    }
+
+    document_object index_description;
+    index_description.insert(std::make_pair("root", new_storage_root));
+    index_description.insert(std::make_pair("definition", document(definition)));
+
+    return create_result{ document(index_description), std::move(new_index) };
+}
+
+void index_type::drop_index(
+    interfaces::document_storage& index_storage,
+    const document& index_description)
+{
+    // buckets and overflow pages are numbered as B-tree nodes
+    btree::btree::drop(index_storage, index_description.as_object().get_field("root"));
+}
+
+void index_type::verify_definition(const document& definition)
+{
+    btree::index_type::verify_definition(definition);
+
+    if (definition.as_object().has_field("include"))
+    {
+        throw exception("Index definition invalid: hash indexes can not include fields");
+    }
+}
+
+} } }
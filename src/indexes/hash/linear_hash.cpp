@@ -0,0 +1,521 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/hash/linear_hash.hpp"
+
+#include "indexes/btree/btree.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace falcondb { namespace indexes { namespace hash {
+
+using btree::node;
+
+// overflow pages are numbered apart from the buckets
+static const std::uint64_t OVERFLOW_PAGE_IDS = std::uint64_t(1) << 63;
+
+linear_hash linear_hash::create(
+    interfaces::document_storage& storage,
+    const document& storage_key,
+    std::size_t bucket_entries,
+    std::size_t page_size,
+    std::size_t cached_buckets)
+{
+    std::uint64_t prefix = btree::btree::node_key_prefix(storage_key);
+    for(std::uint64_t bucket = 0; bucket < initial_buckets; ++bucket)
+    {
+        storage.write(btree::btree::node_key(prefix, bucket), node::create_leaf().to_document());
+    }
+
+    document_object meta;
+    meta.set_field("level_size", document::from(std::uint64_t(initial_buckets)));
+    meta.set_field("split", document::from(std::uint64_t(0)));
+    meta.set_field("entries", document::from(std::uint64_t(0)));
+    storage.write(storage_key, meta);
+
+    return linear_hash(storage, storage_key, bucket_entries, page_size, cached_buckets);
+}
+
+linear_hash linear_hash::load(
+    interfaces::document_storage& storage,
+    const document& storage_key,
+    std::size_t bucket_entries,
+    std::size_t page_size,
+    std::size_t cached_buckets)
+{
+    return linear_hash(storage, storage_key, bucket_entries, page_size, cached_buckets);
+}
+
+linear_hash::linear_hash(
+    interfaces::document_storage& storage,
+    const document& storage_key,
+    std::size_t bucket_entries,
+    std::size_t page_size,
+    std::size_t cached_buckets)
+:
+    _storage(storage),
+    _storage_key(storage_key),
+    _bucket_entries(bucket_entries),
+    // pages are limited by size only
+    _limits(std::numeric_limits<std::size_t>::max(), page_size, page_size),
+    _bucket_key_prefix(btree::btree::node_key_prefix(storage_key)),
+
+    _level_size(initial_buckets),
+    _split(0),
+    _entries(0),
+    _next_page(0),
+    _overflow_pages(0),
+    _meta_dirty(false),
+    _buckets(storage, cached_buckets),
+    _lookups(0),
+    _splits(0),
+    _merges(0)
+{
+    assert(bucket_entries > 0);
+    load_meta_data();
+}
+
+linear_hash::linear_hash(linear_hash&& other)
+:
+    _storage(other._storage),
+    _storage_key(std::move(other._storage_key)),
+    _bucket_entries(other._bucket_entries),
+    _limits(other._limits),
+    _bucket_key_prefix(other._bucket_key_prefix),
+
+    _level_size(other._level_size),
+    _split(other._split),
+    _entries(other._entries),
+    _next_page(other._next_page),
+    _overflow_pages(other._overflow_pages),
+    _meta_dirty(other._meta_dirty),
+    _buckets(std::move(other._buckets)),
+    _lookups(other._lookups.load()),
+    _splits(other._splits.load()),
+    _merges(other._merges.load())
+{
+}
+
+std::uint64_t linear_hash::hash(const std::string& key)
+{
+    // FNV-1a, with the bits mixed by the MurmurHash3 finalizer: bucket numbers are the low bits
+    std::uint64_t h = 14695981039346656037ull;
+    for(char c : key)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+std::uint64_t linear_hash::bucket_of(const std::string& key) const
+{
+    std::uint64_t h = hash(key);
+    std::uint64_t bucket = h % _level_size;
+    // already split in this round: one more bit of the hash decides
+    if (bucket < _split)
+    {
+        bucket = h % (2 * _level_size);
+    }
+    return bucket;
+}
+
+document linear_hash::bucket_key(std::uint64_t bucket) const
+{
+    return btree::btree::node_key(_bucket_key_prefix, bucket);
+}
+
+document linear_hash::page_key(std::uint64_t page) const
+{
+    return btree::btree::node_key(_bucket_key_prefix, OVERFLOW_PAGE_IDS | page);
+}
+
+document_list linear_hash::find(const std::string& key)
+{
+    document_list result;
+    {
+        rwmutex::scoped_read_lock lock(_latch);
+        // the entries may continue in the next page while the last key of a page is the searched one
+        document page_key = bucket_key(bucket_of(key));
+        while(!page_key.is_null())
+        {
+            const node& page = _buckets.get(page_key);
+            if (page.size() > 0 && key < page.keys.front())
+            {
+                break;
+            }
+            auto range = std::equal_range(page.keys.begin(), page.keys.end(), key);
+            for(auto it = range.first; it != range.second; ++it)
+            {
+                result.push_back(document::from_binary(page.values[it - page.keys.begin()]));
+            }
+            if (range.second != page.keys.end())
+            {
+                break;
+            }
+            page_key = page.next;
+        }
+    }
+    try_trim();
+
+    ++_lookups;
+    return result;
+}
+
+void linear_hash::insert(const std::string& key, const document& value)
+{
+    rwmutex::scoped_write_lock lock(_latch);
+
+    // equal keys keep the order of insertion: the entry goes to the last page
+    // which does not start with a greater key
+    document page_key = bucket_key(bucket_of(key));
+    node* page = &_buckets.get(page_key);
+    while(!page->next.is_null())
+    {
+        node& next = _buckets.get(page->next);
+        if (key < next.keys.front())
+        {
+            break;
+        }
+        page_key = page->next;
+        page = &next;
+    }
+    std::size_t i = std::upper_bound(page->keys.begin(), page->keys.end(), key) - page->keys.begin();
+    page->keys.insert(page->keys.begin() + i, key);
+    page->values.insert(page->values.begin() + i, value.to_binary());
+    _buckets.mark_dirty(page_key);
+
+    if (_limits.overflows(*page))
+    {
+        // the upper half continues in a new page
+        node upper = page->split(_limits.split_point(*page));
+        document upper_key = allocate_page();
+        upper.next = page->next;
+        page->next = upper_key;
+        _buckets.put(upper_key, upper);
+    }
+
+    ++_entries;
+    _meta_dirty = true;
+    if (_entries > bucket_count() * _bucket_entries)
+    {
+        split_bucket();
+    }
+    _buckets.trim();
+}
+
+std::size_t linear_hash::remove(const std::string& key)
+{
+    return remove_entries(key, nullptr);
+}
+
+std::size_t linear_hash::remove(const std::string& key, const document& value)
+{
+    std::string binary_value = value.to_binary();
+    return remove_entries(key, &binary_value);
+}
+
+std::size_t linear_hash::remove_entries(const std::string& key, const std::string* value)
+{
+    rwmutex::scoped_write_lock lock(_latch);
+
+    std::size_t removed = 0;
+    document first_changed = document_scalar::null(); // the page before the first changed one, or the bucket
+    document last_changed = document_scalar::null();
+    document previous_key = document_scalar::null();
+    document page_key = bucket_key(bucket_of(key));
+    while(!page_key.is_null())
+    {
+        node& page = _buckets.get(page_key);
+        if (page.size() > 0 && key < page.keys.front())
+        {
+            break;
+        }
+
+        auto range = std::equal_range(page.keys.begin(), page.keys.end(), key);
+        std::size_t first = range.first - page.keys.begin();
+        std::size_t last = range.second - page.keys.begin();
+        bool continues = last == page.size();
+
+        // the kept duplicates are moved to the front of the range, in order
+        std::size_t kept = first;
+        for(std::size_t i = first; value && i < last; ++i)
+        {
+            if (page.values[i] != *value)
+            {
+                page.values[kept++].swap(page.values[i]);
+            }
+        }
+        if (last > kept)
+        {
+            page.keys.erase(page.keys.begin() + kept, page.keys.begin() + last);
+            page.values.erase(page.values.begin() + kept, page.values.begin() + last);
+            _buckets.mark_dirty(page_key);
+
+            if (removed == 0)
+            {
+                first_changed = previous_key.is_null() ? page_key : previous_key;
+            }
+            last_changed = page_key;
+            removed += last - kept;
+        }
+
+        if (!continues)
+        {
+            break;
+        }
+        previous_key = page_key;
+        page_key = page.next;
+    }
+
+    if (removed > 0)
+    {
+        join_pages(first_changed, last_changed);
+
+        _entries -= removed;
+        _meta_dirty = true;
+        while(bucket_count() > initial_buckets && _entries < bucket_count() * _bucket_entries / 4)
+        {
+            merge_bucket();
+        }
+    }
+    _buckets.trim();
+    return removed;
+}
+
+void linear_hash::join_pages(const document& first, document last)
+{
+    // the bucket itself is kept, even if empty
+    document page_key = first;
+    for(;;)
+    {
+        node& page = _buckets.get(page_key);
+        if (page.next.is_null())
+        {
+            return;
+        }
+
+        document next_key = page.next;
+        node& next = _buckets.get(next_key);
+        if (page.size() == 0 || next.size() == 0 || (_limits.underflows(page) && _limits.underflows(next)))
+        {
+            page.append(next);
+            page.next = next.next;
+            _buckets.mark_dirty(page_key);
+            free_page(next_key);
+            if (next_key == last)
+            {
+                last = page_key;
+            }
+        }
+        else if (page_key == last)
+        {
+            return;
+        }
+        else
+        {
+            page_key = next_key;
+        }
+    }
+}
+
+document linear_hash::allocate_page()
+{
+    ++_overflow_pages;
+    _meta_dirty = true;
+    return page_key(_next_page++);
+}
+
+void linear_hash::free_page(const document& key)
+{
+    _buckets.remove(key);
+    --_overflow_pages;
+    _meta_dirty = true;
+}
+
+node linear_hash::take_entries(std::uint64_t bucket)
+{
+    node result = node::create_leaf();
+    document page_key = bucket_key(bucket);
+    while(!page_key.is_null())
+    {
+        node& page = _buckets.get(page_key);
+        result.append(page);
+        document next_key = page.next;
+        if (!(page_key == bucket_key(bucket)))
+        {
+            free_page(page_key);
+        }
+        page_key = next_key;
+    }
+    return result;
+}
+
+void linear_hash::store_entries(std::uint64_t bucket, node& entries)
+{
+    // pages are filled as B-tree leaves in bulk loading, measured with the next page id in place
+    node empty = node::create_leaf();
+    empty.next = page_key(_next_page);
+    const std::size_t overhead = empty.encoded_size() + 4; // count can take up to 4 more bytes
+
+    document key = bucket_key(bucket);
+    while(_limits.overflows(entries))
+    {
+        std::size_t size = overhead;
+        std::size_t fit = 0;
+        while(fit < entries.size() && size + entries.entry_size(fit) <= _limits.leaf_bytes)
+        {
+            size += entries.entry_size(fit++);
+        }
+
+        node rest = entries.split(std::min(std::max<std::size_t>(fit, 1), entries.size() - 1));
+        document next_key = allocate_page();
+        entries.next = next_key;
+        _buckets.put(key, entries);
+        key = next_key;
+        entries = std::move(rest);
+    }
+    entries.next = document_scalar::null();
+    _buckets.put(key, entries);
+}
+
+void linear_hash::split_bucket()
+{
+    // the entries stay sorted, as they are taken in order
+    node entries = take_entries(_split);
+    node kept = node::create_leaf();
+    node moved = node::create_leaf();
+    for(std::size_t i = 0; i < entries.size(); ++i)
+    {
+        node& target = hash(entries.keys[i]) % (2 * _level_size) == _split ? kept : moved;
+        target.keys.push_back(std::move(entries.keys[i]));
+        target.values.push_back(std::move(entries.values[i]));
+    }
+    store_entries(_split, kept);
+    store_entries(_split + _level_size, moved);
+
+    if (++_split == _level_size)
+    {
+        _level_size *= 2;
+        _split = 0;
+    }
+    _meta_dirty = true;
+    ++_splits;
+}
+
+void linear_hash::merge_bucket()
+{
+    // reverse of the last split: the last bucket goes back to the one it was split from
+    if (_split == 0)
+    {
+        _level_size /= 2;
+        _split = _level_size;
+    }
+    --_split;
+
+    node target = take_entries(_split);
+    node source = take_entries(_split + _level_size);
+
+    // equal keys are always in the same bucket, so their order is kept
+    node merged = node::create_leaf();
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while(i < target.size() || j < source.size())
+    {
+        bool from_target = j == source.size() || (i < target.size() && target.keys[i] < source.keys[j]);
+        node& from = from_target ? target : source;
+        std::size_t& k = from_target ? i : j;
+        merged.keys.push_back(std::move(from.keys[k]));
+        merged.values.push_back(std::move(from.values[k]));
+        ++k;
+    }
+    store_entries(_split, merged);
+    _buckets.remove(bucket_key(_split + _level_size));
+
+    _meta_dirty = true;
+    ++_merges;
+}
+
+void linear_hash::flush()
+{
+    rwmutex::scoped_write_lock lock(_latch);
+    _buckets.flush();
+    if (_meta_dirty)
+    {
+        store_meta_data();
+    }
+}
+
+void linear_hash::discard()
+{
+    rwmutex::scoped_write_lock lock(_latch);
+    _buckets.clear();
+    load_meta_data();
+}
+
+void linear_hash::try_trim()
+{
+    // as in btree: readers can't evict buckets other readers may be using
+    if (_latch.try_lock())
+    {
+        _buckets.trim();
+        _latch.unlock();
+    }
+}
+
+linear_hash::stats linear_hash::get_stats() const
+{
+    return stats { bucket_count(), _overflow_pages, _entries, _lookups, _splits, _merges };
+}
+
+void linear_hash::load_meta_data()
+{
+    document_object meta = _storage.read(_storage_key);
+    _level_size = meta.get_field("level_size").as_scalar().to_number<std::uint64_t>();
+    _split = meta.get_field("split").as_scalar().to_number<std::uint64_t>();
+    _entries = meta.get_field("entries").as_scalar().to_number<std::uint64_t>();
+    // absent in tables which never had overflow pages
+    _next_page = meta.has_field("next_page") ? meta.get_field("next_page").as_scalar().to_number<std::uint64_t>() : 0;
+    _overflow_pages = meta.has_field("overflow_pages") ? meta.get_field("overflow_pages").as_scalar().to_number<std::uint64_t>() : 0;
+    _meta_dirty = false;
+}
+
+void linear_hash::store_meta_data()
+{
+    document_object meta;
+    meta.set_field("level_size", document::from(_level_size));
+    meta.set_field("split", document::from(_split));
+    meta.set_field("entries", document::from(_entries));
+    if (_next_page > 0)
+    {
+        meta.set_field("next_page", document::from(_next_page));
+        meta.set_field("overflow_pages", document::from(_overflow_pages));
+    }
+    _storage.write(_storage_key, meta);
+    _meta_dirty = false;
+}
+
+}}} // ns
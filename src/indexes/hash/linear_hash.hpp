@@ -0,0 +1,173 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_INDEXES_HASH_LINEAR_HASH_HPP
+#define FALCONDB_INDEXES_HASH_LINEAR_HASH_HPP
+
+#include "interfaces/document_storage.hpp"
+
+#include "indexes/btree/btree.hpp"
+#include "indexes/btree/node_cache.hpp"
+
+#include "utils/rwmutex.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace falcondb { namespace indexes { namespace hash {
+
+/// Persistent hash table with linear hashing. The table grows one bucket at a time: when the
+/// buckets hold more than 'bucket_entries' entries on average, the bucket at the split pointer
+/// is divided between itself and a new bucket at the end, by one more bit of the key hash.
+/// It shrinks the same way, once the buckets are less than a quarter full.
+///
+/// Each bucket is a B-tree leaf with the entries sorted by key, stored under a key made of
+/// the table storage key and the bucket number, so no directory is needed. A bucket larger than
+/// 'page_size' bytes continues in overflow pages, chained by 'next' and sorted across the chain,
+/// so that many entries with one key are not read and rewritten as a single node.
+/// The meta-data under the table storage key holds 'level_size', 'split' and 'entries',
+/// and with overflow pages 'next_page' and 'overflow_pages'.
+///
+/// Lookups can run concurrently, modifications need exclusive access
+class linear_hash
+{
+public:
+
+    static const std::size_t default_page_size = 32768;
+    static const std::size_t default_cached_buckets = 1024;
+    static const std::uint64_t initial_buckets = 4;
+
+    struct stats
+    {
+        std::uint64_t buckets;
+        std::uint64_t overflow_pages;
+        std::uint64_t entries;
+        std::size_t lookups;
+        std::size_t splits;
+        std::size_t merges;
+    };
+
+    /// Creates new, empty table
+    static linear_hash create(
+        interfaces::document_storage& storage,
+        const document& storage_key,
+        std::size_t bucket_entries,
+        std::size_t page_size = default_page_size,
+        std::size_t cached_buckets = default_cached_buckets);
+
+    static linear_hash load(
+        interfaces::document_storage& storage,
+        const document& storage_key,
+        std::size_t bucket_entries,
+        std::size_t page_size = default_page_size,
+        std::size_t cached_buckets = default_cached_buckets);
+
+    linear_hash(linear_hash&& other);
+
+    /// Values of all entries with the key, in order of insertion
+    document_list find(const std::string& key);
+
+    void insert(const std::string& key, const document& value);
+
+    /// Removes all entries with the key. Returns the number of entries removed
+    std::size_t remove(const std::string& key);
+
+    /// Removes the entries with the key and the value only
+    std::size_t remove(const std::string& key, const document& value);
+
+    std::uint64_t size() const { return _entries; }
+    std::uint64_t bucket_count() const { return _level_size + _split; }
+
+    /// Writes modified buckets and the meta-data to the storage
+    void flush();
+
+    /// Drops changes made since the last flush
+    void discard();
+
+    stats get_stats() const;
+
+    /// Hash of an encoded key. The bucket layout depends on it, so it must not depend on the platform
+    static std::uint64_t hash(const std::string& key);
+
+private:
+
+    linear_hash(
+        interfaces::document_storage& storage,
+        const document& storage_key,
+        std::size_t bucket_entries,
+        std::size_t page_size,
+        std::size_t cached_buckets);
+
+    std::uint64_t bucket_of(const std::string& key) const;
+    document bucket_key(std::uint64_t bucket) const;
+    document page_key(std::uint64_t page) const;
+
+    /// 'value', if set, is the binary form of the only value to remove
+    std::size_t remove_entries(const std::string& key, const std::string* value);
+
+    // with the latch held
+
+    void split_bucket();
+    void merge_bucket();
+
+    document allocate_page();
+    void free_page(const document& key);
+
+    /// Moves all the entries of the bucket out, in order. The overflow pages are freed
+    btree::node take_entries(std::uint64_t bucket);
+
+    /// Stores the entries as the content of the bucket, in as many pages as needed
+    void store_entries(std::uint64_t bucket, btree::node& entries);
+
+    /// Joins the pages from 'first' to 'last' and the one after it with their neighbours
+    /// where they fit together, and drops the empty ones
+    void join_pages(const document& first, document last);
+
+    /// trims the bucket cache, unless the latch is taken
+    void try_trim();
+
+    void load_meta_data();
+    void store_meta_data();
+
+    interfaces::document_storage& _storage;
+    const document _storage_key;
+    const std::size_t _bucket_entries;
+    const btree::btree::node_limits _limits;
+    const std::uint64_t _bucket_key_prefix;
+
+    std::uint64_t _level_size; // buckets at the start of the round, initial_buckets * 2^round
+    std::uint64_t _split; // next bucket to split, the ones below it are split in this round
+    std::uint64_t _entries;
+    std::uint64_t _next_page;
+    std::uint64_t _overflow_pages;
+    bool _meta_dirty;
+
+    btree::node_cache _buckets;
+    rwmutex _latch;
+
+    // stats
+    std::atomic<std::size_t> _lookups;
+    std::atomic<std::size_t> _splits;
+    std::atomic<std::size_t> _merges;
+};
+
+}}} // ns
+
+#endif
@@ -0,0 +1,202 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/hash/index.hpp"
+#include "indexes/hash/index_type.hpp"
+#include "indexes/btree_test/test_document_storage.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+namespace falcondb {
+
+BOOST_AUTO_TEST_SUITE(index_test_suite)
+
+static document index_field(const std::string& name, int direction)
+{
+    document_object field;
+    field.set_field("name", document::from(name));
+    field.set_field("direction", document::from(std::int32_t(direction)));
+    return field;
+}
+
+static document group(int b)
+{
+    document_object key;
+    key.set_field("b", document::from(b));
+    return key;
+}
+
+BOOST_AUTO_TEST_CASE(equality_scans)
+{
+    test_document_storage data;
+    for(int i = 0; i < 100; ++i)
+    {
+        document_object doc;
+        doc.set_field("a", document::from(i));
+        doc.set_field("b", document::from(i % 10));
+        data.write(document::from(i), doc);
+    }
+
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1)}));
+    document_object options;
+    options.set_field("bucket_entries", document::from(2));
+    definition.set_field("options", options);
+
+    test_document_storage index_storage;
+    indexes::hash::index_type type;
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+    interfaces::index& index = *result.new_index;
+    BOOST_CHECK(!index.ordered());
+
+    document_list found = index.scan(group(3), true, group(3), true, boost::none, boost::none, false);
+    BOOST_REQUIRE_EQUAL(found.size(), 10u);
+    for(std::size_t i = 0; i < found.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(found[i].as_scalar().to_number<int>(), int(i * 10 + 3));
+    }
+    BOOST_CHECK_EQUAL(index.count(group(3), true, group(3), true), 10u);
+    BOOST_CHECK_EQUAL(index.count(boost::none, false, boost::none, false), 100u);
+
+    found = index.scan(group(3), true, group(3), true, 2, 1, true);
+    BOOST_REQUIRE_EQUAL(found.size(), 2u);
+    BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 83);
+    BOOST_CHECK_EQUAL(found[1].as_scalar().to_number<int>(), 73);
+
+    // ranges are not answered
+    BOOST_CHECK_THROW(index.scan(group(3), true, group(4), true, boost::none, boost::none, false), std::exception);
+    BOOST_CHECK_THROW(index.scan(group(3), true, group(3), false, boost::none, boost::none, false), std::exception);
+    BOOST_CHECK_THROW(index.create_cursor(), std::exception);
+
+    document_object doc;
+    doc.set_field("b", document::from(3));
+    index.insert(document::from(100), doc);
+    BOOST_CHECK_EQUAL(index.count(group(3), true, group(3), true), 11u);
+
+    // only the entry of the removed document goes
+    index.del(document::from(100), document(doc));
+    BOOST_CHECK_EQUAL(index.count(group(3), true, group(3), true), 10u);
+    index.del(document::from(13), data.read(document::from(13)));
+    found = index.scan(group(3), true, group(3), true, boost::none, boost::none, false);
+    BOOST_REQUIRE_EQUAL(found.size(), 9u);
+    BOOST_CHECK_EQUAL(found[1].as_scalar().to_number<int>(), 23);
+    index.flush();
+
+    // reloaded from the description
+    std::unique_ptr<interfaces::index> loaded = type.load_index(index_storage, result.index_description);
+    BOOST_CHECK_EQUAL(loaded->count(group(7), true, group(7), true), 10u);
+    BOOST_CHECK_EQUAL(loaded->count(group(3), true, group(3), true), 9u);
+}
+
+BOOST_AUTO_TEST_CASE(multikey_lookups)
+{
+    test_document_storage data;
+    for(int i = 0; i < 20; ++i)
+    {
+        document_object doc;
+        doc.set_field("b", document_list({document::from(i % 2), document::from(10 + i % 5)}));
+        data.write(document::from(i), doc);
+    }
+
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1)}));
+    definition.set_field("multikey", document::from(true));
+
+    test_document_storage index_storage;
+    indexes::hash::index_type type;
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+    interfaces::index& index = *result.new_index;
+
+    BOOST_CHECK_EQUAL(index.count(boost::none, false, boost::none, false), 40u);
+    BOOST_CHECK_EQUAL(index.count(group(1), true, group(1), true), 10u);
+    BOOST_CHECK_EQUAL(index.count(group(12), true, group(12), true), 4u);
+
+    index.del(document::from(7), data.read(document::from(7)));
+    BOOST_CHECK_EQUAL(index.count(group(1), true, group(1), true), 9u);
+    document_list found = index.scan(group(12), true, group(12), true, boost::none, boost::none, false);
+    BOOST_REQUIRE_EQUAL(found.size(), 3u);
+    BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 2);
+    BOOST_CHECK_EQUAL(found[1].as_scalar().to_number<int>(), 12);
+
+    // only the changed element is indexed again
+    document_object old_doc = data.read(document::from(3)).as_object();
+    old_doc.set_field("_id", document::from(3));
+    document_object new_doc = old_doc;
+    new_doc.set_field("b", document_list({document::from(0), document::from(13)}));
+    index.update(old_doc, new_doc);
+    BOOST_CHECK_EQUAL(index.count(group(1), true, group(1), true), 8u);
+    BOOST_CHECK_EQUAL(index.count(group(0), true, group(0), true), 11u);
+    found = index.scan(group(13), true, group(13), true, boost::none, boost::none, false);
+    BOOST_REQUIRE_EQUAL(found.size(), 4u);
+    BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(abandoned_creation_is_removed)
+{
+    test_document_storage data;
+    for(int i = 0; i < 5000; ++i)
+    {
+        document_object doc;
+        doc.set_field("b", document::from(i));
+        data.write(document::from(i), doc);
+    }
+
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1)}));
+
+    test_document_storage index_storage;
+    indexes::hash::index_type type;
+    BOOST_CHECK_THROW(
+        type.create_index(definition, index_storage, data,
+            [](std::size_t documents_read, std::size_t entries_written)
+            {
+                if (documents_read >= 3000)
+                    throw exception("cancelled");
+            }),
+        exception);
+    BOOST_CHECK(index_storage.writes() > 0);
+    BOOST_CHECK_EQUAL(index_storage.size(), 0u);
+
+    interfaces::index_type::create_result result = type.create_index(
+        definition, index_storage, data, interfaces::index_type::progress_handler());
+    result.new_index->flush();
+    result.new_index.reset();
+    type.drop_index(index_storage, result.index_description);
+    BOOST_CHECK_EQUAL(index_storage.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(definition_checks)
+{
+    test_document_storage data;
+    test_document_storage index_storage;
+    indexes::hash::index_type type;
+
+    document_object definition;
+    definition.set_field("fields", document_list({index_field("b", 1)}));
+    definition.set_field("include", document_list({document::from(std::string("a"))}));
+    BOOST_CHECK_THROW(
+        type.create_index(definition, index_storage, data, interfaces::index_type::progress_handler()),
+        std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
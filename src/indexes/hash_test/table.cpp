@@ -0,0 +1,169 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "indexes/hash/linear_hash.hpp"
+#include "indexes/btree/btree.hpp"
+#include "indexes/btree_test/test_document_storage.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+namespace falcondb {
+
+using indexes::hash::linear_hash;
+
+BOOST_AUTO_TEST_SUITE(table_test_suite)
+
+static std::string make_key(int i)
+{
+    return indexes::btree::btree::encode_key(document_list({document::from(i)}));
+}
+
+BOOST_AUTO_TEST_CASE(grows_and_shrinks)
+{
+    test_document_storage storage;
+    linear_hash table = linear_hash::create(storage, document::from(std::string("main")), 4);
+    BOOST_CHECK_EQUAL(table.bucket_count(), std::uint64_t(linear_hash::initial_buckets));
+
+    for(int i = 0; i < 1000; ++i)
+    {
+        table.insert(make_key(i % 500), document::from(i));
+    }
+    BOOST_CHECK_EQUAL(table.size(), 1000u);
+    BOOST_CHECK(table.bucket_count() >= 250);
+    BOOST_CHECK(table.get_stats().splits > 0);
+
+    // every key found, duplicates in order of insertion
+    for(int i = 0; i < 500; ++i)
+    {
+        document_list found = table.find(make_key(i));
+        BOOST_REQUIRE_EQUAL(found.size(), 2u);
+        BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), i);
+        BOOST_CHECK_EQUAL(found[1].as_scalar().to_number<int>(), i + 500);
+    }
+    BOOST_CHECK(table.find(make_key(500)).empty());
+
+    for(int i = 0; i < 490; ++i)
+    {
+        BOOST_CHECK_EQUAL(table.remove(make_key(i)), 2u);
+    }
+    BOOST_CHECK_EQUAL(table.remove(make_key(0)), 0u);
+    BOOST_CHECK_EQUAL(table.size(), 20u);
+    BOOST_CHECK(table.bucket_count() < 250);
+    BOOST_CHECK(table.get_stats().merges > 0);
+
+    for(int i = 490; i < 500; ++i)
+    {
+        BOOST_CHECK_EQUAL(table.find(make_key(i)).size(), 2u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reload)
+{
+    test_document_storage storage;
+    document root = document::from(std::string("main"));
+    std::uint64_t buckets = 0;
+    {
+        linear_hash table = linear_hash::create(storage, root, 4);
+        for(int i = 0; i < 200; ++i)
+        {
+            table.insert(make_key(i), document::from(i));
+        }
+        table.flush();
+        buckets = table.bucket_count();
+
+        // not flushed, lost
+        table.insert(make_key(1000), document::from(1000));
+        table.discard();
+        BOOST_CHECK(table.find(make_key(1000)).empty());
+    }
+
+    linear_hash table = linear_hash::load(storage, root, 4);
+    BOOST_CHECK_EQUAL(table.size(), 200u);
+    BOOST_CHECK_EQUAL(table.bucket_count(), buckets);
+    for(int i = 0; i < 200; ++i)
+    {
+        document_list found = table.find(make_key(i));
+        BOOST_REQUIRE_EQUAL(found.size(), 1u);
+        BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(overflow_pages)
+{
+    test_document_storage storage;
+    document root = document::from(std::string("main"));
+    {
+        // one key with many entries, in a bucket of small pages
+        linear_hash table = linear_hash::create(storage, root, 1000, 256);
+        for(int i = 0; i < 300; ++i)
+        {
+            table.insert(make_key(7), document::from(i));
+            table.insert(make_key(i), document::from(-i));
+        }
+        BOOST_CHECK(table.get_stats().overflow_pages > 10);
+
+        document_list found = table.find(make_key(7));
+        BOOST_REQUIRE_EQUAL(found.size(), 301u);
+        for(int i = 0; i <= 7; ++i)
+        {
+            BOOST_CHECK_EQUAL(found[i].as_scalar().to_number<int>(), i);
+        }
+        BOOST_CHECK_EQUAL(found[8].as_scalar().to_number<int>(), -7);
+        BOOST_CHECK_EQUAL(found[300].as_scalar().to_number<int>(), 299);
+
+        for(int i = 0; i < 300; i += 2)
+        {
+            BOOST_CHECK_EQUAL(table.remove(make_key(7), document::from(i)), 1u);
+        }
+        found = table.find(make_key(7));
+        BOOST_REQUIRE_EQUAL(found.size(), 151u);
+        BOOST_CHECK_EQUAL(found[0].as_scalar().to_number<int>(), 1);
+        BOOST_CHECK_EQUAL(found[150].as_scalar().to_number<int>(), 299);
+        table.flush();
+    }
+
+    // the chains are split and merged with the buckets
+    linear_hash table = linear_hash::load(storage, root, 4, 256);
+    BOOST_CHECK_EQUAL(table.find(make_key(7)).size(), 151u);
+    for(int i = 300; i < 600; ++i)
+    {
+        table.insert(make_key(i), document::from(-i));
+    }
+    BOOST_CHECK(table.get_stats().splits > 0);
+    BOOST_CHECK_EQUAL(table.find(make_key(7)).size(), 151u);
+    for(int i = 0; i < 600; ++i)
+    {
+        if (i != 7)
+        {
+            BOOST_CHECK_EQUAL(table.remove(make_key(i)), 1u);
+        }
+    }
+    BOOST_CHECK(table.get_stats().merges > 0);
+    BOOST_CHECK_EQUAL(table.find(make_key(7)).size(), 151u);
+
+    BOOST_CHECK_EQUAL(table.remove(make_key(7)), 151u);
+    BOOST_CHECK_EQUAL(table.size(), 0u);
+    BOOST_CHECK_EQUAL(table.get_stats().overflow_pages, 0u);
+    table.flush();
+    BOOST_CHECK_EQUAL(linear_hash::load(storage, root, 4, 256).get_stats().overflow_pages, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+}
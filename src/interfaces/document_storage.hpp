@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define FALCONDB_INTERFACES_DOCUMENT_STORAGE_HPP
 
 #include "document/document.hpp"
+#include "document/document_view.hpp"
 
 namespace falcondb { namespace interfaces {
 
@@ -34,6 +35,10 @@ public:
     /// iteration callback
     typedef std::function<void (const document& key, const document& value)> key_value_handler;
 
+    /// callbacks receiving lazy views. The view is valid only for the duration of the call
+    typedef std::function<void (const document_view& value)> view_handler;
+    typedef std::function<void (const document& key, const document_view& value)> key_view_handler;
+
     /// Stores document
     virtual void write(const document& key, const document& doc) = 0;
 
@@ -43,9 +48,33 @@ public:
     /// Deletes document
     virtual void remove(const document& key) = 0;
 
-    /// Iterates over all documents
+    /// Iterates over all documents, in key order
     virtual void for_each(const key_value_handler& fun) = 0;
 
+    /// Iterates over documents with keys in range [begin, end), in key order
+    virtual void for_each(const document& begin, const document& end, const key_value_handler& fun) = 0;
+
+    // Lazy access. Implementations keeping documents in binary form should override these
+    // to expose the stored bytes directly; the defaults re-encode the materialized document
+
+    /// Retrieves document as a view
+    virtual void read_view(const document& key, const view_handler& fun)
+    {
+        std::string data = read(key).to_binary();
+        fun(document_view::from_binary(data));
+    }
+
+    /// Iterates over all documents, in key order, without materializing the values
+    virtual void for_each_view(const key_view_handler& fun)
+    {
+        for_each(
+            [&fun](const document& key, const document& value)
+            {
+                std::string data = value.to_binary();
+                fun(key, document_view::from_binary(data));
+            });
+    }
+
 };
 
 }} // namespaces
@@ -47,6 +47,8 @@ public:
     virtual std::vector<std::string> get_databases() = 0;
     virtual database_ptr get_database(const std::string& db_name) = 0;
     virtual void create_database(const std::string& db_name) = 0;
+    /// Creates database stored by one of the backends registered in the engine
+    virtual void create_database(const std::string& db_name, const std::string& backend_name) = 0;
     virtual void drop_database(const std::string& db_name) = 0;
 };
 
@@ -21,15 +21,62 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define FALCONDB_INTERFACES_INDEX_HPP
 
 #include "document/document.hpp"
+#include "document/document_view.hpp"
 
 #include <boost/optional.hpp>
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace falcondb { namespace interfaces {
 
 class document_storage;
 
+/// Ordered iterator over index entries: index keys with storage keys of the documents.
+/// Reads the index lazily, as it moves, in either direction
+class index_cursor
+{
+public:
+
+    typedef std::unique_ptr<index_cursor> unique_ptr;
+
+    virtual ~index_cursor() {}
+
+    virtual void seek_to_first() = 0;
+    virtual void seek_to_last() = 0;
+
+    /// Positions at the first entry with key not less than 'key' (greater, if not inclusive).
+    /// Key is a document with the indexed fields, as the scan bounds
+    virtual void seek(const document& key, bool inclusive) = 0;
+
+    /// Positions at the last entry with key not greater than 'key' (less, if not inclusive)
+    virtual void seek_for_prev(const document& key, bool inclusive) = 0;
+
+    /// Positions at the entry with 'n' entries before it in index order
+    virtual void seek_to_position(std::uint64_t n) = 0;
+
+    virtual bool valid() const = 0;
+    virtual void next() = 0;
+    virtual void prev() = 0;
+
+    /// Indexed fields of the current entry, as an object
+    virtual document key() const = 0;
+    virtual document storage_key() const = 0;
+
+    /// Included fields of the current entry present in the document, as an object.
+    /// Values are as stored in the document, indexed fields are not rebuilt from the key
+    virtual document covered_fields() const = 0;
+
+    /// Serializable position after the current entry, see resume(). For cursors moving forward
+    virtual document position() const = 0;
+
+    /// Continues after the entry at which 'position' was taken, possibly by another cursor
+    virtual void resume(const document& position) = 0;
+};
+
 /// Index abstraction
 class index
 {
@@ -43,20 +90,69 @@ public:
     /// Inserts document into index
     virtual void insert(const document& storage_key, const document& doc) = 0;
 
-    /// Updates index when document is changed
+    /// Updates index when document is changed. Documents are stored under their '_id'
     virtual void update(const document& old_doc, const document& new_doc) = 0;
 
-    /// Removes document from index
-    virtual void del(const document& doc) = 0;
+    /// Removes document from index. Only its own entries are removed, not the other documents' with the same key
+    virtual void del(const document& storage_key, const document& doc) = 0;
 
-    /// ORdered scan. Returns data - list of storage keys
+    /// Removes document from index, reading only the indexed fields
+    virtual void del(const document& storage_key, const document_view& doc) = 0;
+
+    /// ORdered scan. Returns data - list of storage keys.
+    /// Bounds are in index order, where descending fields have greater values first.
+    /// Reverse scan starts at 'max', skip and limit count from there
     virtual document_list scan(
         const boost::optional<document>& min,
         bool min_inclusive, // > or >=
         const boost::optional<document>& max,
         bool max_inclusive, // < or <=
         const boost::optional<std::size_t> limit,
-        const boost::optional<std::size_t> skip) = 0;
+        const boost::optional<std::size_t> skip,
+        bool reverse) = 0;
+
+    /// Checks if a document may have more than one entry, one for each element of an array.
+    /// Scans, counts, ranks and selects of such indexes are per entry, so a document is
+    /// returned or counted once for each of its elements in the range
+    virtual bool multikey() const = 0;
+
+    /// Checks if the index keeps the entries in key order. Unordered indexes answer only equality
+    /// scans and counts (min equal to max, both inclusive), and have no cursors, ranks or selects
+    virtual bool ordered() const = 0;
+
+    /// Number of entries in the range, bounds as in scan(). Not the number of documents, see multikey()
+    virtual std::uint64_t count(
+        const boost::optional<document>& min,
+        bool min_inclusive,
+        const boost::optional<document>& max,
+        bool max_inclusive) = 0;
+
+    /// Number of entries with key less than 'key' (not greater, if inclusive), in index order
+    virtual std::uint64_t rank(const document& key, bool inclusive) = 0;
+
+    /// Indexed fields of the entry with 'n' entries before it, none if there are not so many.
+    /// The key at percentile p is select(p * (count - 1))
+    virtual boost::optional<document> select(std::uint64_t n) = 0;
+
+    /// Checks if the index includes all the fields, so that covered_fields() of its cursors
+    /// answers projections on them as the documents would, without reading them
+    virtual bool covers(const std::vector<std::string>& fields) const = 0;
+
+    /// Creates cursor over the index, not positioned. The index has to outlive it
+    virtual index_cursor::unique_ptr create_cursor() = 0;
+
+    /// Writes changes buffered by the index to the index storage
+    virtual void flush() = 0;
+
+    /// Drops changes buffered since the last flush
+    virtual void discard() = 0;
+
+    /// Implementation-specific counters, as an object
+    virtual document stats() = 0;
+
+    /// Rebuilds the index densely, writing directly to the index storage.
+    /// Returns implementation-specific summary, as an object
+    virtual document compact() = 0;
 };
 
 /// Index type
@@ -72,6 +168,10 @@ public:
         std::unique_ptr<index> new_index;
     };
 
+    /// Reports progress of index creation: documents read from the data storage
+    /// and entries written to the index so far. May throw to abandon the creation
+    typedef std::function<void (std::size_t documents_read, std::size_t entries_written)> progress_handler;
+
     /// Loads index from storage, which has it's root stored under specific key
     virtual std::unique_ptr<index> load_index(
         document_storage& index_storage,
@@ -79,11 +179,17 @@ public:
 
     // Creates index on all elements from the iterator.
     // The index is stored in the index storage. The description has to be stored
-    // and is required to load the index
+    // and is required to load the index. If the creation fails, whatever was stored is removed
     virtual create_result create_index(
         const document& index_definition,
         document_storage& index_storage,
-        document_storage& data_storage) = 0;
+        document_storage& data_storage,
+        const progress_handler& progress) = 0;
+
+    /// Removes all the data of an index created, but never put in use
+    virtual void drop_index(
+        document_storage& index_storage,
+        const document& index_description) = 0;
 };
 
 } } // namespaces
@@ -22,6 +22,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "utils/range.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <memory>
 
 // These interfaces have to be implemented by storage backend
@@ -43,6 +46,51 @@ public:
     virtual database_backend_ptr create_database(const std::string& path) = 0;
 };
 
+/// Ordered, seekable position in database_backend content.
+/// Cursor sees a consistent view of the data, as of its creation.
+/// key() and value() are valid only while the cursor is positioned on the same entry
+class cursor
+{
+public:
+    virtual ~cursor() {}
+
+    /// Positions at the first key >= 'key'
+    virtual void seek(range key) = 0;
+    virtual void seek_to_first() = 0;
+    virtual void seek_to_last() = 0;
+
+    /// false if moved past either end
+    virtual bool valid() const = 0;
+
+    virtual void next() = 0;
+    virtual void prev() = 0;
+
+    virtual range key() const = 0;
+    virtual range value() const = 0;
+};
+typedef std::unique_ptr<cursor> cursor_ptr;
+
+/// Point-in-time state of database_backend content. Reads through a snapshot don't see
+/// later writes, and don't block them. Released when destroyed; must not outlive the database
+class snapshot
+{
+public:
+    virtual ~snapshot() {}
+};
+typedef std::shared_ptr<snapshot> snapshot_ptr;
+
+/// Group of writes applied atomically by database_backend::write.
+/// Not thread-safe, meant to be filled by a single command
+class write_batch
+{
+public:
+    virtual ~write_batch() {}
+
+    virtual void add(range key, range data) = 0;
+    virtual void del(range key) = 0;
+};
+typedef std::unique_ptr<write_batch> write_batch_ptr;
+
 /// Low-level storage interface.
 /// All calls should be thread-safe
 class database_backend
@@ -57,10 +105,59 @@ public:
     virtual void add(range key, range data) = 0;
     virtual void del(range key) = 0;
     virtual std::string get(range key) = 0;
-    virtual void for_each(const key_value_handler& handler) = 0;
+
+    /// Creates cursor, not positioned until one of the seek functions is called
+    virtual cursor_ptr create_cursor() = 0;
+
+    // snapshots
+
+    virtual snapshot_ptr create_snapshot() = 0;
+
+    /// Reads value as of the snapshot, throws if absent
+    virtual std::string get(range key, const snapshot& snap) = 0;
+
+    /// Creates cursor over content as of the snapshot
+    virtual cursor_ptr create_cursor(const snapshot& snap) = 0;
+
+    // iteration helpers, built on cursor
+
+    void for_each(const key_value_handler& handler)
+    {
+        cursor_ptr c = create_cursor();
+        for(c->seek_to_first(); c->valid(); c->next())
+        {
+            handler(c->key(), c->value());
+        }
+    }
 
     // iterates over range [begin, end)
-    virtual void for_each(range begin, range end, const key_value_handler& handler) = 0;
+    void for_each(range begin, range end, const key_value_handler& handler)
+    {
+        cursor_ptr c = create_cursor();
+        for(c->seek(begin); c->valid() && less(c->key(), end); c->next())
+        {
+            handler(c->key(), c->value());
+        }
+    }
+
+    // batches
+
+    /// Creates empty batch, to be written by this database
+    virtual write_batch_ptr create_write_batch() = 0;
+
+    /// Applies all writes from the batch atomically. If 'sync' is set, returns once the data is durable
+    virtual void write(write_batch& batch, bool sync) = 0;
+
+    /// Makes all writes applied so far durable
+    virtual void sync() = 0;
+
+    /// Byte-wise key order, used by all backends
+    static bool less(range a, range b)
+    {
+        std::size_t common = std::min(a.size(), b.size());
+        int r = common ? std::memcmp(a.begin(), b.begin(), common) : 0;
+        return r < 0 || (r == 0 && a.size() < b.size());
+    }
 };
 
 }}
@@ -0,0 +1,172 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "utils/append_log.hpp"
+#include "utils/exception.hpp"
+
+#include <boost/crc.hpp>
+
+#include <fstream>
+#include <iterator>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace falcondb {
+
+static const std::size_t HEADER_SIZE = 8;
+
+static std::uint32_t crc(const char* data, std::size_t size)
+{
+    boost::crc_32_type result;
+    result.process_bytes(data, size);
+    return result.checksum();
+}
+
+static void put_u32(char* out, std::uint32_t v)
+{
+    for(int i = 0; i < 4; ++i)
+    {
+        out[i] = static_cast<char>((v >> (i*8)) & 0xff);
+    }
+}
+
+static std::uint32_t get_u32(const char* in)
+{
+    std::uint32_t v = 0;
+    for(int i = 3; i >= 0; --i)
+    {
+        v = (v << 8) | static_cast<std::uint8_t>(in[i]);
+    }
+    return v;
+}
+
+append_log::append_log(const std::string& path)
+:
+    _path(path),
+    _fd(-1),
+    _size(0)
+{
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (_fd < 0)
+    {
+        throw exception("error opening log ", path, ": ", std::strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(_fd, &st) != 0)
+    {
+        ::close(_fd);
+        throw exception("error reading log size ", path, ": ", std::strerror(errno));
+    }
+    _size = st.st_size;
+}
+
+append_log::~append_log()
+{
+    ::close(_fd);
+}
+
+void append_log::append(const range& record)
+{
+    // single write, so a record is never interleaved with another one
+    std::string buffer(HEADER_SIZE, '\0');
+    put_u32(&buffer[0], record.size());
+    put_u32(&buffer[4], crc(record.begin(), record.size()));
+    buffer.append(record.begin(), record.size());
+
+    const char* data = buffer.data();
+    std::size_t left = buffer.size();
+    while (left > 0)
+    {
+        ssize_t written = ::write(_fd, data, left);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            throw exception("error writing log ", _path, ": ", std::strerror(errno));
+        }
+        data += written;
+        left -= written;
+    }
+    _size += buffer.size();
+}
+
+void append_log::sync()
+{
+    if (::fdatasync(_fd) != 0)
+    {
+        throw exception("error syncing log ", _path, ": ", std::strerror(errno));
+    }
+}
+
+std::uint64_t append_log::replay(const std::string& path, const record_handler& fun)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+    {
+        throw exception("error opening log ", path);
+    }
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    const char* it = content.data();
+    const char* end = it + content.size();
+    while (std::size_t(end - it) >= HEADER_SIZE)
+    {
+        std::uint32_t size = get_u32(it);
+        std::uint32_t checksum = get_u32(it + 4);
+        if (std::size_t(end - it - HEADER_SIZE) < size || crc(it + HEADER_SIZE, size) != checksum)
+        {
+            break;
+        }
+
+        fun(range(it + HEADER_SIZE, size));
+        it += HEADER_SIZE + size;
+    }
+
+    return it - content.data();
+}
+
+void append_log::truncate(const std::string& path, std::uint64_t size)
+{
+    if (::truncate(path.c_str(), size) != 0)
+    {
+        throw exception("error truncating log ", path, ": ", std::strerror(errno));
+    }
+}
+
+void append_log::sync_directory(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        throw exception("error opening directory ", path, ": ", std::strerror(errno));
+    }
+    int r = ::fsync(fd);
+    ::close(fd);
+    if (r != 0)
+    {
+        throw exception("error syncing directory ", path, ": ", std::strerror(errno));
+    }
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_APPEND_LOG_HPP
+#define FALCONDB_APPEND_LOG_HPP
+
+#include "utils/range.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace falcondb {
+
+/// Append-only file of checksummed records.
+/// Each record is: payload size (u32), CRC-32 of payload (u32), payload. Integers are little-endian.
+/// A crash may leave a torn record at the end, replay stops there.
+class append_log
+{
+public:
+
+    typedef std::function<void (const range& record)> record_handler;
+
+    /// Opens file for appending, creates it if it doesn't exist
+    explicit append_log(const std::string& path);
+    ~append_log();
+
+    append_log(const append_log&) = delete;
+    append_log& operator=(const append_log&) = delete;
+
+    /// Appends record. Not durable until sync()
+    void append(const range& record);
+
+    /// Flushes appended records to the disk
+    void sync();
+
+    std::uint64_t size() const { return _size; }
+    const std::string& path() const { return _path; }
+
+    /// Calls 'fun' for each complete, valid record in the file.
+    /// Returns the size of the valid part of the file
+    static std::uint64_t replay(const std::string& path, const record_handler& fun);
+
+    /// Cuts the file to 'size' bytes, removing torn records found by replay
+    static void truncate(const std::string& path, std::uint64_t size);
+
+    /// Makes file creations, renames and removals in the directory durable
+    static void sync_directory(const std::string& path);
+
+private:
+
+    std::string _path;
+    int _fd;
+    std::uint64_t _size;
+};
+
+}
+
+#endif
@@ -0,0 +1,305 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "utils/external_sorter.hpp"
+#include "utils/exception.hpp"
+#include "utils/filesystem.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+
+#include <cstdint>
+
+namespace falcondb {
+
+// per-record bookkeeping, added to the size of key and value
+static const std::size_t RECORD_OVERHEAD = 2 * sizeof(std::string);
+
+// runs merged at once; more are merged in passes, so that open files stay bounded
+static const std::size_t MAX_MERGE_FAN_IN = 64;
+
+// run file: sequence of records: key size (u32), key, value size (u32), value. Little-endian
+static void write_u32(std::ostream& out, std::uint32_t v)
+{
+    char buf[4];
+    for(int i = 0; i < 4; ++i)
+    {
+        buf[i] = static_cast<char>((v >> (i*8)) & 0xff);
+    }
+    out.write(buf, 4);
+}
+
+static bool read_u32(std::istream& in, std::uint32_t& v)
+{
+    char buf[4];
+    if (!in.read(buf, 4))
+    {
+        return false;
+    }
+    v = 0;
+    for(int i = 3; i >= 0; --i)
+    {
+        v = (v << 8) | static_cast<std::uint8_t>(buf[i]);
+    }
+    return true;
+}
+
+static void write_record(std::ostream& out, const range& key, const range& value)
+{
+    write_u32(out, key.size());
+    out.write(key.begin(), key.size());
+    write_u32(out, value.size());
+    out.write(value.begin(), value.size());
+}
+
+static void read_bytes(std::istream& in, std::string& out, const std::string& path)
+{
+    std::uint32_t size = 0;
+    if (!read_u32(in, size))
+    {
+        throw exception("error reading sort run ", path);
+    }
+    out.resize(size);
+    if (size > 0 && !in.read(&out[0], size))
+    {
+        throw exception("error reading sort run ", path);
+    }
+}
+
+namespace {
+
+// reads records from one run
+class run_reader
+{
+public:
+
+    run_reader(const std::string& path, std::size_t index)
+    : _path(path), _in(path.c_str(), std::ios::binary), _index(index)
+    {
+        if (!_in)
+        {
+            throw exception("error opening sort run ", path);
+        }
+    }
+
+    bool next()
+    {
+        if (_in.peek() == std::char_traits<char>::eof())
+        {
+            return false;
+        }
+        read_bytes(_in, _key, _path);
+        read_bytes(_in, _value, _path);
+        return true;
+    }
+
+    const std::string& key() const { return _key; }
+    const std::string& value() const { return _value; }
+    std::size_t index() const { return _index; }
+
+private:
+
+    std::string _path;
+    std::ifstream _in;
+    std::size_t _index;
+    std::string _key;
+    std::string _value;
+};
+
+// orders readers by current key, then by run, so equal keys keep the order they were added in
+struct reader_greater
+{
+    bool operator()(const run_reader* a, const run_reader* b) const
+    {
+        if (a->key() != b->key())
+        {
+            return a->key() > b->key();
+        }
+        return a->index() > b->index();
+    }
+};
+
+}
+
+external_sorter::external_sorter(std::size_t memory_budget, const std::string& temp_dir)
+:
+    _memory_budget(memory_budget),
+    _temp_dir(temp_dir),
+    _memory_used(0),
+    _size(0),
+    _spilled(0)
+{
+}
+
+external_sorter::~external_sorter()
+{
+    for(const std::string& path : _runs)
+    {
+        boost::system::error_code ec;
+        bfs::remove(path, ec);
+    }
+}
+
+void external_sorter::add(const std::string& key, const std::string& value)
+{
+    _records.push_back(std::make_pair(key, value));
+    _memory_used += key.size() + value.size() + RECORD_OVERHEAD;
+    ++_size;
+
+    if (_memory_used > _memory_budget)
+    {
+        spill();
+    }
+}
+
+void external_sorter::sort_records()
+{
+    std::stable_sort(
+        _records.begin(), _records.end(),
+        [](const record& a, const record& b) { return a.first < b.first; });
+}
+
+std::string external_sorter::new_run_path() const
+{
+    return (bfs::path(_temp_dir) / bfs::unique_path("falcondb-sort-%%%%-%%%%-%%%%-%%%%.run")).string();
+}
+
+void external_sorter::spill()
+{
+    sort_records();
+
+    std::string path = new_run_path();
+    _runs.push_back(path);
+    ++_spilled;
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    for(const record& r : _records)
+    {
+        write_record(out, r.first, r.second);
+    }
+    out.flush();
+    if (!out)
+    {
+        throw exception("error writing sort run ", path);
+    }
+
+    _records.clear();
+    _memory_used = 0;
+}
+
+void external_sorter::merge_runs(std::size_t first, std::size_t last, const record_handler& fun) const
+{
+    std::vector<std::unique_ptr<run_reader>> readers;
+    std::priority_queue<run_reader*, std::vector<run_reader*>, reader_greater> heap;
+    for(std::size_t i = first; i < last; ++i)
+    {
+        readers.emplace_back(new run_reader(_runs[i], i));
+        if (readers.back()->next())
+        {
+            heap.push(readers.back().get());
+        }
+    }
+
+    while(!heap.empty())
+    {
+        run_reader* reader = heap.top();
+        heap.pop();
+        fun(reader->key(), reader->value());
+        if (reader->next())
+        {
+            heap.push(reader);
+        }
+    }
+}
+
+void external_sorter::merge_pass()
+{
+    // consecutive runs are merged, so that equal keys stay in the order they were added
+    std::vector<std::string> merged;
+    for(std::size_t first = 0; first < _runs.size(); first += MAX_MERGE_FAN_IN)
+    {
+        std::size_t last = std::min(first + MAX_MERGE_FAN_IN, _runs.size());
+        if (last - first == 1)
+        {
+            merged.push_back(_runs[first]);
+            continue;
+        }
+
+        std::string path = new_run_path();
+        try
+        {
+            std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+            merge_runs(first, last, [&out](const range& key, const range& value) { write_record(out, key, value); });
+            out.flush();
+            if (!out)
+            {
+                throw exception("error writing sort run ", path);
+            }
+        }
+        catch(...)
+        {
+            // leaves the existing files in _runs, to be removed by the destructor
+            boost::system::error_code ec;
+            bfs::remove(path, ec);
+            merged.insert(merged.end(), _runs.begin() + first, _runs.end());
+            _runs.swap(merged);
+            throw;
+        }
+        merged.push_back(path);
+
+        for(std::size_t i = first; i < last; ++i)
+        {
+            boost::system::error_code ec;
+            bfs::remove(_runs[i], ec);
+        }
+    }
+    _runs.swap(merged);
+}
+
+void external_sorter::for_each_sorted(const record_handler& fun)
+{
+    if (_runs.empty())
+    {
+        // everything fits in memory
+        sort_records();
+        for(const record& r : _records)
+        {
+            fun(r.first, r.second);
+        }
+        _records.clear();
+        return;
+    }
+
+    if (!_records.empty())
+    {
+        spill();
+    }
+
+    while(_runs.size() > MAX_MERGE_FAN_IN)
+    {
+        merge_pass();
+    }
+
+    // k-way merge of the runs
+    merge_runs(0, _runs.size(), fun);
+}
+
+}
@@ -0,0 +1,92 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_EXTERNAL_SORTER_HPP
+#define FALCONDB_EXTERNAL_SORTER_HPP
+
+#include "utils/range.hpp"
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace falcondb {
+
+/// Sorts key-value records by key, compared as bytes.
+/// Records are collected in memory; when they exceed the memory budget, they are sorted
+/// and spilled to a temporary file as a run. Runs are merged when the records are read back,
+/// with a bounded number of them open at once: more runs are first merged into fewer in passes.
+class external_sorter
+{
+public:
+
+    typedef std::function<void (const range& key, const range& value)> record_handler;
+
+    /// Runs are created in 'temp_dir'
+    external_sorter(std::size_t memory_budget, const std::string& temp_dir);
+
+    /// Removes the runs
+    ~external_sorter();
+
+    external_sorter(const external_sorter&) = delete;
+    external_sorter& operator=(const external_sorter&) = delete;
+
+    void add(const std::string& key, const std::string& value);
+
+    /// Calls 'fun' for all records in key order. Records with equal keys come in the order added.
+    /// Can be called once
+    void for_each_sorted(const record_handler& fun);
+
+    std::size_t size() const { return _size; }
+
+    /// number of runs spilled to disk
+    std::size_t runs() const { return _spilled; }
+
+private:
+
+    typedef std::pair<std::string, std::string> record;
+
+    /// writes sorted in-memory records as a new run
+    void spill();
+
+    void sort_records();
+
+    std::string new_run_path() const;
+
+    /// merges runs [first, last) into 'fun'
+    void merge_runs(std::size_t first, std::size_t last, const record_handler& fun) const;
+
+    /// replaces runs with fewer, each merged from up to the maximum fan-in of consecutive runs
+    void merge_pass();
+
+    const std::size_t _memory_budget;
+    const std::string _temp_dir;
+
+    std::vector<record> _records;
+    std::size_t _memory_used;
+    std::size_t _size;
+
+    std::vector<std::string> _runs; // file paths
+    std::size_t _spilled;
+};
+
+}
+
+#endif
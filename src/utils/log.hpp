@@ -3,8 +3,9 @@
 
 #include "utils/string.hpp"
 
-#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <iostream>
 #include <thread>
 
 namespace falcondb { namespace logging {
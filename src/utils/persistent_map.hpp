@@ -0,0 +1,592 @@
+/*
+FalconDB, a database
+Copyright (C) 2012 Maciej Gajewski <maciej.gajewski0 at gmail dot com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FALCONDB_PERSISTENT_MAP_HPP
+#define FALCONDB_PERSISTENT_MAP_HPP
+
+#include "utils/range.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace falcondb {
+
+/// Ordered map from byte string keys to values, with persistent versions. A copy takes O(1) and
+/// shares all the nodes with the original; a modification copies only the nodes on the path from
+/// the root to the changed entry, O(log n). Nodes are never changed once created, so a version can
+/// be read by many threads while a writer prepares the next one from it.
+///
+/// The tree is a B+tree. Keys of a node are kept in a single buffer, so that copying a node takes
+/// a few allocations and a lookup reads a few cache lines per level. Values are copied with the
+/// nodes: large ones should be held by shared pointers.
+template<typename Value>
+class persistent_map
+{
+public:
+
+    typedef Value mapped_type;
+
+    /// entries of a leaf, children of an interior node
+    static const std::size_t max_node_size = 32;
+    static const std::size_t min_node_size = max_node_size / 4;
+
+    static int compare(const range& a, const range& b)
+    {
+        int result = std::memcmp(a.begin(), b.begin(), std::min(a.size(), b.size()));
+        if (result != 0)
+        {
+            return result;
+        }
+        return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+    }
+
+private:
+
+    // keys, one after another
+    class key_buffer
+    {
+    public:
+
+        std::size_t size() const { return _ends.size(); }
+
+        range operator[](std::size_t i) const
+        {
+            std::uint32_t begin = i == 0 ? 0 : _ends[i - 1];
+            return range(_data.data() + begin, _ends[i] - begin);
+        }
+
+        void push_back(const range& key)
+        {
+            _data.append(key.begin(), key.size());
+            _ends.push_back(_data.size());
+        }
+
+        /// appends keys [first, last) of 'other'
+        void append(const key_buffer& other, std::size_t first, std::size_t last)
+        {
+            if (first == last)
+            {
+                return;
+            }
+            std::uint32_t begin = first == 0 ? 0 : other._ends[first - 1];
+            std::uint32_t shift = std::uint32_t(_data.size()) - begin;
+            _data.append(other._data, begin, other._ends[last - 1] - begin);
+            for(std::size_t i = first; i < last; ++i)
+            {
+                _ends.push_back(other._ends[i] + shift);
+            }
+        }
+
+        /// first key not less than 'key'
+        std::size_t lower_bound(const range& key) const
+        {
+            std::size_t first = 0;
+            std::size_t count = size();
+            while(count > 0)
+            {
+                std::size_t step = count / 2;
+                if (compare((*this)[first + step], key) < 0)
+                {
+                    first += step + 1;
+                    count -= step + 1;
+                }
+                else
+                {
+                    count = step;
+                }
+            }
+            return first;
+        }
+
+        /// first key greater than 'key'
+        std::size_t upper_bound(const range& key) const
+        {
+            std::size_t first = 0;
+            std::size_t count = size();
+            while(count > 0)
+            {
+                std::size_t step = count / 2;
+                if (compare(key, (*this)[first + step]) >= 0)
+                {
+                    first += step + 1;
+                    count -= step + 1;
+                }
+                else
+                {
+                    count = step;
+                }
+            }
+            return first;
+        }
+
+        void reserve(std::size_t keys, std::size_t bytes)
+        {
+            _ends.reserve(keys);
+            _data.reserve(bytes);
+        }
+
+        std::size_t bytes() const { return _data.size(); }
+
+    private:
+
+        std::string _data;
+        std::vector<std::uint32_t> _ends;
+    };
+
+    struct node;
+    typedef std::shared_ptr<const node> node_ptr;
+
+    // leaf: keys and values of the entries;
+    // interior: children, and keys separating them: child i holds the keys below keys[i], not below keys[i-1]
+    struct node
+    {
+        explicit node(bool l) : leaf(l) { }
+
+        std::size_t size() const { return leaf ? values.size() : children.size(); }
+
+        bool leaf;
+        key_buffer keys;
+        std::vector<Value> values;
+        std::vector<node_ptr> children;
+    };
+
+    // result of a modification of a subtree: the new subtree, or two if it was split
+    struct split_result
+    {
+        node_ptr left;
+        node_ptr right;
+        std::string separator; // the least key of 'right'
+    };
+
+public:
+
+    /// Iterator over the version it was taken from, which has to outlive it.
+    /// Decrementing the first entry gives end(), decrementing end() gives the last one
+    class const_iterator
+    {
+    public:
+
+        const_iterator() : _root(nullptr) { }
+
+        range key() const { assert(!_path.empty()); return _path.back().first->keys[_path.back().second]; }
+        const Value& value() const { assert(!_path.empty()); return _path.back().first->values[_path.back().second]; }
+
+        const_iterator& operator++()
+        {
+            assert(!_path.empty());
+            while(!_path.empty())
+            {
+                step& s = _path.back();
+                if (++s.second < s.first->size())
+                {
+                    if (!s.first->leaf)
+                    {
+                        descend_first(s.first->children[s.second].get());
+                    }
+                    return *this;
+                }
+                _path.pop_back();
+            }
+            return *this;
+        }
+
+        const_iterator& operator--()
+        {
+            if (_path.empty())
+            {
+                descend_last(_root);
+                return *this;
+            }
+            while(!_path.empty())
+            {
+                step& s = _path.back();
+                if (s.second > 0)
+                {
+                    --s.second;
+                    if (!s.first->leaf)
+                    {
+                        descend_last(s.first->children[s.second].get());
+                    }
+                    return *this;
+                }
+                _path.pop_back();
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return _path.empty() ? other._path.empty() : !other._path.empty() && _path.back() == other._path.back();
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+
+        friend class persistent_map;
+
+        typedef std::pair<const node*, std::size_t> step;
+
+        explicit const_iterator(const node* root) : _root(root) { }
+
+        void descend_first(const node* n)
+        {
+            for(; n; n = n->leaf ? nullptr : n->children.front().get())
+            {
+                _path.push_back(step(n, 0));
+            }
+        }
+
+        void descend_last(const node* n)
+        {
+            for(; n; n = n->leaf ? nullptr : n->children.back().get())
+            {
+                _path.push_back(step(n, n->size() - 1));
+            }
+        }
+
+        const node* _root;
+        std::vector<step> _path; // from the root to the current entry, empty at the end
+    };
+
+    persistent_map() : _size(0) { }
+
+    bool empty() const { return _size == 0; }
+    std::size_t size() const { return _size; }
+
+    const_iterator begin() const
+    {
+        const_iterator result(_root.get());
+        result.descend_first(_root.get());
+        return result;
+    }
+
+    const_iterator end() const { return const_iterator(_root.get()); }
+
+    /// First entry with key not less than 'key'
+    const_iterator lower_bound(const range& key) const
+    {
+        const_iterator result(_root.get());
+        const node* n = _root.get();
+        while(n && !n->leaf)
+        {
+            std::size_t i = n->keys.upper_bound(key);
+            result._path.push_back(typename const_iterator::step(n, i));
+            n = n->children[i].get();
+        }
+        if (n)
+        {
+            std::size_t i = n->keys.lower_bound(key);
+            if (i < n->size())
+            {
+                result._path.push_back(typename const_iterator::step(n, i));
+            }
+            else
+            {
+                // all keys of the leaf are less, the next entry is the first of the next leaf
+                result._path.push_back(typename const_iterator::step(n, i - 1));
+                ++result;
+            }
+        }
+        return result;
+    }
+
+    const_iterator find(const range& key) const
+    {
+        const_iterator result = lower_bound(key);
+        if (result != end() && compare(result.key(), key) != 0)
+        {
+            return end();
+        }
+        return result;
+    }
+
+    /// Value of 'key', null if not found
+    const Value* get(const range& key) const
+    {
+        const node* n = _root.get();
+        while(n && !n->leaf)
+        {
+            n = n->children[n->keys.upper_bound(key)].get();
+        }
+        if (n)
+        {
+            std::size_t i = n->keys.lower_bound(key);
+            if (i < n->size() && compare(n->keys[i], key) == 0)
+            {
+                return &n->values[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /// Sets the value of 'key'. Returns true if the key was not there
+    bool insert_or_assign(const range& key, const Value& value)
+    {
+        if (!_root)
+        {
+            std::shared_ptr<node> leaf = std::make_shared<node>(true);
+            leaf->keys.push_back(key);
+            leaf->values.push_back(value);
+            _root = leaf;
+            _size = 1;
+            return true;
+        }
+
+        bool inserted = false;
+        split_result result = insert(*_root, key, value, inserted);
+        if (result.right)
+        {
+            // the tree grows at the root
+            std::shared_ptr<node> root = std::make_shared<node>(false);
+            root->keys.push_back(result.separator);
+            root->children.push_back(result.left);
+            root->children.push_back(result.right);
+            _root = root;
+        }
+        else
+        {
+            _root = result.left;
+        }
+        _size += inserted;
+        return inserted;
+    }
+
+    /// Returns the number of entries removed, 0 or 1
+    std::size_t erase(const range& key)
+    {
+        if (!_root)
+        {
+            return 0;
+        }
+
+        node_ptr root = erase(_root, key);
+        if (root == _root)
+        {
+            return 0;
+        }
+
+        // the tree shrinks at the root
+        if (!root->leaf && root->size() == 1)
+        {
+            root = root->children.front();
+        }
+        else if (root->size() == 0)
+        {
+            root.reset();
+        }
+        _root = root;
+        --_size;
+        return 1;
+    }
+
+    void clear()
+    {
+        _root.reset();
+        _size = 0;
+    }
+
+private:
+
+    // copies entries [first, last) of 'from' to 'to', of the same type.
+    // Children are copied with the separator following each, the last child of 'from' has none
+    static void copy_entries(const node& from, std::size_t first, std::size_t last, node& to)
+    {
+        if (from.leaf)
+        {
+            to.keys.append(from.keys, first, last);
+            to.values.insert(to.values.end(), from.values.begin() + first, from.values.begin() + last);
+        }
+        else
+        {
+            to.keys.append(from.keys, std::min(first, from.keys.size()), std::min(last, from.keys.size()));
+            to.children.insert(to.children.end(), from.children.begin() + first, from.children.begin() + last);
+        }
+    }
+
+    static std::shared_ptr<node> make_node(const node& like, std::size_t size_hint)
+    {
+        std::shared_ptr<node> result = std::make_shared<node>(like.leaf);
+        result->keys.reserve(size_hint, like.keys.bytes() + like.keys.bytes() / std::max<std::size_t>(like.keys.size(), 1) + 16);
+        if (like.leaf)
+        {
+            result->values.reserve(size_hint);
+        }
+        else
+        {
+            result->children.reserve(size_hint);
+        }
+        return result;
+    }
+
+    // splits a node above the maximum size in two halves
+    static split_result split(const std::shared_ptr<node>& n)
+    {
+        std::size_t half = n->size() / 2;
+        std::shared_ptr<node> left = make_node(*n, half);
+        std::shared_ptr<node> right = make_node(*n, n->size() - half);
+        split_result result;
+        if (n->leaf)
+        {
+            copy_entries(*n, 0, half, *left);
+            copy_entries(*n, half, n->size(), *right);
+            result.separator = right->keys[0].to_string();
+        }
+        else
+        {
+            // the separator between the halves goes up
+            left->keys.append(n->keys, 0, half - 1);
+            left->children.assign(n->children.begin(), n->children.begin() + half);
+            right->keys.append(n->keys, half, n->keys.size());
+            right->children.assign(n->children.begin() + half, n->children.end());
+            result.separator = n->keys[half - 1].to_string();
+        }
+        result.left = left;
+        result.right = right;
+        return result;
+    }
+
+    static split_result insert(const node& n, const range& key, const Value& value, bool& inserted)
+    {
+        if (n.leaf)
+        {
+            std::size_t i = n.keys.lower_bound(key);
+            std::shared_ptr<node> result = make_node(n, n.size() + 1);
+            copy_entries(n, 0, i, *result);
+            result->keys.push_back(key);
+            result->values.push_back(value);
+            inserted = i == n.size() || compare(n.keys[i], key) != 0;
+            copy_entries(n, inserted ? i : i + 1, n.size(), *result);
+            if (result->size() > max_node_size)
+            {
+                return split(result);
+            }
+            return split_result { result, node_ptr(), std::string() };
+        }
+
+        std::size_t c = n.keys.upper_bound(key);
+        split_result child = insert(*n.children[c], key, value, inserted);
+
+        std::shared_ptr<node> result = make_node(n, n.size() + 1);
+        copy_entries(n, 0, c, *result);
+        if (child.right)
+        {
+            result->keys.push_back(child.separator);
+        }
+        else if (c < n.keys.size())
+        {
+            result->keys.push_back(n.keys[c]);
+        }
+        result->children.push_back(child.left);
+        if (child.right)
+        {
+            if (c < n.keys.size())
+            {
+                result->keys.push_back(n.keys[c]);
+            }
+            result->children.push_back(child.right);
+        }
+        copy_entries(n, c + 1, n.size(), *result);
+
+        if (result->size() > max_node_size)
+        {
+            return split(result);
+        }
+        return split_result { result, node_ptr(), std::string() };
+    }
+
+    // the same node if the key is not found
+    static node_ptr erase(const node_ptr& n, const range& key)
+    {
+        if (n->leaf)
+        {
+            std::size_t i = n->keys.lower_bound(key);
+            if (i == n->size() || compare(n->keys[i], key) != 0)
+            {
+                return n;
+            }
+            std::shared_ptr<node> result = make_node(*n, n->size() - 1);
+            copy_entries(*n, 0, i, *result);
+            copy_entries(*n, i + 1, n->size(), *result);
+            return result;
+        }
+
+        std::size_t c = n->keys.upper_bound(key);
+        node_ptr child = erase(n->children[c], key);
+        if (child == n->children[c])
+        {
+            return n;
+        }
+
+        std::shared_ptr<node> result = make_node(*n, n->size());
+        if (child->size() >= min_node_size)
+        {
+            copy_entries(*n, 0, n->size(), *result);
+            result->children[c] = child;
+            return result;
+        }
+
+        // the small child is joined with a sibling, and split again if too large
+        std::size_t left = c + 1 < n->size() ? c : c - 1;
+        const node& a = left == c ? *child : *n->children[left];
+        const node& b = left == c ? *n->children[c + 1] : *child;
+        std::shared_ptr<node> joined = make_node(a, a.size() + b.size());
+        copy_entries(a, 0, a.size(), *joined);
+        if (!a.leaf)
+        {
+            joined->keys.push_back(n->keys[left]);
+        }
+        copy_entries(b, 0, b.size(), *joined);
+
+        copy_entries(*n, 0, left, *result);
+        if (joined->size() > max_node_size)
+        {
+            split_result halves = split(joined);
+            result->keys.push_back(halves.separator);
+            result->children.push_back(halves.left);
+            if (left + 1 < n->keys.size())
+            {
+                result->keys.push_back(n->keys[left + 1]);
+            }
+            result->children.push_back(halves.right);
+        }
+        else
+        {
+            if (left + 1 < n->keys.size())
+            {
+                result->keys.push_back(n->keys[left + 1]);
+            }
+            result->children.push_back(joined);
+        }
+        copy_entries(*n, left + 2, n->size(), *result);
+        return result;
+    }
+
+    node_ptr _root;
+    std::size_t _size;
+};
+
+}
+
+#endif